@@ -0,0 +1,411 @@
+/* bench-gate.c -- benchmark regression gate
+ *
+ * Runs crypto-bench and, if miner config is given, dorenom in benchmark
+ * mode. Results are compared against baseline file recorded on the same
+ * host, exit code is non zero when any metric regressed beyond tolerance.
+ *
+ * All metrics are throughputs (higher is better):
+ *   hashrate.<solver type>, hashrate.total  -- dorenom --bench, hashes/sec
+ *   phase.<name>                            -- crypto-bench, calls/sec
+ */
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cJSON/cJSON.h"
+#include "logging.h"
+
+struct gate_opts {
+  const char *baseline;
+  const char *config; // NULL: skip miner benchmark
+  const char *bin_dir;
+  double tolerance; // percent
+  int duration_sec;
+  int warmup_sec;
+  int min_time_ms;
+  int repeat;
+  bool is_update;
+  bool is_force;
+};
+
+static char *read_stream(FILE *fp)
+{
+  size_t len = 0;
+  size_t capacity = 4096;
+  char *buf = malloc(capacity);
+  size_t n;
+  while ((n = fread(buf + len, 1, capacity - len - 1, fp)) > 0) {
+    len += n;
+    if (capacity - len - 1 == 0) {
+      capacity *= 2;
+      buf = realloc(buf, capacity);
+    }
+  }
+  buf[len] = '\0';
+  return buf;
+}
+
+/** Run command and parse its stdout as json. NULL on failure */
+static cJSON *run_json(const char *cmd)
+{
+  log_info("Running: %s", cmd);
+  FILE *fp = popen(cmd, "r");
+  if (fp == NULL) {
+    log_error("Failed to run: %s", cmd);
+    return NULL;
+  }
+  char *out = read_stream(fp);
+  int status = pclose(fp);
+  cJSON *json = NULL;
+  if (status != 0) {
+    log_error("Command failed with status %d: %s", status, cmd);
+  } else if ((json = cJSON_Parse(out)) == NULL) {
+    log_error("Command output is not valid json: %s", cmd);
+  }
+  free(out);
+  return json;
+}
+
+/** keep the best value of repeated runs */
+static void metric_put(cJSON *metrics, const char *name, double value)
+{
+  cJSON *item = cJSON_GetObjectItemCaseSensitive(metrics, name);
+  if (item == NULL) {
+    cJSON_AddNumberToObject(metrics, name, value);
+  } else if (value > item->valuedouble) {
+    cJSON_SetNumberValue(item, value);
+  }
+}
+
+static void metric_add(cJSON *metrics, const char *name, double value)
+{
+  cJSON *item = cJSON_GetObjectItemCaseSensitive(metrics, name);
+  if (item == NULL) {
+    cJSON_AddNumberToObject(metrics, name, value);
+  } else {
+    cJSON_SetNumberValue(item, item->valuedouble + value);
+  }
+}
+
+static double json_number(const cJSON *json, const char *field)
+{
+  const cJSON *item = cJSON_GetObjectItemCaseSensitive(json, field);
+  return cJSON_IsNumber(item) ? item->valuedouble : 0;
+}
+
+static const char *json_string(const cJSON *json, const char *field)
+{
+  const cJSON *item = cJSON_GetObjectItemCaseSensitive(json, field);
+  return cJSON_IsString(item) ? item->valuestring : NULL;
+}
+
+static bool collect_phases(const struct gate_opts *opts, cJSON *metrics)
+{
+  char cmd[1024];
+  snprintf(cmd, sizeof(cmd), "'%s/crypto-bench' --json --min-time %d",
+           opts->bin_dir, opts->min_time_ms);
+  cJSON *json = run_json(cmd);
+  if (json == NULL) {
+    return false;
+  }
+  const cJSON *phase = NULL;
+  cJSON_ArrayForEach(phase, cJSON_GetObjectItemCaseSensitive(json, "phases"))
+  {
+    const char *name = json_string(phase, "name");
+    double ns = json_number(phase, "ns_per_call");
+    if (name == NULL || ns <= 0) {
+      continue;
+    }
+    char metric[128];
+    snprintf(metric, sizeof(metric), "phase.%s", name);
+    metric_put(metrics, metric, 1e9 / ns);
+  }
+  cJSON_Delete(json);
+  return true;
+}
+
+static bool collect_hashrate(const struct gate_opts *opts, cJSON *metrics)
+{
+  char cmd[1024];
+  snprintf(cmd, sizeof(cmd),
+           "'%s/dorenom' --config '%s' --bench-duration %d --bench-warmup %d "
+           "--bench-seed 1 --log-level error",
+           opts->bin_dir, opts->config, opts->duration_sec, opts->warmup_sec);
+  cJSON *json = run_json(cmd);
+  if (json == NULL) {
+    return false;
+  }
+  // sum solvers of the same type
+  cJSON *run = cJSON_CreateObject();
+  const cJSON *miner = NULL;
+  cJSON_ArrayForEach(miner, cJSON_GetObjectItemCaseSensitive(json, "miners"))
+  {
+    const cJSON *solver = NULL;
+    cJSON_ArrayForEach(solver,
+                       cJSON_GetObjectItemCaseSensitive(miner, "solvers"))
+    {
+      const char *type = json_string(solver, "type");
+      char metric[128];
+      snprintf(metric, sizeof(metric), "hashrate.%s",
+               type != NULL ? type : "unknown");
+      metric_add(run, metric, json_number(solver, "hashrate"));
+    }
+  }
+  metric_add(run, "hashrate.total", json_number(json, "hashrate"));
+  const cJSON *item = NULL;
+  cJSON_ArrayForEach(item, run)
+  {
+    metric_put(metrics, item->string, item->valuedouble);
+  }
+  cJSON_Delete(run);
+  cJSON_Delete(json);
+  return true;
+}
+
+/** hostname and cpu model, results are only comparable on the same host */
+static cJSON *host_info()
+{
+  char hostname[256] = {0};
+  gethostname(hostname, sizeof(hostname) - 1);
+  char cpu[256] = "unknown";
+  FILE *fp = fopen("/proc/cpuinfo", "r");
+  if (fp != NULL) {
+    char line[512];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      char *p = strchr(line, ':');
+      if (strncmp(line, "model name", 10) == 0 && p != NULL) {
+        snprintf(cpu, sizeof(cpu), "%s", p + 2);
+        cpu[strcspn(cpu, "\n")] = '\0';
+        break;
+      }
+    }
+    fclose(fp);
+  }
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "hostname", hostname);
+  cJSON_AddStringToObject(json, "cpu", cpu);
+  cJSON_AddNumberToObject(json, "cpus",
+                          (double)sysconf(_SC_NPROCESSORS_ONLN));
+  return json;
+}
+
+static bool is_same_host(const cJSON *a, const cJSON *b)
+{
+  static const char *fields[] = {"hostname", "cpu"};
+  for (size_t i = 0; i < 2; ++i) {
+    const char *x = json_string(a, fields[i]);
+    const char *y = json_string(b, fields[i]);
+    if (x == NULL || y == NULL || strcmp(x, y) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool write_baseline(const char *filename, cJSON *host, cJSON *metrics)
+{
+  cJSON *json = cJSON_CreateObject();
+  char now[32];
+  time_t t = time(NULL);
+  strftime(now, sizeof(now), "%Y-%m-%dT%H:%M:%SZ", gmtime(&t));
+  cJSON_AddStringToObject(json, "created", now);
+  cJSON_AddItemReferenceToObject(json, "host", host);
+  cJSON_AddItemReferenceToObject(json, "metrics", metrics);
+  char *str = cJSON_Print(json);
+  cJSON_Delete(json);
+  FILE *fp = fopen(filename, "w");
+  bool is_ok = fp != NULL && fprintf(fp, "%s\n", str) > 0;
+  if (fp != NULL) {
+    is_ok = fclose(fp) == 0 && is_ok;
+  }
+  free(str);
+  if (!is_ok) {
+    log_error("Unable to write baseline: %s", filename);
+  } else {
+    log_info("Baseline written: %s", filename);
+  }
+  return is_ok;
+}
+
+static cJSON *read_baseline(const char *filename)
+{
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    log_error("Unable to open baseline: %s", filename);
+    return NULL;
+  }
+  char *text = read_stream(fp);
+  fclose(fp);
+  cJSON *json = cJSON_Parse(text);
+  free(text);
+  if (json == NULL) {
+    log_error("Baseline is not valid json: %s", filename);
+  }
+  return json;
+}
+
+/** print comparison table, return number of regressions */
+static int compare(const cJSON *baseline, const cJSON *metrics,
+                   double tolerance)
+{
+  int regressions = 0;
+  printf("%-32s %14s %14s %9s\n", "metric", "baseline", "current", "change");
+  const cJSON *base = NULL;
+  cJSON_ArrayForEach(base, baseline)
+  {
+    const cJSON *cur = cJSON_GetObjectItemCaseSensitive(metrics, base->string);
+    if (!cJSON_IsNumber(cur) || !cJSON_IsNumber(base) ||
+        base->valuedouble <= 0) {
+      printf("%-32s %14.2f %14s %9s\n", base->string, base->valuedouble, "-",
+             "SKIP");
+      continue;
+    }
+    double change = (cur->valuedouble / base->valuedouble - 1) * 100;
+    bool is_regression = change < -tolerance;
+    regressions += is_regression;
+    printf("%-32s %14.2f %14.2f %+8.2f%%%s\n", base->string,
+           base->valuedouble, cur->valuedouble, change,
+           is_regression ? "  REGRESSION" : "");
+  }
+  return regressions;
+}
+
+static void print_usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s --baseline <file.json> [options]\n"
+          "  --update               record new baseline\n"
+          "  --tolerance <percent>  allowed slowdown, default: 3\n"
+          "  --config <file>        also benchmark miner with dorenom "
+          "--bench\n"
+          "  --duration <sec>       miner benchmark duration, default: 30\n"
+          "  --warmup <sec>         miner benchmark warm-up, default: 5\n"
+          "  --min-time <msec>      crypto-bench time per phase, "
+          "default: 1000\n"
+          "  --repeat <n>           keep the best of n runs, default: 3\n"
+          "  --bin-dir <dir>        dorenom and crypto-bench location, "
+          "default: .\n"
+          "  --force                compare results from another host\n",
+          name);
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  struct gate_opts opts = {.bin_dir = ".",
+                           .tolerance = 3,
+                           .duration_sec = 30,
+                           .warmup_sec = 5,
+                           .min_time_ms = 1000,
+                           .repeat = 3};
+  static struct option long_opts[] = {
+      {"help", no_argument, NULL, 'h'},
+      {"baseline", required_argument, NULL, 'b'},
+      {"update", no_argument, NULL, 'u'},
+      {"tolerance", required_argument, NULL, 't'},
+      {"config", required_argument, NULL, 'c'},
+      {"duration", required_argument, NULL, 'd'},
+      {"warmup", required_argument, NULL, 'w'},
+      {"min-time", required_argument, NULL, 'm'},
+      {"repeat", required_argument, NULL, 'r'},
+      {"bin-dir", required_argument, NULL, 'B'},
+      {"force", no_argument, NULL, 'f'},
+      {NULL, 0, NULL, 0}};
+  int c;
+  while ((c = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+    switch (c) {
+    case 'b':
+      opts.baseline = optarg;
+      break;
+    case 'u':
+      opts.is_update = true;
+      break;
+    case 't':
+      opts.tolerance = atof(optarg);
+      break;
+    case 'c':
+      opts.config = optarg;
+      break;
+    case 'd':
+      opts.duration_sec = atoi(optarg);
+      break;
+    case 'w':
+      opts.warmup_sec = atoi(optarg);
+      break;
+    case 'm':
+      opts.min_time_ms = atoi(optarg);
+      break;
+    case 'r':
+      opts.repeat = atoi(optarg);
+      break;
+    case 'B':
+      opts.bin_dir = optarg;
+      break;
+    case 'f':
+      opts.is_force = true;
+      break;
+    default:
+      print_usage(argv[0]);
+    }
+  }
+  if (opts.baseline == NULL || opts.tolerance < 0 || opts.repeat < 1 ||
+      opts.duration_sec < 1 || opts.warmup_sec < 0 || opts.min_time_ms < 1) {
+    print_usage(argv[0]);
+  }
+
+  cJSON *baseline = NULL;
+  if (!opts.is_update) {
+    // fail early, before running benchmarks
+    baseline = read_baseline(opts.baseline);
+    if (baseline == NULL) {
+      return 2;
+    }
+  }
+
+  int exit_code = 2;
+  cJSON *host = host_info();
+  cJSON *metrics = cJSON_CreateObject();
+  for (int i = 0; i < opts.repeat; ++i) {
+    if (!collect_phases(&opts, metrics)) {
+      goto EXIT;
+    }
+    if (opts.config != NULL && !collect_hashrate(&opts, metrics)) {
+      goto EXIT;
+    }
+  }
+
+  if (opts.is_update) {
+    exit_code = write_baseline(opts.baseline, host, metrics) ? 0 : 2;
+    goto EXIT;
+  }
+
+  if (!is_same_host(cJSON_GetObjectItemCaseSensitive(baseline, "host"),
+                    host) &&
+      !opts.is_force) {
+    log_error("Baseline was recorded on another host, use --force to "
+              "compare anyway");
+    goto EXIT;
+  }
+  int regressions =
+      compare(cJSON_GetObjectItemCaseSensitive(baseline, "metrics"), metrics,
+              opts.tolerance);
+  if (regressions > 0) {
+    printf("FAILURE: %d metric(s) regressed more than %.1f%%\n", regressions,
+           opts.tolerance);
+    exit_code = 1;
+  } else {
+    printf("SUCCESS: no regressions\n");
+    exit_code = 0;
+  }
+EXIT:
+  cJSON_Delete(metrics);
+  cJSON_Delete(host);
+  if (baseline != NULL) {
+    cJSON_Delete(baseline);
+  }
+  return exit_code;
+}
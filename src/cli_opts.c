@@ -2,12 +2,30 @@
 
 #include <assert.h>
 #include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+
+#include "console.h"
 
 void print_usage(const char *name)
 {
-  fprintf(stdout, "Usage: %s --config <config.json>\n", name);
+  fprintf(stdout,
+          "Usage: %s --config <config.json> [options]\n"
+          "  --bench                 run benchmark\n"
+          "  --bench-duration <sec>  stop benchmark and print json summary\n"
+          "                          after warm-up and <sec> seconds\n"
+          "  --bench-warmup <sec>    exclude first <sec> seconds, default: 0\n"
+          "  --bench-seed <n>        seed for random job and nonce\n"
+          "  --bench-blob <hex>      benchmark with fixed job blob\n"
+          "  --log-level <level>     error, warn, info or debug\n"
+          "  --log-format <format>   text or json\n"
+          "  --no-color              disable coloured text output\n"
+          "  --metrics-port <port>   serve prometheus metrics on the port\n"
+          "  --metrics-host <addr>   metrics listen address, default: "
+          "127.0.0.1\n",
+          name);
   exit(EXIT_FAILURE);
 }
 
@@ -17,10 +35,28 @@ void parse_cli_opts(int argc, char **argv, struct cli_opts *opts)
   static struct option long_opts[] = {{"help", no_argument, NULL, 'h'},
                                       {"config", required_argument, NULL, 'c'},
                                       {"bench", no_argument, NULL, 'b'},
+                                      {"bench-duration", required_argument,
+                                       NULL, 'D'},
+                                      {"bench-warmup", required_argument,
+                                       NULL, 'W'},
+                                      {"bench-seed", required_argument, NULL,
+                                       'S'},
+                                      {"bench-blob", required_argument, NULL,
+                                       'B'},
+                                      {"log-level", required_argument, NULL,
+                                       'l'},
+                                      {"log-format", required_argument, NULL,
+                                       'f'},
+                                      {"no-color", no_argument, NULL, 'n'},
+                                      {"metrics-port", required_argument,
+                                       NULL, 'p'},
+                                      {"metrics-host", required_argument,
+                                       NULL, 'H'},
                                       {NULL, 0, NULL, 0}};
 
   const char *short_opts = "hcb:";
 
+  bool has_bench_seed = false;
   int c;
   while ((c = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1) {
     switch (c) {
@@ -33,6 +69,69 @@ void parse_cli_opts(int argc, char **argv, struct cli_opts *opts)
     case 'b':
       opts->is_benchmark = true;
       break;
+    case 'D':
+    case 'W': {
+      char *endptr = NULL;
+      long sec = strtol(optarg, &endptr, 10);
+      if (*endptr != '\0' || sec < 0 || sec > INT_MAX) {
+        fprintf(stderr, "Invalid number of seconds: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      if (c == 'D') {
+        opts->bench_duration_sec = (int)sec;
+      } else {
+        opts->bench_warmup_sec = (int)sec;
+      }
+      opts->is_benchmark = true;
+      break;
+    }
+    case 'S': {
+      char *endptr = NULL;
+      unsigned long seed = strtoul(optarg, &endptr, 10);
+      if (*endptr != '\0' || seed > UINT_MAX) {
+        fprintf(stderr, "Invalid seed: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      opts->bench_seed = (unsigned int)seed;
+      has_bench_seed = true;
+      opts->is_benchmark = true;
+      break;
+    }
+    case 'B':
+      opts->bench_blob = optarg;
+      opts->is_benchmark = true;
+      break;
+    case 'l': {
+      enum log_level log_level;
+      if (!console_log_level_from_string(optarg, &log_level)) {
+        fprintf(stderr, "Invalid log level: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      opts->log_level = optarg;
+      break;
+    }
+    case 'f': {
+      enum log_format log_format;
+      if (!console_log_format_from_string(optarg, &log_format)) {
+        fprintf(stderr, "Invalid log format: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      opts->log_format = optarg;
+      break;
+    }
+    case 'n':
+      opts->no_color = true;
+      break;
+    case 'p':
+      opts->metrics_port = atoi(optarg);
+      if (opts->metrics_port <= 0 || opts->metrics_port > 65535) {
+        fprintf(stderr, "Invalid metrics port: %s\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+    case 'H':
+      opts->metrics_host = optarg;
+      break;
     case 'h':
       print_usage(argv[0]);
       exit(EXIT_FAILURE);
@@ -43,6 +142,14 @@ void parse_cli_opts(int argc, char **argv, struct cli_opts *opts)
     }
   }
 
+  if (!has_bench_seed) {
+    opts->bench_seed = (unsigned int)time(NULL);
+  }
+
+  if (opts->metrics_host == NULL) {
+    opts->metrics_host = "127.0.0.1";
+  }
+
   if (opts->config_file == NULL) {
     fprintf(stderr, "Required parameter --config not specified.\n");
     print_usage(argv[0]);
@@ -7,6 +7,20 @@ struct cli_opts {
   /** Path to config file */
   char *config_file;
   bool is_benchmark;
+  /** Benchmark options, any of them enables benchmark mode */
+  int bench_duration_sec; // 0: run until interrupted
+  int bench_warmup_sec;
+  unsigned int bench_seed; // random if not set
+  const char *bench_blob;  // NULL: random blob generated from the seed
+
+  /** Console options, override config file. NULL if not set */
+  const char *log_level;
+  const char *log_format;
+  bool no_color;
+
+  /** Prometheus metrics http endpoint, disabled if port is 0 */
+  const char *metrics_host;
+  int metrics_port;
 };
 
 void parse_cli_opts(int argc, char **argv, struct cli_opts *opts);
@@ -96,7 +96,9 @@ bool read_wallet(const cJSON *json, const char **wallet_address_ptr)
 bool read_password(const cJSON *json, const char **password_address_ptr)
 {
   assert(*password_address_ptr == NULL);
-  const char *password_str = json_get_string(json, "password");
+  const char *password_str = cJSON_HasObjectItem(json, "password")
+                                 ? json_get_string(json, "password")
+                                 : NULL;
   if (password_str == NULL) {
     *password_address_ptr = strdup("");
     return true;
@@ -196,8 +198,41 @@ struct config *config_from_json(const cJSON *json)
   return result;
 }
 
-/** Read config from null terminated string */
-struct config *config_from_string(const char *json_str)
+/** Read optional "console" section */
+bool read_console(const cJSON *json, struct console_config *console_cfg)
+{
+  if (!cJSON_IsObject(json)) {
+    log_error("Config parse: console: Expected object");
+    return false;
+  }
+  if (cJSON_HasObjectItem(json, "log_level")) {
+    const char *str = json_get_string(json, "log_level");
+    if (str == NULL ||
+        !console_log_level_from_string(str, &console_cfg->log_level)) {
+      log_error("Config parse: console: invalid log level");
+      return false;
+    }
+  }
+  if (cJSON_HasObjectItem(json, "log_format")) {
+    const char *str = json_get_string(json, "log_format");
+    if (str == NULL ||
+        !console_log_format_from_string(str, &console_cfg->log_format)) {
+      log_error("Config parse: console: invalid log format");
+      return false;
+    }
+  }
+  if (cJSON_HasObjectItem(json, "no_color") &&
+      !json_get_bool(json, "no_color", &console_cfg->no_color)) {
+    return false;
+  }
+  return true;
+}
+
+/** Read config from null terminated string.
+ *  Config is either an array of miners or an object:
+ *  {"console": {...}, "miners": [...]} */
+struct config *config_from_string(const char *json_str,
+                                  struct console_config *console_cfg)
 {
   log_debug("Parsing config file: %s", json_str);
   const char *parse_end;
@@ -210,13 +245,28 @@ struct config *config_from_string(const char *json_str)
 
   struct config *result = NULL;
 
-  if (!cJSON_IsArray(json_root)) {
+  const cJSON *miners_json = json_root;
+  if (cJSON_IsObject(json_root)) {
+    if (cJSON_HasObjectItem(json_root, "console") &&
+        !read_console(cJSON_GetObjectItem(json_root, "console"),
+                      console_cfg)) {
+      cJSON_Delete(json_root);
+      return NULL;
+    }
+    miners_json = json_get_array(json_root, "miners");
+    if (miners_json == NULL) {
+      cJSON_Delete(json_root);
+      return NULL;
+    }
+  }
+
+  if (!cJSON_IsArray(miners_json)) {
     log_error("Config parse: Expected array of miners");
     cJSON_Delete(json_root);
     return NULL;
   }
 
-  int size = cJSON_GetArraySize(json_root);
+  int size = cJSON_GetArraySize(miners_json);
   if (size <= 0) {
     log_error("Config parse: Empty config");
     cJSON_Delete(json_root);
@@ -226,7 +276,7 @@ struct config *config_from_string(const char *json_str)
   for (int i = size - 1; i >= 0; --i) {
     // parse config
     log_debug("Config parse: parsing miner entry #%d", i);
-    const cJSON *miner_json = cJSON_GetArrayItem(json_root, i);
+    const cJSON *miner_json = cJSON_GetArrayItem(miners_json, i);
     struct config *cfg = config_from_json(miner_json);
     if (cfg == NULL) {
       if (result != NULL) {
@@ -243,7 +293,8 @@ struct config *config_from_string(const char *json_str)
   return result;
 }
 
-struct config *config_from_file(const char *filename)
+struct config *config_from_file(const char *filename,
+                                struct console_config *console_cfg)
 {
   log_debug("Reading config file: %s", filename);
   char *json_str = read_text_file(filename);
@@ -251,7 +302,7 @@ struct config *config_from_file(const char *filename)
     return false;
   }
 
-  struct config *res = config_from_string(json_str);
+  struct config *res = config_from_string(json_str, console_cfg);
   free(json_str);
   return res;
 }
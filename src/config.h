@@ -6,6 +6,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "console.h"
 #include "currency.h"
 
 enum stratum_protocol {
@@ -42,4 +43,7 @@ struct config {
   void (*free)(struct config *);
 };
 
-struct config *config_from_file(const char *filename);
+/** Read miners configuration. Optional console settings found in the file
+ *  are written to `console_cfg` */
+struct config *config_from_file(const char *filename,
+                                struct console_config *console_cfg);
@@ -377,6 +377,12 @@ void connection_stop(connection_handle handle)
   }
 }
 
+bool connection_is_connected(connection_handle handle)
+{
+  assert(handle != NULL);
+  return handle->active != NULL && tcp_connection_is_connected(handle->active);
+}
+
 void connection_write(connection_handle handle, uv_buf_t data)
 {
   assert(handle != NULL && handle->active != NULL);
@@ -1,8 +1,12 @@
 #include "console.h"
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <uv.h>
 
 #define ANSI_COLOR_RED "\x1b[31m"
 #define ANSI_COLOR_GREEN "\x1b[32m"
@@ -19,40 +23,264 @@
 #define WARN_PREFIX ANSI_COLOR_MAGENTA "WARN " ANSI_COLOR_RESET ": "
 #define DEBUG_PREFIX ANSI_COLOR_LIGHT_YELLOW "DEBUG" ANSI_COLOR_RESET ": "
 
-void console_init(const struct console_config *cfg) {}
+static const char *LOG_LEVEL_NAMES[] = {"error", "warn", "info", "debug"};
+static const char *LOG_LEVEL_PREFIXES[] = {ERROR_PREFIX, WARN_PREFIX,
+                                           INFO_PREFIX, DEBUG_PREFIX};
+static const char *LOG_LEVEL_PREFIXES_NO_COLOR[] = {"ERROR: ", "WARN : ",
+                                                    "INFO : ", "DEBUG: "};
 
-void console_log(enum log_level log_level, const char *logger_name,
-                 const char *fmt, ...)
+/** number of messages in the ring, must be power of 2 */
+#define LOG_RING_SIZE 1024
+#define LOG_MESSAGE_SIZE 512
+/** how long writer sleeps when ring is empty */
+#define LOG_WRITER_IDLE_MILLISEC 10
+
+atomic_int console_log_level = DEBUG;
+static atomic_bool console_no_color = false;
+static atomic_int console_log_format = LOG_FORMAT_TEXT;
+
+/** One log record. `seq` is used to hand off slot between producers and
+ *  the writer (bounded MPMC queue by D. Vyukov) */
+struct log_slot {
+  atomic_size_t seq;
+  enum log_level log_level;
+  time_t time;
+  const char *logger_name;
+  char message[LOG_MESSAGE_SIZE];
+};
+
+struct log_ring {
+  struct log_slot slots[LOG_RING_SIZE];
+  atomic_size_t enqueue_pos;
+  size_t dequeue_pos; // single consumer
+  atomic_size_t dropped;
+  atomic_bool is_running;
+  uv_thread_t writer;
+};
+
+static struct log_ring log_ring_storage;
+/** NULL until writer thread is started, messages are written synchronously */
+static struct log_ring *_Atomic log_ring = NULL;
+/** console_log calls in progress, shutdown waits for those that may still
+ *  push into the ring */
+static atomic_size_t log_ring_users = 0;
+
+/** write string as json string literal */
+static void write_json_string(const char *str, FILE *out)
+{
+  putc('"', out);
+  for (const unsigned char *p = (const unsigned char *)str; *p; ++p) {
+    switch (*p) {
+    case '"':
+      fputs("\\\"", out);
+      break;
+    case '\\':
+      fputs("\\\\", out);
+      break;
+    case '\n':
+      fputs("\\n", out);
+      break;
+    case '\r':
+      fputs("\\r", out);
+      break;
+    case '\t':
+      fputs("\\t", out);
+      break;
+    default:
+      if (*p < 0x20) {
+        fprintf(out, "\\u%04x", *p);
+      } else {
+        putc(*p, out);
+      }
+    }
+  }
+  putc('"', out);
+}
+
+static void console_write(enum log_level log_level, time_t now,
+                          const char *logger_name, const char *message)
+{
+  char buff[21];
+  struct tm tm;
+  gmtime_r(&now, &tm);
+
+  size_t len = strlen(message);
+  if (atomic_load(&console_log_format) == LOG_FORMAT_JSON) {
+    // drop trailing newline, the record is terminated by one
+    char msg[len + 1];
+    memcpy(msg, message, len + 1);
+    if (len > 0 && msg[len - 1] == '\n') {
+      msg[len - 1] = '\0';
+    }
+    strftime(buff, sizeof(buff), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    flockfile(stderr);
+    fprintf(stderr, "{\"time\":\"%s\",\"level\":\"%s\",\"logger\":", buff,
+            LOG_LEVEL_NAMES[log_level]);
+    write_json_string(logger_name, stderr);
+    fputs(",\"message\":", stderr);
+    write_json_string(msg, stderr);
+    fputs("}\n", stderr);
+    funlockfile(stderr);
+    return;
+  }
+
+  const char *prefix = atomic_load(&console_no_color)
+                           ? LOG_LEVEL_PREFIXES_NO_COLOR[log_level]
+                           : LOG_LEVEL_PREFIXES[log_level];
+  strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", &tm);
+  const char *eol = len > 0 && message[len - 1] == '\n' ? "" : "\n";
+  fprintf(stderr, "%s%s %s: %s%s", prefix, buff, logger_name, message, eol);
+}
+
+bool console_log_level_from_string(const char *str, enum log_level *out)
+{
+  for (int i = ERROR; i <= DEBUG; ++i) {
+    if (strcmp(str, LOG_LEVEL_NAMES[i]) == 0) {
+      *out = (enum log_level)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool console_log_format_from_string(const char *str, enum log_format *out)
+{
+  if (strcmp(str, "text") == 0) {
+    *out = LOG_FORMAT_TEXT;
+    return true;
+  } else if (strcmp(str, "json") == 0) {
+    *out = LOG_FORMAT_JSON;
+    return true;
+  }
+  return false;
+}
+
+/** Write all queued messages, return number of messages written */
+static size_t log_ring_drain(struct log_ring *ring)
 {
-  switch (log_level) {
-  case DEBUG:
-    fprintf(stderr, DEBUG_PREFIX);
-    break;
-  case INFO:
-    fprintf(stderr, INFO_PREFIX);
-    break;
-  case WARN:
-    fprintf(stderr, WARN_PREFIX);
-    break;
-  case ERROR:
-    fprintf(stderr, ERROR_PREFIX);
-    break;
+  size_t n = 0;
+  for (;;) {
+    struct log_slot *slot =
+        &ring->slots[ring->dequeue_pos & (LOG_RING_SIZE - 1)];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != ring->dequeue_pos + 1) {
+      break; // empty
+    }
+    console_write(slot->log_level, slot->time, slot->logger_name,
+                  slot->message);
+    atomic_store_explicit(&slot->seq, ring->dequeue_pos + LOG_RING_SIZE,
+                          memory_order_release);
+    ++ring->dequeue_pos;
+    ++n;
+  }
+  size_t dropped = atomic_exchange(&ring->dropped, 0);
+  if (dropped > 0) {
+    char message[64];
+    snprintf(message, sizeof(message), "%lu log messages dropped", dropped);
+    console_write(WARN, time(NULL), __FILE__, message);
   }
+  return n;
+}
 
-  char buff[20];
-  struct tm *sTm;
+static void log_ring_writer(void *arg)
+{
+  struct log_ring *ring = arg;
+  while (atomic_load(&ring->is_running)) {
+    if (log_ring_drain(ring) == 0) {
+      uv_sleep(LOG_WRITER_IDLE_MILLISEC);
+    }
+  }
+  log_ring_drain(ring);
+}
 
-  time_t now = time(0);
-  sTm = gmtime(&now);
+/** Queue message, never blocks. Return false if ring is full */
+static bool log_ring_push(struct log_ring *ring, enum log_level log_level,
+                          const char *logger_name, const char *fmt,
+                          va_list vargs)
+{
+  struct log_slot *slot;
+  size_t pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+  for (;;) {
+    slot = &ring->slots[pos & (LOG_RING_SIZE - 1)];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (atomic_compare_exchange_weak_explicit(&ring->enqueue_pos, &pos,
+                                                pos + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+      return false;
+    } else {
+      pos = atomic_load_explicit(&ring->enqueue_pos, memory_order_relaxed);
+    }
+  }
+  slot->log_level = log_level;
+  slot->time = time(NULL);
+  slot->logger_name = logger_name;
+  vsnprintf(slot->message, LOG_MESSAGE_SIZE, fmt, vargs);
+  atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+  return true;
+}
 
-  strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", sTm);
+void console_init(const struct console_config *cfg)
+{
+  atomic_store(&console_log_level, cfg->log_level);
+  atomic_store(&console_no_color, cfg->no_color);
+  atomic_store(&console_log_format, cfg->log_format);
+  if (atomic_load(&log_ring) != NULL) {
+    return;
+  }
+  struct log_ring *ring = &log_ring_storage;
+  for (size_t i = 0; i < LOG_RING_SIZE; ++i) {
+    atomic_init(&ring->slots[i].seq, i);
+  }
+  atomic_init(&ring->enqueue_pos, 0);
+  ring->dequeue_pos = 0;
+  atomic_init(&ring->is_running, true);
+  if (uv_thread_create(&ring->writer, log_ring_writer, ring) != 0) {
+    return; // keep logging synchronously
+  }
+  atomic_store(&log_ring, ring);
+  atexit(console_shutdown);
+}
 
-  fprintf(stderr, "%s %s: ", buff, logger_name);
+void console_shutdown()
+{
+  // switch back to synchronous logging and flush the ring
+  struct log_ring *ring = atomic_exchange(&log_ring, NULL);
+  if (ring == NULL) {
+    return;
+  }
+  atomic_store(&ring->is_running, false);
+  uv_thread_join(&ring->writer);
+  // producers that saw the ring before the switch may still be filling
+  // claimed slots, write them once published
+  while (atomic_load(&log_ring_users) > 0 ||
+         ring->dequeue_pos != atomic_load(&ring->enqueue_pos)) {
+    if (log_ring_drain(ring) == 0) {
+      uv_sleep(1);
+    }
+  }
+}
+
+void console_log(enum log_level log_level, const char *logger_name,
+                 const char *fmt, ...)
+{
   va_list vargs;
   va_start(vargs, fmt);
-  vfprintf(stderr, fmt, vargs);
-  if (fmt[strlen(fmt) - 1] != '\n') {
-    putc('\n', stderr);
+  atomic_fetch_add(&log_ring_users, 1);
+  struct log_ring *ring = atomic_load(&log_ring);
+  if (ring != NULL) {
+    log_ring_push(ring, log_level, logger_name, fmt, vargs);
+    atomic_fetch_sub(&log_ring_users, 1);
+  } else {
+    atomic_fetch_sub(&log_ring_users, 1);
+    char message[LOG_MESSAGE_SIZE];
+    vsnprintf(message, sizeof(message), fmt, vargs);
+    console_write(log_level, time(NULL), logger_name, message);
   }
   va_end(vargs);
 }
@@ -3,17 +3,50 @@
  */
 #pragma once
 
+#include <stdatomic.h>
 #include <stdbool.h>
 
 enum log_level { ERROR, WARN, INFO, DEBUG };
 
-/** */
+/** Messages above this level are removed at compile time */
+#ifndef LOG_LEVEL_COMPILED
+#ifdef NDEBUG
+#define LOG_LEVEL_COMPILED INFO
+#else
+#define LOG_LEVEL_COMPILED DEBUG
+#endif
+#endif
+
+enum log_format {
+  LOG_FORMAT_TEXT, // human readable, coloured unless `no_color` is set
+  LOG_FORMAT_JSON  // one json object per line
+};
+
 struct console_config {
   bool no_color;
   enum log_level log_level;
-  const char *log_format;
+  enum log_format log_format;
 };
 
+bool console_log_level_from_string(const char *str, enum log_level *out);
+bool console_log_format_from_string(const char *str, enum log_format *out);
+
+/** messages above this `enum log_level` are discarded */
+extern atomic_int console_log_level;
+
+static inline bool console_is_enabled(enum log_level log_level)
+{
+  return log_level <= LOG_LEVEL_COMPILED &&
+         (int)log_level <=
+             atomic_load_explicit(&console_log_level, memory_order_relaxed);
+}
+
+/** Apply config and start background log writer. Until then, and after
+ *  `console_shutdown`, messages are written synchronously */
 void console_init(const struct console_config *);
+
+/** Flush pending messages and stop background writer */
+void console_shutdown();
+
 void console_log(enum log_level, const char *logger_name, const char *format,
                  ...);
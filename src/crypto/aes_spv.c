@@ -0,0 +1,250 @@
+#include "crypto/aes_spv.h"
+
+#define AES_SPV_WPOLY 0x011b
+
+/** uint8_t aes_sbox[256] packed into uint[64] */
+static const uint32_t AES_SPV_SBOX[64] = {
+    0x7b777c63, 0xc56f6bf2, 0x2b670130, 0x76abd7fe, 0x7dc982ca, 0xf04759fa,
+    0xafa2d4ad, 0xc072a49c, 0x2693fdb7, 0xccf73f36, 0xf1e5a534, 0x1531d871,
+    0xc323c704, 0x9a059618, 0xe2801207, 0x75b227eb, 0x1a2c8309, 0xa05a6e1b,
+    0xb3d63b52, 0x842fe329, 0xed00d153, 0x5bb1fc20, 0x39becb6a, 0xcf584c4a,
+    0xfbaaefd0, 0x85334d43, 0x7f02f945, 0xa89f3c50, 0x8f40a351, 0xf5389d92,
+    0x21dab6bc, 0xd2f3ff10, 0xec130ccd, 0x1744975f, 0x3d7ea7c4, 0x73195d64,
+    0xdc4f8160, 0x88902a22, 0x14b8ee46, 0xdb0b5ede, 0x0a3a32e0, 0x5c240649,
+    0x62acd3c2, 0x79e49591, 0x6d37c8e7, 0xa94ed58d, 0xeaf4566c, 0x08ae7a65,
+    0x2e2578ba, 0xc6b4a61c, 0x1f74dde8, 0x8a8bbd4b, 0x66b53e70, 0x0ef60348,
+    0xb9573561, 0x9e1dc186, 0x1198f8e1, 0x948ed969, 0xe9871e9b, 0xdf2855ce,
+    0x0d89a18c, 0x6842e6bf, 0x0f2d9941, 0x16bb54b0};
+
+/** table[x] for uint `x` */
+static uint32_t aes_spv_lookup(struct spirv_builder *b,
+                               const struct aes_spv *aes, uint32_t table,
+                               uint32_t x)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ptr = spirv_val(b, OP_ACCESS_CHAIN,
+                           spirv_type_pointer(b, SC_WORKGROUP, uint_t),
+                           aes->table[table], x);
+  return spirv_load(b, uint_t, ptr);
+}
+
+static uint32_t aes_spv_byte(struct spirv_builder *b, uint32_t x,
+                             uint32_t byte)
+{
+  return spirv_val(b, OP_BITFIELD_UEXTRACT, spirv_type_int(b, 32), x,
+                   spirv_const_uint(b, 8 * byte), spirv_const_uint(b, 8));
+}
+
+static uint32_t aes_spv_rotl(struct spirv_builder *b, uint32_t x, uint32_t n)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t sl = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, x,
+                          spirv_const_uint(b, n));
+  uint32_t sr = spirv_val(b, OP_SHIFT_RIGHT_LOGICAL, uint_t, x,
+                          spirv_const_uint(b, 32 - n));
+  return spirv_val(b, OP_BITWISE_OR, uint_t, sl, sr);
+}
+
+void aes_spv_init(struct spirv_builder *b, struct aes_spv *aes)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t uint4_t = spirv_type_vector(b, uint_t, 4);
+  uint32_t table_ptr_t =
+      spirv_type_pointer(b, SC_WORKGROUP, spirv_type_array(b, uint_t, 256));
+  for (uint32_t t = 0; t < 4; ++t) {
+    aes->table[t] = spirv_variable(b, table_ptr_t, SC_WORKGROUP, 0);
+  }
+
+  uint32_t params[5];
+  aes->encode = spirv_function(
+      b, uint4_t, FNC_INLINE,
+      SPIRV_ARGS(spirv_type_pointer(b, SC_FUNCTION, uint4_t), uint_t, uint_t,
+                 uint_t, uint_t),
+      params);
+  uint32_t in = spirv_load(b, uint4_t, params[0]);
+  uint32_t x[4];
+  for (uint32_t k = 0; k < 4; ++k) {
+    x[k] = spirv_val(b, OP_COMPOSITE_EXTRACT, uint_t, in, k);
+  }
+  // r[i] = k[i] ^ AES0[BYTE0(x[i])] ^ AES1[BYTE1(x[i + 1])] ^ ...
+  uint32_t r[4];
+  for (uint32_t i = 0; i < 4; ++i) {
+    r[i] = params[i + 1];
+    for (uint32_t t = 0; t < 4; ++t) {
+      uint32_t y =
+          aes_spv_lookup(b, aes, t, aes_spv_byte(b, x[(i + t) & 3], t));
+      r[i] = spirv_val(b, OP_BITWISE_XOR, uint_t, r[i], y);
+    }
+  }
+  spirv_return_value(b, spirv_val(b, OP_COMPOSITE_CONSTRUCT, uint4_t, r[0],
+                                  r[1], r[2], r[3]));
+  spirv_function_end(b);
+}
+
+uint32_t aes_spv_encode_10_fn(struct spirv_builder *b,
+                              const struct aes_spv *aes)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t uint4_t = spirv_type_vector(b, uint_t, 4);
+  uint32_t ptr_uint_t = spirv_type_pointer(b, SC_FUNCTION, uint_t);
+  uint32_t params[2];
+  uint32_t fn = spirv_function(
+      b, spirv_type_void(b), FNC_INLINE,
+      SPIRV_ARGS(spirv_type_pointer(b, SC_FUNCTION, uint4_t),
+                 spirv_type_pointer(b, SC_FUNCTION,
+                                    spirv_type_array(b, uint_t, 40))),
+      params);
+  // for (i = 0; i < 40; i += 4) *in = aes_encode(in, key[i], .. key[i + 3])
+  struct spirv_loop loop;
+  uint32_t i = spirv_loop_for(b, &loop, spirv_const_uint(b, 0),
+                              spirv_const_uint(b, 40), LC_UNROLL);
+  uint32_t k[4];
+  for (uint32_t j = 0; j < 4; ++j) {
+    uint32_t idx = spirv_val(b, OP_IADD, uint_t, i, spirv_const_uint(b, j));
+    k[j] = spirv_load(
+        b, uint_t, spirv_val(b, OP_ACCESS_CHAIN, ptr_uint_t, params[1], idx));
+  }
+  uint32_t out = spirv_val(b, OP_FUNCTION_CALL, uint4_t, aes->encode,
+                           params[0], k[0], k[1], k[2], k[3]);
+  spirv_store(b, params[0], out);
+  spirv_loop_end(b, &loop, spirv_const_uint(b, 4));
+  spirv_return(b);
+  spirv_function_end(b);
+  return fn;
+}
+
+uint32_t aes_spv_sbox(struct spirv_builder *b, uint32_t x)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t sbox_t = spirv_type_array(b, uint_t, 64);
+  uint32_t sbox_values[64];
+  for (uint32_t i = 0; i < 64; ++i) {
+    sbox_values[i] = spirv_const_uint(b, AES_SPV_SBOX[i]);
+  }
+  uint32_t sbox = spirv_variable(
+      b, spirv_type_pointer(b, SC_FUNCTION, sbox_t), SC_FUNCTION,
+      spirv_const_composite(b, sbox_t, sbox_values, 64));
+  // byte x & 3 of sbox[x >> 2]
+  uint32_t packed = spirv_load(
+      b, uint_t,
+      spirv_val(b, OP_ACCESS_CHAIN, spirv_type_pointer(b, SC_FUNCTION, uint_t),
+                sbox,
+                spirv_val(b, OP_SHIFT_RIGHT_LOGICAL, uint_t, x,
+                          spirv_const_uint(b, 2))));
+  uint32_t offset = spirv_val(
+      b, OP_SHIFT_LEFT_LOGICAL, uint_t,
+      spirv_val(b, OP_BITWISE_AND, uint_t, x, spirv_const_uint(b, 3)),
+      spirv_const_uint(b, 3));
+  return spirv_val(b, OP_BITFIELD_UEXTRACT, uint_t, packed, offset,
+                   spirv_const_uint(b, 8));
+}
+
+uint32_t aes_spv_xtime(struct spirv_builder *b, uint32_t x)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  // (x << 1) ^ (bit7(x) ? AES_WPOLY : 0)
+  uint32_t bit7 = spirv_val(
+      b, OP_INOTEQUAL, spirv_type_bool(b),
+      spirv_val(b, OP_BITFIELD_UEXTRACT, uint_t, x, spirv_const_uint(b, 7),
+                spirv_const_uint(b, 1)),
+      spirv_const_uint(b, 0));
+  return spirv_val(
+      b, OP_BITWISE_XOR, uint_t,
+      spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, x, spirv_const_uint(b, 1)),
+      spirv_val(b, OP_SELECT, uint_t, bit7, spirv_const_uint(b, AES_SPV_WPOLY),
+                spirv_const_uint(b, 0)));
+}
+
+void aes_spv_gen_tables(struct spirv_builder *b, const struct aes_spv *aes,
+                        uint32_t workgroup_size)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t local_size =
+      spirv_val(b, OP_IMUL, uint_t,
+                spirv_val(b, OP_COMPOSITE_EXTRACT, uint_t, workgroup_size, 0),
+                spirv_val(b, OP_COMPOSITE_EXTRACT, uint_t, workgroup_size, 1));
+  uint32_t local_index = spirv_load(
+      b, uint_t, spirv_builtin(b, BUILTIN_LOCAL_INVOCATION_INDEX, uint_t));
+
+  // for (i = local_index; i < 256; i += local_size)
+  struct spirv_loop loop;
+  uint32_t i = spirv_loop_for(b, &loop, local_index, spirv_const_uint(b, 256),
+                              LC_NONE);
+  // x = sbox[i], a = xtime(x), b = a ^ x
+  uint32_t x = aes_spv_sbox(b, i);
+  uint32_t xa = aes_spv_xtime(b, x);
+  uint32_t xb = spirv_val(b, OP_BITWISE_XOR, uint_t, xa, x);
+  // AES_0[i] = uint(a, x, x, b), AES_k[i] = rotl(AES_0[i], 8 * k)
+  uint32_t c = xa;
+  for (uint32_t k = 1; k < 4; ++k) {
+    c = spirv_val(b, OP_BITFIELD_INSERT, uint_t, c, k < 3 ? x : xb,
+                  spirv_const_uint(b, 8 * k), spirv_const_uint(b, 8));
+  }
+  uint32_t ptr_t = spirv_type_pointer(b, SC_WORKGROUP, uint_t);
+  for (uint32_t t = 0; t < 4; ++t) {
+    uint32_t ct = t == 0 ? c : aes_spv_rotl(b, c, 8 * t);
+    spirv_store(b, spirv_val(b, OP_ACCESS_CHAIN, ptr_t, aes->table[t], i), ct);
+  }
+  spirv_loop_end(b, &loop, local_size);
+
+  spirv_op(b, OP_CONTROL_BARRIER, spirv_const_uint(b, SCOPE_WORKGROUP),
+           spirv_const_uint(b, SCOPE_WORKGROUP),
+           spirv_const_uint(b, MEMORY_SEMANTICS_ACQUIRE_RELEASE |
+                                   MEMORY_SEMANTICS_WORGROUP_MEMORY));
+}
+
+void aes_spv_expand_key_10(struct spirv_builder *b, const struct aes_spv *aes,
+                           uint32_t key)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t bool_t = spirv_type_bool(b);
+  uint32_t ptr_t = spirv_type_pointer(b, SC_FUNCTION, uint_t);
+  uint32_t c0 = spirv_const_uint(b, 0);
+
+  // for (i = 8; i < 40; ++i)
+  struct spirv_loop loop;
+  uint32_t i = spirv_loop_for(b, &loop, spirv_const_uint(b, 8),
+                              spirv_const_uint(b, 40), LC_UNROLL);
+  uint32_t prev = spirv_load(
+      b, uint_t,
+      spirv_val(b, OP_ACCESS_CHAIN, ptr_t, key,
+                spirv_val(b, OP_ISUB, uint_t, i, spirv_const_uint(b, 1))));
+  // sub_word(key[i - 1]), sbox is byte 0 of AES_2
+  uint32_t sw = 0;
+  for (uint32_t k = 0; k < 4; ++k) {
+    uint32_t y = spirv_val(
+        b, OP_BITWISE_AND, uint_t,
+        aes_spv_lookup(b, aes, 2, aes_spv_byte(b, prev, k)),
+        spirv_const_uint(b, 0xff));
+    if (k > 0) {
+      y = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, y,
+                    spirv_const_uint(b, 8 * k));
+    }
+    sw = k == 0 ? y : spirv_val(b, OP_BITWISE_OR, uint_t, sw, y);
+  }
+  // t = i & 3 ? key[i - 1] : sub_word(key[i - 1])
+  uint32_t i_and_3 = spirv_val(
+      b, OP_INOTEQUAL, bool_t,
+      spirv_val(b, OP_BITWISE_AND, uint_t, i, spirv_const_uint(b, 3)), c0);
+  uint32_t t = spirv_val(b, OP_SELECT, uint_t, i_and_3, prev, sw);
+  // s = rotl(t, 24) ^ (1 << ((i >> 3) - 1))
+  uint32_t rc = spirv_val(
+      b, OP_SHIFT_LEFT_LOGICAL, uint_t, spirv_const_uint(b, 1),
+      spirv_val(
+          b, OP_ISUB, uint_t,
+          spirv_val(b, OP_SHIFT_RIGHT_LOGICAL, uint_t, i, spirv_const_uint(b, 3)),
+          spirv_const_uint(b, 1)));
+  uint32_t s = spirv_val(b, OP_BITWISE_XOR, uint_t, aes_spv_rotl(b, t, 24), rc);
+  // key[i] = key[i - 8] ^ (i & 7 ? t : s)
+  uint32_t i_and_7 = spirv_val(
+      b, OP_INOTEQUAL, bool_t,
+      spirv_val(b, OP_BITWISE_AND, uint_t, i, spirv_const_uint(b, 7)), c0);
+  uint32_t z = spirv_val(b, OP_SELECT, uint_t, i_and_7, t, s);
+  uint32_t back = spirv_load(
+      b, uint_t,
+      spirv_val(b, OP_ACCESS_CHAIN, ptr_t, key,
+                spirv_val(b, OP_ISUB, uint_t, i, spirv_const_uint(b, 8))));
+  spirv_store(b, spirv_val(b, OP_ACCESS_CHAIN, ptr_t, key, i),
+              spirv_val(b, OP_BITWISE_XOR, uint_t, back, z));
+  spirv_loop_end(b, &loop, spirv_const_uint(b, 1));
+}
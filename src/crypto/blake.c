@@ -8,10 +8,15 @@
  * HMAC is specified by RFC 2104.
  */
 
+#include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #include "crypto/blake.h"
 
 #define U8TO32(p)                                                              \
@@ -214,3 +219,138 @@ void blake_256(const void *input, size_t inputbitlen, uint8_t *digest)
   blake_256_update(&state, input, inputbitlen);
   blake_256_final(&state, digest);
 }
+
+#ifdef __AVX2__
+
+#define ROT_X8(x, n)                                                           \
+  _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n))
+
+/** 8 lanes of 32 bit words, rotations by 16 and 8 are byte shuffles */
+#define G_X8(a, b, c, d, e)                                                    \
+  v[a] = _mm256_add_epi32(                                                     \
+      v[a], _mm256_add_epi32(_mm256_xor_si256(m[sigma[i][e]],                  \
+                                              _mm256_set1_epi32(               \
+                                                  (int)cst[sigma[i][e + 1]])), \
+                             v[b]));                                           \
+  v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rot16);             \
+  v[c] = _mm256_add_epi32(v[c], v[d]);                                         \
+  v[b] = ROT_X8(_mm256_xor_si256(v[b], v[c]), 12);                             \
+  v[a] = _mm256_add_epi32(                                                     \
+      v[a], _mm256_add_epi32(_mm256_xor_si256(m[sigma[i][e + 1]],              \
+                                              _mm256_set1_epi32(               \
+                                                  (int)cst[sigma[i][e]])),     \
+                             v[b]));                                           \
+  v[d] = _mm256_shuffle_epi8(_mm256_xor_si256(v[d], v[a]), rot8);              \
+  v[c] = _mm256_add_epi32(v[c], v[d]);                                         \
+  v[b] = ROT_X8(_mm256_xor_si256(v[b], v[c]), 7);
+
+/** compress one block in each of 8 lanes, `t` is bit counter or 0 if the
+ *  block has no message bits */
+static void blake_256_compress_x8(__m256i h[8], const uint8_t *const block[8],
+                                  uint32_t t)
+{
+  const __m256i rot16 = _mm256_setr_epi8(
+      2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13, 2, 3, 0, 1, 6, 7,
+      4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+  const __m256i rot8 = _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8,
+                                        13, 14, 15, 12, 1, 2, 3, 0, 5, 6, 7, 4,
+                                        9, 10, 11, 8, 13, 14, 15, 12);
+  __m256i v[16], m[16];
+  size_t i;
+  for (i = 0; i < 16; ++i) {
+    m[i] = _mm256_setr_epi32(
+        (int)U8TO32(block[0] + i * 4), (int)U8TO32(block[1] + i * 4),
+        (int)U8TO32(block[2] + i * 4), (int)U8TO32(block[3] + i * 4),
+        (int)U8TO32(block[4] + i * 4), (int)U8TO32(block[5] + i * 4),
+        (int)U8TO32(block[6] + i * 4), (int)U8TO32(block[7] + i * 4));
+  }
+  for (i = 0; i < 8; ++i) {
+    v[i] = h[i];
+    v[i + 8] = _mm256_set1_epi32((int)cst[i]);
+  }
+  // salt is zero, counter high word is zero
+  v[12] = _mm256_xor_si256(v[12], _mm256_set1_epi32((int)t));
+  v[13] = _mm256_xor_si256(v[13], _mm256_set1_epi32((int)t));
+
+  for (i = 0; i < 14; ++i) {
+    G_X8(0, 4, 8, 12, 0);
+    G_X8(1, 5, 9, 13, 2);
+    G_X8(2, 6, 10, 14, 4);
+    G_X8(3, 7, 11, 15, 6);
+    G_X8(3, 4, 9, 14, 14);
+    G_X8(2, 7, 8, 13, 12);
+    G_X8(0, 5, 10, 15, 8);
+    G_X8(1, 6, 11, 12, 10);
+  }
+
+  for (i = 0; i < 8; ++i) {
+    h[i] = _mm256_xor_si256(h[i], _mm256_xor_si256(v[i], v[i + 8]));
+  }
+}
+
+void blake_256_x8(const void *const input[8], size_t inputbitlen,
+                  uint8_t *const digest[8])
+{
+  assert(inputbitlen % 8 == 0 && inputbitlen < ((uint64_t)1 << 32));
+  const size_t len = inputbitlen / 8;
+  static const uint32_t iv[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372,
+                                 0xA54FF53A, 0x510E527F, 0x9B05688C,
+                                 0x1F83D9AB, 0x5BE0CD19};
+  __m256i h[8];
+  for (size_t i = 0; i < 8; ++i) {
+    h[i] = _mm256_set1_epi32((int)iv[i]);
+  }
+
+  const uint8_t *block[8];
+  size_t offset = 0;
+  for (; offset + 64 <= len; offset += 64) {
+    for (size_t k = 0; k < 8; ++k) {
+      block[k] = (const uint8_t *)input[k] + offset;
+    }
+    blake_256_compress_x8(h, block, (uint32_t)(offset + 64) * 8);
+  }
+
+  // padding, same layout in all lanes: message tail, 0x80, 0x01 at byte 55
+  // and 64 bit big endian bit length
+  const size_t rem = len - offset;
+  uint8_t tail[8][128];
+  const size_t tail_len = rem < 56 ? 64 : 128;
+  for (size_t k = 0; k < 8; ++k) {
+    memset(tail[k], 0, tail_len);
+    memcpy(tail[k], (const uint8_t *)input[k] + offset, rem);
+    tail[k][rem] = 0x80;
+    tail[k][tail_len - 9] |= 0x01;
+    U32TO8(tail[k] + tail_len - 4, (uint32_t)inputbitlen);
+    block[k] = tail[k];
+  }
+  // counter is zero for the block without message bits
+  blake_256_compress_x8(h, block, rem > 0 ? (uint32_t)inputbitlen : 0);
+  if (tail_len == 128) {
+    for (size_t k = 0; k < 8; ++k) {
+      block[k] = tail[k] + 64;
+    }
+    blake_256_compress_x8(h, block, 0);
+  }
+
+  uint32_t out[8][8];
+  for (size_t i = 0; i < 8; ++i) {
+    _mm256_storeu_si256((__m256i *)out[i], h[i]);
+  }
+  for (size_t k = 0; k < 8; ++k) {
+    for (size_t i = 0; i < 8; ++i) {
+      U32TO8(digest[k] + i * 4, out[i][k]);
+    }
+  }
+}
+
+#else
+
+void blake_256_x8(const void *const input[8], size_t inputbitlen,
+                  uint8_t *const digest[8])
+{
+  for (size_t k = 0; k < 8; ++k) {
+    blake_256(input[k], inputbitlen, digest[k]);
+  }
+}
+
+#endif // __AVX2__
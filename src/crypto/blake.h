@@ -16,3 +16,7 @@ void blake_256_final(struct blake_state *state, uint8_t *digest);
 
 /** hash fixed size input and produce 256-bit digest */
 void blake_256(const void *input, size_t inputbitlen, uint8_t *digest);
+
+/** hash 8 inputs of the same length at once (AVX2 if available) */
+void blake_256_x8(const void *const input[8], size_t inputbitlen,
+                  uint8_t *const digest[8]);
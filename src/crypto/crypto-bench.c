@@ -0,0 +1,432 @@
+/* crypto-bench.c -- per phase CryptoNight microbenchmark
+ *
+ * Every phase of cryptonight_aesni is timed on its own. Reports time, TSC
+ * ticks and, where the kernel allows it, hardware counters per call.
+ */
+#include <getopt.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <x86intrin.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "cJSON/cJSON.h"
+#include "crypto/blake.h"
+#include "crypto/cryptonight/cryptonight.h"
+#include "crypto/cryptonight/cryptonight_phases.h"
+#include "crypto/groestl.h"
+#include "crypto/jh.h"
+#include "crypto/keccak-tiny.h"
+#include "crypto/skein.h"
+
+#define CN_MEMORY 2097152
+#define CN_INPUT_LEN 76
+#define CN_STATE_LEN 200
+
+/** each phase runs at least this many times */
+#define MIN_CALLS 3
+
+/** states finalized per call of final_batch */
+#define FINAL_BATCH_SIZE 64
+
+struct bench_ctx {
+  alignas(16) uint8_t hash_state[CN_STATE_LEN];
+  uint8_t input[CN_INPUT_LEN];
+  uint8_t digest[32];
+  uint8_t *long_state;
+  struct cryptonight_ctx *cn_ctx;
+  uint8_t batch_states[FINAL_BATCH_SIZE * CN_STATE_LEN];
+  uint8_t batch_hashes[FINAL_BATCH_SIZE * CRYPTONIGHT_FINAL_HASH_LENGTH];
+};
+
+typedef void (*bench_fn)(struct bench_ctx *);
+
+static void bench_keccak_256(struct bench_ctx *b)
+{
+  keccak_256(b->hash_state, CN_STATE_LEN, b->input, CN_INPUT_LEN);
+}
+
+static void bench_explode(struct bench_ctx *b)
+{
+  cn_explode_scratchpad((__m128i *)b->hash_state, (__m128i *)b->long_state);
+}
+
+static void bench_memory_loop(struct bench_ctx *b)
+{
+  cn_memory_loop(b->long_state, b->hash_state, 0x0123456789abcdef);
+}
+
+static void bench_implode(struct bench_ctx *b)
+{
+  cn_implode_scratchpad((__m128i *)b->long_state, (__m128i *)b->hash_state);
+}
+
+static void bench_keccak_f(struct bench_ctx *b)
+{
+  keccak_f((uint64_t *)b->hash_state, 24);
+}
+
+static void bench_blake_256(struct bench_ctx *b)
+{
+  blake_256(b->hash_state, CN_STATE_LEN * 8, b->digest);
+}
+
+static void bench_groestl_256(struct bench_ctx *b)
+{
+  groestl_256(b->hash_state, CN_STATE_LEN * 8, b->digest);
+}
+
+static void bench_jh_256(struct bench_ctx *b)
+{
+  jh_256(b->hash_state, CN_STATE_LEN * 8, b->digest);
+}
+
+static void bench_skein_512_256(struct bench_ctx *b)
+{
+  skein_512_256(b->hash_state, CN_STATE_LEN * 8, b->digest);
+}
+
+static void bench_blake_256_x8(struct bench_ctx *b)
+{
+  const void *input[8];
+  uint8_t *digest[8];
+  for (size_t k = 0; k < 8; ++k) {
+    input[k] = b->hash_state;
+    digest[k] = b->digest;
+  }
+  blake_256_x8(input, CN_STATE_LEN * 8, digest);
+}
+
+static void bench_skein_512_256_x4(struct bench_ctx *b)
+{
+  const void *input[4];
+  uint8_t *digest[4];
+  for (size_t k = 0; k < 4; ++k) {
+    input[k] = b->hash_state;
+    digest[k] = b->digest;
+  }
+  skein_512_256_x4(input, CN_STATE_LEN * 8, digest);
+}
+
+/** all four final hashes in equal share */
+static void bench_final_batch(struct bench_ctx *b)
+{
+  cryptonight_final_batch(b->batch_states, CN_STATE_LEN, FINAL_BATCH_SIZE,
+                          b->batch_hashes);
+}
+
+static void bench_cryptonight(struct bench_ctx *b)
+{
+  cryptonight_aesni(b->input, CN_INPUT_LEN,
+                    (struct cryptonight_hash *)b->hash_state, b->cn_ctx);
+}
+
+static const struct bench_phase {
+  const char *name;
+  bench_fn fn;
+} PHASES[] = {{"keccak_256", bench_keccak_256},
+              {"explode_scratchpad", bench_explode},
+              {"memory_loop", bench_memory_loop},
+              {"implode_scratchpad", bench_implode},
+              {"keccak_f", bench_keccak_f},
+              {"blake_256", bench_blake_256},
+              {"groestl_256", bench_groestl_256},
+              {"jh_256", bench_jh_256},
+              {"skein_512_256", bench_skein_512_256},
+              {"blake_256_x8", bench_blake_256_x8},
+              {"skein_512_256_x4", bench_skein_512_256_x4},
+              {"final_batch", bench_final_batch},
+              {"cryptonight", bench_cryptonight}};
+
+#define PHASES_LEN (sizeof(PHASES) / sizeof(PHASES[0]))
+
+/* ============       perf counters     ============== */
+enum counter {
+  COUNTER_CYCLES,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_CACHE_MISSES,
+  COUNTER_DTLB_MISSES,
+  COUNTERS_LEN
+};
+
+static const char *COUNTER_NAMES[] = {"cycles", "instructions",
+                                      "cache_misses", "dtlb_misses"};
+
+/** -1 if counter is not available */
+static int counter_fds[COUNTERS_LEN];
+
+static void counters_open()
+{
+  for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+    counter_fds[i] = -1;
+  }
+#ifdef __linux__
+  static const struct {
+    uint32_t type;
+    uint64_t config;
+  } events[COUNTERS_LEN] = {
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)}};
+  for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = events[i].type;
+    attr.config = events[i].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    counter_fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+#endif
+}
+
+static void counters_close()
+{
+  for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+    if (counter_fds[i] >= 0) {
+      close(counter_fds[i]);
+    }
+  }
+}
+
+static void counters_start()
+{
+#ifdef __linux__
+  for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+    if (counter_fds[i] >= 0) {
+      ioctl(counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+      ioctl(counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+  }
+#endif
+}
+
+/** stop counters and read values, -1 for unavailable counter */
+static void counters_stop(int64_t values[COUNTERS_LEN])
+{
+  for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+    values[i] = -1;
+#ifdef __linux__
+    uint64_t v;
+    if (counter_fds[i] >= 0 &&
+        ioctl(counter_fds[i], PERF_EVENT_IOC_DISABLE, 0) == 0 &&
+        read(counter_fds[i], &v, sizeof(v)) == sizeof(v)) {
+      values[i] = (int64_t)v;
+    }
+#endif
+  }
+}
+
+/* ============          runner         ============== */
+struct bench_result {
+  uint64_t calls;
+  double ns_per_call;
+  double tsc_per_call;
+  double counters_per_call[COUNTERS_LEN]; // < 0 if not available
+};
+
+static uint64_t now_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/** run phase in doubling batches until `min_time_ns` elapsed */
+static void bench_run(const struct bench_phase *phase, struct bench_ctx *ctx,
+                      uint64_t min_time_ns, struct bench_result *result)
+{
+  phase->fn(ctx); // warm up caches
+
+  uint64_t calls = 0;
+  uint64_t batch = 1;
+  int64_t counters[COUNTERS_LEN];
+  counters_start();
+  uint64_t tsc_start = __rdtsc();
+  uint64_t start = now_ns();
+  uint64_t elapsed = 0;
+  while (elapsed < min_time_ns || calls < MIN_CALLS) {
+    for (uint64_t i = 0; i < batch; ++i) {
+      phase->fn(ctx);
+    }
+    calls += batch;
+    batch *= 2;
+    elapsed = now_ns() - start;
+  }
+  uint64_t tsc = __rdtsc() - tsc_start;
+  counters_stop(counters);
+
+  result->calls = calls;
+  result->ns_per_call = (double)elapsed / (double)calls;
+  result->tsc_per_call = (double)tsc / (double)calls;
+  for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+    result->counters_per_call[i] =
+        counters[i] >= 0 ? (double)counters[i] / (double)calls : -1;
+  }
+}
+
+static void print_text(const struct bench_phase *phase,
+                       const struct bench_result *r)
+{
+  printf("%-20s %10lu %14.1f %14.0f", phase->name, r->calls, r->ns_per_call,
+         r->tsc_per_call);
+  for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+    if (r->counters_per_call[i] >= 0) {
+      printf(" %14.1f", r->counters_per_call[i]);
+    } else {
+      printf(" %14s", "n/a");
+    }
+  }
+  printf("\n");
+}
+
+static cJSON *result_to_json(const struct bench_phase *phase,
+                             const struct bench_result *r)
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "name", phase->name);
+  cJSON_AddNumberToObject(json, "calls", (double)r->calls);
+  cJSON_AddNumberToObject(json, "ns_per_call", r->ns_per_call);
+  cJSON_AddNumberToObject(json, "tsc_per_call", r->tsc_per_call);
+  for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+    if (r->counters_per_call[i] >= 0) {
+      char name[64];
+      snprintf(name, sizeof(name), "%s_per_call", COUNTER_NAMES[i]);
+      cJSON_AddNumberToObject(json, name, r->counters_per_call[i]);
+    }
+  }
+  return json;
+}
+
+static void print_usage(const char *name)
+{
+  fprintf(stderr,
+          "Usage: %s [options] [phase ...]\n"
+          "  --json              print results as json\n"
+          "  --min-time <msec>   minimal run time of every phase, "
+          "default: 1000\n"
+          "Phases:",
+          name);
+  for (size_t i = 0; i < PHASES_LEN; ++i) {
+    fprintf(stderr, " %s", PHASES[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+  static struct option long_opts[] = {
+      {"help", no_argument, NULL, 'h'},
+      {"json", no_argument, NULL, 'j'},
+      {"min-time", required_argument, NULL, 't'},
+      {NULL, 0, NULL, 0}};
+  bool is_json = false;
+  long min_time_ms = 1000;
+  int c;
+  while ((c = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+    switch (c) {
+    case 'j':
+      is_json = true;
+      break;
+    case 't':
+      min_time_ms = strtol(optarg, NULL, 10);
+      if (min_time_ms <= 0) {
+        print_usage(argv[0]);
+      }
+      break;
+    default:
+      print_usage(argv[0]);
+    }
+  }
+
+  bool is_selected[PHASES_LEN];
+  for (size_t i = 0; i < PHASES_LEN; ++i) {
+    is_selected[i] = optind == argc;
+  }
+  for (int a = optind; a < argc; ++a) {
+    size_t i = 0;
+    for (; i < PHASES_LEN && strcmp(argv[a], PHASES[i].name) != 0; ++i)
+      ;
+    if (i == PHASES_LEN) {
+      fprintf(stderr, "Unknown phase: %s\n", argv[a]);
+      print_usage(argv[0]);
+    }
+    is_selected[i] = true;
+  }
+
+  struct bench_ctx *ctx = aligned_alloc(16, sizeof(struct bench_ctx));
+  memset(ctx, 0, sizeof(struct bench_ctx));
+  for (size_t i = 0; i < CN_INPUT_LEN; ++i) {
+    ctx->input[i] = (uint8_t)(i * 7 + 1);
+  }
+  ctx->long_state = aligned_alloc(4096, CN_MEMORY);
+  ctx->cn_ctx = cryptonight_ctx_new();
+  if (ctx->long_state == NULL || ctx->cn_ctx == NULL) {
+    fprintf(stderr, "Memory allocation failed\n");
+    return EXIT_FAILURE;
+  }
+  // realistic state for the phases that depend on it
+  bench_keccak_256(ctx);
+  bench_explode(ctx);
+  for (size_t i = 0; i < sizeof(ctx->batch_states); ++i) {
+    ctx->batch_states[i] = (uint8_t)(i * 31 + 7);
+  }
+  for (size_t i = 0; i < FINAL_BATCH_SIZE; ++i) {
+    ctx->batch_states[i * CN_STATE_LEN] = (uint8_t)i; // select final hash
+  }
+
+  counters_open();
+  if (!is_json) {
+    printf("%-20s %10s %14s %14s", "phase", "calls", "ns/call", "tsc/call");
+    for (size_t i = 0; i < COUNTERS_LEN; ++i) {
+      printf(" %14s", COUNTER_NAMES[i]);
+    }
+    printf("\n");
+  }
+  cJSON *json = cJSON_CreateObject();
+  cJSON *phases = cJSON_CreateArray();
+  cJSON_AddItemToObject(json, "phases", phases);
+  for (size_t i = 0; i < PHASES_LEN; ++i) {
+    if (!is_selected[i]) {
+      continue;
+    }
+    struct bench_result result;
+    bench_run(&PHASES[i], ctx, (uint64_t)min_time_ms * 1000000, &result);
+    if (is_json) {
+      cJSON_AddItemToArray(phases, result_to_json(&PHASES[i], &result));
+    } else {
+      print_text(&PHASES[i], &result);
+    }
+  }
+  if (is_json) {
+    char *str = cJSON_Print(json);
+    printf("%s\n", str);
+    free(str);
+  } else if (counter_fds[COUNTER_CYCLES] < 0) {
+    printf("Hardware counters unavailable, "
+           "check /proc/sys/kernel/perf_event_paranoid\n");
+  }
+  cJSON_Delete(json);
+  counters_close();
+
+  cryptonight_ctx_free(&ctx->cn_ctx);
+  free(ctx->long_state);
+  free(ctx);
+  return EXIT_SUCCESS;
+}
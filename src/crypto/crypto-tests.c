@@ -1,15 +1,19 @@
 #include <assert.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "crypto/blake.h"
 #include "crypto/cryptonight/cryptonight.h"
+#include "crypto/cryptonight_spv.h"
 #include "crypto/groestl.h"
 #include "crypto/jh.h"
 #include "crypto/keccak-tiny.h"
 #include "crypto/skein.h"
 #include "utils/hex.h"
+#include "utils/spirv.h"
 #include "utils/unused.h"
 
 #define DIGEST_LENGTH_BITS 256
@@ -110,6 +114,7 @@ static const char *GROESTL_256_RESULTS[] = {
     "5f87f9404c1142b9e701076dd047386162213a896560c1656c62bbfedfbeddb6",
     "f7c8149059ada9db84706dd1b2826b992134e76357c8c11502a27ef3b02a4a01"};
 
+// messages shorter than 43 bytes are hashed zero padded, see do_cryptonight
 static const struct test_vector CRYPTONIGHT_TEST_VECTORS[] = {
     {.msg = "", .repeat = 0, .enc = ENC_STRING},
     {.msg = "This is a test", .repeat = 0, .enc = ENC_STRING},
@@ -136,6 +141,10 @@ static const struct test_vector CRYPTONIGHT_TEST_VECTORS[] = {
             "4dd4a4ed600010685402",
      .repeat = 0,
      .enc = ENC_HEX},
+    {.msg = "0000000000000000000000000000000000000000000000000000000000000000"
+            "0000000000000000000000",
+     .repeat = 0,
+     .enc = ENC_HEX},
     {.msg = "8519e039172b0d70e5ca7b3383d6b3167315a422747b73f019cf9528f0fde341fd"
             "0f2a63030ba6450525cf6de31837669af6f1df8131faf50aaab8d3a7405589",
      .repeat = 0,
@@ -152,15 +161,16 @@ static const struct test_vector CRYPTONIGHT_TEST_VECTORS[] = {
 };
 
 static const char *CRYPTONIGHT_256_RESULTS[] = {
-    "1355425edbacc55ef903d5b3820fc4e50144aef34f9b39e56f4d21d928bfa10c",
-    "ed8cc757543d7177ea49203ac5e10ca382c9c1757dc4ce0d773a1e5e67c7c15f",
-    "04c86a155e5f23ccdf1426d39b886161ae0658f8c3ebd89964a45fd3dcb76493",
-    "421f2de3e71e3f6f348a59584bc01d5246924cbdd9ab5d67cd1472889c59510d",
-    "0975f309165f2dd320978becefce754e89fe6bbf14e17770af7c107520c3175f",
+    "b20a0fe41a1b41c84b6442f3aaee590b7f09b23ab42a3d381485405d06eef46e",
+    "3930f2924f584b55dd306433fb506cf7b6cad1855aec5445a39aee8d47cb668e",
+    "701756fe3728af7a78369360cea84a5d1d123eee2e89274735257b926cf2e94e",
+    "ad36ebe9b9c4ad1f048090c1530633a83f543f5b2a3ba177e74e18072fb3169e",
+    "c228d79ce4ac74c7d17923d250fcdb3426329e4b59230f0b83a45a245597f813",
     "a634ccbc972a6357af1dc0e029e214c69b99869f8254da410448ce3fd89d4db7",
     "346bd7a82696129e7c091fd3972c950db4d12f035ea355011410b0921ad68a5e",
     "37d00e0fd4aa5da7b7e300fa00da8f65cf08c7ad0463c318951e9732d6b27228",
     "faf8d7e5434b42322b8f23976bb6488ec1ec1b6a37c63a1b7d850a84db89f834",
+    "b5a7f63abb94d07d1a6445c36c07c7e8327fe61b1647e391b4c7edae5de57a3d",
     "5bb40c5880cef2f739bdb6aaaf16161eaae55530e7b10d7ea996b751a299e949",
     "613e638505ba1fd05f428d5c9f8e08f8165614342dac419adc6a47dce257eb3e",
     "ed082e49dbd5bbe34a3726a0d1dad981146062b39d36d62c71eb1ed8ab49459b"};
@@ -197,9 +207,16 @@ void do_groestl(const void *msg, size_t msg_len, uint8_t *digest)
 
 void do_cryptonight(const void *msg, size_t msg_len, uint8_t *digest)
 {
+  // v7 tweak reads past the end of short messages, hash them zero padded
+  size_t buf_len = msg_len > CRYPTONIGHT_MIN_INPUT_READABLE
+                       ? msg_len
+                       : CRYPTONIGHT_MIN_INPUT_READABLE;
+  uint8_t *buf = calloc(1, buf_len);
+  memcpy(buf, msg, msg_len);
   struct cryptonight_ctx *ctx = cryptonight_ctx_new();
-  cryptonight_aesni(msg, msg_len, (struct cryptonight_hash *)digest, ctx);
+  cryptonight_aesni(buf, msg_len, (struct cryptonight_hash *)digest, ctx);
   cryptonight_ctx_free(&ctx);
+  free(buf);
 }
 
 typedef void (*hash_fn)(const void *msg, size_t msg_len, uint8_t *digest);
@@ -274,6 +291,123 @@ int test_cryptonight()
                       CRYPTONIGHT_256_RESULTS, do_cryptonight);
 }
 
+/** multi-buffer and batch finalizers must match single state ones */
+int test_final_batch()
+{
+  enum { N = 61 }; // not a multiple of lane count
+  static const size_t lens[] = {0, 8, 55, 56, 64, 100, 200};
+  uint8_t states[N][CRYPTONIGHT_STATE_SIZE];
+  uint8_t expected[N][CRYPTONIGHT_FINAL_HASH_LENGTH];
+  uint8_t actual[N][CRYPTONIGHT_FINAL_HASH_LENGTH];
+  srand(1);
+  for (size_t i = 0; i < N; ++i) {
+    for (size_t j = 0; j < CRYPTONIGHT_STATE_SIZE; ++j) {
+      states[i][j] = (uint8_t)rand();
+    }
+  }
+
+  int failures = 0;
+  printf("Testing multi-buffer finalizers\n");
+  for (size_t l = 0; l < sizeof(lens) / sizeof(lens[0]); ++l) {
+    const void *input[8];
+    uint8_t *output[8];
+    for (size_t k = 0; k < 8; ++k) {
+      input[k] = states[k];
+      output[k] = actual[k];
+      blake_256(states[k], lens[l] * 8, expected[k]);
+    }
+    blake_256_x8(input, lens[l] * 8, output);
+    if (memcmp(expected, actual, 8 * CRYPTONIGHT_FINAL_HASH_LENGTH) != 0) {
+      printf(" - FAIL: blake_256_x8, %lu bytes\n", lens[l]);
+      ++failures;
+    }
+    for (size_t k = 0; k < 4; ++k) {
+      skein_512_256(states[k], lens[l] * 8, expected[k]);
+    }
+    skein_512_256_x4(input, lens[l] * 8, output);
+    if (memcmp(expected, actual, 4 * CRYPTONIGHT_FINAL_HASH_LENGTH) != 0) {
+      printf(" - FAIL: skein_512_256_x4, %lu bytes\n", lens[l]);
+      ++failures;
+    }
+  }
+
+  for (size_t i = 0; i < N; ++i) {
+    cryptonight_final_hash(states[i], expected[i]);
+  }
+  cryptonight_final_batch((const uint8_t *)states, CRYPTONIGHT_STATE_SIZE, N,
+                          (uint8_t *)actual);
+  if (memcmp(expected, actual, sizeof(expected)) != 0) {
+    printf(" - FAIL: cryptonight_final_batch\n");
+    ++failures;
+  }
+  if (failures == 0) {
+    printf(" + PASS: blake_256_x8, skein_512_256_x4, "
+           "cryptonight_final_batch\n");
+  }
+  return failures;
+}
+
+/** generated shaders must pass spirv-val, `SPIRV_VAL` names the validator,
+ *  SPIRV_VAL=skip only checks the module header */
+int test_spirv()
+{
+  int failures = 0;
+  const char *spirv_val = getenv("SPIRV_VAL");
+  if (spirv_val == NULL || *spirv_val == '\0') {
+    spirv_val = "spirv-val";
+  }
+  bool skip_val = strcmp(spirv_val, "skip") == 0;
+  printf("Testing SPIR-V shaders\n");
+  for (size_t i = 0; i < CRYPTONIGHT_SPV_STAGES; ++i) {
+    const char *name = cryptonight_spv_stage_name(i);
+    size_t size;
+    uint32_t *code = cryptonight_spv_shader(i, &size);
+    if (code == NULL || size < 5 * sizeof(uint32_t) || size % 4 != 0 ||
+        code[0] != SPIRV_MAGIC) {
+      printf(" - FAIL: %s: malformed module\n", name);
+      free(code);
+      ++failures;
+      continue;
+    }
+    if (skip_val) {
+      free(code);
+      continue;
+    }
+    char path[] = "/tmp/dorenom-spirv-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, code, size) != (ssize_t)size) {
+      printf(" - FAIL: %s: can't write %s\n", name, path);
+      free(code);
+      ++failures;
+      continue;
+    }
+    close(fd);
+    free(code);
+
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "%s --target-env vulkan1.1 %s 2>/dev/null",
+             spirv_val, path);
+    int res = system(cmd);
+    if (res != -1 && WIFEXITED(res) && WEXITSTATUS(res) == 127) {
+      printf(" - FAIL: %s not found, install SPIRV-Tools or set "
+             "SPIRV_VAL=skip\n",
+             spirv_val);
+      unlink(path);
+      return failures + 1;
+    } else if (res != 0) {
+      printf(" - FAIL: %s: %s rejected %s\n", name, spirv_val, path);
+      ++failures;
+      continue;
+    }
+    unlink(path);
+  }
+  if (failures == 0) {
+    printf(skip_val ? " - SKIP: validation disabled by SPIRV_VAL=skip\n"
+                    : " + PASS\n");
+  }
+  return failures;
+}
+
 int main(int argc, char **argv)
 {
   UNUSED(argc);
@@ -288,6 +422,8 @@ int main(int argc, char **argv)
   failures += test_hash("Groestl", GROESTL_256_RESULTS, do_groestl);
 
   failures += test_cryptonight();
+  failures += test_final_batch();
+  failures += test_spirv();
   if (failures > 0) {
     printf("FAILURE: Tests failed: %d\n", failures);
   } else {
@@ -1,4 +1,5 @@
 #include "crypto/cryptonight/cryptonight.h"
+#include "crypto/cryptonight/cryptonight_phases.h"
 
 #include <assert.h>
 #include <stdalign.h>
@@ -237,27 +238,11 @@ static inline void cryptonight_monero_tweak(uint64_t *mem_out, __m128i tmp)
   mem_out[1] = vh;
 }
 
-void cryptonight_aesni(const uint8_t *input, size_t input_size,
-                       struct cryptonight_hash *output,
-                       struct cryptonight_ctx *ctx0)
+/** memory-hard loop, inlined into cryptonight_aesni */
+static inline __attribute__((always_inline)) void
+cn_memory_loop_impl(uint8_t *l0, const uint64_t *h0,
+                    const uint64_t monero_tweak_const)
 {
-  assert(input != NULL);
-  assert(output != NULL);
-  assert(ctx0 != NULL);
-
-  // init scratchpad
-  keccak_256(ctx0->hash_state, 200, input, input_size);
-
-  // monero pow v7 const
-  const uint64_t monero_tweak_const =
-      get_monero_tweak_const(input, ctx0->hash_state);
-
-  cn_explode_scratchpad((__m128i *)ctx0->hash_state,
-                        (__m128i *)ctx0->long_state);
-
-  uint8_t *l0 = ctx0->long_state;
-  uint64_t *h0 = (uint64_t *)ctx0->hash_state;
-
   uint64_t al0 = h0[0] ^ h0[4];
   uint64_t ah0 = h0[1] ^ h0[5];
   __m128i bx0 = _mm_set_epi64x(h0[3] ^ h0[7], h0[2] ^ h0[6]);
@@ -290,15 +275,106 @@ void cryptonight_aesni(const uint8_t *input, size_t input_size,
     al0 ^= cl;
     idx0 = al0;
   }
+}
+
+void cn_memory_loop(uint8_t *long_state, const uint8_t *hash_state,
+                    uint64_t monero_tweak_const)
+{
+  cn_memory_loop_impl(long_state, (const uint64_t *)hash_state,
+                      monero_tweak_const);
+}
+
+void cryptonight_aesni(const uint8_t *input, size_t input_size,
+                       struct cryptonight_hash *output,
+                       struct cryptonight_ctx *ctx0)
+{
+  assert(input != NULL);
+  assert(output != NULL);
+  assert(ctx0 != NULL);
+
+  // init scratchpad
+  keccak_256(ctx0->hash_state, 200, input, input_size);
+
+  // monero pow v7 const
+  const uint64_t monero_tweak_const =
+      get_monero_tweak_const(input, ctx0->hash_state);
+
+  cn_explode_scratchpad((__m128i *)ctx0->hash_state,
+                        (__m128i *)ctx0->long_state);
+
+  cn_memory_loop_impl(ctx0->long_state, (uint64_t *)ctx0->hash_state,
+                      monero_tweak_const);
+
   cn_implode_scratchpad((__m128i *)ctx0->long_state,
                         (__m128i *)ctx0->hash_state);
 
   keccak_f((uint64_t *)ctx0->hash_state, 24);
 
-  static void (*const extra_hashes[4])(const void *, size_t, uint8_t *) = {
-      blake_256, groestl_256, jh_256, skein_512_256};
-  const int final_hash_idx = ctx0->hash_state[0] & 3;
-  extra_hashes[final_hash_idx](ctx0->hash_state, 200 * 8, (uint8_t *)output);
+  cryptonight_final_hash(ctx0->hash_state, (uint8_t *)output);
+}
+
+static void (*const extra_hashes[4])(const void *, size_t, uint8_t *) = {
+    blake_256, groestl_256, jh_256, skein_512_256};
+
+void cryptonight_final_hash(const uint8_t *state, uint8_t *output)
+{
+  extra_hashes[state[0] & 3](state, CRYPTONIGHT_STATE_SIZE * 8, output);
+}
+
+/** states waiting for a multi-buffer finalizer */
+struct final_lanes {
+  const void *input[8];
+  uint8_t *output[8];
+  size_t len;
+};
+
+static void final_lanes_flush(struct final_lanes *lanes, size_t width,
+                              void (*hash_xn)(const void *const *, size_t,
+                                              uint8_t *const *))
+{
+  if (lanes->len == 0) {
+    return;
+  }
+  // fill unused lanes with copies of the first one
+  uint8_t scratch[32];
+  for (size_t k = lanes->len; k < width; ++k) {
+    lanes->input[k] = lanes->input[0];
+    lanes->output[k] = scratch;
+  }
+  hash_xn(lanes->input, CRYPTONIGHT_STATE_SIZE * 8, lanes->output);
+  lanes->len = 0;
+}
+
+void cryptonight_final_batch(const uint8_t *states, size_t stride, size_t n,
+                             uint8_t *outputs)
+{
+  struct final_lanes blake = {.len = 0};
+  struct final_lanes skein = {.len = 0};
+  for (size_t i = 0; i < n; ++i) {
+    const uint8_t *state = states + i * stride;
+    uint8_t *output = outputs + i * CRYPTONIGHT_FINAL_HASH_LENGTH;
+    switch (state[0] & 3) {
+    case 0:
+      blake.input[blake.len] = state;
+      blake.output[blake.len++] = output;
+      if (blake.len == 8) {
+        final_lanes_flush(&blake, 8, blake_256_x8);
+      }
+      break;
+    case 3:
+      skein.input[skein.len] = state;
+      skein.output[skein.len++] = output;
+      if (skein.len == 4) {
+        final_lanes_flush(&skein, 4, skein_512_256_x4);
+      }
+      break;
+    default:
+      // groestl (AES-NI) and jh (SSE2 bitslice) are vectorized per state
+      extra_hashes[state[0] & 3](state, CRYPTONIGHT_STATE_SIZE * 8, output);
+    }
+  }
+  final_lanes_flush(&blake, 8, blake_256_x8);
+  final_lanes_flush(&skein, 4, skein_512_256_x4);
 }
 
 struct cryptonight_ctx *cryptonight_ctx_new()
@@ -309,7 +385,7 @@ struct cryptonight_ctx *cryptonight_ctx_new()
     // fallback to regular aligned alloc
     log_warn("Huge pages support unavaliable. Performance may suffer");
     int res =
-        posix_memalign((void *)&ctx->long_state, CRYPTONIGHT_MEMORY, 4096);
+        posix_memalign((void *)&ctx->long_state, 4096, CRYPTONIGHT_MEMORY);
     if (res != 0) {
       log_error("Memory allocation for context failed");
       free(ctx);
@@ -348,3 +424,8 @@ void cryptonight_ctx_free(struct cryptonight_ctx **ptr)
   free(*ptr);
   *ptr = NULL;
 }
+
+const uint8_t *cryptonight_ctx_state(const struct cryptonight_ctx *ctx)
+{
+  return ctx->hash_state;
+}
@@ -5,6 +5,12 @@
 
 #define CRYPTONIGHT_HASH_LENGTH 256
 
+/** keccak state size in bytes */
+#define CRYPTONIGHT_STATE_SIZE 200
+
+/** output of final hash in bytes */
+#define CRYPTONIGHT_FINAL_HASH_LENGTH 32
+
 struct cryptonight_hash {
   uint8_t data[CRYPTONIGHT_HASH_LENGTH];
 };
@@ -15,6 +21,24 @@ struct cryptonight_ctx *cryptonight_ctx_new();
 
 void cryptonight_ctx_free(struct cryptonight_ctx **);
 
+/** keccak state the last hash computed with `ctx` was finalized from */
+const uint8_t *cryptonight_ctx_state(const struct cryptonight_ctx *ctx);
+
+/** Monero v7 tweak reads 8 bytes at offset 35 of the input */
+#define CRYPTONIGHT_MIN_INPUT_READABLE 43
+
+/** `input` must be readable for at least CRYPTONIGHT_MIN_INPUT_READABLE
+ *  bytes even when `input_size` is smaller, pad short inputs with zeros */
 void cryptonight_aesni(const uint8_t *input, size_t input_size,
                        struct cryptonight_hash *output,
                        struct cryptonight_ctx *ctx0);
+
+/** Final hash of keccak state, function is selected by state[0] & 3 */
+void cryptonight_final_hash(const uint8_t *state, uint8_t *output);
+
+/** Final hash of `n` keccak states located `stride` bytes apart.
+ *  States are grouped by final hash function and hashed with multi-buffer
+ *  implementations where available. Hash of i-th state is written to
+ *  outputs + i * CRYPTONIGHT_FINAL_HASH_LENGTH */
+void cryptonight_final_batch(const uint8_t *states, size_t stride, size_t n,
+                             uint8_t *outputs);
@@ -1,5 +1,4 @@
 /** tunable parameters, can be overriden via -D flag to compiler */
-R"===(
 #ifndef CRYPTONIGHT_MEMORY
 #define CRYPTONIGHT_MEMORY 2097152 /* 2 MiB */
 #endif
@@ -415,4 +414,573 @@ cn_implode(global uint *scratchpad_begin, global uint *output)
   }
   vstore4(xout, 4 + b, state);
 }
-)==="
+
+// Final hash of the keccak state and target check, ported from the CPU
+// implementations in crypto/. The state is always 200 bytes: three full
+// 64 byte blocks and 8 bytes of tail, so padding is precomputed.
+
+#ifndef MAX_RESULTS
+#define MAX_RESULTS 256
+#endif
+
+#define BSWAP32(x) (rotate((x)&0x00FF00FFU, 24U) | rotate((x)&0xFF00FF00U, 8U))
+
+/** 32 bit word `i` of the state, read without aliasing it as uint array */
+#define STATE_UINT(s, i) ((uint)((s)[(i) >> 1] >> (((i)&1) * 32)))
+
+// Blake-256 constants
+static const constant uint blake_cst[16] = {
+    0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344, 0xA4093822, 0x299F31D0,
+    0x082EFA98, 0xEC4E6C89, 0x452821E6, 0x38D01377, 0xBE5466CF, 0x34E90C6C,
+    0xC0AC29B7, 0xC97C50DD, 0x3F84D5B5, 0xB5470917};
+
+static const constant uint blake_iv[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372,
+                                          0xA54FF53A, 0x510E527F, 0x9B05688C,
+                                          0x1F83D9AB, 0x5BE0CD19};
+
+static const constant uchar blake_sigma[10][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0}};
+
+#define BLAKE_G(a, b, c, d, e)                                                 \
+  v[a] += (m[s[e]] ^ blake_cst[s[e + 1]]) + v[b];                              \
+  v[d] = rotate(v[d] ^ v[a], 16U);                                             \
+  v[c] += v[d];                                                                \
+  v[b] = rotate(v[b] ^ v[c], 20U);                                             \
+  v[a] += (m[s[e + 1]] ^ blake_cst[s[e]]) + v[b];                              \
+  v[d] = rotate(v[d] ^ v[a], 24U);                                             \
+  v[c] += v[d];                                                                \
+  v[b] = rotate(v[b] ^ v[c], 25U);
+
+/** compress block of big endian words, `t` is message bit counter */
+static inline void blake_256_compress(uint *h, const uint *m, const uint t)
+{
+  uint v[16];
+  for (uint i = 0; i < 8; ++i) {
+    v[i] = h[i];
+    v[i + 8] = blake_cst[i];
+  }
+  // salt is zero, counter high word is zero
+  v[12] ^= t;
+  v[13] ^= t;
+
+  for (uint r = 0; r < 14; ++r) {
+    const constant uchar *s = blake_sigma[r % 10];
+    BLAKE_G(0, 4, 8, 12, 0);
+    BLAKE_G(1, 5, 9, 13, 2);
+    BLAKE_G(2, 6, 10, 14, 4);
+    BLAKE_G(3, 7, 11, 15, 6);
+    BLAKE_G(3, 4, 9, 14, 14);
+    BLAKE_G(2, 7, 8, 13, 12);
+    BLAKE_G(0, 5, 10, 15, 8);
+    BLAKE_G(1, 6, 11, 12, 10);
+  }
+
+  for (uint i = 0; i < 8; ++i) {
+    h[i] ^= v[i] ^ v[i + 8];
+  }
+}
+
+static inline void blake_256(global const ulong *state, uint *hash)
+{
+  uint m[16];
+  for (uint i = 0; i < 8; ++i) {
+    hash[i] = blake_iv[i];
+  }
+  for (uint b = 0; b < 3; ++b) {
+    for (uint i = 0; i < 16; ++i) {
+      m[i] = BSWAP32(STATE_UINT(state, b * 16 + i));
+    }
+    blake_256_compress(hash, m, (b + 1) * 512);
+  }
+
+  // tail, 0x80, 0x01 at byte 55 and 64 bit big endian bit length
+  m[0] = BSWAP32(STATE_UINT(state, 48));
+  m[1] = BSWAP32(STATE_UINT(state, 49));
+  m[2] = 0x80000000U;
+  for (uint i = 3; i < 16; ++i) {
+    m[i] = 0;
+  }
+  m[13] = 0x00000001U;
+  m[15] = HASH_STATE_SIZE * 8;
+  blake_256_compress(hash, m, HASH_STATE_SIZE * 8);
+
+  for (uint i = 0; i < 8; ++i) {
+    hash[i] = BSWAP32(hash[i]);
+  }
+}
+
+// Groestl-256, round table T is built in local memory by groestl_table_init
+// with entries of the generic implementation as (T[2b] << 32 | T[2b + 1]),
+// rotating a column down by n bytes becomes 64 bit rotation by 8n
+
+/** columns used for output column `i` of P and Q rounds, modulo 16 */
+static const constant uint groestl_shift[2][8] = {{0, 2, 4, 6, 9, 11, 13, 15},
+                                                  {2, 6, 10, 14, 1, 5, 9, 13}};
+
+static inline void groestl_table_init(local ulong *T)
+{
+  for (size_t i = get_local_id(0); i < 256; i += get_local_size(0)) {
+    const ulong s1 = aes_sbox[i];
+    const ulong s2 = aes_f2(s1);
+    const ulong s4 = aes_f2(s2);
+    const ulong s3 = s2 ^ s1;
+    const ulong s5 = s4 ^ s1;
+    const ulong s7 = s4 ^ s3;
+    T[i] = s5 | (s4 << 8) | (s3 << 16) | (s2 << 24) | (s2 << 32) |
+           (s7 << 40) | (s5 << 48) | (s3 << 56);
+  }
+}
+
+/** AddRoundConstant, SubBytes, ShiftBytes and MixBytes of round `r` of
+ *  P (q = 0) or Q (q = 1). Words are in little endian byte order */
+static inline void groestl_round(uint *x, uint *y, const local ulong *T,
+                                 const uint q, const uint r)
+{
+  for (uint j = 0; j < 8; ++j) {
+    if (q) {
+      x[2 * j] = ~x[2 * j];
+      x[2 * j + 1] ^= 0xFFFFFFFFU ^ (j << 28) ^ (r << 24);
+    } else {
+      x[2 * j] ^= (j << 4) ^ r;
+    }
+  }
+
+  const constant uint *s = groestl_shift[q];
+  for (uint i = 0; i < 16; i += 2) {
+    ulong c = 0;
+    for (uint k = 0; k < 8; ++k) {
+      const uint w = x[(i + s[k]) & 15];
+      c ^= rotate(T[(w >> (8 * (k & 3))) & 0xFF], (ulong)(8 * k));
+    }
+    y[i] = (uint)(c >> 32);
+    y[i + 1] = (uint)c;
+  }
+}
+
+/** 10 rounds of P or Q permutation */
+static inline void groestl_perm(uint *x, const local ulong *T, const uint q)
+{
+  uint t[16];
+  for (uint r = 0; r < 10; r += 2) {
+    groestl_round(x, t, T, q, r);
+    groestl_round(t, x, T, q, r + 1);
+  }
+}
+
+static inline void groestl_256_compress(uint *h, const uint *m,
+                                        const local ulong *T)
+{
+  uint p[16], q[16];
+  for (uint i = 0; i < 16; ++i) {
+    p[i] = h[i] ^ m[i];
+    q[i] = m[i];
+  }
+  groestl_perm(p, T, 0);
+  groestl_perm(q, T, 1);
+  for (uint i = 0; i < 16; ++i) {
+    h[i] ^= p[i] ^ q[i];
+  }
+}
+
+static inline void groestl_256(global const ulong *state, uint *hash,
+                               const local ulong *T)
+{
+  uint h[16], m[16];
+  for (uint i = 0; i < 16; ++i) {
+    h[i] = 0;
+  }
+  // 64 bit big endian hash length in bits
+  h[15] = 0x00010000U;
+
+  for (uint b = 0; b < 3; ++b) {
+    for (uint i = 0; i < 16; ++i) {
+      m[i] = STATE_UINT(state, b * 16 + i);
+    }
+    groestl_256_compress(h, m, T);
+  }
+
+  // tail, 0x80 and 64 bit big endian block count
+  m[0] = STATE_UINT(state, 48);
+  m[1] = STATE_UINT(state, 49);
+  m[2] = 0x80;
+  for (uint i = 3; i < 16; ++i) {
+    m[i] = 0;
+  }
+  m[15] = 0x04000000U;
+  groestl_256_compress(h, m, T);
+
+  // output transformation, h = P(h) + h
+  for (uint i = 0; i < 16; ++i) {
+    m[i] = h[i];
+  }
+  groestl_perm(m, T, 0);
+  for (uint i = 0; i < 8; ++i) {
+    hash[i] = h[i + 8] ^ m[i + 8];
+  }
+}
+
+// JH-256, bitslice implementation of crypto/jh.c with 128 bit words split
+// into low and high 64 bit halves: x[2 * i] and x[2 * i + 1]
+
+static const constant ulong jh_h0[16] = {
+    0xebd3202c41a398eb, 0xc145b29c7bbecd92,
+    0xfac7d4609151931c, 0x038a507ed6820026,
+    0x45b92677269e23a4, 0x77941ad4481afbe0,
+    0x7a176b0226abb5cd, 0xa82fff0f4224f056,
+    0x754d2e7f8996a371, 0x62e27df70849141d,
+    0x948f2476f7957627, 0x6c29804757b6d587,
+    0x6c0d8eac2d275e5c, 0x0f7a0557c6508451,
+    0xea12247067d3e47b, 0x69d71cd313abe389};
+
+/** E8 round constants: even low, even high, odd low, odd high */
+static const constant ulong jh_rc[42][4] = {
+    {0x67f815dfa2ded572, 0x571523b70a15847b, 0xf6875a4d90d6ab81,
+     0x402bd1c3c54f9f4e},
+    {0x9cfa455ce03a98ea, 0x9a99b26699d2c503, 0x8a53bbf2b4960266,
+     0x31a2db881a1456b5},
+    {0xdb0e199a5c5aa303, 0x1044c1870ab23f40, 0x1d959e848019051c,
+     0xdccde75eadeb336f},
+    {0x416bbf029213ba10, 0xd027bbf7156578dc, 0x5078aa3739812c0a,
+     0xd3910041d2bf1a3f},
+    {0x907eccf60d5a2d42, 0xce97c0929c9f62dd, 0xac442bc70ba75c18,
+     0x23fcc663d665dfd1},
+    {0x1ab8e09e036c6e97, 0xa8ec6c447e450521, 0xfa618e5dbb03f1ee,
+     0x97818394b29796fd},
+    {0x2f3003db37858e4a, 0x956a9ffb2d8d672a, 0x6c69b8f88173fe8a,
+     0x14427fc04672c78a},
+    {0xc45ec7bd8f15f4c5, 0x80bb118fa76f4475, 0xbc88e4aeb775de52,
+     0xf4a3a6981e00b882},
+    {0x1563a3a9338ff48e, 0x89f9b7d524565faa, 0xfde05a7c20edf1b6,
+     0x362c42065ae9ca36},
+    {0x3d98fe4e433529ce, 0xa74b9a7374f93a53, 0x86814e6f591ff5d0,
+     0x9f5ad8af81ad9d0e},
+    {0x6a6234ee670605a7, 0x2717b96ebe280b8b, 0x3f1080c626077447,
+     0x7b487ec66f7ea0e0},
+    {0xc0a4f84aa50a550d, 0x9ef18e979fe7e391, 0xd48d605081727686,
+     0x62b0e5f3415a9e7e},
+    {0x7a205440ec1f9ffc, 0x84c9f4ce001ae4e3, 0xd895fa9df594d74f,
+     0xa554c324117e2e55},
+    {0x286efebd2872df5b, 0xb2c4a50fe27ff578, 0x2ed349eeef7c8905,
+     0x7f5928eb85937e44},
+    {0x4a3124b337695f70, 0x65e4d61df128865e, 0xe720b95104771bc7,
+     0x8a87d423e843fe74},
+    {0xf2947692a3e8297d, 0xc1d9309b097acbdd, 0xe01bdc5bfb301b1d,
+     0xbf829cf24f4924da},
+    {0xffbf70b431bae7a4, 0x48bcf8de0544320d, 0x39d3bb5332fcae3b,
+     0xa08b29e0c1c39f45},
+    {0x0f09aef7fd05c9e5, 0x34f1904212347094, 0x95ed44e301b771a2,
+     0x4a982f4f368e3be9},
+    {0x15f66ca0631d4088, 0xffaf52874b44c147, 0x30c60ae2f14abb7e,
+     0xe68c6eccc5b67046},
+    {0x00ca4fbd56a4d5a4, 0xae183ec84b849dda, 0xadd1643045ce5773,
+     0x67255c1468cea6e8},
+    {0x16e10ecbf28cdaa3, 0x9a99949a5806e933, 0x7b846fc220b2601f,
+     0x1885d1a07facced1},
+    {0xd319dd8da15b5932, 0x46b4a5aac01c9a50, 0xba6b04e467633d9f,
+     0x7eee560bab19caf6},
+    {0x742128a9ea79b11f, 0xee51363b35f7bde9, 0x76d350755aac571d,
+     0x01707da3fec2463a},
+    {0x42d8a498afc135f7, 0x79676b9e20eced78, 0xa8db3aea15638341,
+     0x832c83324d3bc3fa},
+    {0xf347271c1f3b40a7, 0x9a762db734f04059, 0xfd4f21d26c4e3ee7,
+     0xef5957dc398dfdb8},
+    {0xdaeb492b490c9b8d, 0x0d70f36849d7a25b, 0x84558d7ad0ae3b7d,
+     0x658ef8e4f0e9a5f5},
+    {0x533b1036f4a2b8a0, 0x5aec3e759e07a80c, 0x4f88e85692946891,
+     0x4cbcbaf8555cb05b},
+    {0x7b9487f3993bbbe3, 0x5d1c6b72d6f4da75, 0x6db334dc28acae64,
+     0x71db28b850a5346c},
+    {0x2a518d10f2e261f8, 0xfc75dd593364dbe3, 0xa23fce43f1bcac1c,
+     0xb043e8023cd1bb67},
+    {0x75a12988ca5b0a33, 0x5c5316b44d19347f, 0x1e4d790ec3943b92,
+     0x3fafeeb6d7757479},
+    {0x21391abef7d4a8ea, 0x5127234c097ef45c, 0xd23c32ba5324a326,
+     0xadd5a66d4a17a344},
+    {0x08c9f2afa63e1db5, 0x563c6b91983d5983, 0x4d608672a17cf84c,
+     0xf6c76e08cc3ee246},
+    {0x5e76bcb1b333982f, 0x2ae6c4efa566d62b, 0x36d4c1bee8b6f406,
+     0x6321efbc1582ee74},
+    {0x69c953f40d4ec1fd, 0x26585806c45a7da7, 0x16fae0061614c17e,
+     0x3f9d63283daf907e},
+    {0x0cd29b00e3f2c9d2, 0x300cd4b730ceaa5f, 0x9832e0f216512a74,
+     0x9af8cee3d830eb0d},
+    {0x9279f1b57b9ec54b, 0xd36886046ee651ff, 0x316796e6574d239b,
+     0x05750a17f3a6e6cc},
+    {0xce6c3213d98176b1, 0x62a205f88452173c, 0x47154778b3cb2bf4,
+     0x486a9323825446ff},
+    {0x65655e4e0758df38, 0x8e5086fc897cfcf2, 0x86ca0bd0442e7031,
+     0x4e477830a20940f0},
+    {0x8338f7d139eea065, 0xbd3a2ce437e95ef7, 0x6ff8130126b29721,
+     0xe7de9fefd1ed44a3},
+    {0xd992257615dfa08b, 0xbe42dc12f6f7853c, 0x7eb027ab7ceca7d8,
+     0xdea83eaada7d8d53},
+    {0xd86902bd93ce25aa, 0xf908731afd43f65a, 0xa5194a17daef5fc0,
+     0x6a21fd4c33664d97},
+    {0x701541db3198b435, 0x9b54cdedbb0f1eea, 0x72409751a163d09a,
+     0xe26f4791bf9d75f6}};
+
+/** swap bit groups of `n` bits selected by mask `m` with their neighbours */
+#define JH_SWAP(x, m, n) ((((x) & (m)) >> (n)) | (((x) << (n)) & (m)))
+
+/** Sbox S0 and S1 selected by constant bits */
+#define JH_SS(m0, m1, m2, m3, c)                                               \
+  m3 = ~m3;                                                                    \
+  m0 ^= ~m2 & c;                                                               \
+  a = c ^ (m0 & m1);                                                           \
+  m0 ^= m3 & m2;                                                               \
+  m3 ^= ~m1 & m2;                                                              \
+  m1 ^= m0 & m2;                                                               \
+  m2 ^= ~m3 & m0;                                                              \
+  m0 ^= m1 | m3;                                                               \
+  m3 ^= m1 & m2;                                                               \
+  m2 ^= a;                                                                     \
+  m1 ^= a & m0;
+
+/** MDS code */
+#define JH_L(m0, m1, m2, m3, m4, m5, m6, m7)                                   \
+  m4 ^= m1;                                                                    \
+  m5 ^= m2;                                                                    \
+  m6 ^= m3 ^ m0;                                                               \
+  m7 ^= m0;                                                                    \
+  m0 ^= m5;                                                                    \
+  m1 ^= m6;                                                                    \
+  m2 ^= m7 ^ m4;                                                               \
+  m3 ^= m4;
+
+/** compression function F8 of 512 bit block `m` */
+static inline void jh_f8(ulong *x, const ulong *m)
+{
+  for (uint i = 0; i < 8; ++i) {
+    x[i] ^= m[i];
+  }
+
+  for (uint r = 0; r < 42; ++r) {
+    ulong a;
+    for (uint h = 0; h < 2; ++h) {
+      // even words with even constant, odd words with odd constant
+      JH_SS(x[h], x[4 + h], x[8 + h], x[12 + h], jh_rc[r][h]);
+      JH_SS(x[2 + h], x[6 + h], x[10 + h], x[14 + h], jh_rc[r][2 + h]);
+      JH_L(x[h], x[4 + h], x[8 + h], x[12 + h], x[2 + h], x[6 + h], x[10 + h],
+           x[14 + h]);
+    }
+
+    // permutation of the odd words, 7 kinds of rounds
+    for (uint i = 2; i < 16; i += 4) {
+      switch (r % 7) {
+      case 0:
+        x[i] = JH_SWAP(x[i], 0xAAAAAAAAAAAAAAAAUL, 1);
+        x[i + 1] = JH_SWAP(x[i + 1], 0xAAAAAAAAAAAAAAAAUL, 1);
+        break;
+      case 1:
+        x[i] = JH_SWAP(x[i], 0xCCCCCCCCCCCCCCCCUL, 2);
+        x[i + 1] = JH_SWAP(x[i + 1], 0xCCCCCCCCCCCCCCCCUL, 2);
+        break;
+      case 2:
+        x[i] = JH_SWAP(x[i], 0xF0F0F0F0F0F0F0F0UL, 4);
+        x[i + 1] = JH_SWAP(x[i + 1], 0xF0F0F0F0F0F0F0F0UL, 4);
+        break;
+      case 3:
+        x[i] = JH_SWAP(x[i], 0xFF00FF00FF00FF00UL, 8);
+        x[i + 1] = JH_SWAP(x[i + 1], 0xFF00FF00FF00FF00UL, 8);
+        break;
+      case 4:
+        x[i] = JH_SWAP(x[i], 0xFFFF0000FFFF0000UL, 16);
+        x[i + 1] = JH_SWAP(x[i + 1], 0xFFFF0000FFFF0000UL, 16);
+        break;
+      case 5:
+        x[i] = rotate(x[i], 32UL);
+        x[i + 1] = rotate(x[i + 1], 32UL);
+        break;
+      default: {
+        const ulong t = x[i];
+        x[i] = x[i + 1];
+        x[i + 1] = t;
+      }
+      }
+    }
+  }
+
+  for (uint i = 0; i < 8; ++i) {
+    x[i + 8] ^= m[i];
+  }
+}
+
+static inline void jh_256(global const ulong *state, uint *hash)
+{
+  ulong x[16], m[8];
+  for (uint i = 0; i < 16; ++i) {
+    x[i] = jh_h0[i];
+  }
+  for (uint b = 0; b < 3; ++b) {
+    for (uint i = 0; i < 8; ++i) {
+      m[i] = state[b * 8 + i];
+    }
+    jh_f8(x, m);
+  }
+
+  // tail and 0x80, then block with 128 bit big endian bit length
+  m[0] = state[24];
+  m[1] = 0x80;
+  for (uint i = 2; i < 8; ++i) {
+    m[i] = 0;
+  }
+  jh_f8(x, m);
+  m[0] = 0;
+  m[1] = 0;
+  m[7] = 0x4006000000000000UL;
+  jh_f8(x, m);
+
+  for (uint i = 0; i < 4; ++i) {
+    hash[2 * i] = (uint)x[12 + i];
+    hash[2 * i + 1] = (uint)(x[12 + i] >> 32);
+  }
+}
+
+// Skein-512-256
+
+#define SKEIN_KS_PARITY 0x1BD11BDAA9FC1A22UL
+#define SKEIN_T1_FLAG_FIRST (1UL << 62)
+#define SKEIN_T1_FLAG_FINAL (1UL << 63)
+#define SKEIN_T1_BLK_TYPE_MSG (48UL << 56)
+#define SKEIN_T1_BLK_TYPE_OUT (63UL << 56)
+
+static const constant ulong skein_iv[8] = {
+    0xCCD044A12FDB3E13, 0xE83590301A79A9EB, 0x55AEA0614F816E6F,
+    0x2A2767A4AE9B94DB, 0xEC06025E74DD7683, 0xE7A436CDC4746251,
+    0xC36FBAF9393AD185, 0x3EEDBA1833EDFC13};
+
+static const constant uint skein_rot[8][4] = {
+    {46, 36, 19, 37}, {33, 27, 14, 42}, {17, 49, 36, 39}, {44, 9, 54, 56},
+    {39, 30, 34, 24}, {13, 50, 10, 17}, {25, 29, 39, 43}, {8, 35, 56, 22}};
+
+/** word pairs mixed in the 4 rounds between key injections */
+static const constant uint skein_perm[4][8] = {{0, 1, 2, 3, 4, 5, 6, 7},
+                                               {2, 1, 4, 7, 6, 5, 0, 3},
+                                               {4, 1, 6, 3, 0, 5, 2, 7},
+                                               {6, 1, 0, 7, 2, 5, 4, 3}};
+
+/** Threefish-512 of block `m` keyed by `h` and tweak, h = E(m) ^ m */
+static inline void skein_512_block(ulong *h, const ulong *m, const ulong t0,
+                                   const ulong t1)
+{
+  ulong ks[9], x[8];
+  const ulong ts[3] = {t0, t1, t0 ^ t1};
+  ks[8] = SKEIN_KS_PARITY;
+  for (uint i = 0; i < 8; ++i) {
+    ks[i] = h[i];
+    ks[8] ^= h[i];
+    x[i] = m[i] + h[i];
+  }
+  x[5] += t0;
+  x[6] += t1;
+
+  for (uint r = 1; r <= 18; ++r) {
+    for (uint k = 0; k < 4; ++k) {
+      const constant uint *p = skein_perm[k];
+      const constant uint *rot = skein_rot[((r - 1) & 1) * 4 + k];
+      for (uint j = 0; j < 4; ++j) {
+        x[p[2 * j]] += x[p[2 * j + 1]];
+        x[p[2 * j + 1]] =
+            rotate(x[p[2 * j + 1]], (ulong)rot[j]) ^ x[p[2 * j]];
+      }
+    }
+    // key injection
+    for (uint i = 0; i < 8; ++i) {
+      x[i] += ks[(r + i) % 9];
+    }
+    x[5] += ts[r % 3];
+    x[6] += ts[(r + 1) % 3];
+    x[7] += r;
+  }
+
+  for (uint i = 0; i < 8; ++i) {
+    h[i] = x[i] ^ m[i];
+  }
+}
+
+static inline void skein_512_256(global const ulong *state, uint *hash)
+{
+  ulong h[8], m[8];
+  for (uint i = 0; i < 8; ++i) {
+    h[i] = skein_iv[i];
+  }
+  for (uint b = 0; b < 3; ++b) {
+    for (uint i = 0; i < 8; ++i) {
+      m[i] = state[b * 8 + i];
+    }
+    skein_512_block(h, m, (b + 1) * 64,
+                    SKEIN_T1_BLK_TYPE_MSG | (b == 0 ? SKEIN_T1_FLAG_FIRST : 0));
+  }
+
+  // tail, zero padded
+  m[0] = state[24];
+  for (uint i = 1; i < 8; ++i) {
+    m[i] = 0;
+  }
+  skein_512_block(h, m, HASH_STATE_SIZE,
+                  SKEIN_T1_BLK_TYPE_MSG | SKEIN_T1_FLAG_FINAL);
+
+  // output block, counter 0
+  m[0] = 0;
+  skein_512_block(h, m, 8,
+                  SKEIN_T1_BLK_TYPE_OUT | SKEIN_T1_FLAG_FIRST |
+                      SKEIN_T1_FLAG_FINAL);
+
+  for (uint i = 0; i < 4; ++i) {
+    hash[2 * i] = (uint)h[i];
+    hash[2 * i + 1] = (uint)(h[i] >> 32);
+  }
+}
+
+/** Last keccak-f, final hash selected by state[0] & 3 and target check.
+ *  Nonces and hashes below target are appended to `output`:
+ *  count followed by MAX_RESULTS of {nonce, hash[8]} */
+kernel void cn_final(global ulong *states, global uint *output,
+                     const ulong target)
+{
+  const size_t work_id = get_global_id(0) - get_global_offset(0);
+
+  global ulong *state = states + work_id * HASH_STATE_SIZE_ULONG;
+
+  local ulong groestl_T[256];
+  groestl_table_init(groestl_T);
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  keccakf1600(state);
+
+  uint hash[8];
+  switch (state[0] & 3) {
+  case 0:
+    blake_256(state, hash);
+    break;
+  case 1:
+    groestl_256(state, hash, groestl_T);
+    break;
+  case 2:
+    jh_256(state, hash);
+    break;
+  default:
+    skein_512_256(state, hash);
+  }
+
+  // compare last 8 bytes as in monero_solution_hash_val
+  if ((((ulong)hash[7] << 32) | hash[6]) < target) {
+    const uint k = atomic_inc(output);
+    if (k < MAX_RESULTS) {
+      global uint *result = output + 1 + k * 9;
+      result[0] = get_global_id(0);
+      for (uint i = 0; i < 8; ++i) {
+        result[1 + i] = hash[i];
+      }
+    }
+  }
+}
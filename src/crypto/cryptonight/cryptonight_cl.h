@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stddef.h>
+
+/** cryptonight2.cl, embedded at build time, see Makefile */
+extern const char cryptonight_cl_source[];
+
+/** source length without terminating zero */
+extern const size_t cryptonight_cl_source_size;
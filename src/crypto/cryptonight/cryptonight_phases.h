@@ -0,0 +1,19 @@
+/* cryptonight_phases.h -- individual CryptoNight phases
+ *
+ * Exposed for benchmarking, use cryptonight_aesni to compute the hash.
+ * All buffers must be 16 byte aligned.
+ */
+#pragma once
+
+#include <emmintrin.h>
+#include <stdint.h>
+
+/** fill 2MiB scratchpad from 200 byte keccak state */
+void cn_explode_scratchpad(const __m128i *input, __m128i *output);
+
+/** memory-hard loop over 2MiB scratchpad */
+void cn_memory_loop(uint8_t *long_state, const uint8_t *hash_state,
+                    uint64_t monero_tweak_const);
+
+/** fold 2MiB scratchpad back into keccak state */
+void cn_implode_scratchpad(const __m128i *input, __m128i *output);
@@ -0,0 +1,1184 @@
+#include "crypto/cryptonight_spv.h"
+
+#include <stdbool.h>
+
+#include "crypto/aes_spv.h"
+#include "crypto/cryptonight_spv_gen.h"
+
+/* Final step of cryptonight: one of blake-256, groestl-256, jh-256 or
+ * skein-512-256 over keccak state, selected by its first byte, and target
+ * check. Hashes run once per nonce, so rounds are loops rather than unrolled.
+ */
+
+static const uint32_t BLAKE_SPV_IV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372,
+                                         0xA54FF53A, 0x510E527F, 0x9B05688C,
+                                         0x1F83D9AB, 0x5BE0CD19};
+static const uint32_t BLAKE_SPV_CST[16] = {
+    0x243F6A88, 0x85A308D3, 0x13198A2E, 0x03707344, 0xA4093822, 0x299F31D0,
+    0x082EFA98, 0xEC4E6C89, 0x452821E6, 0x38D01377, 0xBE5466CF, 0x34E90C6C,
+    0xC0AC29B7, 0xC97C50DD, 0x3F84D5B5, 0xB5470917};
+static const uint32_t BLAKE_SPV_SIGMA[10][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0}};
+/** v indices (a, b, c, d) of g calls of a round, columns then diagonals */
+static const uint32_t BLAKE_SPV_G[8][4] = {
+    {0, 4, 8, 12}, {1, 5, 9, 13}, {2, 6, 10, 14}, {3, 7, 11, 15},
+    {0, 5, 10, 15}, {1, 6, 11, 12}, {2, 7, 8, 13}, {3, 4, 9, 14}};
+/** padding of 200 byte message, {word index, value} */
+static const uint64_t BLAKE_SPV_PAD[][2] = {
+    {50, 0x80000000}, {61, 1}, {63, 1600}};
+
+static const uint32_t GROESTL_SPV_IV[16] = {[15] = 0x00010000};
+/** ShiftBytes: byte j % 4 of column bytes j comes from word
+ *  (i + shift[j]) % 16 */
+static const uint32_t GROESTL_SPV_SHIFT_P[8] = {0, 2, 4, 6, 9, 11, 13, 15};
+static const uint32_t GROESTL_SPV_SHIFT_Q[8] = {2, 6, 10, 14, 1, 5, 9, 13};
+static const uint64_t GROESTL_SPV_PAD[][2] = {{50, 0x80}, {63, 0x04000000}};
+
+static const uint64_t SKEIN_SPV_IV[8] = {
+    0xccd044a12fdb3e13, 0xe83590301a79a9eb, 0x55aea0614f816e6f,
+    0x2a2767a4ae9b94db, 0xec06025e74dd7683, 0xe7a436cdc4746251,
+    0xc36fbaf9393ad185, 0x3eedba1833edfc13};
+#define SKEIN_SPV_KS_PARITY 0x1bd11bdaa9fc1a22
+/** tweak of message blocks and output block */
+static const uint64_t SKEIN_SPV_T0[5] = {64, 128, 192, 200, 8};
+static const uint64_t SKEIN_SPV_T1[5] = {
+    0x7000000000000000, 0x3000000000000000, 0x3000000000000000,
+    0xb000000000000000, 0xff00000000000000};
+/** rotations of 8 rounds, 4 mixes each */
+static const uint32_t SKEIN_SPV_ROT[32] = {
+    46, 36, 19, 37, 33, 27, 14, 42, 17, 49, 36, 39, 44, 9,  54, 56,
+    39, 30, 34, 24, 13, 50, 10, 17, 25, 29, 39, 43, 8,  35, 56, 22};
+static const uint32_t SKEIN_SPV_PERM[8] = {2, 1, 4, 7, 6, 5, 0, 3};
+
+/** initial state and round constants, {lo, hi} of each ulong2 */
+static const uint64_t JH_SPV_IV[8][2] = {
+    {0xebd3202c41a398eb, 0xc145b29c7bbecd92},
+    {0xfac7d4609151931c, 0x038a507ed6820026},
+    {0x45b92677269e23a4, 0x77941ad4481afbe0},
+    {0x7a176b0226abb5cd, 0xa82fff0f4224f056},
+    {0x754d2e7f8996a371, 0x62e27df70849141d},
+    {0x948f2476f7957627, 0x6c29804757b6d587},
+    {0x6c0d8eac2d275e5c, 0x0f7a0557c6508451},
+    {0xea12247067d3e47b, 0x69d71cd313abe389}};
+static const uint64_t JH_SPV_RC[84][2] = {
+    {0x67f815dfa2ded572, 0x571523b70a15847b},
+    {0xf6875a4d90d6ab81, 0x402bd1c3c54f9f4e},
+    {0x9cfa455ce03a98ea, 0x9a99b26699d2c503},
+    {0x8a53bbf2b4960266, 0x31a2db881a1456b5},
+    {0xdb0e199a5c5aa303, 0x1044c1870ab23f40},
+    {0x1d959e848019051c, 0xdccde75eadeb336f},
+    {0x416bbf029213ba10, 0xd027bbf7156578dc},
+    {0x5078aa3739812c0a, 0xd3910041d2bf1a3f},
+    {0x907eccf60d5a2d42, 0xce97c0929c9f62dd},
+    {0xac442bc70ba75c18, 0x23fcc663d665dfd1},
+    {0x1ab8e09e036c6e97, 0xa8ec6c447e450521},
+    {0xfa618e5dbb03f1ee, 0x97818394b29796fd},
+    {0x2f3003db37858e4a, 0x956a9ffb2d8d672a},
+    {0x6c69b8f88173fe8a, 0x14427fc04672c78a},
+    {0xc45ec7bd8f15f4c5, 0x80bb118fa76f4475},
+    {0xbc88e4aeb775de52, 0xf4a3a6981e00b882},
+    {0x1563a3a9338ff48e, 0x89f9b7d524565faa},
+    {0xfde05a7c20edf1b6, 0x362c42065ae9ca36},
+    {0x3d98fe4e433529ce, 0xa74b9a7374f93a53},
+    {0x86814e6f591ff5d0, 0x9f5ad8af81ad9d0e},
+    {0x6a6234ee670605a7, 0x2717b96ebe280b8b},
+    {0x3f1080c626077447, 0x7b487ec66f7ea0e0},
+    {0xc0a4f84aa50a550d, 0x9ef18e979fe7e391},
+    {0xd48d605081727686, 0x62b0e5f3415a9e7e},
+    {0x7a205440ec1f9ffc, 0x84c9f4ce001ae4e3},
+    {0xd895fa9df594d74f, 0xa554c324117e2e55},
+    {0x286efebd2872df5b, 0xb2c4a50fe27ff578},
+    {0x2ed349eeef7c8905, 0x7f5928eb85937e44},
+    {0x4a3124b337695f70, 0x65e4d61df128865e},
+    {0xe720b95104771bc7, 0x8a87d423e843fe74},
+    {0xf2947692a3e8297d, 0xc1d9309b097acbdd},
+    {0xe01bdc5bfb301b1d, 0xbf829cf24f4924da},
+    {0xffbf70b431bae7a4, 0x48bcf8de0544320d},
+    {0x39d3bb5332fcae3b, 0xa08b29e0c1c39f45},
+    {0x0f09aef7fd05c9e5, 0x34f1904212347094},
+    {0x95ed44e301b771a2, 0x4a982f4f368e3be9},
+    {0x15f66ca0631d4088, 0xffaf52874b44c147},
+    {0x30c60ae2f14abb7e, 0xe68c6eccc5b67046},
+    {0x00ca4fbd56a4d5a4, 0xae183ec84b849dda},
+    {0xadd1643045ce5773, 0x67255c1468cea6e8},
+    {0x16e10ecbf28cdaa3, 0x9a99949a5806e933},
+    {0x7b846fc220b2601f, 0x1885d1a07facced1},
+    {0xd319dd8da15b5932, 0x46b4a5aac01c9a50},
+    {0xba6b04e467633d9f, 0x7eee560bab19caf6},
+    {0x742128a9ea79b11f, 0xee51363b35f7bde9},
+    {0x76d350755aac571d, 0x01707da3fec2463a},
+    {0x42d8a498afc135f7, 0x79676b9e20eced78},
+    {0xa8db3aea15638341, 0x832c83324d3bc3fa},
+    {0xf347271c1f3b40a7, 0x9a762db734f04059},
+    {0xfd4f21d26c4e3ee7, 0xef5957dc398dfdb8},
+    {0xdaeb492b490c9b8d, 0x0d70f36849d7a25b},
+    {0x84558d7ad0ae3b7d, 0x658ef8e4f0e9a5f5},
+    {0x533b1036f4a2b8a0, 0x5aec3e759e07a80c},
+    {0x4f88e85692946891, 0x4cbcbaf8555cb05b},
+    {0x7b9487f3993bbbe3, 0x5d1c6b72d6f4da75},
+    {0x6db334dc28acae64, 0x71db28b850a5346c},
+    {0x2a518d10f2e261f8, 0xfc75dd593364dbe3},
+    {0xa23fce43f1bcac1c, 0xb043e8023cd1bb67},
+    {0x75a12988ca5b0a33, 0x5c5316b44d19347f},
+    {0x1e4d790ec3943b92, 0x3fafeeb6d7757479},
+    {0x21391abef7d4a8ea, 0x5127234c097ef45c},
+    {0xd23c32ba5324a326, 0xadd5a66d4a17a344},
+    {0x08c9f2afa63e1db5, 0x563c6b91983d5983},
+    {0x4d608672a17cf84c, 0xf6c76e08cc3ee246},
+    {0x5e76bcb1b333982f, 0x2ae6c4efa566d62b},
+    {0x36d4c1bee8b6f406, 0x6321efbc1582ee74},
+    {0x69c953f40d4ec1fd, 0x26585806c45a7da7},
+    {0x16fae0061614c17e, 0x3f9d63283daf907e},
+    {0x0cd29b00e3f2c9d2, 0x300cd4b730ceaa5f},
+    {0x9832e0f216512a74, 0x9af8cee3d830eb0d},
+    {0x9279f1b57b9ec54b, 0xd36886046ee651ff},
+    {0x316796e6574d239b, 0x05750a17f3a6e6cc},
+    {0xce6c3213d98176b1, 0x62a205f88452173c},
+    {0x47154778b3cb2bf4, 0x486a9323825446ff},
+    {0x65655e4e0758df38, 0x8e5086fc897cfcf2},
+    {0x86ca0bd0442e7031, 0x4e477830a20940f0},
+    {0x8338f7d139eea065, 0xbd3a2ce437e95ef7},
+    {0x6ff8130126b29721, 0xe7de9fefd1ed44a3},
+    {0xd992257615dfa08b, 0xbe42dc12f6f7853c},
+    {0x7eb027ab7ceca7d8, 0xdea83eaada7d8d53},
+    {0xd86902bd93ce25aa, 0xf908731afd43f65a},
+    {0xa5194a17daef5fc0, 0x6a21fd4c33664d97},
+    {0x701541db3198b435, 0x9b54cdedbb0f1eea},
+    {0x72409751a163d09a, 0xe26f4791bf9d75f6}};
+/** swap of bits, pairs, nibbles, ..., words in round r % 7 as
+ *  (x & hi) >> shift | (x & lo) << shift | x.yx & words, {hi, lo, words,
+ *  shift} */
+static const uint64_t JH_SPV_SWAP[7][4] = {
+    {0xaaaaaaaaaaaaaaaa, 0x5555555555555555, 0, 1},
+    {0xcccccccccccccccc, 0x3333333333333333, 0, 2},
+    {0xf0f0f0f0f0f0f0f0, 0x0f0f0f0f0f0f0f0f, 0, 4},
+    {0xff00ff00ff00ff00, 0x00ff00ff00ff00ff, 0, 8},
+    {0xffff0000ffff0000, 0x0000ffff0000ffff, 0, 16},
+    {0xffffffff00000000, 0x00000000ffffffff, 0, 32},
+    {0, 0, ~0ULL, 0}};
+static const uint64_t JH_SPV_PAD[][2] = {{25, 0x80}, {39, 0x4006000000000000}};
+
+/** Functions and variables shared by the hashes */
+struct final_spv {
+  /** state buffer, uint[50] per invocation */
+  uint32_t state;
+  /** uint state_uint(uint gid, uint idx), 0 past the end of the state */
+  uint32_t state_uint;
+  /** ulong state_ulong(uint gid, uint idx) */
+  uint32_t state_ulong;
+  /** Workgroup uint[512] groestl T table, high and low word of each byte */
+  uint32_t groestl_t;
+  struct cryptonight_spv_keccak keccak;
+};
+
+/** Pointer to element `index` of Function array of `type` */
+static uint32_t final_spv_at(struct spirv_builder *b, uint32_t type,
+                             uint32_t array, uint32_t index)
+{
+  return spirv_val(b, OP_ACCESS_CHAIN,
+                   spirv_type_pointer(b, SC_FUNCTION, type), array, index);
+}
+
+/** array[k] for literal `k` */
+static uint32_t final_spv_get(struct spirv_builder *b, uint32_t type,
+                              uint32_t array, uint32_t k)
+{
+  return spirv_load(b, type,
+                    final_spv_at(b, type, array, spirv_const_uint(b, k)));
+}
+
+/** array[k] = value for literal `k` */
+static void final_spv_set(struct spirv_builder *b, uint32_t type,
+                          uint32_t array, uint32_t k, uint32_t value)
+{
+  spirv_store(b, final_spv_at(b, type, array, spirv_const_uint(b, k)),
+              value);
+}
+
+/** Function variable type[len] initialised with constant ids `values` */
+static uint32_t final_spv_table(struct spirv_builder *b, uint32_t type,
+                                const uint32_t *values, uint32_t len)
+{
+  uint32_t array_t = spirv_type_array(b, type, len);
+  return spirv_variable(b, spirv_type_pointer(b, SC_FUNCTION, array_t),
+                        SC_FUNCTION,
+                        spirv_const_composite(b, array_t, values, len));
+}
+
+static uint32_t final_spv_uint_table(struct spirv_builder *b,
+                                     const uint32_t *values, uint32_t len)
+{
+  uint32_t ids[160];
+  for (uint32_t i = 0; i < len; ++i) {
+    ids[i] = spirv_const_uint(b, values[i]);
+  }
+  return final_spv_table(b, spirv_type_int(b, 32), ids, len);
+}
+
+static uint32_t final_spv_ulong_table(struct spirv_builder *b,
+                                      const uint64_t *values, uint32_t len)
+{
+  uint32_t ids[8];
+  for (uint32_t i = 0; i < len; ++i) {
+    ids[i] = spirv_const_ulong(b, values[i]);
+  }
+  return final_spv_table(b, spirv_type_int(b, 64), ids, len);
+}
+
+/** ulong2 table of {lo, hi} pairs, `hi` NULL splats `lo` */
+static uint32_t final_spv_ulong2_table(struct spirv_builder *b,
+                                       const uint64_t *lo, const uint64_t *hi,
+                                       uint32_t stride, uint32_t len)
+{
+  uint32_t ulong2_t = spirv_type_vector(b, spirv_type_int(b, 64), 2);
+  uint32_t ids[84];
+  for (uint32_t i = 0; i < len; ++i) {
+    uint32_t x = spirv_const_ulong(b, lo[i * stride]);
+    uint32_t y = hi == NULL ? x : spirv_const_ulong(b, hi[i * stride]);
+    ids[i] = spirv_const_composite(b, ulong2_t, SPIRV_ARGS(x, y));
+  }
+  return final_spv_table(b, ulong2_t, ids, len);
+}
+
+/** Padding of message word `idx` of `width` bits, 0 outside of `pad` */
+static uint32_t final_spv_pad(struct spirv_builder *b, uint32_t width,
+                              uint32_t idx, const uint64_t (*pad)[2],
+                              size_t len)
+{
+  uint32_t type = spirv_type_int(b, width);
+  uint32_t r = width == 32 ? spirv_const_uint(b, 0) : spirv_const_ulong(b, 0);
+  for (size_t k = 0; k < len; ++k) {
+    uint32_t eq = spirv_val(b, OP_IEQUAL, spirv_type_bool(b), idx,
+                            spirv_const_uint(b, (uint32_t)pad[k][0]));
+    uint32_t value = width == 32 ? spirv_const_uint(b, (uint32_t)pad[k][1])
+                                 : spirv_const_ulong(b, pad[k][1]);
+    r = spirv_val(b, OP_SELECT, type, eq, value, r);
+  }
+  return r;
+}
+
+/** (ulong)hi << 32 | lo */
+static uint32_t final_spv_ulong(struct spirv_builder *b, uint32_t lo,
+                                uint32_t hi)
+{
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  uint32_t h = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, ulong_t,
+                         spirv_val(b, OP_UCONVERT, ulong_t, hi),
+                         spirv_const_uint(b, 32));
+  return spirv_val(b, OP_BITWISE_OR, ulong_t, h,
+                   spirv_val(b, OP_UCONVERT, ulong_t, lo));
+}
+
+/** Low (`hi` false) or high word of ulong */
+static uint32_t final_spv_word(struct spirv_builder *b, uint32_t x, bool hi)
+{
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  if (hi) {
+    x = spirv_val(b, OP_SHIFT_RIGHT_LOGICAL, ulong_t, x,
+                  spirv_const_uint(b, 32));
+  }
+  return spirv_val(b, OP_UCONVERT, spirv_type_int(b, 32), x);
+}
+
+/** rotr(x, n) of uint, literal 0 < n < 32 */
+static uint32_t final_spv_rotr(struct spirv_builder *b, uint32_t x,
+                               uint32_t n)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t sr = spirv_val(b, OP_SHIFT_RIGHT_LOGICAL, uint_t, x,
+                          spirv_const_uint(b, n));
+  uint32_t sl = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, x,
+                          spirv_const_uint(b, 32 - n));
+  return spirv_val(b, OP_BITWISE_OR, uint_t, sr, sl);
+}
+
+/** Byte swap: rotr(x, 8) & 0xff00ff00 | rotr(x, 24) & 0x00ff00ff */
+static uint32_t final_spv_bswap(struct spirv_builder *b, uint32_t x)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t b13 = spirv_val(b, OP_BITWISE_AND, uint_t, final_spv_rotr(b, x, 8),
+                           spirv_const_uint(b, 0xff00ff00));
+  uint32_t b02 = spirv_val(b, OP_BITWISE_AND, uint_t,
+                           final_spv_rotr(b, x, 24),
+                           spirv_const_uint(b, 0x00ff00ff));
+  return spirv_val(b, OP_BITWISE_OR, uint_t, b13, b02);
+}
+
+static uint32_t final_spv_state_uint_fn(struct spirv_builder *b,
+                                        uint32_t state)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t params[2];
+  uint32_t fn = spirv_function(b, uint_t, FNC_INLINE,
+                               SPIRV_ARGS(uint_t, uint_t), params);
+  // idx < 50 ? state[gid][idx] : 0, index is clamped for the load
+  uint32_t inside = spirv_val(b, OP_ULESS_THAN, spirv_type_bool(b), params[1],
+                              spirv_const_uint(b, 50));
+  uint32_t idx = spirv_val(b, OP_SELECT, uint_t, inside, params[1], c0);
+  uint32_t w = spirv_load(
+      b, uint_t,
+      spirv_val(b, OP_ACCESS_CHAIN, spirv_type_pointer(b, SC_BUFFER, uint_t),
+                state, c0, params[0], idx));
+  spirv_return_value(b, spirv_val(b, OP_SELECT, uint_t, inside, w, c0));
+  spirv_function_end(b);
+  return fn;
+}
+
+static uint32_t final_spv_state_ulong_fn(struct spirv_builder *b,
+                                         uint32_t state_uint)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  uint32_t params[2];
+  uint32_t fn = spirv_function(b, ulong_t, FNC_INLINE,
+                               SPIRV_ARGS(uint_t, uint_t), params);
+  // state_uint(2 * idx + 1) << 32 | state_uint(2 * idx)
+  uint32_t idx = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, params[1],
+                           spirv_const_uint(b, 1));
+  uint32_t lo =
+      spirv_val(b, OP_FUNCTION_CALL, uint_t, state_uint, params[0], idx);
+  uint32_t hi = spirv_val(
+      b, OP_FUNCTION_CALL, uint_t, state_uint, params[0],
+      spirv_val(b, OP_BITWISE_OR, uint_t, idx, spirv_const_uint(b, 1)));
+  spirv_return_value(b, final_spv_ulong(b, lo, hi));
+  spirv_function_end(b);
+  return fn;
+}
+
+/** Begin void hash(uint gid, uint out[8]) */
+static uint32_t final_spv_hash_fn(struct spirv_builder *b, uint32_t *params)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  return spirv_function(
+      b, spirv_type_void(b), FNC_NONE,
+      SPIRV_ARGS(uint_t, spirv_type_pointer(
+                             b, SC_FUNCTION, spirv_type_array(b, uint_t, 8))),
+      params);
+}
+
+/** blake-256 g on v[idx], message and constant words are picked by
+ *  sigma[row + e] and sigma[row + e + 1] */
+static void final_spv_blake_g(struct spirv_builder *b, uint32_t sigma,
+                              uint32_t cst, uint32_t m, uint32_t v,
+                              uint32_t row, uint32_t e, const uint32_t idx[4])
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t s[2];
+  for (uint32_t k = 0; k < 2; ++k) {
+    uint32_t pos = e + k == 0 ? row
+                              : spirv_val(b, OP_IADD, uint_t, row,
+                                          spirv_const_uint(b, e + k));
+    s[k] = spirv_load(b, uint_t, final_spv_at(b, uint_t, sigma, pos));
+  }
+  // x0 = m[s0] ^ cst[s1], x1 = m[s1] ^ cst[s0]
+  uint32_t x[2];
+  for (uint32_t k = 0; k < 2; ++k) {
+    x[k] = spirv_val(
+        b, OP_BITWISE_XOR, uint_t,
+        spirv_load(b, uint_t, final_spv_at(b, uint_t, m, s[k])),
+        spirv_load(b, uint_t, final_spv_at(b, uint_t, cst, s[1 - k])));
+  }
+  uint32_t va = final_spv_get(b, uint_t, v, idx[0]);
+  uint32_t vb = final_spv_get(b, uint_t, v, idx[1]);
+  uint32_t vc = final_spv_get(b, uint_t, v, idx[2]);
+  uint32_t vd = final_spv_get(b, uint_t, v, idx[3]);
+  // a += x + b, d = rotr(d ^ a, 16 or 8), c += d, b = rotr(b ^ c, 12 or 7)
+  static const uint32_t ROT[2][2] = {{16, 12}, {8, 7}};
+  for (uint32_t k = 0; k < 2; ++k) {
+    va = spirv_val(b, OP_IADD, uint_t,
+                   spirv_val(b, OP_IADD, uint_t, va, x[k]), vb);
+    vd = final_spv_rotr(b, spirv_val(b, OP_BITWISE_XOR, uint_t, vd, va),
+                        ROT[k][0]);
+    vc = spirv_val(b, OP_IADD, uint_t, vc, vd);
+    vb = final_spv_rotr(b, spirv_val(b, OP_BITWISE_XOR, uint_t, vb, vc),
+                        ROT[k][1]);
+  }
+  final_spv_set(b, uint_t, v, idx[0], va);
+  final_spv_set(b, uint_t, v, idx[1], vb);
+  final_spv_set(b, uint_t, v, idx[2], vc);
+  final_spv_set(b, uint_t, v, idx[3], vd);
+}
+
+static uint32_t final_spv_blake_fn(struct spirv_builder *b,
+                                   const struct final_spv *f)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t bool_t = spirv_type_bool(b);
+  uint32_t ptr_block_t = spirv_type_pointer(b, SC_FUNCTION,
+                                            spirv_type_array(b, uint_t, 16));
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  uint32_t params[2];
+  uint32_t fn = final_spv_hash_fn(b, params);
+  uint32_t sigma = final_spv_uint_table(b, &BLAKE_SPV_SIGMA[0][0], 160);
+  uint32_t cst = final_spv_uint_table(b, BLAKE_SPV_CST, 16);
+  uint32_t h = final_spv_uint_table(b, BLAKE_SPV_IV, 8);
+  uint32_t m = spirv_variable(b, ptr_block_t, SC_FUNCTION, 0);
+  uint32_t v = spirv_variable(b, ptr_block_t, SC_FUNCTION, 0);
+
+  // for (blk = 0; blk < 4; ++blk), 3 blocks and the padded tail
+  struct spirv_loop blocks;
+  uint32_t blk =
+      spirv_loop_for(b, &blocks, c0, spirv_const_uint(b, 4), LC_NONE);
+  // m[i] = bswap(state[16 * blk + i]) | pad
+  uint32_t base =
+      spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, blk, spirv_const_uint(b, 4));
+  struct spirv_loop words;
+  uint32_t i =
+      spirv_loop_for(b, &words, c0, spirv_const_uint(b, 16), LC_NONE);
+  uint32_t idx = spirv_val(b, OP_IADD, uint_t, base, i);
+  uint32_t w = final_spv_bswap(
+      b, spirv_val(b, OP_FUNCTION_CALL, uint_t, f->state_uint, params[0], idx));
+  spirv_store(b, final_spv_at(b, uint_t, m, i),
+              spirv_val(b, OP_BITWISE_OR, uint_t, w,
+                        final_spv_pad(b, 32, idx, BLAKE_SPV_PAD, 3)));
+  spirv_loop_end(b, &words, c1);
+
+  // t = blk < 3 ? 512 * (blk + 1) : 1600
+  uint32_t full = spirv_val(b, OP_ULESS_THAN, bool_t, blk,
+                            spirv_const_uint(b, 3));
+  uint32_t t = spirv_val(
+      b, OP_SELECT, uint_t, full,
+      spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t,
+                spirv_val(b, OP_IADD, uint_t, blk, c1),
+                spirv_const_uint(b, 9)),
+      spirv_const_uint(b, 1600));
+  // v = {h, cst[0..7]}, v[12] ^= t, v[13] ^= t
+  for (uint32_t k = 0; k < 16; ++k) {
+    uint32_t x = k < 8 ? final_spv_get(b, uint_t, h, k)
+                       : spirv_const_uint(b, BLAKE_SPV_CST[k - 8]);
+    if (k == 12 || k == 13) {
+      x = spirv_val(b, OP_BITWISE_XOR, uint_t, x, t);
+    }
+    final_spv_set(b, uint_t, v, k, x);
+  }
+  // for (r = 0; r < 14; ++r), sigma row r % 10
+  struct spirv_loop rounds;
+  uint32_t r =
+      spirv_loop_for(b, &rounds, c0, spirv_const_uint(b, 14), LC_NONE);
+  uint32_t row = spirv_val(
+      b, OP_SHIFT_LEFT_LOGICAL, uint_t,
+      spirv_val(b, OP_UMOD, uint_t, r, spirv_const_uint(b, 10)),
+      spirv_const_uint(b, 4));
+  for (uint32_t g = 0; g < 8; ++g) {
+    final_spv_blake_g(b, sigma, cst, m, v, row, 2 * g, BLAKE_SPV_G[g]);
+  }
+  spirv_loop_end(b, &rounds, c1);
+  // h[k] ^= v[k] ^ v[k + 8]
+  for (uint32_t k = 0; k < 8; ++k) {
+    uint32_t x = spirv_val(b, OP_BITWISE_XOR, uint_t,
+                           final_spv_get(b, uint_t, v, k),
+                           final_spv_get(b, uint_t, v, k + 8));
+    final_spv_set(b, uint_t, h, k,
+                  spirv_val(b, OP_BITWISE_XOR, uint_t,
+                            final_spv_get(b, uint_t, h, k), x));
+  }
+  spirv_loop_end(b, &blocks, c1);
+
+  // out[k] = bswap(h[k])
+  for (uint32_t k = 0; k < 8; ++k) {
+    final_spv_set(b, uint_t, params[1], k,
+                  final_spv_bswap(b, final_spv_get(b, uint_t, h, k)));
+  }
+  spirv_return(b);
+  spirv_function_end(b);
+  return fn;
+}
+
+/** Fill groestl T table by all invocations of the workgroup and wait for
+ *  them, T[2 * x] and T[2 * x + 1] are the MixBytes column of sbox[x] */
+static void final_spv_groestl_table(struct spirv_builder *b,
+                                    const struct final_spv *f,
+                                    uint32_t workgroup_size)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ptr_t = spirv_type_pointer(b, SC_WORKGROUP, uint_t);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  uint32_t lid = cryptonight_spv_invocation(b, BUILTIN_LOCAL_INVOCATION_ID, 0);
+
+  // for (x = lid; x < 256; x += WG_SIZE)
+  struct spirv_loop loop;
+  uint32_t x =
+      spirv_loop_for(b, &loop, lid, spirv_const_uint(b, 256), LC_NONE);
+  // s_k = k * sbox[x] in GF(2^8)
+  uint32_t s[8];
+  s[1] = aes_spv_sbox(b, x);
+  s[2] = aes_spv_xtime(b, s[1]);
+  s[3] = spirv_val(b, OP_BITWISE_XOR, uint_t, s[2], s[1]);
+  s[4] = aes_spv_xtime(b, s[2]);
+  s[5] = spirv_val(b, OP_BITWISE_XOR, uint_t, s[4], s[1]);
+  s[7] = spirv_val(b, OP_BITWISE_XOR, uint_t, s[4], s[3]);
+  // T[2x] = uint(s2, s7, s5, s3), T[2x + 1] = uint(s5, s4, s3, s2)
+  static const uint32_t BYTES[2][4] = {{2, 7, 5, 3}, {5, 4, 3, 2}};
+  uint32_t x2 = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, x, c1);
+  for (uint32_t k = 0; k < 2; ++k) {
+    uint32_t w = s[BYTES[k][0]];
+    for (uint32_t j = 1; j < 4; ++j) {
+      w = spirv_val(b, OP_BITFIELD_INSERT, uint_t, w, s[BYTES[k][j]],
+                    spirv_const_uint(b, 8 * j), spirv_const_uint(b, 8));
+    }
+    uint32_t idx = k == 0 ? x2 : spirv_val(b, OP_BITWISE_OR, uint_t, x2, c1);
+    spirv_store(b, spirv_val(b, OP_ACCESS_CHAIN, ptr_t, f->groestl_t, idx),
+                w);
+  }
+  spirv_loop_end(b, &loop,
+                 spirv_val(b, OP_COMPOSITE_EXTRACT, uint_t, workgroup_size, 0));
+
+  spirv_op(b, OP_CONTROL_BARRIER, spirv_const_uint(b, SCOPE_WORKGROUP),
+           spirv_const_uint(b, SCOPE_WORKGROUP),
+           spirv_const_uint(b, MEMORY_SEMANTICS_ACQUIRE_RELEASE |
+                                   MEMORY_SEMANTICS_WORGROUP_MEMORY));
+}
+
+/** ShiftBytes, SubBytes and MixBytes of column at words i and i + 1 of
+ *  `x`, high word of the result goes to word i */
+static uint32_t final_spv_groestl_column(struct spirv_builder *b,
+                                         const struct final_spv *f,
+                                         uint32_t x, uint32_t i, bool q)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  uint32_t ptr_t = spirv_type_pointer(b, SC_WORKGROUP, uint_t);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  const uint32_t *shift = q ? GROESTL_SPV_SHIFT_Q : GROESTL_SPV_SHIFT_P;
+  uint32_t col = 0;
+  for (uint32_t j = 0; j < 8; ++j) {
+    // t = T[byte j % 4 of x[(i + shift[j]) % 16]]
+    uint32_t idx = spirv_val(
+        b, OP_BITWISE_AND, uint_t,
+        spirv_val(b, OP_IADD, uint_t, i, spirv_const_uint(b, shift[j])),
+        spirv_const_uint(b, 15));
+    uint32_t byte = spirv_val(
+        b, OP_BITFIELD_UEXTRACT, uint_t,
+        spirv_load(b, uint_t, final_spv_at(b, uint_t, x, idx)),
+        spirv_const_uint(b, 8 * (j % 4)), spirv_const_uint(b, 8));
+    uint32_t t_hi = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, byte, c1);
+    uint32_t t_lo = spirv_val(b, OP_BITWISE_OR, uint_t, t_hi, c1);
+    uint32_t t = final_spv_ulong(
+        b,
+        spirv_load(b, uint_t,
+                   spirv_val(b, OP_ACCESS_CHAIN, ptr_t, f->groestl_t, t_lo)),
+        spirv_load(b, uint_t,
+                   spirv_val(b, OP_ACCESS_CHAIN, ptr_t, f->groestl_t, t_hi)));
+    // col ^= rotl64(t, 8 * j)
+    if (j == 0) {
+      col = t;
+      continue;
+    }
+    t = spirv_val(b, OP_FUNCTION_CALL, ulong_t, f->keccak.rotl64, t,
+                  spirv_const_uint(b, 8 * j));
+    col = spirv_val(b, OP_BITWISE_XOR, ulong_t, col, t);
+  }
+  return col;
+}
+
+/** void groestl_p(uint x[16]) or groestl_q with `q` */
+static uint32_t final_spv_groestl_perm_fn(struct spirv_builder *b,
+                                          const struct final_spv *f, bool q)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ptr_x_t = spirv_type_pointer(b, SC_FUNCTION,
+                                        spirv_type_array(b, uint_t, 16));
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  uint32_t params[1];
+  uint32_t fn = spirv_function(b, spirv_type_void(b), FNC_NONE,
+                               SPIRV_ARGS(ptr_x_t), params);
+  uint32_t x = params[0];
+  uint32_t y = spirv_variable(b, ptr_x_t, SC_FUNCTION, 0);
+
+  // for (r = 0; r < 10; ++r)
+  struct spirv_loop rounds;
+  uint32_t r =
+      spirv_loop_for(b, &rounds, c0, spirv_const_uint(b, 10), LC_NONE);
+  // AddRoundConstant, P: x[2k] ^= k << 4 ^ r
+  // Q: x[2k] ^= ~0, x[2k + 1] ^= ~(k << 28 ^ r << 24)
+  uint32_t r24 = q ? spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, r,
+                               spirv_const_uint(b, 24))
+                   : 0;
+  for (uint32_t k = 0; k < 8; ++k) {
+    uint32_t x0 = final_spv_get(b, uint_t, x, 2 * k);
+    if (!q) {
+      uint32_t rc = spirv_val(b, OP_BITWISE_XOR, uint_t,
+                              spirv_const_uint(b, k << 4), r);
+      final_spv_set(b, uint_t, x, 2 * k,
+                    spirv_val(b, OP_BITWISE_XOR, uint_t, x0, rc));
+      continue;
+    }
+    final_spv_set(b, uint_t, x, 2 * k, spirv_val(b, OP_NOT, uint_t, x0));
+    uint32_t rc = spirv_val(b, OP_BITWISE_XOR, uint_t,
+                            spirv_const_uint(b, ~(k << 28)), r24);
+    uint32_t x1 = final_spv_get(b, uint_t, x, 2 * k + 1);
+    final_spv_set(b, uint_t, x, 2 * k + 1,
+                  spirv_val(b, OP_BITWISE_XOR, uint_t, x1, rc));
+  }
+  // for (i = 0; i < 16; i += 2) y[i], y[i + 1] = column(x, i)
+  struct spirv_loop columns;
+  uint32_t i =
+      spirv_loop_for(b, &columns, c0, spirv_const_uint(b, 16), LC_NONE);
+  uint32_t col = final_spv_groestl_column(b, f, x, i, q);
+  spirv_store(b, final_spv_at(b, uint_t, y, i), final_spv_word(b, col, true));
+  spirv_store(b,
+              final_spv_at(b, uint_t, y,
+                           spirv_val(b, OP_BITWISE_OR, uint_t, i, c1)),
+              final_spv_word(b, col, false));
+  spirv_loop_end(b, &columns, spirv_const_uint(b, 2));
+  spirv_op(b, OP_COPY_MEMORY, x, y);
+  spirv_loop_end(b, &rounds, c1);
+
+  spirv_return(b);
+  spirv_function_end(b);
+  return fn;
+}
+
+static uint32_t final_spv_groestl_fn(struct spirv_builder *b,
+                                     const struct final_spv *f,
+                                     uint32_t perm_p, uint32_t perm_q)
+{
+  uint32_t void_t = spirv_type_void(b);
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ptr_x_t = spirv_type_pointer(b, SC_FUNCTION,
+                                        spirv_type_array(b, uint_t, 16));
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  uint32_t params[2];
+  uint32_t fn = final_spv_hash_fn(b, params);
+  uint32_t h = final_spv_uint_table(b, GROESTL_SPV_IV, 16);
+  uint32_t m = spirv_variable(b, ptr_x_t, SC_FUNCTION, 0);
+  uint32_t p = spirv_variable(b, ptr_x_t, SC_FUNCTION, 0);
+
+  // for (blk = 0; blk < 4; ++blk), 3 blocks and the padded tail
+  struct spirv_loop blocks;
+  uint32_t blk =
+      spirv_loop_for(b, &blocks, c0, spirv_const_uint(b, 4), LC_NONE);
+  // m[i] = state[16 * blk + i] | pad, p[i] = h[i] ^ m[i]
+  uint32_t base =
+      spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, blk, spirv_const_uint(b, 4));
+  struct spirv_loop words;
+  uint32_t i =
+      spirv_loop_for(b, &words, c0, spirv_const_uint(b, 16), LC_NONE);
+  uint32_t idx = spirv_val(b, OP_IADD, uint_t, base, i);
+  uint32_t w = spirv_val(
+      b, OP_BITWISE_OR, uint_t,
+      spirv_val(b, OP_FUNCTION_CALL, uint_t, f->state_uint, params[0], idx),
+      final_spv_pad(b, 32, idx, GROESTL_SPV_PAD, 2));
+  spirv_store(b, final_spv_at(b, uint_t, m, i), w);
+  uint32_t hi = spirv_load(b, uint_t, final_spv_at(b, uint_t, h, i));
+  spirv_store(b, final_spv_at(b, uint_t, p, i),
+              spirv_val(b, OP_BITWISE_XOR, uint_t, hi, w));
+  spirv_loop_end(b, &words, c1);
+  // h ^= P(h ^ m) ^ Q(m)
+  spirv_val(b, OP_FUNCTION_CALL, void_t, perm_q, m);
+  spirv_val(b, OP_FUNCTION_CALL, void_t, perm_p, p);
+  for (uint32_t k = 0; k < 16; ++k) {
+    uint32_t x = spirv_val(b, OP_BITWISE_XOR, uint_t,
+                           final_spv_get(b, uint_t, p, k),
+                           final_spv_get(b, uint_t, m, k));
+    final_spv_set(b, uint_t, h, k,
+                  spirv_val(b, OP_BITWISE_XOR, uint_t,
+                            final_spv_get(b, uint_t, h, k), x));
+  }
+  spirv_loop_end(b, &blocks, c1);
+
+  // out = (P(h) ^ h)[8..15]
+  spirv_op(b, OP_COPY_MEMORY, p, h);
+  spirv_val(b, OP_FUNCTION_CALL, void_t, perm_p, p);
+  for (uint32_t k = 0; k < 8; ++k) {
+    final_spv_set(b, uint_t, params[1], k,
+                  spirv_val(b, OP_BITWISE_XOR, uint_t,
+                            final_spv_get(b, uint_t, h, k + 8),
+                            final_spv_get(b, uint_t, p, k + 8)));
+  }
+  spirv_return(b);
+  spirv_function_end(b);
+  return fn;
+}
+
+/** Key injection `s`: x[j] += ks[(s + j) % 9], x[5] += ts[s % 3],
+ *  x[6] += ts[(s + 1) % 3], x[7] += s */
+static void final_spv_skein_inject(struct spirv_builder *b, uint32_t x,
+                                   uint32_t ks, uint32_t ts, uint32_t s)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  uint32_t c3 = spirv_const_uint(b, 3);
+  uint32_t c9 = spirv_const_uint(b, 9);
+  for (uint32_t j = 0; j < 8; ++j) {
+    uint32_t sj =
+        j == 0 ? s
+               : spirv_val(b, OP_IADD, uint_t, s, spirv_const_uint(b, j));
+    uint32_t k = spirv_val(b, OP_UMOD, uint_t, sj, c9);
+    uint32_t v = spirv_val(
+        b, OP_IADD, ulong_t, final_spv_get(b, ulong_t, x, j),
+        spirv_load(b, ulong_t, final_spv_at(b, ulong_t, ks, k)));
+    if (j == 5 || j == 6) {
+      uint32_t t = spirv_val(
+          b, OP_UMOD, uint_t,
+          j == 5 ? s
+                 : spirv_val(b, OP_IADD, uint_t, s, spirv_const_uint(b, 1)),
+          c3);
+      v = spirv_val(b, OP_IADD, ulong_t, v,
+                    spirv_load(b, ulong_t, final_spv_at(b, ulong_t, ts, t)));
+    } else if (j == 7) {
+      v = spirv_val(b, OP_IADD, ulong_t, v,
+                    spirv_val(b, OP_UCONVERT, ulong_t, s));
+    }
+    final_spv_set(b, ulong_t, x, j, v);
+  }
+}
+
+/** Threefish-512 of message `w` with key `h` and tweak (t0, t1),
+ *  h = E(w) ^ w */
+static void final_spv_skein_block(struct spirv_builder *b,
+                                  const struct final_spv *f, uint32_t h,
+                                  uint32_t w, uint32_t t0, uint32_t t1)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  uint32_t x = spirv_variable(
+      b,
+      spirv_type_pointer(b, SC_FUNCTION, spirv_type_array(b, ulong_t, 8)),
+      SC_FUNCTION, 0);
+  uint32_t ks = spirv_variable(
+      b,
+      spirv_type_pointer(b, SC_FUNCTION, spirv_type_array(b, ulong_t, 9)),
+      SC_FUNCTION, 0);
+  uint32_t ts = spirv_variable(
+      b,
+      spirv_type_pointer(b, SC_FUNCTION, spirv_type_array(b, ulong_t, 3)),
+      SC_FUNCTION, 0);
+  uint32_t rot = final_spv_uint_table(b, SKEIN_SPV_ROT, 32);
+
+  // ks = {h, parity ^ h[0] ^ ... ^ h[7]}, ts = {t0, t1, t0 ^ t1}
+  uint32_t parity = spirv_const_ulong(b, SKEIN_SPV_KS_PARITY);
+  for (uint32_t k = 0; k < 8; ++k) {
+    uint32_t hk = final_spv_get(b, ulong_t, h, k);
+    final_spv_set(b, ulong_t, ks, k, hk);
+    parity = spirv_val(b, OP_BITWISE_XOR, ulong_t, parity, hk);
+  }
+  final_spv_set(b, ulong_t, ks, 8, parity);
+  final_spv_set(b, ulong_t, ts, 0, t0);
+  final_spv_set(b, ulong_t, ts, 1, t1);
+  final_spv_set(b, ulong_t, ts, 2,
+                spirv_val(b, OP_BITWISE_XOR, ulong_t, t0, t1));
+  spirv_op(b, OP_COPY_MEMORY, x, w);
+
+  // for (s = 0; s < 18; ++s) inject(s) and 4 rounds
+  struct spirv_loop injects;
+  uint32_t s =
+      spirv_loop_for(b, &injects, c0, spirv_const_uint(b, 18), LC_NONE);
+  final_spv_skein_inject(b, x, ks, ts, s);
+  uint32_t rot_base = spirv_val(
+      b, OP_SHIFT_LEFT_LOGICAL, uint_t,
+      spirv_val(b, OP_BITWISE_AND, uint_t, s, c1), spirv_const_uint(b, 4));
+  struct spirv_loop rounds;
+  uint32_t d = spirv_loop_for(b, &rounds, c0, spirv_const_uint(b, 4), LC_NONE);
+  uint32_t rot_row = spirv_val(
+      b, OP_IADD, uint_t, rot_base,
+      spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, d, spirv_const_uint(b, 2)));
+  uint32_t v[8];
+  for (uint32_t k = 0; k < 8; ++k) {
+    v[k] = final_spv_get(b, ulong_t, x, k);
+  }
+  // v[2j] += v[2j + 1], v[2j + 1] = rotl64(v[2j + 1], rot[row + j]) ^ v[2j]
+  for (uint32_t j = 0; j < 4; ++j) {
+    uint32_t n = spirv_load(
+        b, uint_t,
+        final_spv_at(b, uint_t, rot,
+                     j == 0 ? rot_row
+                            : spirv_val(b, OP_IADD, uint_t, rot_row,
+                                        spirv_const_uint(b, j))));
+    v[2 * j] = spirv_val(b, OP_IADD, ulong_t, v[2 * j], v[2 * j + 1]);
+    v[2 * j + 1] = spirv_val(
+        b, OP_BITWISE_XOR, ulong_t,
+        spirv_val(b, OP_FUNCTION_CALL, ulong_t, f->keccak.rotl64,
+                  v[2 * j + 1], n),
+        v[2 * j]);
+  }
+  // x[k] = v[perm[k]]
+  for (uint32_t k = 0; k < 8; ++k) {
+    final_spv_set(b, ulong_t, x, k, v[SKEIN_SPV_PERM[k]]);
+  }
+  spirv_loop_end(b, &rounds, c1);
+  spirv_loop_end(b, &injects, c1);
+  final_spv_skein_inject(b, x, ks, ts, spirv_const_uint(b, 18));
+
+  // h = x ^ w
+  for (uint32_t k = 0; k < 8; ++k) {
+    final_spv_set(b, ulong_t, h, k,
+                  spirv_val(b, OP_BITWISE_XOR, ulong_t,
+                            final_spv_get(b, ulong_t, x, k),
+                            final_spv_get(b, ulong_t, w, k)));
+  }
+}
+
+static uint32_t final_spv_skein_fn(struct spirv_builder *b,
+                                   const struct final_spv *f)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  uint32_t params[2];
+  uint32_t fn = final_spv_hash_fn(b, params);
+  uint32_t h = final_spv_ulong_table(b, SKEIN_SPV_IV, 8);
+  uint32_t t0 = final_spv_ulong_table(b, SKEIN_SPV_T0, 5);
+  uint32_t t1 = final_spv_ulong_table(b, SKEIN_SPV_T1, 5);
+  uint32_t w = spirv_variable(
+      b,
+      spirv_type_pointer(b, SC_FUNCTION, spirv_type_array(b, ulong_t, 8)),
+      SC_FUNCTION, 0);
+
+  // for (blk = 0; blk < 5; ++blk), 4 message blocks and the output block
+  struct spirv_loop blocks;
+  uint32_t blk =
+      spirv_loop_for(b, &blocks, c0, spirv_const_uint(b, 5), LC_NONE);
+  // w[i] = state[8 * blk + i], 0 past the end
+  uint32_t base =
+      spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, blk, spirv_const_uint(b, 3));
+  struct spirv_loop words;
+  uint32_t i = spirv_loop_for(b, &words, c0, spirv_const_uint(b, 8), LC_NONE);
+  spirv_store(b, final_spv_at(b, ulong_t, w, i),
+              spirv_val(b, OP_FUNCTION_CALL, ulong_t, f->state_ulong,
+                        params[0], spirv_val(b, OP_IADD, uint_t, base, i)));
+  spirv_loop_end(b, &words, c1);
+  final_spv_skein_block(
+      b, f, h, w, spirv_load(b, ulong_t, final_spv_at(b, ulong_t, t0, blk)),
+      spirv_load(b, ulong_t, final_spv_at(b, ulong_t, t1, blk)));
+  spirv_loop_end(b, &blocks, c1);
+
+  // out = h[0..3]
+  for (uint32_t k = 0; k < 4; ++k) {
+    uint32_t hk = final_spv_get(b, ulong_t, h, k);
+    final_spv_set(b, uint_t, params[1], 2 * k, final_spv_word(b, hk, false));
+    final_spv_set(b, uint_t, params[1], 2 * k + 1,
+                  final_spv_word(b, hk, true));
+  }
+  spirv_return(b);
+  spirv_function_end(b);
+  return fn;
+}
+
+/** JH S-box of bitsliced `m` selected by round constant bits `c` */
+static void final_spv_jh_sbox(struct spirv_builder *b, uint32_t c,
+                              uint32_t m[4])
+{
+  uint32_t t = spirv_type_vector(b, spirv_type_int(b, 64), 2);
+#define JH_NOT(x) spirv_val(b, OP_NOT, t, (x))
+#define JH_AND(x, y) spirv_val(b, OP_BITWISE_AND, t, (x), (y))
+#define JH_OR(x, y) spirv_val(b, OP_BITWISE_OR, t, (x), (y))
+#define JH_XOR(x, y) spirv_val(b, OP_BITWISE_XOR, t, (x), (y))
+  uint32_t m3 = JH_NOT(m[3]);
+  uint32_t m0 = JH_XOR(m[0], JH_AND(JH_NOT(m[2]), c));
+  uint32_t a = JH_XOR(c, JH_AND(m0, m[1]));
+  m0 = JH_XOR(m0, JH_AND(m3, m[2]));
+  m3 = JH_XOR(m3, JH_AND(JH_NOT(m[1]), m[2]));
+  uint32_t m1 = JH_XOR(m[1], JH_AND(m0, m[2]));
+  uint32_t m2 = JH_XOR(m[2], JH_AND(JH_NOT(m3), m0));
+  m0 = JH_XOR(m0, JH_OR(m1, m3));
+  m3 = JH_XOR(m3, JH_AND(m1, m2));
+  m2 = JH_XOR(m2, a);
+  m1 = JH_XOR(m1, JH_AND(a, m0));
+#undef JH_NOT
+#undef JH_AND
+#undef JH_OR
+#undef JH_XOR
+  m[0] = m0;
+  m[1] = m1;
+  m[2] = m2;
+  m[3] = m3;
+}
+
+/** JH tables of f8 */
+struct final_spv_jh {
+  /** ulong2[84] round constants */
+  uint32_t rc;
+  /** ulong2[7] splats of JH_SPV_SWAP columns */
+  uint32_t swap[4];
+};
+
+/** E8 of `x` with message `m` xored before and after */
+static void final_spv_jh_f8(struct spirv_builder *b,
+                            const struct final_spv_jh *jh, uint32_t x,
+                            uint32_t m)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ulong2_t = spirv_type_vector(b, spirv_type_int(b, 64), 2);
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  // x[0..3] ^= m
+  for (uint32_t k = 0; k < 4; ++k) {
+    final_spv_set(b, ulong2_t, x, k,
+                  spirv_val(b, OP_BITWISE_XOR, ulong2_t,
+                            final_spv_get(b, ulong2_t, x, k),
+                            final_spv_get(b, ulong2_t, m, k)));
+  }
+
+  // for (r = 0; r < 42; ++r)
+  struct spirv_loop rounds;
+  uint32_t r =
+      spirv_loop_for(b, &rounds, c0, spirv_const_uint(b, 42), LC_NONE);
+  uint32_t r2 = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, r, c1);
+  // S-boxes of even and odd words with rc[2r] and rc[2r + 1]
+  uint32_t y[2][4];
+  for (uint32_t k = 0; k < 8; ++k) {
+    y[k & 1][k >> 1] = final_spv_get(b, ulong2_t, x, k);
+  }
+  for (uint32_t k = 0; k < 2; ++k) {
+    uint32_t idx =
+        k == 0 ? r2 : spirv_val(b, OP_BITWISE_OR, uint_t, r2, c1);
+    final_spv_jh_sbox(
+        b, spirv_load(b, ulong2_t, final_spv_at(b, ulong2_t, jh->rc, idx)),
+        y[k]);
+  }
+  // L: linear transform between even words a and odd words b
+  uint32_t *ea = y[0];
+  uint32_t *ob = y[1];
+#define JH_XOR(x, z) spirv_val(b, OP_BITWISE_XOR, ulong2_t, (x), (z))
+  ob[0] = JH_XOR(ob[0], ea[1]);
+  ob[1] = JH_XOR(ob[1], ea[2]);
+  ob[2] = JH_XOR(JH_XOR(ob[2], ea[3]), ea[0]);
+  ob[3] = JH_XOR(ob[3], ea[0]);
+  ea[0] = JH_XOR(ea[0], ob[1]);
+  ea[1] = JH_XOR(ea[1], ob[2]);
+  ea[2] = JH_XOR(JH_XOR(ea[2], ob[3]), ob[0]);
+  ea[3] = JH_XOR(ea[3], ob[0]);
+#undef JH_XOR
+  // swap of odd words by round r % 7
+  uint32_t rm = spirv_val(b, OP_UMOD, uint_t, r, spirv_const_uint(b, 7));
+  uint32_t sw[4];
+  for (uint32_t k = 0; k < 4; ++k) {
+    sw[k] = spirv_load(b, ulong2_t,
+                       final_spv_at(b, ulong2_t, jh->swap[k], rm));
+  }
+  for (uint32_t k = 0; k < 4; ++k) {
+    uint32_t v = ob[k];
+    uint32_t hi = spirv_val(b, OP_SHIFT_RIGHT_LOGICAL, ulong2_t,
+                            spirv_val(b, OP_BITWISE_AND, ulong2_t, v, sw[0]),
+                            sw[3]);
+    uint32_t lo = spirv_val(b, OP_SHIFT_LEFT_LOGICAL, ulong2_t,
+                            spirv_val(b, OP_BITWISE_AND, ulong2_t, v, sw[1]),
+                            sw[3]);
+    uint32_t words = spirv_val(
+        b, OP_BITWISE_AND, ulong2_t,
+        spirv_val(b, OP_VECTOR_SHUFFLE, ulong2_t, v, v, 1, 0), sw[2]);
+    final_spv_set(b, ulong2_t, x, 2 * k,
+                  ea[k]);
+    final_spv_set(b, ulong2_t, x, 2 * k + 1,
+                  spirv_val(b, OP_BITWISE_OR, ulong2_t,
+                            spirv_val(b, OP_BITWISE_OR, ulong2_t, hi, lo),
+                            words));
+  }
+  spirv_loop_end(b, &rounds, c1);
+
+  // x[4..7] ^= m
+  for (uint32_t k = 0; k < 4; ++k) {
+    final_spv_set(b, ulong2_t, x, k + 4,
+                  spirv_val(b, OP_BITWISE_XOR, ulong2_t,
+                            final_spv_get(b, ulong2_t, x, k + 4),
+                            final_spv_get(b, ulong2_t, m, k)));
+  }
+}
+
+static uint32_t final_spv_jh_fn(struct spirv_builder *b,
+                                const struct final_spv *f)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  uint32_t ulong2_t = spirv_type_vector(b, ulong_t, 2);
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t c1 = spirv_const_uint(b, 1);
+  uint32_t params[2];
+  uint32_t fn = final_spv_hash_fn(b, params);
+  uint32_t x = final_spv_ulong2_table(b, &JH_SPV_IV[0][0], &JH_SPV_IV[0][1],
+                                      2, 8);
+  struct final_spv_jh jh;
+  jh.rc =
+      final_spv_ulong2_table(b, &JH_SPV_RC[0][0], &JH_SPV_RC[0][1], 2, 84);
+  for (uint32_t k = 0; k < 4; ++k) {
+    jh.swap[k] = final_spv_ulong2_table(b, &JH_SPV_SWAP[0][k], NULL, 4, 7);
+  }
+  uint32_t m = spirv_variable(
+      b,
+      spirv_type_pointer(b, SC_FUNCTION, spirv_type_array(b, ulong2_t, 4)),
+      SC_FUNCTION, 0);
+
+  // for (blk = 0; blk < 5; ++blk), 3 blocks and 2 padded tail blocks
+  struct spirv_loop blocks;
+  uint32_t blk =
+      spirv_loop_for(b, &blocks, c0, spirv_const_uint(b, 5), LC_NONE);
+  // m[i] = {state[k], state[k + 1] | pad}, k = 8 * blk + 2 * i
+  uint32_t base =
+      spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, blk, spirv_const_uint(b, 3));
+  struct spirv_loop words;
+  uint32_t i = spirv_loop_for(b, &words, c0, spirv_const_uint(b, 4), LC_NONE);
+  uint32_t k0 = spirv_val(b, OP_IADD, uint_t, base,
+                          spirv_val(b, OP_SHIFT_LEFT_LOGICAL, uint_t, i, c1));
+  uint32_t k1 = spirv_val(b, OP_BITWISE_OR, uint_t, k0, c1);
+  uint32_t s0 =
+      spirv_val(b, OP_FUNCTION_CALL, ulong_t, f->state_ulong, params[0], k0);
+  uint32_t s1 = spirv_val(
+      b, OP_BITWISE_OR, ulong_t,
+      spirv_val(b, OP_FUNCTION_CALL, ulong_t, f->state_ulong, params[0], k1),
+      final_spv_pad(b, 64, k1, JH_SPV_PAD, 2));
+  spirv_store(b, final_spv_at(b, ulong2_t, m, i),
+              spirv_val(b, OP_COMPOSITE_CONSTRUCT, ulong2_t, s0, s1));
+  spirv_loop_end(b, &words, c1);
+  final_spv_jh_f8(b, &jh, x, m);
+  spirv_loop_end(b, &blocks, c1);
+
+  // out = x[6], x[7]
+  for (uint32_t k = 0; k < 4; ++k) {
+    uint32_t v = spirv_val(b, OP_COMPOSITE_EXTRACT, ulong_t,
+                           final_spv_get(b, ulong2_t, x, 6 + k / 2), k % 2);
+    final_spv_set(b, uint_t, params[1], 2 * k, final_spv_word(b, v, false));
+    final_spv_set(b, uint_t, params[1], 2 * k + 1,
+                  final_spv_word(b, v, true));
+  }
+  spirv_return(b);
+  spirv_function_end(b);
+  return fn;
+}
+
+/** Job input at binding 0: struct { uint nonce; ...; ulong target; }, the
+ *  target follows the input words at offset 208 */
+static uint32_t final_spv_input_buffer(struct spirv_builder *b)
+{
+  uint32_t type = spirv_type_struct(
+      b, SPIRV_ARGS(spirv_type_int(b, 32), spirv_type_int(b, 64)));
+  spirv_decorate(b, type, DECOR_BLOCK);
+  for (uint32_t k = 0; k < 2; ++k) {
+    spirv_member_decorate(b, type, k, DECOR_NON_WRITABLE);
+    spirv_member_decorate(b, type, k, DECOR_OFFSET, 208 * k);
+  }
+  uint32_t var = spirv_variable(b, spirv_type_pointer(b, SC_BUFFER, type),
+                                SC_BUFFER, 0);
+  spirv_decorate(b, var, DECOR_DESCRIPTOR_SET, 0);
+  spirv_decorate(b, var, DECOR_BINDING, 0);
+  return var;
+}
+
+/** Results at binding 2: struct { uint count; uint results[][9]; }, a
+ *  result is nonce and hash */
+static uint32_t final_spv_output_buffer(struct spirv_builder *b)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t result_t = spirv_type_array(b, uint_t, 9);
+  spirv_decorate(b, result_t, DECOR_ARRAY_STRIDE, 4);
+  uint32_t results_t = spirv_type_runtime_array(b, result_t);
+  spirv_decorate(b, results_t, DECOR_ARRAY_STRIDE, 36);
+  uint32_t type = spirv_type_struct(b, SPIRV_ARGS(uint_t, results_t));
+  spirv_decorate(b, type, DECOR_BLOCK);
+  for (uint32_t k = 0; k < 2; ++k) {
+    spirv_member_decorate(b, type, k, DECOR_OFFSET, 4 * k);
+  }
+  uint32_t var = spirv_variable(b, spirv_type_pointer(b, SC_BUFFER, type),
+                                SC_BUFFER, 0);
+  spirv_decorate(b, var, DECOR_DESCRIPTOR_SET, 0);
+  spirv_decorate(b, var, DECOR_BINDING, 2);
+  return var;
+}
+
+/** Final stage: hash state by state[0] & 3 and report hashes below target */
+void cryptonight_spv_gen_final(struct spirv_builder *b)
+{
+  uint32_t void_t = spirv_type_void(b);
+  uint32_t bool_t = spirv_type_bool(b);
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ulong_t = spirv_type_int(b, 64);
+  uint32_t hash_t = spirv_type_array(b, uint_t, 8);
+  uint32_t ptr_uint_t = spirv_type_pointer(b, SC_BUFFER, uint_t);
+  uint32_t c0 = spirv_const_uint(b, 0);
+  uint32_t c1 = spirv_const_uint(b, 1);
+
+  uint32_t input = final_spv_input_buffer(b);
+  struct final_spv f;
+  f.state = cryptonight_spv_buffer(b, 1, cryptonight_spv_state_type(b, 32),
+                                   200);
+  uint32_t output = final_spv_output_buffer(b);
+  f.groestl_t = spirv_variable(
+      b,
+      spirv_type_pointer(b, SC_WORKGROUP, spirv_type_array(b, uint_t, 512)),
+      SC_WORKGROUP, 0);
+  cryptonight_spv_keccak_init(b, &f.keccak);
+  f.state_uint = final_spv_state_uint_fn(b, f.state);
+  f.state_ulong = final_spv_state_ulong_fn(b, f.state_uint);
+  uint32_t perm_p = final_spv_groestl_perm_fn(b, &f, false);
+  uint32_t perm_q = final_spv_groestl_perm_fn(b, &f, true);
+  const uint32_t hashes[4] = {
+      final_spv_blake_fn(b, &f), final_spv_groestl_fn(b, &f, perm_p, perm_q),
+      final_spv_jh_fn(b, &f), final_spv_skein_fn(b, &f)};
+
+  uint32_t workgroup_size;
+  cryptonight_spv_main(b, 1, &workgroup_size);
+  uint32_t hash = spirv_variable(
+      b, spirv_type_pointer(b, SC_FUNCTION, hash_t), SC_FUNCTION, 0);
+  uint32_t gid = cryptonight_spv_invocation(b, BUILTIN_GLOBAL_INVOCATION_ID, 0);
+  final_spv_groestl_table(b, &f, workgroup_size);
+
+  // switch (state[0] & 3): blake, groestl, jh, skein
+  uint32_t sel = spirv_val(
+      b, OP_BITWISE_AND, uint_t,
+      spirv_val(b, OP_FUNCTION_CALL, uint_t, f.state_uint, gid, c0),
+      spirv_const_uint(b, 3));
+  uint32_t merge = spirv_id(b);
+  uint32_t cases[4];
+  for (uint32_t k = 0; k < 4; ++k) {
+    cases[k] = spirv_id(b);
+  }
+  spirv_op(b, OP_SELECTION_MERGE, merge, SEL_NONE);
+  spirv_op(b, OP_SWITCH, sel, merge, 0, cases[0], 1, cases[1], 2, cases[2], 3,
+           cases[3]);
+  for (uint32_t k = 0; k < 4; ++k) {
+    spirv_label(b, cases[k]);
+    spirv_val(b, OP_FUNCTION_CALL, void_t, hashes[k], gid, hash);
+    spirv_op(b, OP_BRANCH, merge);
+  }
+  spirv_label(b, merge);
+
+  // if (hash[7] << 32 | hash[6]) < target
+  uint32_t value = final_spv_ulong(b, final_spv_get(b, uint_t, hash, 6),
+                                   final_spv_get(b, uint_t, hash, 7));
+  uint32_t target = spirv_load(
+      b, ulong_t,
+      spirv_val(b, OP_ACCESS_CHAIN, spirv_type_pointer(b, SC_BUFFER, ulong_t),
+                input, c1));
+  uint32_t below = spirv_if_begin(
+      b, spirv_val(b, OP_ULESS_THAN, bool_t, value, target));
+  // idx = atomicAdd(count, 1), results[idx] = {nonce + gid, hash}
+  uint32_t idx = spirv_val(
+      b, OP_ATOMIC_IINCREMENT, uint_t,
+      spirv_val(b, OP_ACCESS_CHAIN, ptr_uint_t, output, c0),
+      spirv_const_uint(b, SCOPE_DEVICE),
+      spirv_const_uint(b, MEMORY_SEMANTICS_RELAXED));
+  uint32_t fits = spirv_if_begin(
+      b, spirv_val(b, OP_ULESS_THAN, bool_t, idx,
+                   spirv_const_uint(b, CRYPTONIGHT_SPV_FINAL_MAX_RESULTS)));
+  uint32_t nonce = spirv_val(
+      b, OP_IADD, uint_t,
+      spirv_load(b, uint_t,
+                 spirv_val(b, OP_ACCESS_CHAIN, ptr_uint_t, input, c0)),
+      gid);
+  for (uint32_t k = 0; k < 9; ++k) {
+    spirv_store(b,
+                spirv_val(b, OP_ACCESS_CHAIN, ptr_uint_t, output, c1, idx,
+                          spirv_const_uint(b, k)),
+                k == 0 ? nonce : final_spv_get(b, uint_t, hash, k - 1));
+  }
+  spirv_if_end(b, fits);
+  spirv_if_end(b, below);
+
+  cryptonight_spv_main_end(b);
+}
@@ -0,0 +1,189 @@
+#include "crypto/cryptonight_spv.h"
+
+#include "crypto/aes_spv.h"
+#include "crypto/cryptonight_spv_gen.h"
+
+static const char *CRYPTONIGHT_SPV_STAGE_NAMES[] = {
+    "cn_init",    "cn_keccak", "cn_explode",     "cn_memloop",
+    "cn_implode", "cn_final",  "cn_init_keccak", "cn_implode_keccak"};
+
+static void (*const CRYPTONIGHT_SPV_GENERATORS[])(struct spirv_builder *) = {
+    [CRYPTONIGHT_SPV_INIT] = cryptonight_spv_gen_init,
+    [CRYPTONIGHT_SPV_KECCAK] = cryptonight_spv_gen_keccak,
+    [CRYPTONIGHT_SPV_EXPLODE] = cryptonight_spv_gen_explode,
+    [CRYPTONIGHT_SPV_MEMLOOP] = cryptonight_spv_gen_memloop,
+    [CRYPTONIGHT_SPV_IMPLODE] = cryptonight_spv_gen_implode,
+    [CRYPTONIGHT_SPV_FINAL] = cryptonight_spv_gen_final,
+    [CRYPTONIGHT_SPV_INIT_KECCAK] = cryptonight_spv_gen_init_keccak,
+    [CRYPTONIGHT_SPV_IMPLODE_KECCAK] = cryptonight_spv_gen_implode_keccak};
+
+const char *cryptonight_spv_stage_name(enum cryptonight_spv_stage stage)
+{
+  return CRYPTONIGHT_SPV_STAGE_NAMES[stage];
+}
+
+uint32_t *cryptonight_spv_shader(enum cryptonight_spv_stage stage,
+                                 size_t *size)
+{
+  struct spirv_builder b;
+  spirv_builder_init(&b);
+  CRYPTONIGHT_SPV_GENERATORS[stage](&b);
+  return spirv_builder_finish(&b, size);
+}
+
+uint32_t cryptonight_spv_main(struct spirv_builder *b, uint32_t local_size_y,
+                              uint32_t *workgroup_size)
+{
+  spirv_capability(b, CAP_SHADER);
+  spirv_extension(b, "SPV_KHR_storage_buffer_storage_class");
+  spirv_op(b, OP_MEMORY_MODEL, AM_LOGICAL, MM_GLSL450);
+
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t wg_size = spirv_spec_const_uint(b, CRYPTONIGHT_SPV_SPEC_WG_SIZE,
+                                           CRYPTONIGHT_SPV_LOCAL_WG_SIZE);
+  *workgroup_size = spirv_spec_const_composite(
+      b, spirv_type_vector(b, uint_t, 3),
+      SPIRV_ARGS(wg_size, spirv_const_uint(b, local_size_y),
+                 spirv_const_uint(b, 1)));
+  spirv_decorate(b, *workgroup_size, DECOR_BUILTIN, BUILTIN_WORKGROUP_SIZE);
+
+  uint32_t main = spirv_function(b, spirv_type_void(b), FNC_NONE, NULL, 0, NULL);
+  spirv_entry_point(b, EXEC_MODEL_GLCOMPUTE, main, "main");
+  spirv_op(b, OP_EXECUTION_MODE, main, EXEC_MODE_LOCALSIZE,
+           CRYPTONIGHT_SPV_LOCAL_WG_SIZE, local_size_y, 1);
+  return main;
+}
+
+void cryptonight_spv_main_end(struct spirv_builder *b)
+{
+  spirv_return(b);
+  spirv_function_end(b);
+}
+
+uint32_t cryptonight_spv_invocation(struct spirv_builder *b,
+                                    enum SPV_BUILTINS builtin,
+                                    uint32_t component)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t var = spirv_builtin(b, builtin, spirv_type_vector(b, uint_t, 3));
+  uint32_t ptr = spirv_val(b, OP_ACCESS_CHAIN,
+                           spirv_type_pointer(b, SC_INPUT, uint_t), var,
+                           spirv_const_uint(b, component));
+  return spirv_load(b, uint_t, ptr);
+}
+
+uint32_t cryptonight_spv_state_type(struct spirv_builder *b, uint32_t width)
+{
+  uint32_t type = spirv_type_array(b, spirv_type_int(b, width), 1600 / width);
+  spirv_decorate(b, type, DECOR_ARRAY_STRIDE, width / 8);
+  return type;
+}
+
+uint32_t cryptonight_spv_buffer(struct spirv_builder *b, uint32_t binding,
+                                uint32_t element, uint32_t stride)
+{
+  uint32_t array = spirv_type_runtime_array(b, element);
+  spirv_decorate(b, array, DECOR_ARRAY_STRIDE, stride);
+  uint32_t type = spirv_type_struct(b, SPIRV_ARGS(array));
+  spirv_decorate(b, type, DECOR_BLOCK);
+  spirv_member_decorate(b, type, 0, DECOR_OFFSET, 0);
+  uint32_t var = spirv_variable(b, spirv_type_pointer(b, SC_BUFFER, type),
+                                SC_BUFFER, 0);
+  spirv_decorate(b, var, DECOR_DESCRIPTOR_SET, 0);
+  spirv_decorate(b, var, DECOR_BINDING, binding);
+  return var;
+}
+
+uint32_t cryptonight_spv_input_buffer(struct spirv_builder *b,
+                                      uint32_t binding)
+{
+  uint32_t type = spirv_type_struct(
+      b, SPIRV_ARGS(spirv_type_int(b, 32), cryptonight_spv_state_type(b, 32)));
+  spirv_decorate(b, type, DECOR_BLOCK);
+  for (uint32_t k = 0; k < 2; ++k) {
+    spirv_member_decorate(b, type, k, DECOR_NON_WRITABLE);
+    spirv_member_decorate(b, type, k, DECOR_OFFSET, 4 * k);
+  }
+  uint32_t var = spirv_variable(b, spirv_type_pointer(b, SC_BUFFER, type),
+                                SC_BUFFER, 0);
+  spirv_decorate(b, var, DECOR_DESCRIPTOR_SET, 0);
+  spirv_decorate(b, var, DECOR_BINDING, binding);
+  return var;
+}
+
+uint32_t cryptonight_spv_buffer_at(struct spirv_builder *b, uint32_t buffer,
+                                   uint32_t element, uint32_t index)
+{
+  return spirv_val(b, OP_ACCESS_CHAIN,
+                   spirv_type_pointer(b, SC_BUFFER, element), buffer,
+                   spirv_const_uint(b, 0), index);
+}
+
+uint32_t cryptonight_spv_load_uint4(struct spirv_builder *b, uint32_t pointer,
+                                    enum SPV_STORAGE_CLASS storage,
+                                    uint32_t index)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t ptr_t = spirv_type_pointer(b, storage, uint_t);
+  uint32_t w[4];
+  for (uint32_t k = 0; k < 4; ++k) {
+    uint32_t i =
+        k == 0 ? index
+               : spirv_val(b, OP_IADD, uint_t, index, spirv_const_uint(b, k));
+    w[k] = spirv_load(b, uint_t, spirv_val(b, OP_ACCESS_CHAIN, ptr_t, pointer, i));
+  }
+  return spirv_val(b, OP_COMPOSITE_CONSTRUCT, spirv_type_vector(b, uint_t, 4),
+                   w[0], w[1], w[2], w[3]);
+}
+
+void cryptonight_spv_aes_stage(struct spirv_builder *b, uint32_t key_index,
+                               struct cryptonight_spv_aes_stage *stage)
+{
+  uint32_t uint_t = spirv_type_int(b, 32);
+  uint32_t uint4_t = spirv_type_vector(b, uint_t, 4);
+  uint32_t state_t = cryptonight_spv_state_type(b, 32);
+  uint32_t ptr_uint_t = spirv_type_pointer(b, SC_BUFFER, uint_t);
+  uint32_t key_t = spirv_type_array(b, uint_t, 40);
+  uint32_t state_buffer = cryptonight_spv_buffer(b, 0, state_t, 200);
+  stage->scratchpad = cryptonight_spv_buffer(b, 1, uint4_t, 16);
+  stage->memory = spirv_spec_const_uint(b, CRYPTONIGHT_SPV_SPEC_MEMORY,
+                                        CRYPTONIGHT_SPV_MEMORY);
+  struct aes_spv aes;
+  aes_spv_init(b, &aes);
+  stage->encode_10 = aes_spv_encode_10_fn(b, &aes);
+
+  uint32_t workgroup_size;
+  cryptonight_spv_main(b, 8, &workgroup_size);
+  stage->text = spirv_variable(b, spirv_type_pointer(b, SC_FUNCTION, uint4_t),
+                               SC_FUNCTION, 0);
+  stage->key = spirv_variable(b, spirv_type_pointer(b, SC_FUNCTION, key_t),
+                              SC_FUNCTION, 0);
+  uint32_t gid = cryptonight_spv_invocation(b, BUILTIN_GLOBAL_INVOCATION_ID, 0);
+  stage->block = cryptonight_spv_invocation(b, BUILTIN_LOCAL_INVOCATION_ID, 1);
+  stage->state = cryptonight_spv_buffer_at(b, state_buffer, state_t, gid);
+  stage->scratchpad_base = spirv_val(b, OP_IMUL, uint_t, gid, stage->memory);
+
+  aes_spv_gen_tables(b, &aes, workgroup_size);
+  uint32_t ptr_key_t = spirv_type_pointer(b, SC_FUNCTION, uint_t);
+  for (uint32_t i = 0; i < 8; ++i) {
+    uint32_t w = spirv_load(
+        b, uint_t,
+        spirv_val(b, OP_ACCESS_CHAIN, ptr_uint_t, stage->state,
+                  spirv_const_uint(b, key_index + i)));
+    spirv_store(b,
+                spirv_val(b, OP_ACCESS_CHAIN, ptr_key_t, stage->key,
+                          spirv_const_uint(b, i)),
+                w);
+  }
+  aes_spv_expand_key_10(b, &aes, stage->key);
+
+  // bytes 64..191 of the state are split into 8 blocks of 16 bytes, one
+  // block per local invocation y
+  stage->block_index = spirv_val(
+      b, OP_IMUL, uint_t,
+      spirv_val(b, OP_IADD, uint_t, stage->block, spirv_const_uint(b, 4)),
+      spirv_const_uint(b, 4));
+  spirv_store(b, stage->text,
+              cryptonight_spv_load_uint4(b, stage->state, SC_BUFFER,
+                                         stage->block_index));
+}
@@ -5,22 +5,43 @@
 
 #define CRYPTONIGHT_SPV_LOCAL_WG_SIZE 8
 
-extern const uint32_t cryptonight_init_shader[];
-
-extern const size_t cryptonight_init_shader_size;
-
-extern const uint32_t cryptonight_keccak_shader[];
-
-extern const size_t cryptonight_keccak_shader_size;
-
-extern const uint32_t cryptonight_explode_shader[];
-
-extern const size_t cryptonight_explode_shader_size;
-
-extern const uint32_t cryptonight_memloop_shader[];
-
-extern const size_t cryptonight_memloop_shader_size;
-
-extern const uint32_t cryptonight_implode_shader[];
-
-extern const size_t cryptonight_implode_shader_size;
+/** Specialization constant ids shared by all shaders, values are uint.
+ *  WG_SIZE is the local size x, ITERATIONS the memory loop count,
+ *  MEMORY the scratchpad length in uint4 and MASK the byte mask
+ *  of scratchpad addresses in the memory loop */
+#define CRYPTONIGHT_SPV_SPEC_WG_SIZE 0
+#define CRYPTONIGHT_SPV_SPEC_ITERATIONS 1
+#define CRYPTONIGHT_SPV_SPEC_MEMORY 2
+#define CRYPTONIGHT_SPV_SPEC_MASK 3
+
+/** defaults of specialization constants, cryptonight v0 */
+#define CRYPTONIGHT_SPV_ITERATIONS 0x80000
+#define CRYPTONIGHT_SPV_MEMORY (2097152 >> 4)
+#define CRYPTONIGHT_SPV_MASK 0x1FFFF0
+
+/** capacity of the result list written by the final shader */
+#define CRYPTONIGHT_SPV_FINAL_MAX_RESULTS 256
+
+/** Shader stages in dispatch order, then fused ones replacing two stages
+ *  with a single dispatch */
+enum cryptonight_spv_stage {
+  CRYPTONIGHT_SPV_INIT = 0,
+  CRYPTONIGHT_SPV_KECCAK,
+  CRYPTONIGHT_SPV_EXPLODE,
+  CRYPTONIGHT_SPV_MEMLOOP,
+  CRYPTONIGHT_SPV_IMPLODE,
+  CRYPTONIGHT_SPV_FINAL,
+  /** init, keccak */
+  CRYPTONIGHT_SPV_INIT_KECCAK,
+  /** implode, keccak */
+  CRYPTONIGHT_SPV_IMPLODE_KECCAK,
+  CRYPTONIGHT_SPV_STAGES
+};
+
+/** Shader name for logs, e.g. `cn_init` */
+const char *cryptonight_spv_stage_name(enum cryptonight_spv_stage stage);
+
+/** Generate SPIR-V module of `stage` with entry point `main`, size in bytes.
+ *  NULL on allocation failure, caller frees the result */
+uint32_t *cryptonight_spv_shader(enum cryptonight_spv_stage stage,
+                                 size_t *size);
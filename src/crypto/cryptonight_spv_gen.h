@@ -0,0 +1,101 @@
+/* cryptonight_spv_gen.h -- generators of cryptonight shader stages
+ *
+ * Internal to crypto/cryptonight_*_spv.c, see cryptonight_spv_shader().
+ * Buffers are bound to descriptor set 0, hash state of an invocation is
+ * 200 bytes at index of its global invocation id.
+ */
+#pragma once
+
+#include "utils/spirv_builder.h"
+
+void cryptonight_spv_gen_init(struct spirv_builder *b);
+void cryptonight_spv_gen_keccak(struct spirv_builder *b);
+void cryptonight_spv_gen_explode(struct spirv_builder *b);
+void cryptonight_spv_gen_memloop(struct spirv_builder *b);
+void cryptonight_spv_gen_implode(struct spirv_builder *b);
+void cryptonight_spv_gen_init_keccak(struct spirv_builder *b);
+void cryptonight_spv_gen_implode_keccak(struct spirv_builder *b);
+void cryptonight_spv_gen_final(struct spirv_builder *b);
+
+/** Begin compute entry point `main` with local size [WG_SIZE specialization
+ *  constant, local_size_y, 1], the constant goes to `workgroup_size` */
+uint32_t cryptonight_spv_main(struct spirv_builder *b, uint32_t local_size_y,
+                              uint32_t *workgroup_size);
+
+/** End `main` */
+void cryptonight_spv_main_end(struct spirv_builder *b);
+
+/** Component of uvec3 invocation built-in, e.g. gl_GlobalInvocationID.x */
+uint32_t cryptonight_spv_invocation(struct spirv_builder *b,
+                                    enum SPV_BUILTINS builtin,
+                                    uint32_t component);
+
+/** Hash state type: uint[50] or ulong[25] for `width` 32 or 64 */
+uint32_t cryptonight_spv_state_type(struct spirv_builder *b, uint32_t width);
+
+/** Storage buffer struct { element data[]; } at `binding` */
+uint32_t cryptonight_spv_buffer(struct spirv_builder *b, uint32_t binding,
+                                uint32_t element, uint32_t stride);
+
+/** Read-only job input at `binding`: struct { uint nonce; uint input[50]; } */
+uint32_t cryptonight_spv_input_buffer(struct spirv_builder *b,
+                                      uint32_t binding);
+
+/** Pointer to `buffer`.data[index] of `element` type */
+uint32_t cryptonight_spv_buffer_at(struct spirv_builder *b, uint32_t buffer,
+                                   uint32_t element, uint32_t index);
+
+/** Load uint4 from words [index, index + 3] of uint array at `pointer` in
+ *  `storage` class */
+uint32_t cryptonight_spv_load_uint4(struct spirv_builder *b, uint32_t pointer,
+                                    enum SPV_STORAGE_CLASS storage,
+                                    uint32_t index);
+
+/** Explode and implode: main with local size [WG_SIZE, 8, 1], invocation
+ *  (x, y) processes every 8th 16 byte block of scratchpad of hash x
+ *  starting at y */
+struct cryptonight_spv_aes_stage {
+  /** uint[50] hash state */
+  uint32_t state;
+  /** scratchpad buffer and uint4 index of the scratchpad of the hash */
+  uint32_t scratchpad;
+  uint32_t scratchpad_base;
+  /** MEMORY specialization constant */
+  uint32_t memory;
+  /** local invocation id y */
+  uint32_t block;
+  /** index of the first state word of the text block, 4 * (y + 4) */
+  uint32_t block_index;
+  /** Function uint4 text block, initialised from the state */
+  uint32_t text;
+  /** Function uint[40] round keys */
+  uint32_t key;
+  /** void aes_encode_10(uint4 *text, uint[40] *key) */
+  uint32_t encode_10;
+};
+
+/** Begin main of scratchpad stage, AES key is expanded from state words
+ *  [key_index, key_index + 7] */
+void cryptonight_spv_aes_stage(struct spirv_builder *b, uint32_t key_index,
+                               struct cryptonight_spv_aes_stage *stage);
+
+/** keccak-f[1600], functions are declared before main by
+ *  cryptonight_spv_keccak_init() */
+struct cryptonight_spv_keccak {
+  /** ulong rotl64(ulong x, uint n) */
+  uint32_t rotl64;
+};
+
+void cryptonight_spv_keccak_init(struct spirv_builder *b,
+                                 struct cryptonight_spv_keccak *keccak);
+
+/** 24 rounds over 25 ulong pointers of any storage class */
+void cryptonight_spv_keccak_f(struct spirv_builder *b,
+                              const struct cryptonight_spv_keccak *keccak,
+                              const uint32_t ptr[25]);
+
+/** Permute 50 uint `words` in function variables and store the result to
+ *  uint[50] `state` in a storage buffer */
+void cryptonight_spv_keccak_words(struct spirv_builder *b,
+                                  const struct cryptonight_spv_keccak *keccak,
+                                  const uint32_t words[50], uint32_t state);
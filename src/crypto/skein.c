@@ -3,6 +3,10 @@
 #include <assert.h>
 #include <string.h>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
 #define SKEIN_512_ROUNDS_TOTAL 72
 #define SKEIN_KS_PARITY 0x1BD11BDAA9FC1A22
 
@@ -308,3 +312,158 @@ void skein_512_256(const void *input, size_t inputbitlen, uint8_t *digest)
   skein_512_update(&state, input, inputbitlen);
   skein_512_final(&state, 256, digest);
 }
+
+#ifdef __AVX2__
+
+#define RotL_64_X4(x, N)                                                       \
+  _mm256_or_si256(_mm256_slli_epi64(x, N), _mm256_srli_epi64(x, 64 - (N)))
+
+#define R512_X4(p0, p1, p2, p3, p4, p5, p6, p7, ROT)                           \
+  X##p0 = _mm256_add_epi64(X##p0, X##p1);                                      \
+  X##p1 = _mm256_xor_si256(RotL_64_X4(X##p1, ROT##_0), X##p0);                 \
+  X##p2 = _mm256_add_epi64(X##p2, X##p3);                                      \
+  X##p3 = _mm256_xor_si256(RotL_64_X4(X##p3, ROT##_1), X##p2);                 \
+  X##p4 = _mm256_add_epi64(X##p4, X##p5);                                      \
+  X##p5 = _mm256_xor_si256(RotL_64_X4(X##p5, ROT##_2), X##p4);                 \
+  X##p6 = _mm256_add_epi64(X##p6, X##p7);                                      \
+  X##p7 = _mm256_xor_si256(RotL_64_X4(X##p7, ROT##_3), X##p6);
+
+#define I512_X4(R)                                                             \
+  X0 = _mm256_add_epi64(X0, ks[((R) + 1) % 9]);                                \
+  X1 = _mm256_add_epi64(X1, ks[((R) + 2) % 9]);                                \
+  X2 = _mm256_add_epi64(X2, ks[((R) + 3) % 9]);                                \
+  X3 = _mm256_add_epi64(X3, ks[((R) + 4) % 9]);                                \
+  X4 = _mm256_add_epi64(X4, ks[((R) + 5) % 9]);                                \
+  X5 = _mm256_add_epi64(X5, _mm256_add_epi64(ks[((R) + 6) % 9],                \
+                                             ts[((R) + 1) % 3]));              \
+  X6 = _mm256_add_epi64(X6, _mm256_add_epi64(ks[((R) + 7) % 9],                \
+                                             ts[((R) + 2) % 3]));              \
+  X7 = _mm256_add_epi64(                                                       \
+      X7, _mm256_add_epi64(ks[((R) + 8) % 9], _mm256_set1_epi64x((R) + 1)));
+
+#define R512_8_rounds_X4(R)                                                    \
+  R512_X4(0, 1, 2, 3, 4, 5, 6, 7, R_512_0);                                    \
+  R512_X4(2, 1, 4, 7, 6, 5, 0, 3, R_512_1);                                    \
+  R512_X4(4, 1, 6, 3, 0, 5, 2, 7, R_512_2);                                    \
+  R512_X4(6, 1, 0, 7, 2, 5, 4, 3, R_512_3);                                    \
+  I512_X4(2 * (R));                                                            \
+  R512_X4(0, 1, 2, 3, 4, 5, 6, 7, R_512_4);                                    \
+  R512_X4(2, 1, 4, 7, 6, 5, 0, 3, R_512_5);                                    \
+  R512_X4(4, 1, 6, 3, 0, 5, 2, 7, R_512_6);                                    \
+  R512_X4(6, 1, 0, 7, 2, 5, 4, 3, R_512_7);                                    \
+  I512_X4(2 * (R) + 1);
+
+/** process one block in each of 4 lanes, tweak is the same for all lanes */
+static void skein_512_process_block_x4(__m256i chaining[8],
+                                       const uint8_t *const block[4],
+                                       uint64_t t0, uint64_t t1)
+{
+  __m256i ks[9], ts[3], w[8];
+  ks[8] = _mm256_set1_epi64x((long long)SKEIN_KS_PARITY);
+  for (size_t i = 0; i < 8; ++i) {
+    ks[i] = chaining[i];
+    ks[8] = _mm256_xor_si256(ks[8], ks[i]);
+    uint64_t m[4];
+    for (size_t k = 0; k < 4; ++k) {
+      memcpy(&m[k], block[k] + i * 8, sizeof(uint64_t));
+    }
+    w[i] = _mm256_setr_epi64x((long long)m[0], (long long)m[1],
+                              (long long)m[2], (long long)m[3]);
+  }
+  ts[0] = _mm256_set1_epi64x((long long)t0);
+  ts[1] = _mm256_set1_epi64x((long long)t1);
+  ts[2] = _mm256_set1_epi64x((long long)(t0 ^ t1));
+
+  __m256i X0 = _mm256_add_epi64(w[0], ks[0]);
+  __m256i X1 = _mm256_add_epi64(w[1], ks[1]);
+  __m256i X2 = _mm256_add_epi64(w[2], ks[2]);
+  __m256i X3 = _mm256_add_epi64(w[3], ks[3]);
+  __m256i X4 = _mm256_add_epi64(w[4], ks[4]);
+  __m256i X5 = _mm256_add_epi64(w[5], _mm256_add_epi64(ks[5], ts[0]));
+  __m256i X6 = _mm256_add_epi64(w[6], _mm256_add_epi64(ks[6], ts[1]));
+  __m256i X7 = _mm256_add_epi64(w[7], ks[7]);
+
+  R512_8_rounds_X4(0);
+  R512_8_rounds_X4(1);
+  R512_8_rounds_X4(2);
+  R512_8_rounds_X4(3);
+  R512_8_rounds_X4(4);
+  R512_8_rounds_X4(5);
+  R512_8_rounds_X4(6);
+  R512_8_rounds_X4(7);
+  R512_8_rounds_X4(8);
+
+  chaining[0] = _mm256_xor_si256(X0, w[0]);
+  chaining[1] = _mm256_xor_si256(X1, w[1]);
+  chaining[2] = _mm256_xor_si256(X2, w[2]);
+  chaining[3] = _mm256_xor_si256(X3, w[3]);
+  chaining[4] = _mm256_xor_si256(X4, w[4]);
+  chaining[5] = _mm256_xor_si256(X5, w[5]);
+  chaining[6] = _mm256_xor_si256(X6, w[6]);
+  chaining[7] = _mm256_xor_si256(X7, w[7]);
+}
+
+void skein_512_256_x4(const void *const input[4], size_t inputbitlen,
+                      uint8_t *const digest[4])
+{
+  assert(inputbitlen % 8 == 0);
+  const size_t len = inputbitlen / 8;
+  struct skein_512_state init;
+  skein_512_256_init(&init);
+  __m256i chaining[8];
+  for (size_t i = 0; i < 8; ++i) {
+    chaining[i] = _mm256_set1_epi64x((long long)init.chaining[i]);
+  }
+
+  // the last 1..64 bytes go to the final block
+  const size_t full_blocks = len > 0 ? (len - 1) / SKEIN_512_BLOCK_SIZE : 0;
+  uint64_t t1 = SKEIN_T1_FLAG_FIRST | SKEIN_T1_BLK_TYPE_MSG;
+  const uint8_t *block[4];
+  size_t offset = 0;
+  for (size_t b = 0; b < full_blocks; ++b) {
+    for (size_t k = 0; k < 4; ++k) {
+      block[k] = (const uint8_t *)input[k] + offset;
+    }
+    offset += SKEIN_512_BLOCK_SIZE;
+    skein_512_process_block_x4(chaining, block, offset, t1);
+    t1 &= ~SKEIN_T1_FLAG_FIRST;
+  }
+
+  uint8_t tail[4][SKEIN_512_BLOCK_SIZE];
+  for (size_t k = 0; k < 4; ++k) {
+    memset(tail[k], 0, SKEIN_512_BLOCK_SIZE);
+    memcpy(tail[k], (const uint8_t *)input[k] + offset, len - offset);
+    block[k] = tail[k];
+  }
+  skein_512_process_block_x4(chaining, block, len, t1 | SKEIN_T1_FLAG_FINAL);
+
+  // output stage: counter block of zeros
+  static const uint8_t zeros[SKEIN_512_BLOCK_SIZE] = {0};
+  for (size_t k = 0; k < 4; ++k) {
+    block[k] = zeros;
+  }
+  skein_512_process_block_x4(chaining, block, sizeof(uint64_t),
+                             SKEIN_T1_FLAG_FIRST | SKEIN_T1_BLK_TYPE_OUT_FINAL);
+
+  uint64_t out[4][4];
+  for (size_t i = 0; i < 4; ++i) {
+    _mm256_storeu_si256((__m256i *)out[i], chaining[i]);
+  }
+  for (size_t k = 0; k < 4; ++k) {
+    for (size_t i = 0; i < 4; ++i) {
+      memcpy(digest[k] + i * 8, &out[i][k], sizeof(uint64_t));
+    }
+  }
+}
+
+#else
+
+void skein_512_256_x4(const void *const input[4], size_t inputbitlen,
+                      uint8_t *const digest[4])
+{
+  for (size_t k = 0; k < 4; ++k) {
+    skein_512_256(input[k], inputbitlen, digest[k]);
+  }
+}
+
+#endif // __AVX2__
@@ -34,3 +34,7 @@ void skein_512_final(struct skein_512_state *state, size_t digestlenbits,
 
 /** hash fixed size input with skein-512 and produce 256-bit digest */
 void skein_512_256(const void *input, size_t inputbitlen, uint8_t *digest);
+
+/** hash 4 inputs of the same length at once (AVX2 if available) */
+void skein_512_256_x4(const void *const input[4], size_t inputbitlen,
+                      uint8_t *const digest[4]);
@@ -4,11 +4,13 @@
 #include <time.h>
 #include <uv.h>
 
+#include "cJSON/cJSON.h"
 #include "cli_opts.h"
 #include "config.h"
 #include "console.h"
 #include "foreman.h"
 #include "logging.h"
+#include "metrics.h"
 
 static const char *uv_handle_type_str[] = {"UV_UNKNOWN_HANDLE",
                                            "UV_ASYNC",
@@ -37,16 +39,70 @@ void on_uv_walk(uv_handle_t *handle, void *arg)
   uv_close(handle, NULL);
 }
 
-void on_sigint_received(uv_signal_t *handle, int signum)
+void shutdown_loop(uv_loop_t *loop)
 {
-  log_warn("SIGINT received. Gracefully shutting down");
-  int result = uv_loop_close(handle->loop);
+  int result = uv_loop_close(loop);
   if (result == UV_EBUSY) {
     log_debug("Closing active event handles");
-    uv_walk(handle->loop, on_uv_walk, NULL);
+    uv_walk(loop, on_uv_walk, NULL);
   }
   // uv_print_all_handles(uv_default_loop(), stdout);
-  uv_stop(uv_default_loop());
+  uv_stop(loop);
+}
+
+void on_sigint_received(uv_signal_t *handle, int signum)
+{
+  log_warn("SIGINT received. Gracefully shutting down");
+  shutdown_loop(handle->loop);
+}
+
+void on_benchmark_finished(uv_timer_t *handle)
+{
+  log_info("Benchmark finished");
+  shutdown_loop(handle->loop);
+}
+
+/** Print summary of all miners as json to stdout */
+void print_benchmark_summary(const struct cli_opts *opts,
+                             foreman_handle *foremans, size_t foremans_len)
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddNumberToObject(json, "seed", opts->bench_seed);
+  cJSON_AddNumberToObject(json, "warmup_sec", opts->bench_warmup_sec);
+  cJSON_AddNumberToObject(json, "duration_sec", opts->bench_duration_sec);
+  cJSON *miners = cJSON_CreateArray();
+  cJSON_AddItemToObject(json, "miners", miners);
+  double hashrate = 0;
+  for (size_t i = 0; i < foremans_len; ++i) {
+    cJSON *result = foreman_benchmark_result(foremans[i]);
+    if (result == NULL) {
+      continue;
+    }
+    const cJSON *h = cJSON_GetObjectItemCaseSensitive(result, "hashrate");
+    hashrate += cJSON_IsNumber(h) ? h->valuedouble : 0;
+    cJSON_AddItemToArray(miners, result);
+  }
+  cJSON_AddNumberToObject(json, "hashrate", hashrate);
+  char *str = cJSON_Print(json);
+  fprintf(stdout, "%s\n", str);
+  fflush(stdout);
+  free(str);
+  cJSON_Delete(json);
+}
+
+/** command line options take precedence over config file */
+void console_config_apply_cli_opts(const struct cli_opts *opts,
+                                   struct console_config *cfg)
+{
+  if (opts->log_level != NULL) {
+    console_log_level_from_string(opts->log_level, &cfg->log_level);
+  }
+  if (opts->log_format != NULL) {
+    console_log_format_from_string(opts->log_format, &cfg->log_format);
+  }
+  if (opts->no_color) {
+    cfg->no_color = true;
+  }
 }
 
 int main(int argc, char **argv)
@@ -56,14 +112,22 @@ int main(int argc, char **argv)
   struct cli_opts cli_opts = {0};
   parse_cli_opts(argc, argv, &cli_opts);
 
-  // TODO: init console
+  // init console
+  const struct console_config console_default_cfg = {
+      .no_color = false, .log_level = INFO, .log_format = LOG_FORMAT_TEXT};
+  struct console_config console_cfg = console_default_cfg;
+  console_config_apply_cli_opts(&cli_opts, &console_cfg);
+  console_init(&console_cfg);
 
   // read config
-  struct config *cfg = config_from_file(cli_opts.config_file);
+  console_cfg = console_default_cfg;
+  struct config *cfg = config_from_file(cli_opts.config_file, &console_cfg);
   if (cfg == NULL) {
     log_error("Error when reading config.");
     exit(1);
   }
+  console_config_apply_cli_opts(&cli_opts, &console_cfg);
+  console_init(&console_cfg);
   size_t cfg_size = 0;
   for (struct config *p = cfg; p != NULL; ++cfg_size) {
     p = p->next;
@@ -72,10 +136,16 @@ int main(int argc, char **argv)
 
   int exit_code = 0;
   foreman_handle *foremans = calloc(cfg_size, sizeof(foreman_handle));
+  const struct miner_benchmark_opts benchmark_opts = {
+      .seed = cli_opts.bench_seed,
+      .blob = cli_opts.bench_blob,
+      .warmup_sec = cli_opts.bench_warmup_sec,
+      .duration_sec = cli_opts.bench_duration_sec};
 
   struct config *p = cfg;
   for (size_t i = 0; i < cfg_size; ++i, p = p->next) {
-    foremans[i] = foreman_new(p, cli_opts.is_benchmark);
+    foremans[i] =
+        foreman_new(p, cli_opts.is_benchmark ? &benchmark_opts : NULL);
     if (foremans[i] == NULL) {
       exit_code = 1;
       goto SHUTDOWN;
@@ -98,14 +168,40 @@ int main(int argc, char **argv)
 
   pool_connection_connect(h);*/
 
+  bool is_started = true;
   for (size_t i = 0; i < cfg_size; ++i) {
-    foreman_start(foremans[i]);
+    is_started = foreman_start(foremans[i]) && is_started;
+  }
+  if (!is_started) {
+    exit_code = 1;
+    goto SHUTDOWN;
+  }
+
+  uv_timer_t benchmark_timer;
+  if (cli_opts.is_benchmark && cli_opts.bench_duration_sec > 0) {
+    // half a second extra to take the last hashrate sample
+    uint64_t timeout_ms = (uint64_t)(cli_opts.bench_warmup_sec +
+                                     cli_opts.bench_duration_sec) *
+                              1000 +
+                          500;
+    uv_timer_init(loop, &benchmark_timer);
+    uv_timer_start(&benchmark_timer, on_benchmark_finished, timeout_ms, 0);
+  }
+
+  if (cli_opts.metrics_port > 0 &&
+      !metrics_server_start(cli_opts.metrics_host, cli_opts.metrics_port)) {
+    exit_code = 1;
+    goto SHUTDOWN;
   }
 
   log_debug("Starting event loop");
   uv_run(loop, UV_RUN_DEFAULT);
+  if (cli_opts.is_benchmark) {
+    print_benchmark_summary(&cli_opts, foremans, cfg_size);
+  }
 SHUTDOWN:
   log_debug("Shutting down.");
+  metrics_server_stop();
   for (size_t i = 0; i < cfg_size; ++i) {
     if (foremans[i]) {
       foreman_stop(foremans[i]);
@@ -1,12 +1,38 @@
 #include "foreman.h"
 
 #include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "cJSON/cJSON.h"
 #include "connection.h"
 #include "logging.h"
+#include "metrics.h"
 #include "miner.h"
 #include "stratum.h"
+#include "utils/unused.h"
+
+#define PENDING_SHARES_SIZE 64
+
+/** Pool status and share statistics */
+struct foreman_stats {
+  bool is_logged_in;
+  uint64_t logins;
+  uint64_t jobs_received;
+  uint64_t last_job_at; // uv_hrtime
+  uint64_t shares_submitted;
+  uint64_t shares_accepted;
+  uint64_t shares_rejected;
+  /** share submit to pool response latency */
+  uint64_t share_latency_sum; // nanoseconds
+  uint64_t share_latency_count;
+  /** submit timestamps of shares awaiting response, pool replies in order */
+  uint64_t pending_shares[PENDING_SHARES_SIZE];
+  size_t pending_shares_head;
+  size_t pending_shares_len;
+};
 
 struct foreman {
   const struct config *cfg;
@@ -17,8 +43,173 @@ struct foreman {
   miner_handle miner;
   struct miner_event_handler miner_event_handler;
   bool is_benchmark;
+  struct miner_benchmark_opts benchmark_opts;
+  int foreman_id;
+  struct foreman_stats stats;
+  struct foreman *next; // in foremen list
 };
 
+static int foreman_next_id = 0;
+/** all foremen in creation order, metrics are collected over the list */
+static struct foreman *foremen = NULL;
+
+void foreman_stats_share_submitted(struct foreman_stats *stats)
+{
+  ++stats->shares_submitted;
+  if (stats->pending_shares_len == PENDING_SHARES_SIZE) {
+    // drop the oldest one
+    stats->pending_shares_head =
+        (stats->pending_shares_head + 1) % PENDING_SHARES_SIZE;
+    --stats->pending_shares_len;
+  }
+  size_t tail = (stats->pending_shares_head + stats->pending_shares_len) %
+                PENDING_SHARES_SIZE;
+  stats->pending_shares[tail] = uv_hrtime();
+  ++stats->pending_shares_len;
+}
+
+void foreman_stats_share_response(struct foreman_stats *stats, bool accepted)
+{
+  if (accepted) {
+    ++stats->shares_accepted;
+  } else {
+    ++stats->shares_rejected;
+  }
+  if (stats->pending_shares_len > 0) {
+    uint64_t submitted_at = stats->pending_shares[stats->pending_shares_head];
+    stats->pending_shares_head =
+        (stats->pending_shares_head + 1) % PENDING_SHARES_SIZE;
+    --stats->pending_shares_len;
+    stats->share_latency_sum += uv_hrtime() - submitted_at;
+    ++stats->share_latency_count;
+  }
+}
+
+/** Write pool and miner metrics of all foremen, each family once */
+void foreman_metrics(struct metrics_buffer *buf, void *data)
+{
+  UNUSED(data);
+  size_t n = 0;
+  for (struct foreman *f = foremen; f != NULL; f = f->next) {
+    ++n;
+  }
+  if (n == 0) {
+    return;
+  }
+  struct foreman *list[n];
+  char labels[n][64];
+  const struct foreman_stats *s[n];
+  bool has_pool = false;
+  size_t i = 0;
+  for (struct foreman *f = foremen; f != NULL; f = f->next, ++i) {
+    list[i] = f;
+    snprintf(labels[i], sizeof(labels[i]), "miner=\"%d\"", f->foreman_id);
+    s[i] = &f->stats;
+    has_pool = has_pool || !f->is_benchmark;
+  }
+
+  if (has_pool) {
+    metrics_family(buf, "dorenom_pool_connected", "gauge",
+                   "1 if connected to the pool");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf, "dorenom_pool_connected{%s} %d\n", labels[i],
+                       connection_is_connected(list[i]->connection) ? 1 : 0);
+      }
+    }
+    metrics_family(buf, "dorenom_pool_logged_in", "gauge",
+                   "1 if logged in to the pool");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf, "dorenom_pool_logged_in{%s} %d\n", labels[i],
+                       s[i]->is_logged_in ? 1 : 0);
+      }
+    }
+    metrics_family(buf, "dorenom_pool_logins_total", "counter",
+                   "Successful pool logins");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf, "dorenom_pool_logins_total{%s} %lu\n", labels[i],
+                       s[i]->logins);
+      }
+    }
+    metrics_family(buf, "dorenom_pool_jobs_total", "counter",
+                   "Jobs received from the pool");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf, "dorenom_pool_jobs_total{%s} %lu\n", labels[i],
+                       s[i]->jobs_received);
+      }
+    }
+    metrics_family(buf, "dorenom_pool_job_age_seconds", "gauge",
+                   "Time since the last job was received");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf, "dorenom_pool_job_age_seconds{%s} %.3f\n",
+                       labels[i],
+                       s[i]->last_job_at > 0
+                           ? (uv_hrtime() - s[i]->last_job_at) / 1e9
+                           : 0.0);
+      }
+    }
+    metrics_family(buf, "dorenom_shares_submitted_total", "counter",
+                   "Shares submitted to the pool");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf, "dorenom_shares_submitted_total{%s} %lu\n",
+                       labels[i], s[i]->shares_submitted);
+      }
+    }
+    metrics_family(buf, "dorenom_shares_accepted_total", "counter",
+                   "Shares accepted by the pool");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf, "dorenom_shares_accepted_total{%s} %lu\n",
+                       labels[i], s[i]->shares_accepted);
+      }
+    }
+    metrics_family(buf, "dorenom_shares_rejected_total", "counter",
+                   "Shares rejected by the pool");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf, "dorenom_shares_rejected_total{%s} %lu\n",
+                       labels[i], s[i]->shares_rejected);
+      }
+    }
+    metrics_family(buf, "dorenom_share_response_seconds", "summary",
+                   "Time from share submit to pool response");
+    for (i = 0; i < n; ++i) {
+      if (!list[i]->is_benchmark) {
+        metrics_printf(buf,
+                       "dorenom_share_response_seconds_sum{%s} %.6f\n"
+                       "dorenom_share_response_seconds_count{%s} %lu\n",
+                       labels[i], s[i]->share_latency_sum / 1e9, labels[i],
+                       s[i]->share_latency_count);
+      }
+    }
+  }
+
+  // miners of one kind write their families together
+  miner_handle miners[n];
+  const char *miner_labels[n];
+  bool is_written[n];
+  memset(is_written, 0, sizeof(is_written));
+  for (i = 0; i < n; ++i) {
+    if (is_written[i] || list[i]->miner->metrics == NULL) {
+      continue;
+    }
+    size_t len = 0;
+    for (size_t j = i; j < n; ++j) {
+      if (list[j]->miner->metrics == list[i]->miner->metrics) {
+        miners[len] = list[j]->miner;
+        miner_labels[len++] = labels[j];
+        is_written[j] = true;
+      }
+    }
+    list[i]->miner->metrics(miners, miner_labels, len, buf);
+  }
+}
+
 void on_foreman_miner_event(const struct miner_event *event, void *data)
 {
   struct foreman *foreman = data;
@@ -28,6 +219,7 @@ void on_foreman_miner_event(const struct miner_event *event, void *data)
   switch (event->event_type) {
   case MINER_EVENT_RESULT_FOUND:
     log_info("Result found!");
+    foreman_stats_share_submitted(&foreman->stats);
     foreman->stratum->submit(foreman->stratum,
                              ((struct miner_event_result_found *)event)->data);
     break;
@@ -53,16 +245,27 @@ void on_foreman_stratum_event(const struct stratum_event *event, void *data)
     break;
   }
   case STRATUM_EVENT_LOGIN_FAILED: {
+    foreman->stats.is_logged_in = false;
     const char *err = ((const struct stratum_event_login_failed *)event)->error;
     log_error("%s: Login failed. Error: %s", foreman->cfg->name, err);
     break;
   }
   case STRATUM_EVENT_LOGIN_SUCCESS: {
     log_debug("%s: Login result event", foreman->cfg->name);
+    foreman->stats.is_logged_in = true;
+    ++foreman->stats.logins;
     break;
   }
+  case STRATUM_EVENT_SHARE_ACCEPTED:
+    foreman_stats_share_response(&foreman->stats, true);
+    break;
+  case STRATUM_EVENT_SHARE_REJECTED:
+    foreman_stats_share_response(&foreman->stats, false);
+    break;
   case STRATUM_EVENT_NEW_JOB: {
     log_debug("%s: New job event", foreman->cfg->name);
+    ++foreman->stats.jobs_received;
+    foreman->stats.last_job_at = uv_hrtime();
     void *job_data = ((struct stratum_event_new_job *)event)->job_data;
     foreman->miner->new_job(foreman->miner, job_data,
                             &foreman->miner_event_handler);
@@ -100,8 +303,10 @@ void on_foreman_connection_event(enum connection_event_type event,
   }
 }
 
-foreman_handle foreman_new(const struct config *cfg, bool is_benchmark)
+foreman_handle foreman_new(const struct config *cfg,
+                           const struct miner_benchmark_opts *benchmark)
 {
+  bool is_benchmark = benchmark != NULL;
   if (is_benchmark) {
     log_info("Benchmark mode: ON");
   } else {
@@ -135,7 +340,11 @@ foreman_handle foreman_new(const struct config *cfg, bool is_benchmark)
 
   struct foreman *foreman = calloc(1, sizeof(struct foreman));
   foreman->is_benchmark = is_benchmark;
+  if (is_benchmark) {
+    foreman->benchmark_opts = *benchmark;
+  }
   foreman->cfg = cfg;
+  foreman->foreman_id = foreman_next_id++;
 
   if (!is_benchmark) {
     foreman->connection = pool_connection;
@@ -150,21 +359,42 @@ foreman_handle foreman_new(const struct config *cfg, bool is_benchmark)
   foreman->miner_event_handler.data = foreman;
   foreman->miner_event_handler.cb = on_foreman_miner_event;
   foreman->miner = miner;
+  if (foremen == NULL) {
+    metrics_register(foreman_metrics, NULL);
+  }
+  struct foreman **tail = &foremen;
+  while (*tail != NULL) {
+    tail = &(*tail)->next;
+  }
+  *tail = foreman;
 
   return foreman;
 }
 
-void foreman_start(foreman_handle foreman)
+bool foreman_start(foreman_handle foreman)
 {
   log_debug("Starting foreman: %s", foreman->cfg->name);
   assert(foreman != NULL);
   if (!foreman->is_benchmark) {
     assert(foreman->connection != NULL);
     connection_start(foreman->connection, &foreman->connection_event_handler);
-  } else {
-    assert(foreman->miner->benchmark);
-    foreman->miner->benchmark(foreman->miner);
+    return true;
   }
+  assert(foreman->miner->benchmark);
+  return foreman->miner->benchmark(foreman->miner, &foreman->benchmark_opts);
+}
+
+struct cJSON *foreman_benchmark_result(foreman_handle foreman)
+{
+  assert(foreman != NULL);
+  if (!foreman->is_benchmark || foreman->miner->benchmark_result == NULL) {
+    return NULL;
+  }
+  cJSON *json = foreman->miner->benchmark_result(foreman->miner);
+  if (json != NULL && foreman->cfg->name[0] != '\0') {
+    cJSON_AddStringToObject(json, "name", foreman->cfg->name);
+  }
+  return json;
 }
 
 void foreman_stop(foreman_handle foreman)
@@ -181,6 +411,15 @@ void foreman_free(foreman_handle *foreman_ptr)
 {
   assert(*foreman_ptr != NULL);
   struct foreman *foreman = *foreman_ptr;
+  for (struct foreman **p = &foremen; *p != NULL; p = &(*p)->next) {
+    if (*p == foreman) {
+      *p = foreman->next;
+      break;
+    }
+  }
+  if (foremen == NULL) {
+    metrics_unregister(foreman_metrics, NULL);
+  }
   if (foreman->connection != NULL) {
     connection_free(&foreman->connection);
   }
@@ -1,19 +1,25 @@
 #pragma once
 
 #include "config.h"
+#include "miner.h"
 #include <stdbool.h>
 
 struct foreman;
 
 typedef struct foreman *foreman_handle;
 
-foreman_handle foreman_new(const struct config *cfg, bool benchmark_mode);
+/** `benchmark` is NULL unless running in benchmark mode */
+foreman_handle foreman_new(const struct config *cfg,
+                           const struct miner_benchmark_opts *benchmark);
 
 /** free resource and reset handle to NULL*/
 void foreman_free(foreman_handle *foreman);
 
-/** start foreman */
-void foreman_start(foreman_handle foreman);
+/** start foreman, return false if failed */
+bool foreman_start(foreman_handle foreman);
+
+/** benchmark results, NULL if not in benchmark mode. Caller owns json */
+struct cJSON *foreman_benchmark_result(foreman_handle foreman);
 
 /** stop foreman */
 void foreman_stop(foreman_handle foreman);
@@ -2,7 +2,14 @@
 
 #include "console.h"
 
-#define log_error(...) console_log(ERROR, __FILE__, __VA_ARGS__)
-#define log_warn(...) console_log(WARN, __FILE__, __VA_ARGS__)
-#define log_info(...) console_log(INFO, __FILE__, __VA_ARGS__)
-#define log_debug(...) console_log(DEBUG, __FILE__, __VA_ARGS__)
+#define LOG_AT(level, ...)                                                     \
+  do {                                                                         \
+    if (console_is_enabled(level)) {                                           \
+      console_log(level, __FILE__, __VA_ARGS__);                               \
+    }                                                                          \
+  } while (0)
+
+#define log_error(...) LOG_AT(ERROR, __VA_ARGS__)
+#define log_warn(...) LOG_AT(WARN, __VA_ARGS__)
+#define log_info(...) LOG_AT(INFO, __VA_ARGS__)
+#define log_debug(...) LOG_AT(DEBUG, __VA_ARGS__)
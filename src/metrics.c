@@ -0,0 +1,264 @@
+#include "metrics.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+
+#include "logging.h"
+#include "utils/unused.h"
+
+#define METRICS_MAX_COLLECTORS 16
+#define METRICS_INITIAL_CAPACITY (16 * 1024)
+#define HTTP_MAX_REQUEST_SIZE 4096
+
+struct metrics_collector {
+  metrics_collect_cb cb;
+  void *data;
+};
+
+static struct metrics_collector collectors[METRICS_MAX_COLLECTORS];
+static size_t collectors_len = 0;
+
+struct http_client {
+  uv_tcp_t socket;
+  char request[HTTP_MAX_REQUEST_SIZE];
+  size_t request_len;
+  bool is_responded;
+};
+
+typedef struct {
+  uv_write_t req;
+  uv_buf_t buf;
+} write_req_t;
+
+static uv_tcp_t *metrics_server = NULL;
+
+bool metrics_printf(struct metrics_buffer *buf, const char *fmt, ...)
+{
+  for (;;) {
+    size_t available = buf->capacity - buf->len;
+    va_list vargs;
+    va_start(vargs, fmt);
+    int len = vsnprintf(buf->data + buf->len, available, fmt, vargs);
+    va_end(vargs);
+    if (len < 0) {
+      return false;
+    }
+    if ((size_t)len < available) {
+      buf->len += (size_t)len;
+      return true;
+    }
+    size_t capacity = buf->capacity > 0 ? buf->capacity * 2
+                                        : METRICS_INITIAL_CAPACITY;
+    while (capacity - buf->len <= (size_t)len) {
+      capacity *= 2;
+    }
+    char *data = realloc(buf->data, capacity);
+    if (data == NULL) {
+      log_error("Metrics buffer allocation failed");
+      return false;
+    }
+    buf->data = data;
+    buf->capacity = capacity;
+  }
+}
+
+void metrics_family(struct metrics_buffer *buf, const char *name,
+                    const char *type, const char *help)
+{
+  for (size_t i = 0; i < buf->families_len; ++i) {
+    if (strcmp(buf->families[i], name) == 0) {
+      return;
+    }
+  }
+  if (buf->families_len < METRICS_MAX_FAMILIES) {
+    buf->families[buf->families_len++] = name;
+  }
+  metrics_printf(buf, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_register(metrics_collect_cb cb, void *data)
+{
+  if (collectors_len == METRICS_MAX_COLLECTORS) {
+    log_error("Too many metrics collectors");
+    return;
+  }
+  collectors[collectors_len++] =
+      (struct metrics_collector){.cb = cb, .data = data};
+}
+
+void metrics_unregister(metrics_collect_cb cb, void *data)
+{
+  for (size_t i = 0; i < collectors_len; ++i) {
+    if (collectors[i].cb == cb && collectors[i].data == data) {
+      memmove(&collectors[i], &collectors[i + 1],
+              (collectors_len - i - 1) * sizeof(struct metrics_collector));
+      --collectors_len;
+      return;
+    }
+  }
+}
+
+void metrics_collect(struct metrics_buffer *buf)
+{
+  memset(buf, 0, sizeof(struct metrics_buffer));
+  metrics_printf(buf, "%s", "");
+  for (size_t i = 0; i < collectors_len; ++i) {
+    collectors[i].cb(buf, collectors[i].data);
+  }
+}
+
+/* ============         HTTP            ============== */
+void on_http_client_close(uv_handle_t *handle) { free(handle->data); }
+
+void on_http_write(uv_write_t *req, int status)
+{
+  if (status < 0) {
+    log_warn("Metrics: write error: %s", uv_strerror(status));
+  }
+  write_req_t *wr = (write_req_t *)req;
+  struct http_client *client = req->handle->data;
+  free(wr->buf.base);
+  free(wr);
+  if (!uv_is_closing((uv_handle_t *)&client->socket)) {
+    uv_close((uv_handle_t *)&client->socket, on_http_client_close);
+  }
+}
+
+void http_respond(struct http_client *client, const char *status,
+                  const char *body, size_t body_len)
+{
+  static const char *header = "HTTP/1.1 %s\r\n"
+                              "Content-Type: text/plain; version=0.0.4\r\n"
+                              "Content-Length: %lu\r\n"
+                              "Connection: close\r\n\r\n";
+  int header_len = snprintf(NULL, 0, header, status, body_len);
+  write_req_t *req = calloc(1, sizeof(write_req_t));
+  char *data = malloc((size_t)header_len + body_len + 1);
+  snprintf(data, (size_t)header_len + 1, header, status, body_len);
+  memcpy(data + header_len, body, body_len);
+  req->buf = uv_buf_init(data, (unsigned int)(header_len + body_len));
+  client->is_responded = true;
+  uv_read_stop((uv_stream_t *)&client->socket);
+  int err = uv_write(&req->req, (uv_stream_t *)&client->socket, &req->buf, 1,
+                     on_http_write);
+  if (err < 0) {
+    log_warn("Metrics: write error: %s", uv_strerror(err));
+    free(data);
+    free(req);
+    uv_close((uv_handle_t *)&client->socket, on_http_client_close);
+  }
+}
+
+void http_handle_request(struct http_client *client)
+{
+  if (strncmp(client->request, "GET ", 4) != 0) {
+    static const char body[] = "Method not allowed\n";
+    http_respond(client, "405 Method Not Allowed", body, sizeof(body) - 1);
+    return;
+  }
+  const char *path = client->request + 4;
+  size_t path_len = strcspn(path, " ?\r\n");
+  if ((path_len == 8 && strncmp(path, "/metrics", 8) == 0) ||
+      (path_len == 1 && path[0] == '/')) {
+    struct metrics_buffer buf;
+    metrics_collect(&buf);
+    http_respond(client, "200 OK", buf.data, buf.len);
+    free(buf.data);
+  } else {
+    static const char body[] = "Not found\n";
+    http_respond(client, "404 Not Found", body, sizeof(body) - 1);
+  }
+}
+
+void on_http_alloc(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+  UNUSED(suggested_size);
+  struct http_client *client = handle->data;
+  // leave space for terminating zero
+  *buf = uv_buf_init(client->request + client->request_len,
+                     HTTP_MAX_REQUEST_SIZE - client->request_len - 1);
+}
+
+void on_http_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+  UNUSED(buf);
+  struct http_client *client = stream->data;
+  if (nread < 0) {
+    if (!uv_is_closing((uv_handle_t *)stream)) {
+      uv_close((uv_handle_t *)stream, on_http_client_close);
+    }
+    return;
+  }
+  if (client->is_responded) {
+    return;
+  }
+  client->request_len += (size_t)nread;
+  client->request[client->request_len] = '\0';
+  if (strstr(client->request, "\r\n\r\n") != NULL ||
+      strstr(client->request, "\n\n") != NULL) {
+    http_handle_request(client);
+  } else if (client->request_len >= HTTP_MAX_REQUEST_SIZE - 1) {
+    static const char body[] = "Request too large\n";
+    http_respond(client, "413 Payload Too Large", body, sizeof(body) - 1);
+  }
+}
+
+void on_http_connection(uv_stream_t *server, int status)
+{
+  if (status < 0) {
+    log_warn("Metrics: connection error: %s", uv_strerror(status));
+    return;
+  }
+  struct http_client *client = calloc(1, sizeof(struct http_client));
+  uv_tcp_init(server->loop, &client->socket);
+  client->socket.data = client;
+  if (uv_accept(server, (uv_stream_t *)&client->socket) != 0) {
+    uv_close((uv_handle_t *)&client->socket, on_http_client_close);
+    return;
+  }
+  uv_read_start((uv_stream_t *)&client->socket, on_http_alloc, on_http_read);
+}
+
+void on_metrics_server_close(uv_handle_t *handle) { free(handle); }
+
+bool metrics_server_start(const char *host, int port)
+{
+  assert(metrics_server == NULL);
+  struct sockaddr_in addr;
+  int err = uv_ip4_addr(host, port, &addr);
+  if (err < 0) {
+    log_error("Metrics: invalid address %s:%d: %s", host, port,
+              uv_strerror(err));
+    return false;
+  }
+  uv_tcp_t *server = calloc(1, sizeof(uv_tcp_t));
+  uv_tcp_init(uv_default_loop(), server);
+  err = uv_tcp_bind(server, (const struct sockaddr *)&addr, 0);
+  if (err == 0) {
+    err = uv_listen((uv_stream_t *)server, 16, on_http_connection);
+  }
+  if (err < 0) {
+    log_error("Metrics: unable to listen on %s:%d: %s", host, port,
+              uv_strerror(err));
+    uv_close((uv_handle_t *)server, on_metrics_server_close);
+    return false;
+  }
+  log_info("Metrics available at http://%s:%d/metrics", host, port);
+  metrics_server = server;
+  return true;
+}
+
+void metrics_server_stop()
+{
+  if (metrics_server == NULL) {
+    return;
+  }
+  if (!uv_is_closing((uv_handle_t *)metrics_server)) {
+    uv_close((uv_handle_t *)metrics_server, on_metrics_server_close);
+  }
+  metrics_server = NULL;
+}
@@ -0,0 +1,45 @@
+/* metrics.h -- metrics exposition in prometheus text format
+ *
+ * Components register collectors, collectors are called on every scrape of
+ * local http endpoint served from the default uv loop.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define METRICS_MAX_FAMILIES 64
+
+/** Growing text buffer for one scrape */
+struct metrics_buffer {
+  char *data;
+  size_t len;
+  size_t capacity;
+
+  /** metric families with HELP/TYPE already written */
+  const char *families[METRICS_MAX_FAMILIES];
+  size_t families_len;
+};
+
+/** Append formatted text, return false on allocation failure */
+bool metrics_printf(struct metrics_buffer *, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/** Write HELP and TYPE lines once per scrape.
+ *  `name` must be a string literal */
+void metrics_family(struct metrics_buffer *, const char *name,
+                    const char *type, const char *help);
+
+typedef void (*metrics_collect_cb)(struct metrics_buffer *, void *data);
+
+void metrics_register(metrics_collect_cb cb, void *data);
+
+void metrics_unregister(metrics_collect_cb cb, void *data);
+
+/** Collect all registered metrics into buffer, caller frees buf->data */
+void metrics_collect(struct metrics_buffer *buf);
+
+/** Start http listener on default loop, serving GET /metrics */
+bool metrics_server_start(const char *host, int port);
+
+void metrics_server_stop();
@@ -26,11 +26,29 @@ struct miner_event_handler {
 
 typedef struct miner *miner_handle;
 
+struct metrics_buffer;
+struct cJSON;
+
+/** Benchmark run parameters */
+struct miner_benchmark_opts {
+  unsigned int seed; // seed for random job and starting nonce
+  const char *blob;  // hex encoded job blob, random if NULL
+  int warmup_sec;    // not included in results
+  int duration_sec;  // 0: run until interrupted
+};
+
 struct miner {
   void (*new_job)(miner_handle, void *job_data,
                   struct miner_event_handler *event_handler);
   void (*free)(miner_handle *);
-  void (*benchmark)(miner_handle);
+  /** start benchmark, return false if it can't be started */
+  bool (*benchmark)(miner_handle, const struct miner_benchmark_opts *);
+  /** benchmark results since warm-up, caller owns returned json */
+  struct cJSON *(*benchmark_result)(miner_handle);
+  /** write metrics of `len` miners sharing this callback, each family once,
+   *  `labels[i]` are added to every sample of `miners[i]` */
+  void (*metrics)(miner_handle *miners, const char *const *labels, size_t len,
+                  struct metrics_buffer *);
 };
 
 miner_handle miner_new(const struct config *cfg);
@@ -0,0 +1,238 @@
+/* gpu-tests.c -- GPU solvers against CPU hashes
+ *
+ * Solvers hash a few batches with target UINT64_MAX, so every hash is
+ * reported, and each one is compared with cryptonight_aesni. Any device
+ * works, CPU drivers such as mesa lavapipe or PoCL are enough. A backend
+ * without devices is skipped.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "crypto/cryptonight/cryptonight.h"
+#include "crypto/cryptonight_spv.h"
+#include "monero/monero.h"
+#include "monero/monero_finalizer.h"
+#include "monero/monero_solver.h"
+#include "utils/hex.h"
+#include "utils/opencl_inc.h"
+#include "utils/unused.h"
+
+/** hashes per batch, small enough for CPU drivers */
+#define BATCH_SIZE 16
+/** batches per run, more than in flight so process completes some */
+#define BATCHES 3
+#define NONCES (BATCH_SIZE * BATCHES)
+
+/** monero v7 block blob */
+static const char INPUT_HEX[] =
+    "0606ebba9cd005f688598a3ad7ae62d6e150005ded336138b26417772375b1bd5d"
+    "3c0bc480eeb000000005f3c91e30aab34cbacb1bbb3eecb8b4dfd5e799aa4407b8"
+    "a0ea4ee397707bc51017";
+
+/** CPU hashes of nonces 0..NONCES - 1 */
+struct reference {
+  uint8_t input[MONERO_INPUT_HASH_LEN];
+  size_t input_len;
+  uint8_t hashes[NONCES][MONERO_OUTPUT_HASH_LEN];
+  /** final hash function, state[0] & 3 */
+  int selectors[NONCES];
+};
+
+static void reference_init(struct reference *ref)
+{
+  ref->input_len =
+      hex_to_binary(INPUT_HEX, sizeof(INPUT_HEX) - 1, ref->input);
+  uint8_t input[MONERO_INPUT_HASH_LEN];
+  memcpy(input, ref->input, ref->input_len);
+  struct cryptonight_ctx *ctx = cryptonight_ctx_new();
+  struct cryptonight_hash hash;
+  for (uint32_t nonce = 0; nonce < NONCES; ++nonce) {
+    memcpy(&input[MONERO_NONCE_POSITION], &nonce, sizeof(nonce));
+    cryptonight_aesni(input, ref->input_len, &hash, ctx);
+    memcpy(ref->hashes[nonce], hash.data, MONERO_OUTPUT_HASH_LEN);
+    ref->selectors[nonce] = cryptonight_ctx_state(ctx)[0] & 3;
+  }
+  cryptonight_ctx_free(&ctx);
+}
+
+/** Check reported solutions, mark their nonces in `seen` */
+static int check_solutions(const char *name, const struct reference *ref,
+                           const uint8_t *hashes, const uint32_t *nonces,
+                           size_t num, uint32_t nonce_end, bool *seen)
+{
+  int failures = 0;
+  for (size_t i = 0; i < num; ++i) {
+    uint32_t nonce = nonces[i];
+    if (nonce >= nonce_end || seen[nonce]) {
+      printf(" - FAIL: %s: unexpected nonce %u\n", name, nonce);
+      ++failures;
+      continue;
+    }
+    seen[nonce] = true;
+    if (memcmp(ref->hashes[nonce], hashes + i * MONERO_OUTPUT_HASH_LEN,
+               MONERO_OUTPUT_HASH_LEN) != 0) {
+      printf(" - FAIL: %s: nonce %u, final hash %d\n", name, nonce,
+             ref->selectors[nonce]);
+      ++failures;
+    }
+  }
+  return failures;
+}
+
+/** Hash BATCHES batches with set_job, process and flush, compare with CPU */
+static int check_solver(const char *name, struct monero_solver *solver,
+                        const struct reference *ref)
+{
+  uint8_t hashes[MONERO_OUTPUT_HASH_LEN * MONERO_SOLVER_MAX_SOLUTIONS];
+  uint32_t nonces[MONERO_SOLVER_MAX_SOLUTIONS];
+  size_t num = 0;
+  bool seen[NONCES] = {false};
+  if (!solver->set_job(solver, ref->input, ref->input_len, UINT64_MAX, hashes,
+                       nonces, &num)) {
+    printf(" - FAIL: %s: set_job\n", name);
+    return 1;
+  }
+  int failures = 0;
+  uint32_t nonce = 0;
+  for (int b = 0; b < BATCHES; ++b) {
+    int n = solver->process(solver, nonce);
+    if (n < 0 || nonce + (uint32_t)n > NONCES) {
+      printf(" - FAIL: %s: process returned %d\n", name, n);
+      return failures + 1;
+    }
+    nonce += (uint32_t)n;
+    failures += check_solutions(name, ref, hashes, nonces, num, nonce, seen);
+  }
+  if (solver->flush != NULL) {
+    if (solver->flush(solver) < 0) {
+      printf(" - FAIL: %s: flush\n", name);
+      return failures + 1;
+    }
+    failures += check_solutions(name, ref, hashes, nonces, num, nonce, seen);
+  }
+
+  int selectors = 0;
+  for (uint32_t i = 0; i < nonce; ++i) {
+    if (!seen[i]) {
+      printf(" - FAIL: %s: nonce %u not reported\n", name, i);
+      ++failures;
+    }
+    selectors |= 1 << ref->selectors[i];
+  }
+  if (selectors != 0xF) {
+    printf(" - FAIL: %s: %u hashes do not use all final hashes\n", name,
+           nonce);
+    ++failures;
+  }
+  return failures;
+}
+
+/** Vulkan solver configurations, all with in_flight 2 */
+static const struct {
+  int queues;
+  bool fused;
+} VK_CONFIGS[] = {{1, false}, {1, true}, {2, false}, {2, true}};
+
+int test_vk(const struct reference *ref)
+{
+  printf("Testing Vulkan solver\n");
+  if (monero_solver_vk_devices() == 0) {
+    printf(" - SKIP: no Vulkan device\n");
+    return 0;
+  }
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(VK_CONFIGS) / sizeof(VK_CONFIGS[0]); ++i) {
+    struct monero_config_solver_vk cfg = {
+        .solver = {.solver_type = MONERO_CONFIG_SOLVER_VK,
+                   .affine_to_cpu = -1},
+        .device_id = 0,
+        .parallelism = BATCH_SIZE,
+        .fused = VK_CONFIGS[i].fused,
+        .in_flight = 2,
+        .queues = VK_CONFIGS[i].queues,
+        .worksize = CRYPTONIGHT_SPV_LOCAL_WG_SIZE,
+        .iterations = CRYPTONIGHT_SPV_ITERATIONS,
+        .memory = CRYPTONIGHT_SPV_MEMORY << 4,
+        .mask = CRYPTONIGHT_SPV_MASK};
+    char name[64];
+    snprintf(name, sizeof(name), "vk, %d queues, %s", cfg.queues,
+             cfg.fused ? "fused" : "unfused");
+    struct monero_solver *solver = monero_solver_new_vk(&cfg, NULL);
+    if (solver == NULL) {
+      printf(" - FAIL: %s: solver not created\n", name);
+      ++failures;
+      continue;
+    }
+    failures += check_solver(name, solver, ref);
+    monero_solver_free(solver);
+  }
+  if (failures == 0) {
+    printf(" + PASS\n");
+  }
+  return failures;
+}
+
+/** OpenCL solver builds the embedded kernel, hashes are finished by
+ *  cn_final or, with cpu_final, by the finalizer pool */
+int test_cl(const struct reference *ref)
+{
+  printf("Testing OpenCL solver\n");
+  cl_uint platforms = 0;
+  if (clGetPlatformIDs(0, NULL, &platforms) != CL_SUCCESS || platforms == 0) {
+    printf(" - SKIP: no OpenCL platform\n");
+    return 0;
+  }
+  struct monero_finalizer *finalizer = monero_finalizer_new(1);
+  if (finalizer == NULL) {
+    printf(" - FAIL: finalizer not created\n");
+    return 1;
+  }
+  int failures = 0;
+  for (int cpu_final = 0; cpu_final <= 1; ++cpu_final) {
+    struct monero_config_solver_cl cfg = {
+        .solver = {.solver_type = MONERO_CONFIG_SOLVER_CL,
+                   .affine_to_cpu = -1},
+        .platform_id = 0,
+        .device_id = 0,
+        .intensity = BATCH_SIZE,
+        .worksize = 8,
+        .in_flight = 2,
+        .cpu_final = cpu_final};
+    const char *name = cpu_final ? "cl, cpu_final" : "cl, cn_final";
+    struct monero_solver *solver =
+        monero_solver_new_cl(&cfg, cpu_final ? finalizer : NULL, NULL);
+    if (solver == NULL) {
+      printf(" - FAIL: %s: solver not created\n", name);
+      ++failures;
+      continue;
+    }
+    failures += check_solver(name, solver, ref);
+    monero_solver_free(solver);
+  }
+  monero_finalizer_free(finalizer);
+  if (failures == 0) {
+    printf(" + PASS\n");
+  }
+  return failures;
+}
+
+int main(int argc, char **argv)
+{
+  UNUSED(argc);
+  UNUSED(argv);
+
+  static struct reference ref;
+  reference_init(&ref);
+
+  int failures = 0;
+  failures += test_vk(&ref);
+  failures += test_cl(&ref);
+  if (failures > 0) {
+    printf("FAILURE: Tests failed: %d\n", failures);
+  } else {
+    printf("SUCCESS: All test passed\n");
+  }
+  return failures;
+}
@@ -0,0 +1,942 @@
+/* mock-pool.c -- mock monero stratum pool for load and integration testing
+ *
+ * Issues jobs at configurable rate and difficulty, verifies submitted shares
+ * with cryptonight_aesni and injects faults: disconnects, split and coalesced
+ * frames, malformed json.
+ */
+#include <assert.h>
+#include <getopt.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <uv.h>
+
+#include "cJSON/cJSON.h"
+
+#include "crypto/cryptonight/cryptonight.h"
+#include "logging.h"
+#include "monero/monero.h"
+#include "utils/hex.h"
+#include "utils/unused.h"
+
+#define MOCK_POOL_READ_BUFFER_SIZE (64 * 1024)
+#define MOCK_POOL_BLOB_LEN 76
+#define MOCK_POOL_JOB_HISTORY 4
+#define MOCK_POOL_MAX_NONCES_PER_JOB 256
+#define MOCK_POOL_SPLIT_DELAY_MILLISEC 50
+
+struct mock_pool_opts {
+  const char *host;
+  int port;
+  uint64_t difficulty;
+  uint64_t job_interval_ms;
+  uint64_t duration_sec;
+  uint64_t stats_interval_sec;
+  unsigned int seed;
+  bool no_verify;
+  /** fault injection, 0 - disabled */
+  uint64_t disconnect_every; // close connection instead of every N-th job
+  uint64_t split_every;      // split every N-th message into two tcp writes
+  uint64_t coalesce_every;   // send every N-th job glued with another one
+  uint64_t malformed_every;  // send malformed json before every N-th message
+};
+
+struct mock_pool_stats {
+  uint64_t connections;
+  uint64_t jobs_issued;
+  uint64_t shares_submitted;
+  uint64_t shares_accepted;
+  uint64_t rejected_stale;
+  uint64_t rejected_duplicate;
+  uint64_t rejected_bad_hash;
+  uint64_t rejected_low_diff;
+  uint64_t rejected_internal; // share could not be verified
+  uint64_t invalid_requests;
+  uint64_t disconnects_injected;
+  uint64_t frames_split;
+  uint64_t frames_coalesced;
+  uint64_t frames_malformed;
+  /** job-to-share latency, nanoseconds */
+  uint64_t latency_samples;
+  uint64_t latency_total;
+  uint64_t latency_min;
+  uint64_t latency_max;
+};
+
+struct mock_job {
+  char job_id[17];
+  uint8_t blob[MONERO_INPUT_HASH_LEN];
+  size_t blob_len;
+  uint64_t target;
+  uint64_t issued_at; // uv_hrtime()
+  uint32_t nonces[MOCK_POOL_MAX_NONCES_PER_JOB];
+  size_t nonces_len;
+};
+
+struct mock_client {
+  uv_tcp_t socket;
+  struct mock_client *prev, *next;
+  uint64_t client_id;
+  bool is_logged_in;
+  bool is_closing;
+  bool is_closed;
+  /** async operations holding the client, it is freed when 0 and closed */
+  size_t refcount;
+
+  char read_buf[MOCK_POOL_READ_BUFFER_SIZE];
+  size_t read_len;
+
+  /** last issued jobs, the most recent is at `jobs_head` */
+  struct mock_job jobs[MOCK_POOL_JOB_HISTORY];
+  size_t jobs_head;
+  size_t jobs_len;
+};
+
+struct mock_pool {
+  struct mock_pool_opts opts;
+  struct mock_pool_stats stats;
+  uv_tcp_t server;
+  uv_timer_t job_timer;
+  uv_timer_t stats_timer;
+  uv_timer_t duration_timer;
+  uv_signal_t sigint;
+  struct mock_client *clients;
+  /** tails of split messages waiting for their timer */
+  struct split_write_req *split_writes;
+  uint64_t next_client_id;
+  uint64_t next_job_id;
+  uint64_t messages_sent;
+};
+
+typedef struct {
+  uv_write_t req;
+  uv_buf_t buf;
+} write_req_t;
+
+struct split_write_req {
+  uv_timer_t timer;
+  struct split_write_req *prev, *next;
+  struct mock_pool *pool;
+  struct mock_client *client;
+  uv_buf_t buf;
+};
+
+struct verify_req {
+  uv_work_t req;
+  struct mock_pool *pool;
+  struct mock_client *client;
+  cJSON *id_json;
+  uint64_t received_at;
+  uint64_t job_issued_at;
+  uint64_t target;
+  uint8_t blob[MONERO_INPUT_HASH_LEN];
+  size_t blob_len;
+  uint8_t result[MONERO_OUTPUT_HASH_LEN];
+  struct cryptonight_hash hash;
+  bool is_hashed;
+};
+
+static struct mock_pool mock_pool;
+
+/** one cryptonight context per threadpool worker */
+static _Thread_local struct cryptonight_ctx *verify_ctx;
+
+/* ============         Options         ============== */
+void mock_pool_print_usage(const char *name)
+{
+  fprintf(stdout,
+          "Usage: %s [options]\n"
+          "  --host <addr>            listen address, default: 127.0.0.1\n"
+          "  --port <port>            listen port, default: 3333\n"
+          "  --difficulty <n>         share difficulty, default: 1000\n"
+          "  --job-interval <ms>      new job interval, default: 30000\n"
+          "  --duration <sec>         stop after given time, default: never\n"
+          "  --stats-interval <sec>   report interval, default: 10\n"
+          "  --seed <n>               random seed for job blobs\n"
+          "  --no-verify              accept shares without verification\n"
+          "  --disconnect-every <n>   drop connection instead of n-th job\n"
+          "  --split-every <n>        split n-th message into two writes\n"
+          "  --coalesce-every <n>     send n-th job in one write with another\n"
+          "  --malformed-every <n>    send malformed json before n-th message\n",
+          name);
+}
+
+void mock_pool_parse_opts(int argc, char **argv, struct mock_pool_opts *opts)
+{
+  static struct option long_opts[] = {
+      {"help", no_argument, NULL, 'h'},
+      {"host", required_argument, NULL, 'H'},
+      {"port", required_argument, NULL, 'p'},
+      {"difficulty", required_argument, NULL, 'd'},
+      {"job-interval", required_argument, NULL, 'j'},
+      {"duration", required_argument, NULL, 't'},
+      {"stats-interval", required_argument, NULL, 'i'},
+      {"seed", required_argument, NULL, 's'},
+      {"no-verify", no_argument, NULL, 'n'},
+      {"disconnect-every", required_argument, NULL, 'D'},
+      {"split-every", required_argument, NULL, 'S'},
+      {"coalesce-every", required_argument, NULL, 'C'},
+      {"malformed-every", required_argument, NULL, 'M'},
+      {NULL, 0, NULL, 0}};
+
+  opts->host = "127.0.0.1";
+  opts->port = 3333;
+  opts->difficulty = 1000;
+  opts->job_interval_ms = 30000;
+  opts->stats_interval_sec = 10;
+  opts->seed = (unsigned int)time(NULL);
+
+  int c;
+  while ((c = getopt_long(argc, argv, "h", long_opts, NULL)) != -1) {
+    switch (c) {
+    case 'H':
+      opts->host = optarg;
+      break;
+    case 'p':
+      opts->port = atoi(optarg);
+      break;
+    case 'd':
+      opts->difficulty = strtoull(optarg, NULL, 10);
+      break;
+    case 'j':
+      opts->job_interval_ms = strtoull(optarg, NULL, 10);
+      break;
+    case 't':
+      opts->duration_sec = strtoull(optarg, NULL, 10);
+      break;
+    case 'i':
+      opts->stats_interval_sec = strtoull(optarg, NULL, 10);
+      break;
+    case 's':
+      opts->seed = (unsigned int)strtoul(optarg, NULL, 10);
+      break;
+    case 'n':
+      opts->no_verify = true;
+      break;
+    case 'D':
+      opts->disconnect_every = strtoull(optarg, NULL, 10);
+      break;
+    case 'S':
+      opts->split_every = strtoull(optarg, NULL, 10);
+      break;
+    case 'C':
+      opts->coalesce_every = strtoull(optarg, NULL, 10);
+      break;
+    case 'M':
+      opts->malformed_every = strtoull(optarg, NULL, 10);
+      break;
+    case 'h':
+      mock_pool_print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    default:
+      fprintf(stderr, "Try `%s --help' for more information.\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (opts->difficulty == 0 || opts->job_interval_ms == 0 ||
+      opts->stats_interval_sec == 0) {
+    fprintf(stderr, "Difficulty and intervals must be greater than zero.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* ============          Stats          ============== */
+static inline bool every_nth(uint64_t n, uint64_t counter)
+{
+  return n > 0 && counter % n == 0;
+}
+
+static inline uint64_t
+mock_pool_stats_rejected(const struct mock_pool_stats *s)
+{
+  return s->rejected_stale + s->rejected_duplicate + s->rejected_bad_hash +
+         s->rejected_low_diff + s->rejected_internal;
+}
+
+void mock_pool_print_stats(const struct mock_pool_stats *s)
+{
+  uint64_t rejected = mock_pool_stats_rejected(s);
+  // being verified, or dropped with their connection before the response
+  uint64_t unanswered = s->shares_submitted - s->shares_accepted - rejected;
+  double accept_rate = s->shares_submitted > 0
+                           ? 100.0 * s->shares_accepted / s->shares_submitted
+                           : 0.0;
+  uint64_t latency_avg =
+      s->latency_samples > 0 ? s->latency_total / s->latency_samples : 0;
+  log_info("Connections: %lu, jobs: %lu, shares: %lu, accepted: %lu (%.2f%%), "
+           "rejected: %lu [stale: %lu, duplicate: %lu, bad hash: %lu, "
+           "low diff: %lu, internal: %lu], unanswered: %lu, "
+           "invalid requests: %lu",
+           s->connections, s->jobs_issued, s->shares_submitted,
+           s->shares_accepted, accept_rate, rejected, s->rejected_stale,
+           s->rejected_duplicate, s->rejected_bad_hash, s->rejected_low_diff,
+           s->rejected_internal, unanswered, s->invalid_requests);
+  log_info("Job-to-share latency ms min:avg:max %.3f:%.3f:%.3f",
+           s->latency_min / 1e6, latency_avg / 1e6, s->latency_max / 1e6);
+  log_info("Faults injected: disconnects: %lu, split: %lu, coalesced: %lu, "
+           "malformed: %lu",
+           s->disconnects_injected, s->frames_split, s->frames_coalesced,
+           s->frames_malformed);
+}
+
+static inline void mock_pool_stats_add_latency(struct mock_pool_stats *s,
+                                               uint64_t latency)
+{
+  ++s->latency_samples;
+  s->latency_total += latency;
+  if (s->latency_min == 0 || latency < s->latency_min) {
+    s->latency_min = latency;
+  }
+  if (latency > s->latency_max) {
+    s->latency_max = latency;
+  }
+}
+
+/* ============          Jobs           ============== */
+static inline uint64_t difficulty_to_target(uint64_t d)
+{
+  return d > 0 ? 0xffffffffffffffff / d : 0xffffffffffffffff;
+}
+
+struct mock_job *mock_client_new_job(struct mock_pool *pool,
+                                     struct mock_client *client)
+{
+  client->jobs_head = (client->jobs_head + 1) % MOCK_POOL_JOB_HISTORY;
+  if (client->jobs_len < MOCK_POOL_JOB_HISTORY) {
+    ++client->jobs_len;
+  }
+  struct mock_job *job = &client->jobs[client->jobs_head];
+  memset(job, 0, sizeof(struct mock_job));
+
+  snprintf(job->job_id, sizeof(job->job_id), "%016lx", pool->next_job_id++);
+  job->blob_len = MOCK_POOL_BLOB_LEN;
+  for (size_t i = 0; i < job->blob_len; ++i) {
+    job->blob[i] = (uint8_t)rand();
+  }
+  job->target = difficulty_to_target(pool->opts.difficulty);
+  job->issued_at = uv_hrtime();
+  ++pool->stats.jobs_issued;
+  return job;
+}
+
+struct mock_job *mock_client_find_job(struct mock_client *client,
+                                      const char *job_id)
+{
+  for (size_t i = 0; i < client->jobs_len; ++i) {
+    struct mock_job *job = &client->jobs[i];
+    if (strcmp(job->job_id, job_id) == 0) {
+      return job;
+    }
+  }
+  return NULL;
+}
+
+/** Format job as json object, caller is responsible for freeing the result */
+cJSON *mock_job_to_json(const struct mock_job *job)
+{
+  char blob[MONERO_INPUT_HASH_LEN * 2 + 1] = {0};
+  char target[17] = {0};
+  hex_from_binary(job->blob, job->blob_len, blob);
+  // 64bit LE integer encoded in hex
+  hex_from_binary(&job->target, sizeof(job->target), target);
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "blob", blob);
+  cJSON_AddStringToObject(json, "job_id", job->job_id);
+  cJSON_AddStringToObject(json, "target", target);
+  return json;
+}
+
+/* ============         Writing         ============== */
+/** release client reference held by async operation */
+void mock_client_release(struct mock_client *client)
+{
+  assert(client->refcount > 0);
+  --client->refcount;
+  if (client->is_closed && client->refcount == 0) {
+    free(client);
+  }
+}
+
+void on_mock_write(uv_write_t *req, int status)
+{
+  if (status < 0 && status != UV_ECANCELED) {
+    log_error("Error writing to socket: %s", uv_strerror(status));
+  }
+  write_req_t *wr = (write_req_t *)req;
+  free(wr->buf.base);
+  free(wr);
+}
+
+/** write takes ownership of data */
+void mock_client_write_raw(struct mock_client *client, char *data, size_t len)
+{
+  if (client->is_closing) {
+    free(data);
+    return;
+  }
+  write_req_t *req = calloc(1, sizeof(write_req_t));
+  req->buf = uv_buf_init(data, (unsigned int)len);
+  int status = uv_write((uv_write_t *)req, (uv_stream_t *)&client->socket,
+                        &req->buf, 1, on_mock_write);
+  if (status < 0) {
+    log_error("Error when queueing write: %s", uv_strerror(status));
+    free(req->buf.base);
+    free(req);
+  }
+}
+
+void on_split_timer_close(uv_handle_t *handle)
+{
+  struct split_write_req *req = handle->data;
+  if (req->prev != NULL) {
+    req->prev->next = req->next;
+  } else {
+    req->pool->split_writes = req->next;
+  }
+  if (req->next != NULL) {
+    req->next->prev = req->prev;
+  }
+  mock_client_release(req->client);
+  free(req->buf.base);
+  free(req);
+}
+
+void on_split_timer(uv_timer_t *handle)
+{
+  struct split_write_req *req = handle->data;
+  mock_client_write_raw(req->client, req->buf.base, req->buf.len);
+  req->buf.base = NULL;
+  uv_close((uv_handle_t *)&req->timer, on_split_timer_close);
+}
+
+void mock_client_send_line(struct mock_pool *pool, struct mock_client *client,
+                           char *line)
+{
+  ++pool->messages_sent;
+  if (every_nth(pool->opts.malformed_every, pool->messages_sent)) {
+    static const char malformed[] =
+        "{\"jsonrpc\":\"2.0\",\"method\":\"job\",\"params\":{\"blob\":\n";
+    ++pool->stats.frames_malformed;
+    mock_client_write_raw(client, strdup(malformed), sizeof(malformed) - 1);
+  }
+
+  size_t len = strlen(line);
+  if (every_nth(pool->opts.split_every, pool->messages_sent) && len > 1) {
+    ++pool->stats.frames_split;
+    size_t head_len = len / 2;
+    struct split_write_req *req = calloc(1, sizeof(struct split_write_req));
+    req->pool = pool;
+    req->client = client;
+    req->buf.len = len - head_len;
+    req->buf.base = malloc(req->buf.len);
+    memcpy(req->buf.base, line + head_len, req->buf.len);
+    // keep client alive until the tail is written
+    ++client->refcount;
+    req->next = pool->split_writes;
+    if (pool->split_writes != NULL) {
+      pool->split_writes->prev = req;
+    }
+    pool->split_writes = req;
+    uv_timer_init(uv_default_loop(), &req->timer);
+    req->timer.data = req;
+    uv_timer_start(&req->timer, on_split_timer, MOCK_POOL_SPLIT_DELAY_MILLISEC,
+                   0);
+    mock_client_write_raw(client, line, head_len);
+  } else {
+    mock_client_write_raw(client, line, len);
+  }
+}
+
+/** Serialize json followed by newline, caller frees the result */
+char *mock_json_to_line(cJSON *json)
+{
+  char *str = cJSON_PrintUnformatted(json);
+  size_t len = strlen(str);
+  char *line = malloc(len + 2);
+  memcpy(line, str, len);
+  line[len] = '\n';
+  line[len + 1] = '\0';
+  free(str);
+  return line;
+}
+
+void mock_client_send_json(struct mock_pool *pool, struct mock_client *client,
+                           cJSON *json)
+{
+  mock_client_send_line(pool, client, mock_json_to_line(json));
+}
+
+void mock_client_send_response(struct mock_pool *pool,
+                               struct mock_client *client, cJSON *id,
+                               cJSON *result, const char *error)
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddItemToObject(json, "id", id != NULL ? cJSON_Duplicate(id, true)
+                                               : cJSON_CreateNull());
+  cJSON_AddStringToObject(json, "jsonrpc", "2.0");
+  if (error != NULL) {
+    cJSON *error_json = cJSON_CreateObject();
+    cJSON_AddNumberToObject(error_json, "code", -1);
+    cJSON_AddStringToObject(error_json, "message", error);
+    cJSON_AddItemToObject(json, "error", error_json);
+    cJSON_AddNullToObject(json, "result");
+    cJSON_Delete(result);
+  } else {
+    cJSON_AddNullToObject(json, "error");
+    cJSON_AddItemToObject(json, "result", result);
+  }
+  mock_client_send_json(pool, client, json);
+  cJSON_Delete(json);
+}
+
+cJSON *mock_job_notification(const struct mock_job *job)
+{
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "jsonrpc", "2.0");
+  cJSON_AddStringToObject(json, "method", "job");
+  cJSON_AddItemToObject(json, "params", mock_job_to_json(job));
+  return json;
+}
+
+/* ============       Connections       ============== */
+void on_mock_client_close(uv_handle_t *handle)
+{
+  struct mock_client *client = handle->data;
+  client->is_closed = true;
+  if (client->refcount == 0) {
+    free(client);
+  }
+}
+
+void mock_client_close(struct mock_pool *pool, struct mock_client *client)
+{
+  if (client->is_closing) {
+    return;
+  }
+  log_info("Client #%lu: closing connection", client->client_id);
+  client->is_closing = true;
+  // unlink
+  if (client->prev != NULL) {
+    client->prev->next = client->next;
+  } else {
+    pool->clients = client->next;
+  }
+  if (client->next != NULL) {
+    client->next->prev = client->prev;
+  }
+  client->prev = client->next = NULL;
+  uv_close((uv_handle_t *)&client->socket, on_mock_client_close);
+}
+
+void mock_client_send_job(struct mock_pool *pool, struct mock_client *client)
+{
+  if (!client->is_logged_in) {
+    return;
+  }
+  struct mock_job *job = mock_client_new_job(pool, client);
+  if (!every_nth(pool->opts.coalesce_every, pool->stats.jobs_issued)) {
+    cJSON *json = mock_job_notification(job);
+    mock_client_send_json(pool, client, json);
+    cJSON_Delete(json);
+    return;
+  }
+  // glue two jobs in one tcp write, the second one supersedes the first
+  ++pool->stats.frames_coalesced;
+  cJSON *first_json = mock_job_notification(job);
+  char *first = mock_json_to_line(first_json);
+  cJSON_Delete(first_json);
+
+  job = mock_client_new_job(pool, client);
+  cJSON *second_json = mock_job_notification(job);
+  char *second = mock_json_to_line(second_json);
+  cJSON_Delete(second_json);
+
+  size_t first_len = strlen(first), second_len = strlen(second);
+  char *line = malloc(first_len + second_len + 1);
+  memcpy(line, first, first_len);
+  memcpy(line + first_len, second, second_len + 1);
+  free(first);
+  free(second);
+  mock_client_send_line(pool, client, line);
+}
+
+/* ============     Share verification  ============== */
+void mock_pool_verify_work(uv_work_t *req)
+{
+  struct verify_req *v = req->data;
+  if (verify_ctx == NULL) {
+    verify_ctx = cryptonight_ctx_new();
+    if (verify_ctx == NULL) {
+      return;
+    }
+  }
+  cryptonight_aesni(v->blob, v->blob_len, &v->hash, verify_ctx);
+  v->is_hashed = true;
+}
+
+void mock_pool_share_result(struct mock_pool *pool, struct mock_client *client,
+                            cJSON *id, bool is_valid_hash, uint64_t hash_val,
+                            uint64_t target)
+{
+  if (!is_valid_hash) {
+    ++pool->stats.rejected_bad_hash;
+    mock_client_send_response(pool, client, id, NULL, "Invalid hash");
+  } else if (hash_val >= target) {
+    ++pool->stats.rejected_low_diff;
+    mock_client_send_response(pool, client, id, NULL, "Low difficulty share");
+  } else {
+    ++pool->stats.shares_accepted;
+    cJSON *result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "status", "OK");
+    mock_client_send_response(pool, client, id, result, NULL);
+  }
+}
+
+void mock_pool_verify_done(uv_work_t *req, int status)
+{
+  struct verify_req *v = req->data;
+  if (!v->client->is_closing && (status != 0 || !v->is_hashed)) {
+    log_error("Client #%lu: unable to verify share", v->client->client_id);
+    ++v->pool->stats.rejected_internal;
+    mock_client_send_response(v->pool, v->client, v->id_json, NULL,
+                              "Internal error");
+  } else if (!v->client->is_closing) {
+    bool is_valid_hash =
+        memcmp(v->hash.data, v->result, MONERO_OUTPUT_HASH_LEN) == 0;
+    mock_pool_share_result(v->pool, v->client, v->id_json, is_valid_hash,
+                           *(uint64_t *)&v->hash.data[24], v->target);
+  }
+  mock_client_release(v->client);
+  cJSON_Delete(v->id_json);
+  free(v);
+}
+
+/* ============     Request handling    ============== */
+void mock_pool_handle_login(struct mock_pool *pool, struct mock_client *client,
+                            cJSON *id, const cJSON *params)
+{
+  const cJSON *login = cJSON_GetObjectItem(params, "login");
+  if (!cJSON_IsString(login)) {
+    ++pool->stats.invalid_requests;
+    mock_client_send_response(pool, client, id, NULL, "Missing login");
+    return;
+  }
+  log_info("Client #%lu: login: %s", client->client_id, login->valuestring);
+  client->is_logged_in = true;
+
+  char miner_id[32];
+  snprintf(miner_id, sizeof(miner_id), "mock-%lu", client->client_id);
+  struct mock_job *job = mock_client_new_job(pool, client);
+
+  cJSON *result = cJSON_CreateObject();
+  cJSON_AddStringToObject(result, "id", miner_id);
+  cJSON_AddItemToObject(result, "job", mock_job_to_json(job));
+  cJSON_AddStringToObject(result, "status", "OK");
+  mock_client_send_response(pool, client, id, result, NULL);
+}
+
+void mock_pool_handle_submit(struct mock_pool *pool, struct mock_client *client,
+                             cJSON *id, const cJSON *params)
+{
+  uint64_t received_at = uv_hrtime();
+
+  const cJSON *job_id = cJSON_GetObjectItem(params, "job_id");
+  const cJSON *nonce = cJSON_GetObjectItem(params, "nonce");
+  const cJSON *result = cJSON_GetObjectItem(params, "result");
+  uint8_t nonce_bin[4], result_bin[MONERO_OUTPUT_HASH_LEN];
+  if (!cJSON_IsString(job_id) || !cJSON_IsString(nonce) ||
+      !cJSON_IsString(result) || strlen(nonce->valuestring) != 8 ||
+      strlen(result->valuestring) != MONERO_OUTPUT_HASH_LEN * 2 ||
+      hex_to_binary(nonce->valuestring, 8, nonce_bin) != 4 ||
+      hex_to_binary(result->valuestring, MONERO_OUTPUT_HASH_LEN * 2,
+                    result_bin) != MONERO_OUTPUT_HASH_LEN) {
+    ++pool->stats.invalid_requests;
+    mock_client_send_response(pool, client, id, NULL, "Malformed share");
+    return;
+  }
+  ++pool->stats.shares_submitted;
+
+  struct mock_job *job = mock_client_find_job(client, job_id->valuestring);
+  if (job == NULL) {
+    ++pool->stats.rejected_stale;
+    mock_client_send_response(pool, client, id, NULL, "Block expired");
+    return;
+  }
+  mock_pool_stats_add_latency(&pool->stats, received_at - job->issued_at);
+
+  uint32_t nonce_val;
+  memcpy(&nonce_val, nonce_bin, sizeof(nonce_val));
+  for (size_t i = 0; i < job->nonces_len; ++i) {
+    if (job->nonces[i] == nonce_val) {
+      ++pool->stats.rejected_duplicate;
+      mock_client_send_response(pool, client, id, NULL, "Duplicate share");
+      return;
+    }
+  }
+  if (job->nonces_len < MOCK_POOL_MAX_NONCES_PER_JOB) {
+    job->nonces[job->nonces_len++] = nonce_val;
+  }
+
+  if (pool->opts.no_verify) {
+    mock_pool_share_result(pool, client, id, true,
+                           *(uint64_t *)&result_bin[24], job->target);
+    return;
+  }
+
+  struct verify_req *v = calloc(1, sizeof(struct verify_req));
+  v->req.data = v;
+  v->pool = pool;
+  v->client = client;
+  v->id_json = id != NULL ? cJSON_Duplicate(id, true) : NULL;
+  v->received_at = received_at;
+  v->job_issued_at = job->issued_at;
+  v->target = job->target;
+  v->blob_len = job->blob_len;
+  memcpy(v->blob, job->blob, job->blob_len);
+  memcpy(v->blob + MONERO_NONCE_POSITION, nonce_bin, sizeof(nonce_bin));
+  memcpy(v->result, result_bin, MONERO_OUTPUT_HASH_LEN);
+
+  ++client->refcount;
+  int err = uv_queue_work(uv_default_loop(), &v->req, mock_pool_verify_work,
+                          mock_pool_verify_done);
+  if (err < 0) {
+    log_error("Error when queueing share verification: %s", uv_strerror(err));
+    --client->refcount;
+    cJSON_Delete(v->id_json);
+    free(v);
+    ++pool->stats.rejected_internal;
+    mock_client_send_response(pool, client, id, NULL, "Internal error");
+  }
+}
+
+void mock_pool_handle_line(struct mock_pool *pool, struct mock_client *client,
+                           const char *line)
+{
+  cJSON *json = cJSON_Parse(line);
+  if (json == NULL) {
+    log_warn("Client #%lu: invalid json: %s", client->client_id, line);
+    ++pool->stats.invalid_requests;
+    return;
+  }
+  cJSON *id = cJSON_GetObjectItem(json, "id");
+  const cJSON *method = cJSON_GetObjectItem(json, "method");
+  const cJSON *params = cJSON_GetObjectItem(json, "params");
+  if (!cJSON_IsString(method) || !cJSON_IsObject(params)) {
+    ++pool->stats.invalid_requests;
+    mock_client_send_response(pool, client, id, NULL, "Invalid request");
+  } else if (strcmp(method->valuestring, "login") == 0) {
+    mock_pool_handle_login(pool, client, id, params);
+  } else if (!client->is_logged_in) {
+    ++pool->stats.invalid_requests;
+    mock_client_send_response(pool, client, id, NULL, "Unauthenticated");
+  } else if (strcmp(method->valuestring, "submit") == 0) {
+    mock_pool_handle_submit(pool, client, id, params);
+  } else if (strcmp(method->valuestring, "keepalived") == 0) {
+    cJSON *result = cJSON_CreateObject();
+    cJSON_AddStringToObject(result, "status", "KEEPALIVED");
+    mock_client_send_response(pool, client, id, result, NULL);
+  } else {
+    ++pool->stats.invalid_requests;
+    mock_client_send_response(pool, client, id, NULL, "Unsupported method");
+  }
+  cJSON_Delete(json);
+}
+
+/* ============       Callbacks         ============== */
+void on_mock_alloc(uv_handle_t *handle, size_t suggested_size, uv_buf_t *buf)
+{
+  UNUSED(suggested_size);
+  struct mock_client *client = handle->data;
+  // leave space for terminating zero
+  size_t available = MOCK_POOL_READ_BUFFER_SIZE - client->read_len - 1;
+  *buf = uv_buf_init(client->read_buf + client->read_len,
+                     (unsigned int)available);
+}
+
+void on_mock_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
+{
+  UNUSED(buf);
+  struct mock_client *client = stream->data;
+  struct mock_pool *pool = &mock_pool;
+  if (nread < 0) {
+    if (nread != UV_EOF) {
+      log_error("Client #%lu: read error: %s", client->client_id,
+                uv_strerror((int)nread));
+    }
+    mock_client_close(pool, client);
+    return;
+  }
+  client->read_len += (size_t)nread;
+  client->read_buf[client->read_len] = '\0';
+
+  // requests are separated by newline
+  char *line = client->read_buf;
+  char *eol;
+  while (!client->is_closing && (eol = strchr(line, '\n')) != NULL) {
+    *eol = '\0';
+    if (eol > line) {
+      mock_pool_handle_line(pool, client, line);
+    }
+    line = eol + 1;
+  }
+  client->read_len -= (size_t)(line - client->read_buf);
+  memmove(client->read_buf, line, client->read_len);
+
+  if (client->read_len >= MOCK_POOL_READ_BUFFER_SIZE - 1) {
+    log_error("Client #%lu: request is too large", client->client_id);
+    ++pool->stats.invalid_requests;
+    mock_client_close(pool, client);
+  }
+}
+
+void on_mock_connection(uv_stream_t *server, int status)
+{
+  struct mock_pool *pool = server->data;
+  if (status < 0) {
+    log_error("Connection error: %s", uv_strerror(status));
+    return;
+  }
+  struct mock_client *client = calloc(1, sizeof(struct mock_client));
+  client->client_id = ++pool->next_client_id;
+  client->jobs_head = MOCK_POOL_JOB_HISTORY - 1;
+  uv_tcp_init(uv_default_loop(), &client->socket);
+  client->socket.data = client;
+  if (uv_accept(server, (uv_stream_t *)&client->socket) != 0) {
+    uv_close((uv_handle_t *)&client->socket, on_mock_client_close);
+    return;
+  }
+  uv_tcp_nodelay(&client->socket, 1);
+  ++pool->stats.connections;
+  log_info("Client #%lu: connected", client->client_id);
+
+  client->next = pool->clients;
+  if (pool->clients != NULL) {
+    pool->clients->prev = client;
+  }
+  pool->clients = client;
+  uv_read_start((uv_stream_t *)&client->socket, on_mock_alloc, on_mock_read);
+}
+
+void on_mock_job_timer(uv_timer_t *handle)
+{
+  struct mock_pool *pool = handle->data;
+  struct mock_client *client = pool->clients;
+  while (client != NULL) {
+    struct mock_client *next = client->next;
+    if (client->is_logged_in &&
+        every_nth(pool->opts.disconnect_every, pool->stats.jobs_issued + 1)) {
+      ++pool->stats.jobs_issued;
+      ++pool->stats.disconnects_injected;
+      mock_client_close(pool, client);
+    } else {
+      mock_client_send_job(pool, client);
+    }
+    client = next;
+  }
+}
+
+void on_mock_stats_timer(uv_timer_t *handle)
+{
+  struct mock_pool *pool = handle->data;
+  mock_pool_print_stats(&pool->stats);
+}
+
+void on_mock_walk(uv_handle_t *handle, void *arg)
+{
+  UNUSED(arg);
+  if (!uv_is_closing(handle)) {
+    uv_close(handle, NULL);
+  }
+}
+
+void mock_pool_stop(struct mock_pool *pool)
+{
+  log_info("Shutting down.");
+  while (pool->clients != NULL) {
+    mock_client_close(pool, pool->clients);
+  }
+  // pending tails hold their clients, drop them before the walk below
+  for (struct split_write_req *req = pool->split_writes; req != NULL;
+       req = req->next) {
+    if (!uv_is_closing((uv_handle_t *)&req->timer)) {
+      uv_close((uv_handle_t *)&req->timer, on_split_timer_close);
+    }
+  }
+  uv_walk(uv_default_loop(), on_mock_walk, NULL);
+}
+
+void on_mock_duration_timer(uv_timer_t *handle)
+{
+  mock_pool_stop(handle->data);
+}
+
+void on_mock_sigint(uv_signal_t *handle, int signum)
+{
+  UNUSED(signum);
+  log_warn("SIGINT received. Gracefully shutting down");
+  mock_pool_stop(handle->data);
+}
+
+int main(int argc, char **argv)
+{
+  struct mock_pool *pool = &mock_pool;
+  mock_pool_parse_opts(argc, argv, &pool->opts);
+  srand(pool->opts.seed);
+
+  uv_loop_t *loop = uv_default_loop();
+  struct sockaddr_in addr;
+  int err = uv_ip4_addr(pool->opts.host, pool->opts.port, &addr);
+  if (err < 0) {
+    log_error("Invalid listen address %s:%d: %s", pool->opts.host,
+              pool->opts.port, uv_strerror(err));
+    return 1;
+  }
+  uv_tcp_init(loop, &pool->server);
+  pool->server.data = pool;
+  err = uv_tcp_bind(&pool->server, (const struct sockaddr *)&addr, 0);
+  if (err == 0) {
+    err = uv_listen((uv_stream_t *)&pool->server, 128, on_mock_connection);
+  }
+  if (err < 0) {
+    log_error("Unable to listen on %s:%d: %s", pool->opts.host,
+              pool->opts.port, uv_strerror(err));
+    return 1;
+  }
+  log_info("Mock pool listening on %s:%d, difficulty: %lu, seed: %u",
+           pool->opts.host, pool->opts.port, pool->opts.difficulty,
+           pool->opts.seed);
+
+  uv_timer_init(loop, &pool->job_timer);
+  pool->job_timer.data = pool;
+  uv_timer_start(&pool->job_timer, on_mock_job_timer,
+                 pool->opts.job_interval_ms, pool->opts.job_interval_ms);
+
+  uv_timer_init(loop, &pool->stats_timer);
+  pool->stats_timer.data = pool;
+  uv_timer_start(&pool->stats_timer, on_mock_stats_timer,
+                 pool->opts.stats_interval_sec * 1000,
+                 pool->opts.stats_interval_sec * 1000);
+
+  if (pool->opts.duration_sec > 0) {
+    uv_timer_init(loop, &pool->duration_timer);
+    pool->duration_timer.data = pool;
+    uv_timer_start(&pool->duration_timer, on_mock_duration_timer,
+                   pool->opts.duration_sec * 1000, 0);
+  }
+
+  uv_signal_init(loop, &pool->sigint);
+  pool->sigint.data = pool;
+  uv_signal_start(&pool->sigint, on_mock_sigint, SIGINT);
+
+  // returns after share verifications queued before the stop have finished
+  uv_run(loop, UV_RUN_DEFAULT);
+  uv_loop_close(loop);
+  mock_pool_print_stats(&pool->stats);
+
+  uint64_t rejected = mock_pool_stats_rejected(&pool->stats);
+  return rejected + pool->stats.invalid_requests > 0 ? 2 : 0;
+}
@@ -1,5 +1,6 @@
 #include "monero/monero_config.h"
 
+#include "crypto/cryptonight_spv.h"
 #include "currency.h"
 #include "utils/json.h"
 #include <assert.h>
@@ -57,6 +58,12 @@ monero_config_solver_cpu_from_json(const cJSON *json)
   return &res->solver;
 }
 
+/** Read optional non-negative field, `out` keeps default when missing */
+static bool json_get_uint_opt(const cJSON *json, const char *field, int *out)
+{
+  return !cJSON_HasObjectItem(json, field) || json_get_uint(json, field, out);
+}
+
 struct monero_config_solver *
 monero_config_solver_vk_from_json(const cJSON *json)
 {
@@ -81,11 +88,91 @@ monero_config_solver_vk_from_json(const cJSON *json)
 
   int device_id = -1, parallelism = -1;
 
-  if (!json_get_uint(json, "device", &device_id)) {
+  // device index or "all" for every device found
+  const cJSON *json_device = cJSON_GetObjectItem(json, "device");
+  if (cJSON_IsString(json_device) &&
+      strcmp(json_device->valuestring, "all") == 0) {
+    device_id = MONERO_CONFIG_VK_ALL_DEVICES;
+  } else if (!json_get_uint(json, "device", &device_id)) {
+    return NULL;
+  }
+
+  // optional, autotuned parallelism is limited by the one given
+  bool autotune = false;
+  if (cJSON_HasObjectItem(json, "autotune") &&
+      !json_get_bool(json, "autotune", &autotune)) {
+    return NULL;
+  }
+
+  // optional, init and implode fused with keccak
+  bool fused = false;
+  if (cJSON_HasObjectItem(json, "fused") &&
+      !json_get_bool(json, "fused", &fused)) {
     return NULL;
   }
 
-  if (!json_get_uint(json, "parallelism", &parallelism)) {
+  // optional, GPU time per shader stage in metrics
+  bool profile = false;
+  if (cJSON_HasObjectItem(json, "profile") &&
+      !json_get_bool(json, "profile", &profile)) {
+    return NULL;
+  }
+
+  if (autotune ? !json_get_uint_opt(json, "parallelism", &parallelism)
+               : !json_get_uint(json, "parallelism", &parallelism)) {
+    return NULL;
+  }
+
+  // optional, double buffered by default
+  int in_flight = 2;
+  if (!json_get_uint_opt(json, "in_flight", &in_flight)) {
+    return NULL;
+  }
+  if (in_flight < 1 || in_flight > MONERO_CONFIG_VK_MAX_IN_FLIGHT) {
+    log_error("Field \"in_flight\" must be between 1 and %d",
+              MONERO_CONFIG_VK_MAX_IN_FLIGHT);
+    return NULL;
+  }
+
+  // optional, batches of one device are queued in turn by default
+  int queues = 1;
+  if (!json_get_uint_opt(json, "queues", &queues)) {
+    return NULL;
+  }
+  if (queues < 1 || queues > in_flight) {
+    log_error("Field \"queues\" must be between 1 and \"in_flight\"");
+    return NULL;
+  }
+
+  // optional, cryptonight v0 parameters by default
+  int worksize = CRYPTONIGHT_SPV_LOCAL_WG_SIZE;
+  int iterations = CRYPTONIGHT_SPV_ITERATIONS;
+  int memory = CRYPTONIGHT_SPV_MEMORY << 4;
+  if (!json_get_uint_opt(json, "worksize", &worksize) ||
+      !json_get_uint_opt(json, "iterations", &iterations) ||
+      !json_get_uint_opt(json, "memory", &memory)) {
+    return NULL;
+  }
+  int mask = memory == CRYPTONIGHT_SPV_MEMORY << 4 ? CRYPTONIGHT_SPV_MASK
+                                                   : memory - 16;
+  if (!json_get_uint_opt(json, "mask", &mask)) {
+    return NULL;
+  }
+  if (worksize < 1) {
+    log_error("Field \"worksize\" must be positive");
+    return NULL;
+  }
+  if (iterations < 1) {
+    log_error("Field \"iterations\" must be positive");
+    return NULL;
+  }
+  // explode and implode walk the scratchpad in 8 lanes of 16 bytes
+  if (memory < 128 || memory % 128 != 0) {
+    log_error("Field \"memory\" must be a positive multiple of 128");
+    return NULL;
+  }
+  if (mask % 16 != 0 || mask >= memory) {
+    log_error("Field \"mask\" must be a multiple of 16 below memory");
     return NULL;
   }
 
@@ -94,7 +181,16 @@ monero_config_solver_vk_from_json(const cJSON *json)
   res->solver.solver_type = MONERO_CONFIG_SOLVER_VK;
   res->solver.affine_to_cpu = affinity;
   res->parallelism = parallelism;
+  res->autotune = autotune;
+  res->fused = fused;
+  res->profile = profile;
   res->device_id = device_id;
+  res->in_flight = in_flight;
+  res->queues = queues;
+  res->worksize = worksize;
+  res->iterations = iterations;
+  res->memory = memory;
+  res->mask = mask;
   return &res->solver;
 }
 
@@ -128,11 +224,38 @@ monero_config_solver_cl_from_json(const cJSON *json)
     return NULL;
   }
 
-  if (!json_get_uint(json, "intensity", &intensity)) {
+  // optional, autotuned intensity is limited by the one given
+  bool autotune = false;
+  if (cJSON_HasObjectItem(json, "autotune") &&
+      !json_get_bool(json, "autotune", &autotune)) {
+    return NULL;
+  }
+
+  if (autotune ? !json_get_uint_opt(json, "intensity", &intensity)
+               : !json_get_uint(json, "intensity", &intensity)) {
     return NULL;
   }
 
-  if (!json_get_uint(json, "worksize", &worksize)) {
+  if (autotune ? !json_get_uint_opt(json, "worksize", &worksize)
+               : !json_get_uint(json, "worksize", &worksize)) {
+    return NULL;
+  }
+
+  // optional, double buffered by default
+  int in_flight = 2;
+  if (!json_get_uint_opt(json, "in_flight", &in_flight)) {
+    return NULL;
+  }
+  if (in_flight < 1 || in_flight > MONERO_CONFIG_CL_MAX_IN_FLIGHT) {
+    log_error("Field \"in_flight\" must be between 1 and %d",
+              MONERO_CONFIG_CL_MAX_IN_FLIGHT);
+    return NULL;
+  }
+
+  // optional, final hashes run in cn_final by default
+  bool cpu_final = false;
+  if (cJSON_HasObjectItem(json, "cpu_final") &&
+      !json_get_bool(json, "cpu_final", &cpu_final)) {
     return NULL;
   }
 
@@ -142,8 +265,11 @@ monero_config_solver_cl_from_json(const cJSON *json)
   res->solver.affine_to_cpu = affinity;
   res->intensity = intensity;
   res->worksize = worksize;
+  res->autotune = autotune;
   res->platform_id = platform_id;
   res->device_id = device_id;
+  res->in_flight = in_flight;
+  res->cpu_final = cpu_final;
   return &res->solver;
 }
 
@@ -183,6 +309,40 @@ void monero_config_free(struct config *ptr)
   if (cfg->config.password != NULL) {
     free((void *)cfg->config.password);
   }
+  if (cfg->cache_dir != NULL) {
+    free((void *)cfg->cache_dir);
+  }
+}
+
+bool monero_config_verify_from_json(const cJSON *json,
+                                    struct monero_config_verify *verify)
+{
+  assert(json != NULL);
+  if (!cJSON_IsObject(json)) {
+    log_error("Solutions verification config is not a JSON object");
+    return false;
+  }
+  if (!json_get_uint(json, "max_per_sec", &verify->max_per_sec)) {
+    return false;
+  }
+  if (!json_get_uint(json, "max_mismatches", &verify->max_mismatches)) {
+    return false;
+  }
+  if (verify->max_mismatches == 0) {
+    log_error("Field \"max_mismatches\" must be greater than zero");
+    return false;
+  }
+  if (cJSON_HasObjectItem(json, "sample") &&
+      !json_get_double(json, "sample", &verify->sample)) {
+    return false;
+  }
+  if (!(verify->sample >= 0 &&
+        verify->sample <= MONERO_CONFIG_VERIFY_MAX_SAMPLE)) {
+    log_error("Field \"sample\" must be between 0 and %g",
+              MONERO_CONFIG_VERIFY_MAX_SAMPLE);
+    return false;
+  }
+  return true;
 }
 
 struct config *monero_config_from_json(const cJSON *json)
@@ -210,10 +370,46 @@ struct config *monero_config_from_json(const cJSON *json)
     solvers_list = solver;
   }
 
+  // read optional solutions verification settings, disabled by default
+  struct monero_config_verify verify = {
+      .max_per_sec = 0, .max_mismatches = 1, .sample = 0};
+  if (cJSON_HasObjectItem(json, "verify_solutions") &&
+      !monero_config_verify_from_json(
+          cJSON_GetObjectItem(json, "verify_solutions"), &verify)) {
+    monero_config_solver_list_free(&solvers_list);
+    return NULL;
+  }
+
+  // read optional number of GPU batch finalizer threads
+  int finalizer_threads = 0;
+  if (cJSON_HasObjectItem(json, "finalizer_threads") &&
+      !json_get_uint(json, "finalizer_threads", &finalizer_threads)) {
+    monero_config_solver_list_free(&solvers_list);
+    return NULL;
+  }
+
+  // read optional cache directory for compiled GPU programs, `false` disables
+  const char *cache_dir = NULL;
+  bool cache_disabled = false;
+  const cJSON *json_cache_dir = cJSON_GetObjectItem(json, "cache_dir");
+  if (cJSON_IsFalse(json_cache_dir)) {
+    cache_disabled = true;
+  } else if (cJSON_IsString(json_cache_dir)) {
+    cache_dir = json_cache_dir->valuestring;
+  } else if (json_cache_dir != NULL) {
+    log_error("Field \"cache_dir\" must be a string or `false`");
+    monero_config_solver_list_free(&solvers_list);
+    return NULL;
+  }
+
   struct monero_config *cfg = calloc(1, sizeof(struct monero_config));
   cfg->config.currency = CURRENCY_XMR;
   cfg->config.free = monero_config_free;
   cfg->solvers_list = solvers_list;
+  cfg->verify = verify;
+  cfg->finalizer_threads = finalizer_threads;
+  cfg->cache_dir = cache_dir != NULL ? strdup(cache_dir) : NULL;
+  cfg->cache_disabled = cache_disabled;
 
   return &cfg->config;
 }
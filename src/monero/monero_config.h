@@ -20,23 +20,60 @@ struct monero_config_solver_cpu {
   struct monero_config_solver solver;
 };
 
+/** max batches queued on one OpenCL device */
+#define MONERO_CONFIG_CL_MAX_IN_FLIGHT 4
+
 struct monero_config_solver_cl {
   struct monero_config_solver solver;
   int platform_id;
   int device_id;
-  int intensity;
-  int worksize;
+  int intensity; /** hashes per batch, upper bound or -1 with autotune */
+  int worksize;  /** hashes per workgroup, ignored with autotune */
+  bool autotune; /** pick worksize and intensity by timed batches */
+  int in_flight; /** batches queued on GPU, 1..MONERO_CONFIG_CL_MAX_IN_FLIGHT */
+  bool cpu_final; /** final hashes on the CPU finalizer pool, not cn_final */
 };
 
+/** max batches queued on one Vulkan device */
+#define MONERO_CONFIG_VK_MAX_IN_FLIGHT 4
+
+/** `"device": "all"`, one solver per Vulkan device */
+#define MONERO_CONFIG_VK_ALL_DEVICES -1
+
 struct monero_config_solver_vk {
   struct monero_config_solver solver;
-  int device_id;
-  int parallelism;
+  int device_id; /** device index or MONERO_CONFIG_VK_ALL_DEVICES */
+  int parallelism; /** hashes per batch, upper bound or -1 with autotune */
+  bool autotune;   /** pick worksize and parallelism by timed batches */
+  bool fused;      /** init and implode dispatched together with keccak */
+  bool profile;    /** time shader stages with GPU timestamps */
+  int in_flight; /** batches queued on GPU, 1..MONERO_CONFIG_VK_MAX_IN_FLIGHT */
+  int queues;    /** compute queues batches are spread over, 1..in_flight */
+  /** shader specialization, see crypto/cryptonight_spv.h */
+  int worksize;   /** hashes per workgroup */
+  int iterations; /** memory loop iterations */
+  int memory;     /** scratchpad bytes per hash, multiple of 128 */
+  int mask;       /** scratchpad address mask, below memory */
+};
+
+/** upper bound of verify sample, keeps samples well below the number of
+ *  results a GPU batch can report */
+#define MONERO_CONFIG_VERIFY_MAX_SAMPLE 0.01
+
+/** CPU verification of solutions before submit */
+struct monero_config_verify {
+  int max_per_sec;    /** verifications per second, 0 - disabled */
+  int max_mismatches; /** disable solver after so many invalid solutions */
+  double sample;      /** fraction of all hashes verified too, 0 - none */
 };
 
 struct monero_config {
   struct config config;
   struct monero_config_solver *solvers_list;
+  struct monero_config_verify verify;
+  int finalizer_threads; /** cpu_final finalizer threads, 0 - one per GPU */
+  const char *cache_dir; /** NULL - default location, see file_cache_dir */
+  bool cache_disabled;   /** do not read or write on-disk caches */
 };
 
 struct config *monero_config_from_json(const cJSON *json);
@@ -0,0 +1,185 @@
+#include "monero/monero_finalizer.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uv.h>
+
+#include "crypto/cryptonight/cryptonight.h"
+#include "crypto/keccak-tiny.h"
+#include "logging.h"
+
+/** states per work item, multiple of multi-buffer hash lanes */
+#define FINALIZER_CHUNK_SIZE 64
+
+struct monero_finalizer {
+  uv_mutex_t lock;
+  /** signalled when batch is queued or pool is stopping */
+  uv_cond_t work_cond;
+  /** signalled when batch is done */
+  uv_cond_t done_cond;
+
+  /** batches with unclaimed chunks */
+  struct monero_finalizer_batch *head;
+  struct monero_finalizer_batch *tail;
+
+  bool is_alive;
+  size_t threads_len;
+  uv_thread_t threads[];
+};
+
+static size_t finalize_chunk(struct monero_finalizer_batch *batch,
+                             size_t from, size_t n, uint8_t *hashes,
+                             size_t *found)
+{
+  uint8_t *states = batch->states + from * CRYPTONIGHT_STATE_SIZE;
+  if (batch->keccak_f) {
+    for (size_t i = 0; i < n; ++i) {
+      keccak_f((uint64_t *)(states + i * CRYPTONIGHT_STATE_SIZE), 24);
+    }
+  }
+  cryptonight_final_batch(states, CRYPTONIGHT_STATE_SIZE, n, hashes);
+
+  size_t found_len = 0;
+  for (size_t i = 0; i < n; ++i) {
+    const uint8_t *hash = hashes + i * CRYPTONIGHT_FINAL_HASH_LENGTH;
+    if (monero_solution_hash_val(hash) < batch->target) {
+      found[found_len++] = i;
+    }
+  }
+  return found_len;
+}
+
+static void monero_finalizer_worker(void *arg)
+{
+  struct monero_finalizer *f = arg;
+  uint8_t hashes[FINALIZER_CHUNK_SIZE * CRYPTONIGHT_FINAL_HASH_LENGTH];
+  size_t found[FINALIZER_CHUNK_SIZE];
+
+  uv_mutex_lock(&f->lock);
+  for (;;) {
+    while (f->head == NULL && f->is_alive) {
+      uv_cond_wait(&f->work_cond, &f->lock);
+    }
+    if (f->head == NULL) {
+      break;
+    }
+    // claim next chunk of the oldest batch
+    struct monero_finalizer_batch *batch = f->head;
+    size_t chunk = batch->next_chunk++;
+    if (batch->next_chunk == batch->num_chunks) {
+      f->head = batch->next;
+      if (f->head == NULL) {
+        f->tail = NULL;
+      }
+    }
+    uv_mutex_unlock(&f->lock);
+
+    size_t from = chunk * FINALIZER_CHUNK_SIZE;
+    size_t n = batch->n - from < FINALIZER_CHUNK_SIZE ? batch->n - from
+                                                      : FINALIZER_CHUNK_SIZE;
+    size_t found_len = finalize_chunk(batch, from, n, hashes, found);
+
+    uv_mutex_lock(&f->lock);
+    for (size_t i = 0; i < found_len; ++i) {
+      if (batch->num_solutions == MONERO_SOLVER_MAX_SOLUTIONS) {
+        log_error("Finalizer: solutions buffer full!");
+        break;
+      }
+      memcpy(batch->hashes + MONERO_OUTPUT_HASH_LEN * batch->num_solutions,
+             hashes + found[i] * CRYPTONIGHT_FINAL_HASH_LENGTH,
+             MONERO_OUTPUT_HASH_LEN);
+      batch->nonces[batch->num_solutions] =
+          batch->nonce_from + (uint32_t)(from + found[i]);
+      ++batch->num_solutions;
+    }
+    if (++batch->chunks_done == batch->num_chunks) {
+      batch->is_done = true;
+      uv_cond_broadcast(&f->done_cond);
+    }
+  }
+  uv_mutex_unlock(&f->lock);
+}
+
+struct monero_finalizer *monero_finalizer_new(size_t threads)
+{
+  assert(threads > 0);
+  size_t size = sizeof(struct monero_finalizer) + threads * sizeof(uv_thread_t);
+  struct monero_finalizer *f = calloc(1, size);
+  uv_mutex_init(&f->lock);
+  uv_cond_init(&f->work_cond);
+  uv_cond_init(&f->done_cond);
+  f->is_alive = true;
+  for (; f->threads_len < threads; ++f->threads_len) {
+    if (uv_thread_create(&f->threads[f->threads_len], monero_finalizer_worker,
+                         f) != 0) {
+      log_error("Unable to start finalizer thread");
+      monero_finalizer_free(f);
+      return NULL;
+    }
+  }
+  log_info("Started %lu finalizer threads", threads);
+  return f;
+}
+
+void monero_finalizer_free(struct monero_finalizer *f)
+{
+  uv_mutex_lock(&f->lock);
+  assert(f->head == NULL);
+  f->is_alive = false;
+  uv_cond_broadcast(&f->work_cond);
+  uv_mutex_unlock(&f->lock);
+  for (size_t i = 0; i < f->threads_len; ++i) {
+    uv_thread_join(&f->threads[i]);
+  }
+  uv_cond_destroy(&f->done_cond);
+  uv_cond_destroy(&f->work_cond);
+  uv_mutex_destroy(&f->lock);
+  free(f);
+}
+
+void monero_finalizer_submit(struct monero_finalizer *f,
+                             struct monero_finalizer_batch *batch)
+{
+  batch->num_solutions = 0;
+  batch->next_chunk = 0;
+  batch->chunks_done = 0;
+  batch->num_chunks =
+      (batch->n + FINALIZER_CHUNK_SIZE - 1) / FINALIZER_CHUNK_SIZE;
+  batch->is_done = batch->num_chunks == 0;
+  batch->next = NULL;
+  if (batch->is_done) {
+    return;
+  }
+
+  uv_mutex_lock(&f->lock);
+  if (f->tail != NULL) {
+    f->tail->next = batch;
+  } else {
+    f->head = batch;
+  }
+  f->tail = batch;
+  if (batch->num_chunks == 1) {
+    uv_cond_signal(&f->work_cond);
+  } else {
+    uv_cond_broadcast(&f->work_cond);
+  }
+  uv_mutex_unlock(&f->lock);
+}
+
+size_t monero_finalizer_wait(struct monero_finalizer *f,
+                             struct monero_finalizer_batch *batch,
+                             uint8_t *output_hash, uint32_t *output_nonces)
+{
+  uv_mutex_lock(&f->lock);
+  while (!batch->is_done) {
+    uv_cond_wait(&f->done_cond, &f->lock);
+  }
+  uv_mutex_unlock(&f->lock);
+
+  memcpy(output_hash, batch->hashes,
+         MONERO_OUTPUT_HASH_LEN * batch->num_solutions);
+  memcpy(output_nonces, batch->nonces,
+         sizeof(uint32_t) * batch->num_solutions);
+  return batch->num_solutions;
+}
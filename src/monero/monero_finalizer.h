@@ -0,0 +1,57 @@
+/* monero_finalizer.h -- shared thread pool for final hashes of GPU batches
+ *
+ * GPU solvers hand over cryptonight states of a completed batch and go on
+ * with the next one. Workers split the batch into chunks, run the final hash
+ * selected by keccak state and check the target. Solutions are collected by
+ * the solver with monero_finalizer_wait.
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "monero/monero.h"
+#include "monero/monero_solver.h"
+
+struct monero_finalizer;
+
+/** Batch of cryptonight states waiting for final hash */
+struct monero_finalizer_batch {
+  /** n * CRYPTONIGHT_STATE_SIZE bytes, owned by caller, must stay untouched
+   *  until monero_finalizer_wait returns */
+  uint8_t *states;
+  size_t n;
+  /** states are not yet permuted with keccak-f */
+  bool keccak_f;
+  uint64_t target;
+  uint32_t nonce_from;
+
+  /** solutions, filled by workers */
+  uint8_t hashes[MONERO_OUTPUT_HASH_LEN * MONERO_SOLVER_MAX_SOLUTIONS];
+  uint32_t nonces[MONERO_SOLVER_MAX_SOLUTIONS];
+  size_t num_solutions;
+
+  /** internal */
+  size_t next_chunk;
+  size_t chunks_done;
+  size_t num_chunks;
+  bool is_done;
+  struct monero_finalizer_batch *next;
+};
+
+/** start pool with given number of worker threads */
+struct monero_finalizer *monero_finalizer_new(size_t threads);
+
+/** stop worker threads, all submitted batches must be waited for */
+void monero_finalizer_free(struct monero_finalizer *);
+
+/** queue batch, returns immediately */
+void monero_finalizer_submit(struct monero_finalizer *,
+                             struct monero_finalizer_batch *);
+
+/** wait until batch is finalized and copy solutions to output,
+ *  return number of solutions */
+size_t monero_finalizer_wait(struct monero_finalizer *,
+                             struct monero_finalizer_batch *,
+                             uint8_t *output_hash, uint32_t *output_nonces);
@@ -1,20 +1,96 @@
 #include "monero/monero_miner.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <uv.h>
 
+#include "cJSON/cJSON.h"
+#include "crypto/cryptonight/cryptonight.h"
 #include "logging.h"
+#include "metrics.h"
 #include "monero/monero.h"
+#include "monero/monero_finalizer.h"
 #include "monero/monero_job.h"
 #include "monero/monero_result.h"
 #include "monero/monero_solver.h"
 
 #include "utils/byteswap.h"
+#include "utils/file_cache.h"
 #include "utils/hex.h"
 
+#define VERIFY_QUEUE_SIZE 16
+/** queue slots samples may take, the rest is kept for solutions */
+#define VERIFY_QUEUE_SAMPLES (VERIFY_QUEUE_SIZE / 2)
+
+/** solution or sample waiting for CPU verification */
+struct monero_verify_item {
+  int solver_id;
+  struct monero_solution solution;
+  uint8_t input_hash[MONERO_INPUT_HASH_LEN];
+  size_t input_hash_len;
+};
+
+/** rate limit: token bucket refilled max_per_sec times per second */
+struct monero_verify_budget {
+  double tokens;
+  uint64_t updated_at; // ms, uv_now
+};
+
+/** CPU verification of solutions and samples found by solvers.
+ *  Solutions are verified one at a time on a dedicated cryptonight context.
+ *  Samples have their own budget and queue slots, they never delay or push
+ *  out a solution */
+struct monero_verifier {
+  struct monero_miner *miner; // NULL when miner is freed while busy
+  struct monero_config_verify cfg;
+  struct cryptonight_ctx *ctx;
+  struct cryptonight_hash output_hash;
+  uv_work_t work_req;
+  bool is_busy;
+
+  struct monero_verify_budget solutions_budget;
+  struct monero_verify_budget samples_budget;
+
+  struct monero_verify_item queue[VERIFY_QUEUE_SIZE];
+  size_t queue_head;
+  size_t queue_len;
+  size_t queue_samples; // samples in the queue
+};
+
+struct monero_solver_verify_stats {
+  uint64_t verified;
+  uint64_t mismatched;
+  uint64_t unverified; // submitted without verification due to rate limit
+  uint64_t sampled;    // samples verified, including mismatched ones
+  uint64_t sample_mismatched;
+  bool is_disabled;
+};
+
+/** Running hashrate statistics of one benchmark series */
+struct monero_benchmark_series {
+  uint64_t hashes_start; // at the end of warm-up
+  uint64_t hashes_prev;  // at previous sample
+  uint64_t solutions_start;
+  size_t samples;
+  double mean; // hashes/sec
+  double m2;   // sum of squared differences from the mean (Welford)
+};
+
+#define BENCHMARK_SAMPLE_SEC 1
+
+struct monero_benchmark {
+  uv_timer_t timer_req;
+  struct miner_benchmark_opts opts;
+  uint64_t started_at; // ns, benchmark start
+  uint64_t warm_at;    // ns, end of warm-up, 0 while warming up
+  uint64_t sampled_at; // ns, previous sample
+  struct monero_benchmark_series *solvers; // len == solvers_len
+  struct monero_benchmark_series total;
+};
+
 struct monero_miner {
   struct miner miner;
 
@@ -22,10 +98,16 @@ struct monero_miner {
   size_t solvers_len;
   struct monero_solver **solvers;
   uint32_t nonce_chunk_size;
+  struct monero_solver_verify_stats *verify_stats; // len == solvers_len
+  struct monero_verifier *verifier; // NULL when verification is disabled
+  struct monero_finalizer *finalizer; // NULL when no solver has cpu_final
+  uint64_t sample_target; // hashes below are verified as samples, 0 - none
 
   /** current job */
   int job_seq_id; // internal monotonically increasing job id
   const char *job_id;
+  uint8_t input_hash[MONERO_INPUT_HASH_LEN];
+  size_t input_hash_len;
   uint64_t target;
   struct miner_event_handler *event_handler;
 
@@ -33,6 +115,10 @@ struct monero_miner {
   uv_timer_t timer_req;
   time_t time_start;
   uint64_t *hashes_prev; // len == solvers_len
+  uint64_t *hashrate;    // len == solvers_len, hashes/sec in last interval
+  enum monero_config_solver_type *solver_types; // len == solvers_len
+
+  struct monero_benchmark *benchmark; // NULL when not benchmarking
 };
 
 #define PRINT_METRICS_SEC 10
@@ -52,37 +138,161 @@ inline static uint64_t read_target(const char *str)
   return 0; // error
 }
 
+static const char *SOLVER_TYPE_NAMES[] = {"cpu", "cl", "vk"};
+
 void monero_miner_print_metrics(uv_timer_t *handle)
 {
   struct monero_miner *miner = handle->data;
   assert(miner != NULL);
   int seconds_elapsed = (int)difftime(time(NULL), miner->time_start);
   assert(seconds_elapsed >= 0);
+  if (seconds_elapsed == 0) {
+    seconds_elapsed = 1;
+  }
   char buf[1024];
-  char *buf_ptr = stpcpy(buf, "Metrics Cur:Avg:Sol ");
+  size_t len = (size_t)snprintf(buf, sizeof(buf), "Metrics Cur:Avg:Sol ");
   struct monero_solver_metrics metrics;
   for (size_t i = 0; i < miner->solvers_len; ++i) {
     monero_solver_get_metrics(miner->solvers[i], &metrics);
     uint64_t cur = (metrics.hashes_processed_total - miner->hashes_prev[i]) /
                    PRINT_METRICS_SEC;
     miner->hashes_prev[i] = metrics.hashes_processed_total;
+    miner->hashrate[i] = cur;
     uint64_t avg = metrics.hashes_processed_total / seconds_elapsed;
-    buf_ptr += sprintf(buf_ptr, "| %llu:%llu:%llu ", cur, avg,
-                       metrics.solutions_found);
+    if (len < sizeof(buf)) {
+      len += (size_t)snprintf(buf + len, sizeof(buf) - len, "| %lu:%lu:%lu ",
+                              cur, avg, metrics.solutions_found);
+    }
+    if (miner->verifier != NULL && len < sizeof(buf)) {
+      const struct monero_solver_verify_stats *v = &miner->verify_stats[i];
+      len += (size_t)snprintf(buf + len, sizeof(buf) - len, "bad:%lu%s ",
+                              v->mismatched + v->sample_mismatched,
+                              v->is_disabled ? " OFF " : "");
+    }
   }
-  *buf_ptr = 0;
-  log_info(buf);
+  log_info("%s", buf);
 }
 
-void monero_miner_submit(int solver_id, struct monero_solution *solution,
-                         void *data)
+/** Write per solver metrics of all miners in prometheus text format */
+void monero_miner_metrics(miner_handle *handles, const char *const *labels,
+                          size_t len, struct metrics_buffer *buf)
 {
-  struct monero_miner *miner = (struct monero_miner *)data;
-  if (solution->job_id != miner->job_seq_id) {
-    log_warn("Stale solution detected!");
+  size_t n = 0;
+  for (size_t m = 0; m < len; ++m) {
+    n += ((struct monero_miner *)handles[m])->solvers_len;
+  }
+  if (n == 0) {
     return;
   }
+  // solvers of all miners in order, `miners[i]` owns solver `i`
+  struct monero_miner *miners[n];
+  const struct monero_solver_verify_stats *verify[n];
+  uint64_t hashrate[n];
+  struct monero_solver_metrics metrics[n];
+  char solver_labels[n][128];
+  bool has_verifier = false, has_samples = false;
+  for (size_t m = 0, i = 0; m < len; ++m) {
+    struct monero_miner *miner = (struct monero_miner *)handles[m];
+    has_verifier = has_verifier || miner->verifier != NULL;
+    has_samples = has_samples || miner->sample_target != 0;
+    for (size_t k = 0; k < miner->solvers_len; ++k, ++i) {
+      miners[i] = miner;
+      verify[i] = &miner->verify_stats[k];
+      hashrate[i] = miner->hashrate[k];
+      monero_solver_get_metrics(miner->solvers[k], &metrics[i]);
+      snprintf(solver_labels[i], sizeof(solver_labels[i]),
+               "%s,solver=\"%lu\",type=\"%s\"", labels[m], k,
+               SOLVER_TYPE_NAMES[miner->solver_types[k]]);
+    }
+  }
 
+  metrics_family(buf, "dorenom_solver_hashrate", "gauge",
+                 "Hashes per second over the last metrics interval");
+  for (size_t i = 0; i < n; ++i) {
+    metrics_printf(buf, "dorenom_solver_hashrate{%s} %lu\n", solver_labels[i],
+                   hashrate[i]);
+  }
+  metrics_family(buf, "dorenom_solver_hashes_total", "counter",
+                 "Hashes processed");
+  for (size_t i = 0; i < n; ++i) {
+    metrics_printf(buf, "dorenom_solver_hashes_total{%s} %lu\n",
+                   solver_labels[i], metrics[i].hashes_processed_total);
+  }
+  metrics_family(buf, "dorenom_solver_solutions_total", "counter",
+                 "Solutions found");
+  for (size_t i = 0; i < n; ++i) {
+    metrics_printf(buf, "dorenom_solver_solutions_total{%s} %lu\n",
+                   solver_labels[i], metrics[i].solutions_found);
+  }
+  metrics_family(buf, "dorenom_solver_best_difficulty", "gauge",
+                 "Difficulty of the 10 best solutions found");
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t r = 0; r < 10 && r < metrics[i].solutions_found; ++r) {
+      metrics_printf(buf,
+                     "dorenom_solver_best_difficulty{%s,rank=\"%lu\"} %lu\n",
+                     solver_labels[i], r + 1,
+                     target_to_difficulty(metrics[i].top_10_solutions[r]));
+    }
+  }
+  if (has_verifier) {
+    metrics_family(buf, "dorenom_solver_verified_total", "counter",
+                   "Solutions verified on CPU");
+    for (size_t i = 0; i < n; ++i) {
+      if (miners[i]->verifier != NULL) {
+        metrics_printf(buf, "dorenom_solver_verified_total{%s} %lu\n",
+                       solver_labels[i], verify[i]->verified);
+      }
+    }
+    metrics_family(buf, "dorenom_solver_invalid_solutions_total", "counter",
+                   "Solutions failed CPU verification");
+    for (size_t i = 0; i < n; ++i) {
+      if (miners[i]->verifier != NULL) {
+        metrics_printf(buf, "dorenom_solver_invalid_solutions_total{%s} %lu\n",
+                       solver_labels[i], verify[i]->mismatched);
+      }
+    }
+  }
+  if (has_samples) {
+    metrics_family(buf, "dorenom_solver_samples_total", "counter",
+                   "Hashes above target verified on CPU");
+    for (size_t i = 0; i < n; ++i) {
+      if (miners[i]->sample_target != 0) {
+        metrics_printf(buf, "dorenom_solver_samples_total{%s} %lu\n",
+                       solver_labels[i], verify[i]->sampled);
+      }
+    }
+    metrics_family(buf, "dorenom_solver_invalid_samples_total", "counter",
+                   "Sampled hashes failed CPU verification");
+    for (size_t i = 0; i < n; ++i) {
+      if (miners[i]->sample_target != 0) {
+        metrics_printf(buf, "dorenom_solver_invalid_samples_total{%s} %lu\n",
+                       solver_labels[i], verify[i]->sample_mismatched);
+      }
+    }
+  }
+  metrics_family(buf, "dorenom_solver_stage_seconds_total", "counter",
+                 "Device time per shader stage, GPU solvers with profile");
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t k = 0; k < metrics[i].stages_len; ++k) {
+      metrics_printf(buf,
+                     "dorenom_solver_stage_seconds_total{%s,stage=\"%s\"} "
+                     "%.6f\n",
+                     solver_labels[i], metrics[i].stages[k].name,
+                     1.0e-9 * (double)metrics[i].stages[k].ns_total);
+    }
+  }
+  metrics_family(buf, "dorenom_solver_enabled", "gauge",
+                 "0 if solver was disabled");
+  for (size_t i = 0; i < n; ++i) {
+    metrics_printf(buf, "dorenom_solver_enabled{%s} %d\n", solver_labels[i],
+                   verify[i]->is_disabled ? 0 : 1);
+  }
+}
+
+/** send solution to the pool */
+void monero_miner_submit_result(struct monero_miner *miner, int solver_id,
+                                const struct monero_solution *solution)
+{
   log_info("#%d: Solution found: nonce: %x, solution: %lx, target: %lx",
            solver_id, solution->nonce, monero_solution_hash_val(solution->hash),
            miner->target);
@@ -102,23 +312,277 @@ void monero_miner_submit(int solver_id, struct monero_solution *solution,
   }
 }
 
+void monero_verifier_start(struct monero_verifier *verifier);
+
+/** Called from thread pool */
+void monero_verifier_work(uv_work_t *req)
+{
+  struct monero_verifier *verifier = req->data;
+  struct monero_verify_item *item = &verifier->queue[verifier->queue_head];
+  memcpy(&item->input_hash[MONERO_NONCE_POSITION], &item->solution.nonce,
+         sizeof(uint32_t));
+  cryptonight_aesni(item->input_hash, item->input_hash_len,
+                    &verifier->output_hash, verifier->ctx);
+}
+
+void monero_verifier_free(struct monero_verifier *verifier)
+{
+  cryptonight_ctx_free(&verifier->ctx);
+  free(verifier);
+}
+
+void monero_miner_disable_solver(struct monero_miner *miner, int solver_id)
+{
+  struct monero_solver_verify_stats *stats = &miner->verify_stats[solver_id];
+  if (stats->is_disabled) {
+    return;
+  }
+  log_error("#%d: Too many invalid solutions(%lu). Solver disabled",
+            solver_id, stats->mismatched + stats->sample_mismatched);
+  stats->is_disabled = true;
+  monero_solver_pause(miner->solvers[solver_id]);
+}
+
+/** Called on main loop when verification is complete */
+void monero_verifier_work_done(uv_work_t *req, int status)
+{
+  struct monero_verifier *verifier = req->data;
+  struct monero_miner *miner = verifier->miner;
+  if (miner == NULL) {
+    // miner is gone
+    monero_verifier_free(verifier);
+    return;
+  }
+  const struct monero_verify_item item = verifier->queue[verifier->queue_head];
+  verifier->queue_head = (verifier->queue_head + 1) % VERIFY_QUEUE_SIZE;
+  --verifier->queue_len;
+  verifier->queue_samples -= item.solution.is_sample;
+  verifier->is_busy = false;
+
+  if (status == 0) {
+    struct monero_solver_verify_stats *stats =
+        &miner->verify_stats[item.solver_id];
+    bool is_valid = memcmp(verifier->output_hash.data, item.solution.hash,
+                           MONERO_OUTPUT_HASH_LEN) == 0;
+    if (item.solution.is_sample) {
+      ++stats->sampled;
+      stats->sample_mismatched += !is_valid;
+    } else if (is_valid) {
+      ++stats->verified;
+      if (item.solution.job_id != miner->job_seq_id) {
+        log_warn("Stale solution detected!");
+      } else {
+        monero_miner_submit_result(miner, item.solver_id, &item.solution);
+      }
+    } else {
+      ++stats->mismatched;
+    }
+    if (!is_valid) {
+      log_error("#%d: Invalid %s: nonce: %x, solution: %lx, expected: %lx",
+                item.solver_id, item.solution.is_sample ? "sample" : "solution",
+                item.solution.nonce,
+                monero_solution_hash_val(item.solution.hash),
+                monero_solution_hash_val(verifier->output_hash.data));
+      if (stats->mismatched + stats->sample_mismatched >=
+          (uint64_t)verifier->cfg.max_mismatches) {
+        monero_miner_disable_solver(miner, item.solver_id);
+      }
+    }
+  } else {
+    log_error("Solution verification failed: %s", uv_strerror(status));
+  }
+  monero_verifier_start(verifier);
+}
+
+void monero_verifier_start(struct monero_verifier *verifier)
+{
+  if (verifier->is_busy || verifier->queue_len == 0) {
+    return;
+  }
+  verifier->work_req.data = verifier;
+  int err = uv_queue_work(uv_default_loop(), &verifier->work_req,
+                          monero_verifier_work, monero_verifier_work_done);
+  if (err < 0) {
+    log_error("Unable to queue solution verification: %s", uv_strerror(err));
+    return;
+  }
+  verifier->is_busy = true;
+}
+
+/** take one token from the bucket, return false if rate limit exceeded */
+bool monero_verify_budget_take(struct monero_verify_budget *budget,
+                               int max_per_sec)
+{
+  uint64_t now = uv_now(uv_default_loop());
+  double refill = (double)(now - budget->updated_at) * max_per_sec / 1000.0;
+  budget->updated_at = now;
+  budget->tokens += refill;
+  if (budget->tokens > max_per_sec) {
+    budget->tokens = max_per_sec;
+  }
+  if (budget->tokens < 1.0) {
+    return false;
+  }
+  budget->tokens -= 1.0;
+  return true;
+}
+
+/** remove the most recently queued sample that is not being verified,
+ *  return false if there is none */
+bool monero_verifier_drop_sample(struct monero_verifier *verifier)
+{
+  size_t first = verifier->is_busy ? 1 : 0;
+  for (size_t i = verifier->queue_len; i-- > first;) {
+    size_t pos = (verifier->queue_head + i) % VERIFY_QUEUE_SIZE;
+    if (!verifier->queue[pos].solution.is_sample) {
+      continue;
+    }
+    for (size_t j = i + 1; j < verifier->queue_len; ++j) {
+      size_t next = (verifier->queue_head + j) % VERIFY_QUEUE_SIZE;
+      verifier->queue[pos] = verifier->queue[next];
+      pos = next;
+    }
+    --verifier->queue_len;
+    --verifier->queue_samples;
+    return true;
+  }
+  return false;
+}
+
+/** queue solution or sample for verification, return false if rate limit
+ *  exceeded */
+bool monero_verifier_push(struct monero_verifier *verifier,
+                          struct monero_miner *miner, int solver_id,
+                          const struct monero_solution *solution)
+{
+  if (solution->is_sample) {
+    if (verifier->queue_len == VERIFY_QUEUE_SIZE ||
+        verifier->queue_samples == VERIFY_QUEUE_SAMPLES ||
+        !monero_verify_budget_take(&verifier->samples_budget,
+                                   verifier->cfg.max_per_sec)) {
+      return false;
+    }
+    ++verifier->queue_samples;
+  } else if ((verifier->queue_len == VERIFY_QUEUE_SIZE &&
+              !monero_verifier_drop_sample(verifier)) ||
+             !monero_verify_budget_take(&verifier->solutions_budget,
+                                        verifier->cfg.max_per_sec)) {
+    return false;
+  }
+  size_t tail =
+      (verifier->queue_head + verifier->queue_len) % VERIFY_QUEUE_SIZE;
+  struct monero_verify_item *item = &verifier->queue[tail];
+  item->solver_id = solver_id;
+  item->solution = *solution;
+  memcpy(item->input_hash, miner->input_hash, miner->input_hash_len);
+  item->input_hash_len = miner->input_hash_len;
+  ++verifier->queue_len;
+  monero_verifier_start(verifier);
+  return true;
+}
+
+struct monero_verifier *
+monero_verifier_new(struct monero_miner *miner,
+                    const struct monero_config_verify *cfg)
+{
+  struct cryptonight_ctx *ctx = cryptonight_ctx_new();
+  if (ctx == NULL) {
+    log_error("Unable to allocate cryptonight context for verification");
+    return NULL;
+  }
+  struct monero_verifier *verifier = calloc(1, sizeof(struct monero_verifier));
+  verifier->miner = miner;
+  verifier->cfg = *cfg;
+  verifier->ctx = ctx;
+  uint64_t now = uv_now(uv_default_loop());
+  verifier->solutions_budget.tokens = cfg->max_per_sec;
+  verifier->solutions_budget.updated_at = now;
+  verifier->samples_budget.tokens = cfg->max_per_sec;
+  verifier->samples_budget.updated_at = now;
+  log_info("Solutions verification enabled: %d/sec, max mismatches: %d, "
+           "sample: %g",
+           cfg->max_per_sec, cfg->max_mismatches, cfg->sample);
+  return verifier;
+}
+
+void monero_miner_submit(int solver_id, struct monero_solution *solution,
+                         void *data)
+{
+  struct monero_miner *miner = (struct monero_miner *)data;
+  if (solution->job_id != miner->job_seq_id) {
+    if (!solution->is_sample) {
+      log_warn("Stale solution detected!");
+    }
+    return;
+  }
+  struct monero_solver_verify_stats *stats = &miner->verify_stats[solver_id];
+  if (stats->is_disabled) {
+    return;
+  }
+  if (solution->is_sample) {
+    // dropped when rate limit is exceeded
+    if (miner->verifier != NULL) {
+      monero_verifier_push(miner->verifier, miner, solver_id, solution);
+    }
+    return;
+  }
+  if (miner->verifier != NULL) {
+    if (monero_verifier_push(miner->verifier, miner, solver_id, solution)) {
+      return; // submitted when verified
+    }
+    ++stats->unverified;
+  }
+  monero_miner_submit_result(miner, solver_id, solution);
+}
+
+/** Solvers created for config entry, `"device": "all"` gives one per Vulkan
+ *  device */
+static size_t monero_miner_config_solvers(const struct monero_config_solver *p)
+{
+  if (p->solver_type == MONERO_CONFIG_SOLVER_VK &&
+      ((const struct monero_config_solver_vk *)p)->device_id ==
+          MONERO_CONFIG_VK_ALL_DEVICES) {
+    return monero_solver_vk_devices();
+  }
+  return 1;
+}
+
 void monero_miner_free(miner_handle *handle)
 {
   struct monero_miner *miner = (struct monero_miner *)*handle;
   uv_timer_stop(&miner->timer_req);
+  if (miner->benchmark != NULL) {
+    uv_timer_stop(&miner->benchmark->timer_req);
+    free(miner->benchmark->solvers);
+    free(miner->benchmark);
+  }
+  if (miner->verifier != NULL) {
+    if (miner->verifier->is_busy) {
+      // verification in progress, will be freed when done
+      miner->verifier->miner = NULL;
+    } else {
+      monero_verifier_free(miner->verifier);
+    }
+  }
+  free(miner->verify_stats);
   if (miner->job_id != NULL) {
     free((void *)miner->job_id);
   }
   if (miner->solvers_len > 0) {
     free(miner->hashes_prev);
+    free(miner->hashrate);
+    free(miner->solver_types);
     for (size_t i = 0; i < miner->solvers_len; ++i) {
       struct monero_solver *solver = miner->solvers[i];
       if (solver != NULL) {
-        solver->free(solver);
+        monero_solver_free(solver);
       }
     }
     free(miner->solvers);
   }
+  if (miner->finalizer != NULL) {
+    monero_finalizer_free(miner->finalizer);
+  }
   free((void *)miner);
   *handle = NULL;
 }
@@ -165,6 +629,8 @@ void monero_miner_new_job(miner_handle handle, void *job_data,
     free((void *)miner->job_id);
   }
   miner->job_id = strdup(job->job_id);
+  memcpy(miner->input_hash, input_hash, input_hash_len);
+  miner->input_hash_len = input_hash_len;
   ++miner->job_seq_id;
   miner->event_handler = event_handler;
   // submit to executors.
@@ -175,21 +641,167 @@ void monero_miner_new_job(miner_handle handle, void *job_data,
   // split nonce into work chunks of equal size
   for (size_t i = 0; i < miner->solvers_len; ++i) {
     uint32_t nonce_to = nonce_from + miner->nonce_chunk_size;
+    if (miner->verify_stats[i].is_disabled) {
+      nonce_from = nonce_to;
+      continue;
+    }
     monero_solver_work(miner->solvers[i], monero_miner_submit, miner,
                        miner->job_seq_id, input_hash, input_hash_len,
-                       miner->target, nonce_from, nonce_to);
+                       miner->target, miner->sample_target, nonce_from,
+                       nonce_to);
     nonce_from = nonce_to;
   }
 FREE:
   free(input_hash);
 }
 
-void monero_miner_benchmark(miner_handle h)
+static void benchmark_series_add(struct monero_benchmark_series *series,
+                                 uint64_t hashes, double seconds)
+{
+  double rate = (double)(hashes - series->hashes_prev) / seconds;
+  series->hashes_prev = hashes;
+  ++series->samples;
+  double delta = rate - series->mean;
+  series->mean += delta / (double)series->samples;
+  series->m2 += delta * (rate - series->mean);
+}
+
+static void benchmark_series_to_json(const struct monero_benchmark_series *s,
+                                     uint64_t hashes, uint64_t solutions,
+                                     double seconds, cJSON *json)
+{
+  double variance = s->samples > 1 ? s->m2 / (double)(s->samples - 1) : 0;
+  uint64_t n = hashes - s->hashes_start;
+  cJSON_AddNumberToObject(json, "hashrate", seconds > 0 ? n / seconds : 0);
+  cJSON_AddNumberToObject(json, "hashrate_variance", variance);
+  cJSON_AddNumberToObject(json, "hashrate_stddev", sqrt(variance));
+  cJSON_AddNumberToObject(json, "samples", (double)s->samples);
+  cJSON_AddNumberToObject(json, "hashes", (double)n);
+  cJSON_AddNumberToObject(json, "solutions",
+                          (double)(solutions - s->solutions_start));
+}
+
+/** Sample hashrate of every solver once per BENCHMARK_SAMPLE_SEC */
+void monero_miner_benchmark_sample(uv_timer_t *handle)
+{
+  struct monero_miner *miner = handle->data;
+  struct monero_benchmark *bench = miner->benchmark;
+  uint64_t now = uv_hrtime();
+  bool is_warm = bench->warm_at != 0;
+  if (!is_warm && now - bench->started_at <
+                      (uint64_t)bench->opts.warmup_sec * 1000000000) {
+    return;
+  }
+  double seconds = (double)(now - bench->sampled_at) / 1e9;
+  bench->sampled_at = now;
+  if (!is_warm) {
+    bench->warm_at = now;
+    log_info("Benchmark: warm-up finished");
+  }
+
+  uint64_t total_hashes = 0;
+  uint64_t total_solutions = 0;
+  struct monero_solver_metrics metrics;
+  for (size_t i = 0; i < miner->solvers_len; ++i) {
+    monero_solver_get_metrics(miner->solvers[i], &metrics);
+    struct monero_benchmark_series *series = &bench->solvers[i];
+    if (is_warm) {
+      benchmark_series_add(series, metrics.hashes_processed_total, seconds);
+    } else {
+      series->hashes_start = metrics.hashes_processed_total;
+      series->hashes_prev = metrics.hashes_processed_total;
+      series->solutions_start = metrics.solutions_found;
+    }
+    total_hashes += metrics.hashes_processed_total;
+    total_solutions += metrics.solutions_found;
+  }
+  if (is_warm) {
+    benchmark_series_add(&bench->total, total_hashes, seconds);
+  } else {
+    bench->total.hashes_start = total_hashes;
+    bench->total.hashes_prev = total_hashes;
+    bench->total.solutions_start = total_solutions;
+  }
+}
+
+bool monero_miner_benchmark(miner_handle h,
+                            const struct miner_benchmark_opts *opts)
 {
   assert(h != NULL);
+  struct monero_miner *miner = (struct monero_miner *)h;
+  assert(miner->benchmark == NULL);
+  srand(opts->seed);
   struct monero_job *job_data = monero_job_gen_random();
+  if (opts->blob != NULL) {
+    size_t blob_len = strlen(opts->blob);
+    uint8_t blob[MONERO_INPUT_HASH_LEN];
+    if (blob_len % 2 != 0 || blob_len / 2 > MONERO_INPUT_HASH_LEN ||
+        blob_len / 2 < MONERO_NONCE_POSITION + sizeof(uint32_t) ||
+        hex_to_binary(opts->blob, blob_len, blob) != blob_len / 2) {
+      log_error("Invalid benchmark blob: %s", opts->blob);
+      monero_job_free(job_data);
+      return false;
+    }
+    free((void *)job_data->blob);
+    job_data->blob = strdup(opts->blob);
+  }
+  log_info("Benchmark: seed: %u, blob: %s", opts->seed, job_data->blob);
+
+  struct monero_benchmark *bench = calloc(1, sizeof(struct monero_benchmark));
+  bench->opts = *opts;
+  bench->solvers =
+      calloc(miner->solvers_len, sizeof(struct monero_benchmark_series));
+  bench->started_at = uv_hrtime();
+  bench->sampled_at = bench->started_at;
+  miner->benchmark = bench;
+  uv_timer_init(uv_default_loop(), &bench->timer_req);
+  bench->timer_req.data = miner;
+  uv_timer_start(&bench->timer_req, monero_miner_benchmark_sample,
+                 BENCHMARK_SAMPLE_SEC * 1000, BENCHMARK_SAMPLE_SEC * 1000);
+
   h->new_job(h, job_data, NULL);
   monero_job_free(job_data);
+  return true;
+}
+
+struct cJSON *monero_miner_benchmark_result(miner_handle h)
+{
+  struct monero_miner *miner = (struct monero_miner *)h;
+  struct monero_benchmark *bench = miner->benchmark;
+  if (bench == NULL) {
+    return NULL;
+  }
+  // hashrate is averaged up to the last sample
+  double seconds =
+      bench->warm_at != 0 ? (double)(bench->sampled_at - bench->warm_at) / 1e9
+                          : 0;
+  char blob[1 + MONERO_INPUT_HASH_LEN * 2] = {0};
+  hex_from_binary(miner->input_hash, miner->input_hash_len, blob);
+
+  cJSON *json = cJSON_CreateObject();
+  cJSON_AddStringToObject(json, "blob", blob);
+  cJSON_AddNumberToObject(json, "seconds", seconds);
+  cJSON *solvers = cJSON_CreateArray();
+  cJSON_AddItemToObject(json, "solvers", solvers);
+  uint64_t total_solutions = 0;
+  for (size_t i = 0; i < miner->solvers_len; ++i) {
+    const struct monero_benchmark_series *series = &bench->solvers[i];
+    struct monero_solver_metrics metrics;
+    monero_solver_get_metrics(miner->solvers[i], &metrics);
+    total_solutions += metrics.solutions_found;
+    cJSON *solver = cJSON_CreateObject();
+    cJSON_AddNumberToObject(solver, "solver", (double)i);
+    cJSON_AddStringToObject(solver, "type",
+                            SOLVER_TYPE_NAMES[miner->solver_types[i]]);
+    cJSON_AddBoolToObject(solver, "enabled",
+                          !miner->verify_stats[i].is_disabled);
+    benchmark_series_to_json(series, series->hashes_prev,
+                             metrics.solutions_found, seconds, solver);
+    cJSON_AddItemToArray(solvers, solver);
+  }
+  benchmark_series_to_json(&bench->total, bench->total.hashes_prev,
+                           total_solutions, seconds, json);
+  return json;
 }
 
 miner_handle monero_miner_new(const struct monero_config *cfg)
@@ -201,40 +813,96 @@ miner_handle monero_miner_new(const struct monero_config *cfg)
   miner->new_job = monero_miner_new_job;
   miner->free = monero_miner_free;
   miner->benchmark = monero_miner_benchmark;
+  miner->benchmark_result = monero_miner_benchmark_result;
+  miner->metrics = monero_miner_metrics;
 
-  size_t solvers_len = 0;
+  // GPU solvers finalize hashes on device unless asked for cpu_final
+  size_t solvers_len = 0, cpu_final_solvers_len = 0, gpu_solvers_len = 0;
   struct monero_config_solver *p = cfg->solvers_list;
-  for (; p != NULL; p = p->next, ++solvers_len)
-    ;
+  for (; p != NULL; p = p->next) {
+    size_t n = monero_miner_config_solvers(p);
+    if (n == 0) {
+      log_error("No Vulkan devices found");
+      goto ERROR;
+    }
+    solvers_len += n;
+    cpu_final_solvers_len +=
+        p->solver_type == MONERO_CONFIG_SOLVER_CL &&
+        ((const struct monero_config_solver_cl *)p)->cpu_final;
+    gpu_solvers_len += p->solver_type != MONERO_CONFIG_SOLVER_CPU ? n : 0;
+  }
 
   monero_miner->solvers_len = solvers_len;
   monero_miner->nonce_chunk_size =
       0xffffffff / (uint32_t)(monero_miner->solvers_len + 1);
   monero_miner->solvers = calloc(solvers_len, sizeof(struct monero_solver **));
-  p = cfg->solvers_list;
-  for (size_t i = 0; i < monero_miner->solvers_len; ++i, p = p->next) {
-    switch (p->solver_type) {
-    case MONERO_CONFIG_SOLVER_CPU:
-      monero_miner->solvers[i] =
-          monero_solver_new_cpu((const struct monero_config_solver_cpu *)p);
-      break;
-    case MONERO_CONFIG_SOLVER_CL:
-      monero_miner->solvers[i] =
-          monero_solver_new_cl((const struct monero_config_solver_cl *)p);
-      break;
-    case MONERO_CONFIG_SOLVER_VK:
-      monero_miner->solvers[i] =
-          monero_solver_new_vk((const struct monero_config_solver_vk *)p);
-      break;
-    }
-    if (monero_miner->solvers[i] == NULL) {
+  monero_miner->verify_stats =
+      calloc(solvers_len, sizeof(struct monero_solver_verify_stats));
+  monero_miner->hashes_prev = calloc(solvers_len, sizeof(uint64_t));
+  monero_miner->hashrate = calloc(solvers_len, sizeof(uint64_t));
+  monero_miner->solver_types =
+      calloc(solvers_len, sizeof(enum monero_config_solver_type));
+  if (cpu_final_solvers_len > 0) {
+    size_t threads = cfg->finalizer_threads > 0
+                         ? (size_t)cfg->finalizer_threads
+                         : cpu_final_solvers_len;
+    monero_miner->finalizer = monero_finalizer_new(threads);
+    if (monero_miner->finalizer == NULL) {
+      goto ERROR;
+    }
+  }
+  // compiled GPU programs are kept between restarts
+  char cache_dir_buf[4096];
+  const char *cache_dir = NULL;
+  if (gpu_solvers_len > 0 && !cfg->cache_disabled &&
+      file_cache_dir(cfg->cache_dir, cache_dir_buf, sizeof(cache_dir_buf))) {
+    cache_dir = cache_dir_buf;
+  }
+  size_t i = 0;
+  for (p = cfg->solvers_list; p != NULL && i < solvers_len; p = p->next) {
+    const size_t n = monero_miner_config_solvers(p);
+    for (size_t d = 0; d < n && i < solvers_len; ++d, ++i) {
+      switch (p->solver_type) {
+      case MONERO_CONFIG_SOLVER_CPU:
+        monero_miner->solvers[i] =
+            monero_solver_new_cpu((const struct monero_config_solver_cpu *)p);
+        break;
+      case MONERO_CONFIG_SOLVER_CL:
+        monero_miner->solvers[i] =
+            monero_solver_new_cl((const struct monero_config_solver_cl *)p,
+                                 monero_miner->finalizer, cache_dir);
+        break;
+      case MONERO_CONFIG_SOLVER_VK: {
+        struct monero_config_solver_vk vk_cfg =
+            *(const struct monero_config_solver_vk *)p;
+        if (vk_cfg.device_id == MONERO_CONFIG_VK_ALL_DEVICES) {
+          vk_cfg.device_id = (int)d;
+        }
+        monero_miner->solvers[i] = monero_solver_new_vk(&vk_cfg, cache_dir);
+        break;
+      }
+      }
+      if (monero_miner->solvers[i] == NULL) {
+        goto ERROR;
+      }
+      monero_miner->solvers[i]->solver_id = (int)i;
+      monero_miner->solver_types[i] = p->solver_type;
+    }
+  }
+  if (i != solvers_len) {
+    log_error("Vulkan devices changed while solvers were created");
+    goto ERROR;
+  }
+
+  if (cfg->verify.max_per_sec > 0) {
+    monero_miner->verifier = monero_verifier_new(monero_miner, &cfg->verify);
+    if (monero_miner->verifier == NULL) {
       goto ERROR;
     }
-    monero_miner->solvers[i]->solver_id = (int)i;
+    // solvers report hashes below sample target, a fraction of every batch
+    monero_miner->sample_target = (uint64_t)(cfg->verify.sample * 0x1p64);
   }
 
-  monero_miner->hashes_prev =
-      calloc(sizeof(uint64_t), monero_miner->solvers_len);
   monero_miner->time_start = time(NULL);
   uv_timer_init(uv_default_loop(), &monero_miner->timer_req);
   monero_miner->timer_req.data = monero_miner;
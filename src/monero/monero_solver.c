@@ -10,7 +10,12 @@
 #include "utils/affinity.h"
 #include "utils/port_sleep.h"
 
-#define SOLUTIONS_BUFFER_SIZE 256
+#define SOLUTIONS_BUFFER_SIZE MONERO_SOLVER_MAX_SOLUTIONS
+/** samples expected from one batch, sample target is lowered to keep the
+ *  device results buffer free for solutions */
+#define SAMPLES_PER_BATCH (MONERO_SOLVER_MAX_SOLUTIONS / 16)
+/** samples are dropped when solutions buffer is filled up to this size */
+#define SAMPLES_BUFFER_SIZE (SOLUTIONS_BUFFER_SIZE / 2)
 
 struct monero_solver_internal {
   /** set to false to terminate worker thread */
@@ -24,6 +29,7 @@ struct monero_solver_internal {
   uint8_t input_hash[MONERO_INPUT_HASH_LEN];
   size_t input_hash_len;
   uint64_t target;
+  uint64_t sample_target;
   uint32_t nonce_from;
   uint32_t nonce_to;
 
@@ -53,6 +59,9 @@ void monero_solver_get_metrics(struct monero_solver *solver,
 
   s->metrics.hashes_processed_total += atomic_exchange(&s->hashes_counter, 0);
   *metrics = s->metrics;
+  if (solver->stage_metrics != NULL) {
+    solver->stage_metrics(solver, metrics);
+  }
 }
 
 static inline void metrics_add_solution(struct monero_solver_metrics *m,
@@ -60,7 +69,8 @@ static inline void metrics_add_solution(struct monero_solver_metrics *m,
 {
   ++m->solutions_found;
   for (size_t i = 0; i < m->solutions_found && i < 10; ++i) {
-    if (m->top_10_solutions[i] > sol) {
+    // empty slots are zero
+    if (m->top_10_solutions[i] == 0 || m->top_10_solutions[i] > sol) {
       uint64_t tmp = m->top_10_solutions[i];
       m->top_10_solutions[i] = sol;
       sol = tmp;
@@ -90,9 +100,61 @@ void monero_solver_solution_found(uv_async_t *handle)
   assert(solver->submit != NULL);
   for (size_t i = 0; i < num_solutions; ++i) {
     solver->submit(s->solver_id, &solutions[i], solver->submit_data);
-    metrics_add_solution(&solver->metrics,
-                         monero_solution_hash_val(solutions[i].hash));
+    if (!solutions[i].is_sample) {
+      metrics_add_solution(&solver->metrics,
+                           monero_solution_hash_val(solutions[i].hash));
+    }
+  }
+}
+
+/** Hand solutions of one batch over to the main loop, hashes not below
+ *  `target` are samples */
+static void monero_solver_push_solutions(struct monero_solver_internal *solver,
+                                         int job_id, uint64_t target,
+                                         const uint8_t *output_hash,
+                                         const uint32_t *output_nonces,
+                                         size_t solutions_found)
+{
+  if (solutions_found == 0) {
+    return;
+  }
+  uv_mutex_lock(&solver->solution_lock);
+  // copy solutions
+  for (size_t i = 0; i < solutions_found; ++i) {
+    const uint8_t *hash = &output_hash[MONERO_OUTPUT_HASH_LEN * i];
+    bool is_sample = monero_solution_hash_val(hash) >= target;
+    if (is_sample && solver->num_solutions >= SAMPLES_BUFFER_SIZE) {
+      continue; // keep the rest for solutions
+    }
+    if (solver->num_solutions < SOLUTIONS_BUFFER_SIZE) {
+      struct monero_solution *sol = &solver->solutions[solver->num_solutions++];
+      sol->job_id = job_id;
+      sol->nonce = output_nonces[i];
+      memcpy(sol->hash, hash, MONERO_OUTPUT_HASH_LEN);
+      sol->is_sample = is_sample;
+    } else {
+      log_error("Solutions buffer full!");
+    }
+  }
+  uv_mutex_unlock(&solver->solution_lock);
+  uv_async_send(&solver->solution_found_async); // notify main loop
+}
+
+/** target passed to the device: `target` or sample target lowered so that
+ *  a batch of `batch` hashes yields SAMPLES_PER_BATCH samples on average,
+ *  whichever is higher. No samples while batch size is unknown */
+static uint64_t monero_solver_device_target(uint64_t target,
+                                            uint64_t sample_target, int batch)
+{
+  if (batch > 0) {
+    double limit = SAMPLES_PER_BATCH * 0x1p64 / batch;
+    if (limit < (double)sample_target) {
+      sample_target = (uint64_t)limit;
+    }
+  } else {
+    sample_target = 0;
   }
+  return target > sample_target ? target : sample_target;
 }
 
 void monero_solver_work_thread(void *arg)
@@ -106,11 +168,32 @@ void monero_solver_work_thread(void *arg)
   uint32_t nonce = 0, nonce_to = 0;
   size_t input_hash_len = 0;
   uint64_t target = 0;
+  uint64_t sample_target = 0;
+  uint64_t device_target = 0; // see monero_solver_device_target
+  int batch = 0;              // hashes of the largest batch so far
+  bool retarget = false;      // device target changed with batch size
   uint8_t output_hash[MONERO_OUTPUT_HASH_LEN * SOLUTIONS_BUFFER_SIZE];
   uint32_t output_nonces[SOLUTIONS_BUFFER_SIZE];
+  size_t solutions_found = 0;
   bool new_job = false;
+  // last batch is still being finalized, see monero_solver.flush
+  bool has_pending = false;
   while (atomic_load(&solver->is_alive)) {
     int j = atomic_load(&solver->job_id);
+    if (has_pending && (j != current_job_id || nonce >= nonce_to || retarget)) {
+      // pending solutions belong to the current job
+      solutions_found = 0;
+      if (s->flush(s) >= 0) {
+        monero_solver_push_solutions(solver, current_job_id, target,
+                                     output_hash, output_nonces,
+                                     solutions_found);
+      }
+      has_pending = false;
+    }
+    if (retarget) {
+      new_job = true; // pass new device target to set_job
+      retarget = false;
+    }
     if (j != current_job_id) {
       // LOAD NEW JOB
 
@@ -127,15 +210,18 @@ void monero_solver_work_thread(void *arg)
         nonce_to = solver->nonce_to;
         // target
         target = solver->target;
+        sample_target = solver->sample_target;
+        device_target =
+            monero_solver_device_target(target, sample_target, batch);
         current_job_id = j;
       }
       new_job = true;
     } else if (nonce < nonce_to) {
-      size_t solutions_found = 0;
+      solutions_found = 0;
 
       if (new_job) {
-        if (s->set_job(s, input_hash, input_hash_len, target, output_hash,
-                       output_nonces, &solutions_found)) {
+        if (s->set_job(s, input_hash, input_hash_len, device_target,
+                       output_hash, output_nonces, &solutions_found)) {
           new_job = false;
         } else {
           // error
@@ -147,30 +233,24 @@ void monero_solver_work_thread(void *arg)
       // PROCESS ONE CHUNK
       int nonces_processed = s->process(s, nonce);
       bool success = nonces_processed >= 0;
-      if (success && solutions_found > 0) {
-        uv_mutex_lock(&solver->solution_lock);
-        // copy solutions
-        for (size_t i = 0; i < solutions_found; ++i) {
-          if (solver->num_solutions < SOLUTIONS_BUFFER_SIZE) {
-            struct monero_solution *sol =
-                &solver->solutions[solver->num_solutions++];
-            sol->job_id = current_job_id;
-            sol->nonce = output_nonces[i];
-            memcpy(sol->hash, &output_hash[MONERO_OUTPUT_HASH_LEN * i],
-                   MONERO_OUTPUT_HASH_LEN);
-          } else {
-            log_error("Solutions buffer full!");
-          }
-        }
-        uv_mutex_unlock(&solver->solution_lock);
-        uv_async_send(&solver->solution_found_async); // notify main loop
-      }
       if (success) {
+        monero_solver_push_solutions(solver, current_job_id, target,
+                                     output_hash, output_nonces,
+                                     solutions_found);
         atomic_fetch_add(&solver->hashes_counter, nonces_processed);
         nonce += nonces_processed;
+        has_pending = s->flush != NULL;
+        if (nonces_processed > batch) {
+          batch = nonces_processed;
+          uint64_t t =
+              monero_solver_device_target(target, sample_target, batch);
+          retarget = t != device_target;
+          device_target = t;
+        }
       } else {
         // processing error, bail on this job and wait for the next one
         nonce = nonce_to = 0;
+        has_pending = false;
       }
     } else {
       // SLEEP: NO JOB AVAILABLE
@@ -187,7 +267,9 @@ void monero_solver_free(struct monero_solver *ptr)
   atomic_store(&solver->is_alive, false);
 
   uv_thread_join(&solver->worker);
-  uv_close((uv_handle_t *)&solver->solution_found_async, NULL);
+  if (!uv_is_closing((uv_handle_t *)&solver->solution_found_async)) {
+    uv_close((uv_handle_t *)&solver->solution_found_async, NULL);
+  }
   uv_mutex_destroy(&solver->solution_lock);
 
   free(solver);
@@ -230,7 +312,8 @@ bool monero_solver_init(const struct monero_config_solver *cfg,
 void monero_solver_work(struct monero_solver *ptr, monero_solver_submit submit,
                         void *submit_data, int job_id,
                         const uint8_t *input_hash, size_t input_hash_len,
-                        uint64_t target, uint32_t nonce_from, uint32_t nonce_to)
+                        uint64_t target, uint64_t sample_target,
+                        uint32_t nonce_from, uint32_t nonce_to)
 {
   assert(ptr != NULL);
   assert(submit != NULL);
@@ -247,6 +330,7 @@ void monero_solver_work(struct monero_solver *ptr, monero_solver_submit submit,
     memcpy(solver->input_hash, input_hash, input_hash_len);
     solver->input_hash_len = input_hash_len;
     solver->target = target;
+    solver->sample_target = sample_target;
     solver->nonce_from = nonce_from;
     solver->nonce_to = nonce_to;
 
@@ -257,3 +341,12 @@ void monero_solver_work(struct monero_solver *ptr, monero_solver_submit submit,
               input_hash_len);
   }
 }
+
+void monero_solver_pause(struct monero_solver *ptr)
+{
+  assert(ptr != NULL);
+  struct monero_solver_internal *solver = ptr->internal;
+  log_debug("Pause solver #%d", ptr->solver_id);
+  solver->nonce_from = solver->nonce_to = 0;
+  atomic_store(&solver->job_id, -1); // signal worker of job change
+}
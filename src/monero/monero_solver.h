@@ -7,10 +7,14 @@
 #include "monero/monero.h"
 #include "monero/monero_config.h"
 
+/** max solutions reported by one call to process */
+#define MONERO_SOLVER_MAX_SOLUTIONS 256
+
 struct monero_solution {
   int job_id;
   uint32_t nonce;
   uint8_t hash[MONERO_OUTPUT_HASH_LEN];
+  bool is_sample; // not below target, reported only for CPU verification
 };
 
 static inline uint64_t monero_solution_hash_val(const uint8_t *hash)
@@ -18,10 +22,19 @@ static inline uint64_t monero_solution_hash_val(const uint8_t *hash)
   return *(uint64_t *)&hash[24];
 }
 
+/** max shader stages timed by a GPU solver */
+#define MONERO_SOLVER_MAX_STAGES 8
+
 struct monero_solver_metrics {
   uint64_t hashes_processed_total;
   uint64_t solutions_found;
   uint64_t top_10_solutions[10];
+  /** device time per shader stage, solvers with stage profiling only */
+  size_t stages_len;
+  struct {
+    const char *name;
+    uint64_t ns_total;
+  } stages[MONERO_SOLVER_MAX_STAGES];
 };
 
 typedef void (*monero_solver_submit)(int solver_id,
@@ -39,14 +52,28 @@ struct monero_solver {
 
   int (*process)(struct monero_solver *, uint32_t nonce_from);
 
+  /** report solutions of the batch still being finalized, called before job
+   *  change. NULL if solver reports solutions from process */
+  int (*flush)(struct monero_solver *);
+
   void (*free)(struct monero_solver *);
+
+  /** fill stage times of metrics, called from the main loop. NULL if solver
+   *  does not time its stages */
+  void (*stage_metrics)(struct monero_solver *,
+                        struct monero_solver_metrics *);
 };
 
+/** Start work on a job. Hashes below `sample_target` that miss `target` are
+ *  submitted as samples, 0 - solutions only */
 void monero_solver_work(struct monero_solver *ptr, monero_solver_submit submit,
                         void *submit_data, int job_id,
                         const uint8_t *input_hash, size_t input_hash_len,
-                        uint64_t target, uint32_t nonce_from,
-                        uint32_t nonce_to);
+                        uint64_t target, uint64_t sample_target,
+                        uint32_t nonce_from, uint32_t nonce_to);
+
+/** stop processing current job, solver stays idle until next work */
+void monero_solver_pause(struct monero_solver *ptr);
 
 void monero_solver_get_metrics(struct monero_solver *,
                                struct monero_solver_metrics *);
@@ -55,13 +82,23 @@ void monero_solver_get_metrics(struct monero_solver *,
 struct monero_solver *
 monero_solver_new_cpu(const struct monero_config_solver_cpu *cfg);
 
-/** new monero opencl solver */
+struct monero_finalizer;
+
+/** new monero opencl solver, cache_dir is NULL when caching is disabled */
 struct monero_solver *
-monero_solver_new_cl(const struct monero_config_solver_cl *cfg);
+monero_solver_new_cl(const struct monero_config_solver_cl *cfg,
+                     struct monero_finalizer *finalizer, const char *cache_dir);
 
-/** new monero vulkan solver */
+/** new monero vulkan solver, cache_dir is NULL when caching is disabled */
 struct monero_solver *
-monero_solver_new_vk(const struct monero_config_solver_vk *cfg);
+monero_solver_new_vk(const struct monero_config_solver_vk *cfg,
+                     const char *cache_dir);
+
+/** number of Vulkan devices, 0 when none or Vulkan is not available */
+size_t monero_solver_vk_devices();
 
 bool monero_solver_init(const struct monero_config_solver *,
                         struct monero_solver *);
+
+/** stop worker thread and free solver */
+void monero_solver_free(struct monero_solver *ptr);
@@ -2,44 +2,84 @@
 
 #include "logging.h"
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <uv.h>
 
 #include "monero.h"
 
 #include "utils/opencl_inc.h"
 
+#include "utils/file_cache.h"
 #include "utils/opencl_err.h"
 #include "utils/port_sleep.h"
 
-#include "crypto/blake.h"
 #include "crypto/cryptonight/cryptonight.h"
-#include "crypto/groestl.h"
-#include "crypto/jh.h"
-#include "crypto/keccak-tiny.h"
-#include "crypto/skein.h"
+#include "crypto/cryptonight/cryptonight_cl.h"
+#include "monero/monero_finalizer.h"
 
 #define STR(x) #x
 
 #define INPUT_BUFFER_SIZE MONERO_INPUT_HASH_LEN
 #define SCRATCHPAD_BUFFER_SIZE(threads)                                        \
   ((size_t)threads * MONERO_CRYPTONIGHT_MEMORY)
-#define OUTPUT_BUFFER_SIZE(threads) ((size_t)threads * 200)
+#define STATE_BUFFER_SIZE(threads)                                             \
+  ((size_t)threads * CRYPTONIGHT_STATE_SIZE)
+/** capacity of the result list written by cn_final */
+#define OUTPUT_MAX_RESULTS 256
+
+/** Output buffer, nonces and hashes below target appended by cn_final */
+struct monero_solver_cl_output {
+  /** number of hashes found, may exceed results capacity */
+  uint32_t count;
+  struct {
+    uint32_t nonce;
+    uint8_t hash[MONERO_OUTPUT_HASH_LEN];
+  } results[OUTPUT_MAX_RESULTS];
+};
+
+/** Buffers of one in-flight batch */
+struct monero_solver_cl_slot {
+  /** states written by kernels, read back only with cpu_final */
+  cl_mem state_buffer;
+  /** results of cn_final, NULL with cpu_final */
+  cl_mem output_buffer;
+  /** pinned host memory output or states are read back to, mapped for its
+   *  lifetime */
+  cl_mem host_buffer;
+  struct monero_solver_cl_output *output;
+  uint8_t *states;
+  /** signalled when output or states are in host memory */
+  cl_event read_event;
+
+  /** batch currently on device */
+  bool is_submitted;
+  uint32_t nonce_from;
+  /** states handed to the finalizer pool, cpu_final only */
+  struct monero_finalizer_batch batch;
+};
 
 struct monero_solver_cl_context {
   /** Config options */
   size_t intensity;
   size_t worksize;
+  /** states are read back and finalized on the CPU, cn_final is not run */
+  bool cpu_final;
 
   cl_context cl_ctx;
   cl_device_id device_id;
   cl_command_queue command_queue;
   cl_program cryptonight_program;
-  cl_kernel krn_init, krn_explode, krn_memloop, krn_implode;
+  cl_kernel krn_init, krn_explode, krn_memloop, krn_implode, krn_final;
 
   cl_mem input_buffer;
+  /** scratchpad is shared, batches run in order on the queue */
   cl_mem scratchpad_buffer;
-  cl_mem output_buffer;
+
+  /** batches queued on device in turn */
+  size_t slots_len;
+  struct monero_solver_cl_slot slots[MONERO_CONFIG_CL_MAX_IN_FLIGHT];
 
   /** Device info and capabilities */
   char device_name[256];
@@ -61,10 +101,20 @@ get_valid_workgroup_size(const struct monero_solver_cl_context *ctx,
 
 struct monero_solver_cl_context *
 monero_solver_cl_context_init(cl_uint platform_id, cl_uint device_id,
-                              size_t intensity, size_t worksize);
+                              size_t intensity, size_t worksize,
+                              size_t slots_len, bool cpu_final,
+                              const char *cache_dir);
+
+static struct monero_solver_cl_context *
+monero_solver_cl_context_open(cl_uint platform_id, cl_uint device_id,
+                              size_t slots_len);
+
+static size_t
+monero_solver_cl_max_intensity(const struct monero_solver_cl_context *ctx,
+                               size_t worksize);
 
 bool monero_solver_cl_context_prepare_kernel(
-    struct monero_solver_cl_context *cl);
+    struct monero_solver_cl_context *cl, const char *cache_dir);
 
 bool monero_solver_cl_context_query_device(struct monero_solver_cl_context *cl);
 
@@ -76,8 +126,11 @@ struct monero_solver_cl {
   /** CL context */
   struct monero_solver_cl_context *cl;
 
-  /** output buffer */
-  uint8_t *output_buffer;
+  /** slot of the next batch, also the oldest batch on device */
+  size_t next_slot;
+
+  /** shared pool finishing hashes with cpu_final, NULL otherwise */
+  struct monero_finalizer *finalizer;
 
   const uint8_t *input_hash;
   size_t input_hash_len;
@@ -85,12 +138,14 @@ struct monero_solver_cl {
   uint8_t *output_hash;
   uint32_t *output_nonces;
   size_t *output_num;
-
-  /** cryptonight context */
-  struct cryptonight_ctx *cryptonight_ctx;
-  struct cryptonight_hash cryptonight_output_hash;
 };
 
+static bool
+monero_solver_cl_autotune(const struct monero_config_solver_cl *cfg,
+                          struct monero_finalizer *finalizer,
+                          const char *cache_dir, size_t *worksize,
+                          size_t *intensity);
+
 bool monero_solver_cl_set_job(struct monero_solver *ptr,
                               const uint8_t *input_hash, size_t input_hash_len,
                               const uint64_t target, uint8_t *output_hash,
@@ -120,8 +175,8 @@ bool monero_solver_cl_set_job(struct monero_solver *ptr,
   cl_uint ret;
   struct monero_solver_cl_context *ctx = solver->cl;
   assert(ctx != NULL);
-  // INPUT BUFFER DATA
-  ret = clEnqueueWriteBuffer(ctx->command_queue, ctx->input_buffer, CL_FALSE, 0,
+  // INPUT BUFFER DATA, no batch is in flight on job change
+  ret = clEnqueueWriteBuffer(ctx->command_queue, ctx->input_buffer, CL_TRUE, 0,
                              INPUT_BUFFER_SIZE, input_buffer, 0, NULL, NULL);
 
   if (ret != CL_SUCCESS) {
@@ -138,6 +193,15 @@ bool monero_solver_cl_set_job(struct monero_solver *ptr,
     return false;
   }
 
+  // TARGET
+  const cl_ulong cl_target = target;
+  ret = clSetKernelArg(ctx->krn_final, 2, sizeof(cl_ulong), &cl_target);
+  if (ret != CL_SUCCESS) {
+    log_error("Error when calling clSetKernelArg for arg #2[target]: %s",
+              cl_err_str(ret));
+    return false;
+  }
+
   return true;
 }
 
@@ -150,38 +214,88 @@ static inline void print_debug(const char *s, uint8_t *mem, size_t N)
   printf("\n");
 }
 
-// *output_hash: SOLUTIONS_BUFFER_SIZE * MONERO_OUTPUT_HASH_LEN
-int monero_solver_cl_process(struct monero_solver *ptr, uint32_t nonce_from)
+/** Enqueue final hash and target check of the batch behind its kernels */
+static bool
+monero_solver_cl_enqueue_final(struct monero_solver_cl_context *ctx,
+                               struct monero_solver_cl_slot *slot,
+                               size_t global_offset)
 {
-  cl_uint ret;
-  struct monero_solver_cl *solver = (struct monero_solver_cl *)ptr;
-  struct monero_solver_cl_context *ctx = solver->cl;
-  assert(ctx != NULL);
+  static const uint32_t zero_count = 0;
+  const size_t global_work_size = ctx->intensity;
+  const size_t local_work_size = ctx->worksize;
+  cl_int ret =
+      clSetKernelArg(ctx->krn_final, 0, sizeof(cl_mem), &slot->state_buffer);
+  if (ret == CL_SUCCESS) {
+    ret =
+        clSetKernelArg(ctx->krn_final, 1, sizeof(cl_mem), &slot->output_buffer);
+  }
+  if (ret != CL_SUCCESS) {
+    log_error("Error when calling clSetKernelArg for final kernel: %s",
+              cl_err_str(ret));
+    return false;
+  }
 
-  const size_t global_work_size = solver->cl->intensity;
-  const size_t local_work_size =
-      get_valid_workgroup_size(ctx, solver->cl->worksize, 1);
-  const size_t output_buffer_size = OUTPUT_BUFFER_SIZE(global_work_size);
+  // reset result counter, source is static so the write need not block
+  ret = clEnqueueWriteBuffer(ctx->command_queue, slot->output_buffer, CL_FALSE,
+                             0, sizeof(zero_count), &zero_count, 0, NULL,
+                             NULL);
+  if (ret != CL_SUCCESS) {
+    log_error("Error when calling clEnqueueWriteBuffer to reset results: %s",
+              cl_err_str(ret));
+    return false;
+  }
+
+  ret = clEnqueueNDRangeKernel(ctx->command_queue, ctx->krn_final, 1,
+                               &global_offset, &global_work_size,
+                               &local_work_size, 0, NULL, NULL);
+  if (ret != CL_SUCCESS) {
+    log_error("Error when calling clEnqueueNDRangeKernel(final): %s",
+              cl_err_str(ret));
+    return false;
+  }
+  return true;
+}
 
+/** Enqueue kernels of the batch and non-blocking read of its results, or
+ *  of its states with cpu_final */
+static bool monero_solver_cl_enqueue(struct monero_solver_cl_context *ctx,
+                                     struct monero_solver_cl_slot *slot,
+                                     uint32_t nonce_from)
+{
+  cl_int ret;
+  const size_t global_work_size = ctx->intensity;
+  const size_t local_work_size = ctx->worksize;
   size_t global_offset = nonce_from;
 
+  // kernel arguments are captured at enqueue time
+  const cl_kernel kernels[] = {ctx->krn_init, ctx->krn_explode,
+                               ctx->krn_memloop, ctx->krn_implode};
+  for (size_t i = 0; i < sizeof(kernels) / sizeof(cl_kernel); ++i) {
+    ret = clSetKernelArg(kernels[i], 1, sizeof(cl_mem), &slot->state_buffer);
+    if (ret != CL_SUCCESS) {
+      log_error("Error when calling clSetKernelArg for state buffer: %s",
+                cl_err_str(ret));
+      return false;
+    }
+  }
+
   ret = clEnqueueNDRangeKernel(ctx->command_queue, ctx->krn_init, 1,
                                &global_offset, &global_work_size,
                                &local_work_size, 0, NULL, NULL);
   if (ret != CL_SUCCESS) {
     log_error("Error when calling clEnqueueNDRangeKernel: %s", cl_err_str(ret));
-    return -1;
+    return false;
   }
 
   size_t gw[3] = {global_work_size, 8, 1};
-  size_t lw[3] = {get_valid_workgroup_size(ctx, local_work_size, 8), 8, 1};
+  size_t lw[3] = {local_work_size, 8, 1};
   size_t go[3] = {global_offset, 0, 0};
   ret = clEnqueueNDRangeKernel(ctx->command_queue, ctx->krn_explode, 3, go, gw,
                                lw, 0, NULL, NULL);
   if (ret != CL_SUCCESS) {
     log_error("Error when calling clEnqueueNDRangeKernel(explode): %s",
               cl_err_str(ret));
-    return -1;
+    return false;
   }
 
   ret = clEnqueueNDRangeKernel(ctx->command_queue, ctx->krn_memloop, 1,
@@ -190,7 +304,7 @@ int monero_solver_cl_process(struct monero_solver *ptr, uint32_t nonce_from)
   if (ret != CL_SUCCESS) {
     log_error("Error when calling clEnqueueNDRangeKernel(memloop): %s",
               cl_err_str(ret));
-    return -1;
+    return false;
   }
 
   ret = clEnqueueNDRangeKernel(ctx->command_queue, ctx->krn_implode, 3, go, gw,
@@ -198,91 +312,207 @@ int monero_solver_cl_process(struct monero_solver *ptr, uint32_t nonce_from)
   if (ret != CL_SUCCESS) {
     log_error("Error when calling clEnqueueNDRangeKernel(implode): %s",
               cl_err_str(ret));
-    return -1;
+    return false;
   }
 
-  // READ RESULTS
-  ret = clEnqueueReadBuffer(ctx->command_queue, ctx->output_buffer, CL_TRUE, 0,
-                            output_buffer_size, solver->output_buffer, 0, NULL,
-                            NULL);
+  if (ctx->cpu_final) {
+    // READ STATES into pinned memory, waited for by monero_solver_cl_complete
+    ret = clEnqueueReadBuffer(ctx->command_queue, slot->state_buffer, CL_FALSE,
+                              0, STATE_BUFFER_SIZE(global_work_size),
+                              slot->states, 0, NULL, &slot->read_event);
+  } else if (monero_solver_cl_enqueue_final(ctx, slot, global_offset)) {
+    // READ RESULTS into pinned memory, waited for by monero_solver_cl_complete
+    ret = clEnqueueReadBuffer(ctx->command_queue, slot->output_buffer, CL_FALSE,
+                              0, sizeof(struct monero_solver_cl_output),
+                              slot->output, 0, NULL, &slot->read_event);
+  } else {
+    return false;
+  }
   if (ret != CL_SUCCESS) {
     log_error("Error when calling clEnqueueReadBuffer to fetch results: %s",
               cl_err_str(ret));
-    return -1;
+    return false;
   }
 
-  static void (*const extra_hashes[4])(const void *, size_t, uint8_t *) = {
-      blake_256, groestl_256, jh_256, skein_512_256};
+  // start execution, host does not wait for it
+  ret = clFlush(ctx->command_queue);
+  if (ret != CL_SUCCESS) {
+    log_error("Error when calling clFlush: %s", cl_err_str(ret));
+    clReleaseEvent(slot->read_event);
+    slot->read_event = NULL;
+    return false;
+  }
+  return true;
+}
 
-  static const size_t OUT_SZ = 200;
-  uint8_t output[256];
-  *solver->output_num = 0;
+/** Wait for results of the batch, with cpu_final its states are queued
+ *  on the finalizer */
+static bool monero_solver_cl_complete(struct monero_solver_cl *solver,
+                                      struct monero_solver_cl_slot *slot)
+{
+  assert(slot->is_submitted);
+  slot->is_submitted = false;
 
-  for (size_t i = 0; i < global_work_size; ++i) {
-    uint8_t *hash_state = solver->output_buffer + i * OUT_SZ;
+  cl_int ret = clWaitForEvents(1, &slot->read_event);
+  clReleaseEvent(slot->read_event);
+  slot->read_event = NULL;
+  if (ret != CL_SUCCESS) {
+    log_error("Error when calling clWaitForEvents for batch %x: %s",
+              slot->nonce_from, cl_err_str(ret));
+    return false;
+  }
 
-    keccak_f((uint64_t *)hash_state, 24);
+  if (solver->finalizer != NULL) {
+    monero_finalizer_submit(solver->finalizer, &slot->batch);
+  }
+  return true;
+}
 
-    const int final_hash_idx = hash_state[0] & 3;
-    extra_hashes[final_hash_idx](hash_state, OUT_SZ * 8, output);
+/** Append one solution to output, false when output is full */
+static bool monero_solver_cl_append(struct monero_solver_cl *solver,
+                                    uint32_t nonce, const uint8_t *hash)
+{
+  size_t k = *solver->output_num;
+  if (k == MONERO_SOLVER_MAX_SOLUTIONS) {
+    log_error("Solutions buffer full!");
+    return false;
+  }
+  memcpy(solver->output_hash + MONERO_OUTPUT_HASH_LEN * k, hash,
+         MONERO_OUTPUT_HASH_LEN);
+  solver->output_nonces[k] = nonce;
+  ++(*solver->output_num);
+  return true;
+}
 
-    if (monero_solution_hash_val(output) < solver->target) {
-      uint32_t nonce = nonce_from + (uint32_t)i;
-      log_debug("Solution found: %x!", nonce);
-      // solution found
-      memcpy(solver->output_hash, output, MONERO_OUTPUT_HASH_LEN);
-      (*solver->output_nonces++) = nonce;
-      ++(*solver->output_num);
+/** Append solutions of the completed batch to output, with cpu_final waits
+ *  until the batch is finalized */
+static void monero_solver_cl_collect(struct monero_solver_cl *solver,
+                                     struct monero_solver_cl_slot *slot)
+{
+  if (solver->finalizer != NULL) {
+    uint8_t hashes[MONERO_OUTPUT_HASH_LEN * MONERO_SOLVER_MAX_SOLUTIONS];
+    uint32_t nonces[MONERO_SOLVER_MAX_SOLUTIONS];
+    size_t n =
+        monero_finalizer_wait(solver->finalizer, &slot->batch, hashes, nonces);
+    for (size_t i = 0; i < n; ++i) {
+      if (!monero_solver_cl_append(solver, nonces[i],
+                                   hashes + MONERO_OUTPUT_HASH_LEN * i)) {
+        break;
+      }
     }
+    return;
+  }
 
-      // compare against CPU version
-//#define __VERIFY_CL_
-#ifdef __VERIFY_CL_
-    log_debug("Verifying results");
-    printf("+++: %d\n", final_hash_idx);
-    *(uint32_t *)&solver->input_hash[MONERO_NONCE_POSITION] = nonce_from + i;
-    cryptonight_aesni(solver->input_hash, solver->input_hash_len,
-                      &solver->cryptonight_output_hash,
-                      solver->cryptonight_ctx);
-    print_debug("FINAL HASH CL:: ", output, 32);
-    print_debug("FINAL HASH CPU: ", &solver->cryptonight_output_hash, 32);
-    if (memcmp(output, &solver->cryptonight_output_hash, 32) != 0) {
-      log_error("Don't match: %lu", i);
-      exit(1);
-    } else {
-      log_info("Match: %lu", i);
+  const struct monero_solver_cl_output *output = slot->output;
+  size_t n = output->count;
+  if (n > OUTPUT_MAX_RESULTS) {
+    log_error("Batch %x: %lu solutions, results buffer full!",
+              slot->nonce_from, n);
+    n = OUTPUT_MAX_RESULTS;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (!monero_solver_cl_append(solver, output->results[i].nonce,
+                                 output->results[i].hash)) {
+      break;
     }
-#endif
+  }
+}
+
+/** Complete all batches on device in submission order and collect
+ *  solutions */
+static bool monero_solver_cl_drain(struct monero_solver_cl *solver)
+{
+  struct monero_solver_cl_context *ctx = solver->cl;
+  bool completed[MONERO_CONFIG_CL_MAX_IN_FLIGHT] = {false};
+  bool res = true;
+  // complete every batch first, finalizer threads take them together
+  for (size_t i = 0; i < ctx->slots_len; ++i) {
+    size_t k = (solver->next_slot + i) % ctx->slots_len;
+    if (ctx->slots[k].is_submitted) {
+      completed[k] = monero_solver_cl_complete(solver, &ctx->slots[k]);
+      res = res && completed[k];
+    }
+  }
+  for (size_t i = 0; i < ctx->slots_len; ++i) {
+    size_t k = (solver->next_slot + i) % ctx->slots_len;
+    if (completed[k]) {
+      monero_solver_cl_collect(solver, &ctx->slots[k]);
+    }
+  }
+  return res;
+}
+
+/** Report solutions of all batches still in flight */
+int monero_solver_cl_flush(struct monero_solver *ptr)
+{
+  struct monero_solver_cl *solver = (struct monero_solver_cl *)ptr;
+  *solver->output_num = 0;
+  return monero_solver_cl_drain(solver) ? 0 : -1;
+}
+
+// *output_hash: MONERO_SOLVER_MAX_SOLUTIONS * MONERO_OUTPUT_HASH_LEN
+int monero_solver_cl_process(struct monero_solver *ptr, uint32_t nonce_from)
+{
+  struct monero_solver_cl *solver = (struct monero_solver_cl *)ptr;
+  struct monero_solver_cl_context *ctx = solver->cl;
+  assert(ctx != NULL);
+  struct monero_solver_cl_slot *slot = &ctx->slots[solver->next_slot];
+  *solver->output_num = 0;
+
+  // oldest batch, the rest of the queue keeps device busy meanwhile. Its
+  // buffers are reused, so it is completed before the next enqueue
+  if (slot->is_submitted) {
+    if (!monero_solver_cl_complete(solver, slot)) {
+      monero_solver_cl_drain(solver);
+      return -1;
+    }
+    monero_solver_cl_collect(solver, slot);
   }
 
-  return (int)global_work_size;
+  slot->nonce_from = nonce_from;
+  slot->batch.target = solver->target;
+  slot->batch.nonce_from = nonce_from;
+  if (!monero_solver_cl_enqueue(ctx, slot, nonce_from)) {
+    monero_solver_cl_drain(solver); // batches in flight are dropped
+    return -1;
+  }
+  slot->is_submitted = true;
+  solver->next_slot = (solver->next_slot + 1) % ctx->slots_len;
+
+  return (int)ctx->intensity;
 }
 
 void monero_solver_cl_free(struct monero_solver *ptr)
 {
   struct monero_solver_cl *solver = (struct monero_solver_cl *)ptr;
 
-  free(solver->output_buffer);
   if (solver->cl != NULL) {
+    // worker thread is gone, drop solutions
+    uint8_t hashes[MONERO_OUTPUT_HASH_LEN * MONERO_SOLVER_MAX_SOLUTIONS];
+    uint32_t nonces[MONERO_SOLVER_MAX_SOLUTIONS];
+    size_t num = 0;
+    solver->output_hash = hashes;
+    solver->output_nonces = nonces;
+    solver->output_num = &num;
+    monero_solver_cl_drain(solver);
+
     monero_solver_cl_context_release(solver->cl);
   }
 
   free(ptr);
 }
 
-struct monero_solver *
-monero_solver_new_cl(const struct monero_config_solver_cl *cfg)
+/** Solver without worker thread, used by autotune as is */
+static struct monero_solver_cl *
+monero_solver_cl_create(const struct monero_config_solver_cl *cfg,
+                        struct monero_finalizer *finalizer,
+                        const char *cache_dir, size_t worksize,
+                        size_t intensity)
 {
-  assert(cfg != NULL);
-  // init gpu
-  assert(cfg->platform_id >= 0);
-  assert(cfg->device_id >= 0);
-  assert(cfg->worksize >= 0);
-  assert(cfg->intensity >= 0);
-
+  assert(!cfg->cpu_final || finalizer != NULL);
   struct monero_solver_cl_context *cl = monero_solver_cl_context_init(
-      (cl_uint)cfg->platform_id, (cl_uint)cfg->device_id,
-      (size_t)cfg->intensity, (size_t)cfg->worksize);
+      (cl_uint)cfg->platform_id, (cl_uint)cfg->device_id, intensity, worksize,
+      (size_t)cfg->in_flight, cfg->cpu_final, cache_dir);
 
   if (cl == NULL) {
     log_error("Error when initializing opencl device");
@@ -292,15 +522,41 @@ monero_solver_new_cl(const struct monero_config_solver_cl *cfg)
   struct monero_solver_cl *solver_cl =
       calloc(1, sizeof(struct monero_solver_cl));
 
-  solver_cl->cryptonight_ctx = cryptonight_ctx_new();
-
-  solver_cl->output_buffer = calloc(1, OUTPUT_BUFFER_SIZE(cfg->intensity));
-
   solver_cl->cl = cl;
+  solver_cl->finalizer = cfg->cpu_final ? finalizer : NULL;
 
   solver_cl->solver.set_job = monero_solver_cl_set_job;
   solver_cl->solver.process = monero_solver_cl_process;
+  solver_cl->solver.flush = monero_solver_cl_flush;
   solver_cl->solver.free = monero_solver_cl_free;
+  return solver_cl;
+}
+
+struct monero_solver *
+monero_solver_new_cl(const struct monero_config_solver_cl *cfg,
+                     struct monero_finalizer *finalizer, const char *cache_dir)
+{
+  assert(cfg != NULL);
+  // init gpu
+  assert(cfg->platform_id >= 0);
+  assert(cfg->device_id >= 0);
+  assert(cfg->autotune || cfg->worksize >= 0);
+  assert(cfg->autotune || cfg->intensity >= 0);
+
+  size_t worksize = (size_t)cfg->worksize;
+  size_t intensity = (size_t)cfg->intensity;
+  if (cfg->autotune && !monero_solver_cl_autotune(cfg, finalizer, cache_dir,
+                                                  &worksize, &intensity)) {
+    log_error("Autotune failed for OpenCL device %d:%d", cfg->platform_id,
+              cfg->device_id);
+    return NULL;
+  }
+
+  struct monero_solver_cl *solver_cl =
+      monero_solver_cl_create(cfg, finalizer, cache_dir, worksize, intensity);
+  if (solver_cl == NULL) {
+    return NULL;
+  }
 
   if (monero_solver_init(&cfg->solver, &solver_cl->solver)) {
     return &solver_cl->solver;
@@ -311,10 +567,11 @@ monero_solver_new_cl(const struct monero_config_solver_cl *cfg)
   }
 }
 
-struct monero_solver_cl_context *
-monero_solver_cl_context_init(cl_uint platform_id, cl_uint device_id,
-                              size_t intensity, size_t worksize)
+static struct monero_solver_cl_context *
+monero_solver_cl_context_open(cl_uint platform_id, cl_uint device_id,
+                              size_t slots_len)
 {
+  assert(slots_len > 0 && slots_len <= MONERO_CONFIG_CL_MAX_IN_FLIGHT);
   // init cl context
   cl_int ret;
   cl_uint num_platforms = 0;
@@ -383,8 +640,7 @@ monero_solver_cl_context_init(cl_uint platform_id, cl_uint device_id,
 
   struct monero_solver_cl_context *ctx =
       calloc(1, sizeof(struct monero_solver_cl_context));
-  ctx->intensity = intensity;
-  ctx->worksize = worksize;
+  ctx->slots_len = slots_len;
 
   ctx->cl_ctx = cl_ctx;
   ctx->device_id = devices[device_id];
@@ -394,8 +650,76 @@ monero_solver_cl_context_init(cl_uint platform_id, cl_uint device_id,
     monero_solver_cl_context_release(ctx);
     return NULL;
   }
+  return ctx;
+}
+
+static size_t
+monero_solver_cl_max_intensity(const struct monero_solver_cl_context *ctx,
+                               size_t worksize)
+{
+  // scratchpad is one allocation, a quarter of device memory is left to
+  // driver and other applications
+  size_t max_intensity =
+      ctx->device_max_memalloc_size / SCRATCHPAD_BUFFER_SIZE(1);
+  const size_t hash_size =
+      SCRATCHPAD_BUFFER_SIZE(1) + STATE_BUFFER_SIZE(ctx->slots_len);
+  if (max_intensity > ctx->device_total_memsize / 4 * 3 / hash_size) {
+    max_intensity = ctx->device_total_memsize / 4 * 3 / hash_size;
+  }
+  return max_intensity / worksize * worksize;
+}
 
-  if (!monero_solver_cl_context_prepare_kernel(ctx)) {
+struct monero_solver_cl_context *
+monero_solver_cl_context_init(cl_uint platform_id, cl_uint device_id,
+                              size_t intensity, size_t worksize,
+                              size_t slots_len, bool cpu_final,
+                              const char *cache_dir)
+{
+  struct monero_solver_cl_context *ctx =
+      monero_solver_cl_context_open(platform_id, device_id, slots_len);
+  if (ctx == NULL) {
+    return NULL;
+  }
+  ctx->cpu_final = cpu_final;
+
+  // explode and implode run 8 work items per hash, global size must be a
+  // multiple of work group size
+  ctx->worksize = get_valid_workgroup_size(ctx, worksize, 8);
+  ctx->intensity = intensity / ctx->worksize * ctx->worksize;
+  ctx->intensity = ctx->intensity == 0 ? ctx->worksize : ctx->intensity;
+  const size_t max_intensity =
+      monero_solver_cl_max_intensity(ctx, ctx->worksize);
+  if (max_intensity == 0) {
+    log_error("Scratchpad of %lu bytes exceeds device memory %lu or max "
+              "allocation size %lu",
+              SCRATCHPAD_BUFFER_SIZE(ctx->worksize), ctx->device_total_memsize,
+              ctx->device_max_memalloc_size);
+    monero_solver_cl_context_release(ctx);
+    return NULL;
+  }
+  if (ctx->intensity > max_intensity) {
+    log_warn("OpenCL device %s: intensity %lu does not fit device memory of "
+             "%lu MiB or max allocation of %lu MiB, lowered to %lu",
+             ctx->device_name, ctx->intensity,
+             (unsigned long)(ctx->device_total_memsize >> 20),
+             (unsigned long)(ctx->device_max_memalloc_size >> 20),
+             max_intensity);
+    ctx->intensity = max_intensity;
+  }
+  log_info("OpenCL device %s: intensity %lu, worksize %lu, %lu batches in "
+           "flight",
+           ctx->device_name, ctx->intensity, ctx->worksize, ctx->slots_len);
+  const size_t hash_size =
+      SCRATCHPAD_BUFFER_SIZE(1) + STATE_BUFFER_SIZE(ctx->slots_len);
+  log_info("OpenCL device %s: %lu MiB of scratchpad and state, %lu MiB "
+           "headroom",
+           ctx->device_name,
+           (unsigned long)((hash_size * ctx->intensity) >> 20),
+           (unsigned long)((ctx->device_total_memsize -
+                            hash_size * ctx->intensity) >>
+                           20));
+
+  if (!monero_solver_cl_context_prepare_kernel(ctx, cache_dir)) {
     log_error("Failed initialize OpenCL solver kernel");
     monero_solver_cl_context_release(ctx);
     return NULL;
@@ -410,13 +734,27 @@ void monero_solver_cl_context_release(struct monero_solver_cl_context *ctx)
   if (v != NULL)                                                               \
   fn(v)
 
+  for (size_t i = 0; i < ctx->slots_len; ++i) {
+    struct monero_solver_cl_slot *slot = &ctx->slots[i];
+    NULL_SAFE_RELEASE(slot->read_event, clReleaseEvent);
+    void *mapped =
+        slot->output != NULL ? (void *)slot->output : (void *)slot->states;
+    if (mapped != NULL) {
+      clEnqueueUnmapMemObject(ctx->command_queue, slot->host_buffer, mapped, 0,
+                              NULL, NULL);
+      clFinish(ctx->command_queue);
+    }
+    NULL_SAFE_RELEASE(slot->host_buffer, clReleaseMemObject);
+    NULL_SAFE_RELEASE(slot->output_buffer, clReleaseMemObject);
+    NULL_SAFE_RELEASE(slot->state_buffer, clReleaseMemObject);
+  }
   NULL_SAFE_RELEASE(ctx->scratchpad_buffer, clReleaseMemObject);
-  NULL_SAFE_RELEASE(ctx->output_buffer, clReleaseMemObject);
   NULL_SAFE_RELEASE(ctx->input_buffer, clReleaseMemObject);
   NULL_SAFE_RELEASE(ctx->krn_init, clReleaseKernel);
   NULL_SAFE_RELEASE(ctx->krn_implode, clReleaseKernel);
   NULL_SAFE_RELEASE(ctx->krn_memloop, clReleaseKernel);
   NULL_SAFE_RELEASE(ctx->krn_explode, clReleaseKernel);
+  NULL_SAFE_RELEASE(ctx->krn_final, clReleaseKernel);
   NULL_SAFE_RELEASE(ctx->cryptonight_program, clReleaseProgram);
   NULL_SAFE_RELEASE(ctx->command_queue, clReleaseCommandQueue);
   NULL_SAFE_RELEASE(ctx->cl_ctx, clReleaseContext);
@@ -456,12 +794,12 @@ bool monero_solver_cl_context_query_device(struct monero_solver_cl_context *gpu)
   log_debug("Device query success: CL_DEVICE_GLOBAL_MEM_SIZE: %lu",
             gpu->device_total_memsize);
 
-  GET_DEVICE_INFO(CL_DEVICE_LOCAL_MEM_SIZE, &gpu->device_max_memalloc_size,
+  GET_DEVICE_INFO(CL_DEVICE_MAX_MEM_ALLOC_SIZE, &gpu->device_max_memalloc_size,
                   sizeof(cl_ulong));
   log_debug("Device query success: CL_DEVICE_MAX_MEM_ALLOC_SIZE: %lu",
             gpu->device_max_memalloc_size);
 
-  GET_DEVICE_INFO(CL_DEVICE_MAX_MEM_ALLOC_SIZE, &gpu->device_local_memsize,
+  GET_DEVICE_INFO(CL_DEVICE_LOCAL_MEM_SIZE, &gpu->device_local_memsize,
                   sizeof(cl_ulong));
   log_debug("Device query success: CL_DEVICE_LOCAL_MEM_SIZE: %lu",
             gpu->device_local_memsize);
@@ -469,43 +807,12 @@ bool monero_solver_cl_context_query_device(struct monero_solver_cl_context *gpu)
   return true;
 }
 
-bool monero_solver_cl_context_prepare_kernel(
-    struct monero_solver_cl_context *ctx)
+/** Build program for the device, build log goes to error log on failure */
+static bool monero_solver_cl_build_program(struct monero_solver_cl_context *ctx,
+                                           const char *build_options)
 {
-  cl_int ret;
-
-  log_debug("Initializing command queue");
-#ifdef CL_VERSION_2_0
-  const cl_queue_properties queue_prop[] = {0, 0, 0};
-  ctx->command_queue = clCreateCommandQueueWithProperties(
-      ctx->cl_ctx, ctx->device_id, queue_prop, &ret);
-#else
-  const cl_command_queue_properties queue_prop = {0};
-  ctx->command_queue =
-      clCreateCommandQueue(ctx->cl_ctx, ctx->device_id, queue_prop, &ret);
-#endif
-
-  if (ret != CL_SUCCESS) {
-    log_error("Error when calling clCreateCommandQueueWithProperties: %s",
-              cl_err_str(ret));
-    return false;
-  }
-
-  log_debug("Creating CL kernel from source");
-//  ctx->cryptonight_program = clCreateProgramWithSource(
-//      ctx->cl_ctx, 1, &RC_CL_SOURCE_CRYPTONIGHT, NULL, &ret);
-  if (ret != CL_SUCCESS) {
-    log_error("Error when calling clCreateProgramWithSource: ",
-              cl_err_str(ret));
-    return false;
-  }
-
-  char build_options[256] = {0};
-  sprintf(build_options, "-DWORKSIZE=%d",
-          (int)get_valid_workgroup_size(ctx, ctx->worksize, 8));
-  log_debug("Compiling CL kernel with options: %s", build_options);
-  ret = clBuildProgram(ctx->cryptonight_program, 1, &ctx->device_id,
-                       build_options, NULL, NULL);
+  cl_int ret = clBuildProgram(ctx->cryptonight_program, 1, &ctx->device_id,
+                              build_options, NULL, NULL);
   if (ret != CL_SUCCESS) {
     log_error("Error when calling  clBuildProgram: %s", cl_err_str(ret));
     size_t build_log_len;
@@ -532,7 +839,7 @@ bool monero_solver_cl_context_prepare_kernel(
   }
 
   cl_build_status status;
-  do {
+  for (;;) {
     ret = clGetProgramBuildInfo(ctx->cryptonight_program, ctx->device_id,
                                 CL_PROGRAM_BUILD_STATUS,
                                 sizeof(cl_build_status), &status, NULL);
@@ -541,9 +848,153 @@ bool monero_solver_cl_context_prepare_kernel(
                 cl_err_str(ret));
       return false;
     }
+    if (status != CL_BUILD_IN_PROGRESS) {
+      break;
+    }
     port_sleep(1);
+  }
+  return true;
+}
+
+/** Hash of device vendor, name, version and driver version */
+static uint64_t
+monero_solver_cl_device_hash(const struct monero_solver_cl_context *ctx)
+{
+  static const cl_device_info device_params[] = {
+      CL_DEVICE_VENDOR, CL_DEVICE_NAME, CL_DEVICE_VERSION, CL_DRIVER_VERSION};
+  uint64_t device_hash = FILE_CACHE_HASH_INIT;
+  for (size_t i = 0; i < sizeof(device_params) / sizeof(cl_device_info);
+       ++i) {
+    char value[1024] = {0};
+    if (clGetDeviceInfo(ctx->device_id, device_params[i], sizeof(value) - 1,
+                        value, NULL) == CL_SUCCESS) {
+      device_hash = file_cache_hash(device_hash, value, strlen(value) + 1);
+    }
+  }
+  return device_hash;
+}
+
+/** Program cache entry name: binaries are only valid for the same device,
+ *  driver, kernel source and build options */
+static void
+monero_solver_cl_program_cache_name(struct monero_solver_cl_context *ctx,
+                                    const char *build_options, char *name,
+                                    size_t name_len)
+{
+  const uint64_t device_hash = monero_solver_cl_device_hash(ctx);
+  uint64_t h = FILE_CACHE_HASH_INIT;
+  h = file_cache_hash(h, cryptonight_cl_source, cryptonight_cl_source_size);
+  h = file_cache_hash(h, build_options, strlen(build_options));
+  snprintf(name, name_len, "cl-%016llx-%016llx.bin",
+           (unsigned long long)device_hash, (unsigned long long)h);
+}
+
+/** Create and build program from cached binary, false when the entry is
+ *  missing or rejected by driver */
+static bool monero_solver_cl_load_program(struct monero_solver_cl_context *ctx,
+                                          const char *cache_dir,
+                                          const char *cache_name,
+                                          const char *build_options)
+{
+  size_t size = 0;
+  unsigned char *binary = file_cache_load(cache_dir, cache_name, &size);
+  if (binary == NULL) {
+    return false;
+  }
+
+  cl_int ret, binary_status = CL_SUCCESS;
+  const unsigned char *binaries[1] = {binary};
+  ctx->cryptonight_program =
+      clCreateProgramWithBinary(ctx->cl_ctx, 1, &ctx->device_id, &size,
+                                binaries, &binary_status, &ret);
+  free(binary);
+  if (ret != CL_SUCCESS || binary_status != CL_SUCCESS ||
+      !monero_solver_cl_build_program(ctx, build_options)) {
+    log_warn("Program cache %s rejected by driver", cache_name);
+    if (ctx->cryptonight_program != NULL) {
+      clReleaseProgram(ctx->cryptonight_program);
+      ctx->cryptonight_program = NULL;
+    }
+    return false;
+  }
+  log_info("Loaded program cache %s, %lu bytes", cache_name, size);
+  return true;
+}
+
+/** Write binary of the built program to disk */
+static void monero_solver_cl_store_program(struct monero_solver_cl_context *ctx,
+                                           const char *cache_dir,
+                                           const char *cache_name)
+{
+  // one device per program
+  size_t size = 0;
+  cl_int ret = clGetProgramInfo(ctx->cryptonight_program,
+                                CL_PROGRAM_BINARY_SIZES, sizeof(size), &size,
+                                NULL);
+  if (ret != CL_SUCCESS || size == 0) {
+    log_warn("Program binary is not available: %s", cl_err_str(ret));
+    return;
+  }
+  unsigned char *binary = malloc(size);
+  ret = clGetProgramInfo(ctx->cryptonight_program, CL_PROGRAM_BINARIES,
+                         sizeof(binary), &binary, NULL);
+  if (ret != CL_SUCCESS) {
+    log_warn("Error when calling clGetProgramInfo for binaries: %s",
+             cl_err_str(ret));
+  } else if (file_cache_store(cache_dir, cache_name, binary, size)) {
+    log_info("Saved program cache %s, %lu bytes", cache_name, size);
+  }
+  free(binary);
+}
+
+bool monero_solver_cl_context_prepare_kernel(
+    struct monero_solver_cl_context *ctx, const char *cache_dir)
+{
+  cl_int ret;
+
+  log_debug("Initializing command queue");
+#ifdef CL_VERSION_2_0
+  const cl_queue_properties queue_prop[] = {0, 0, 0};
+  ctx->command_queue = clCreateCommandQueueWithProperties(
+      ctx->cl_ctx, ctx->device_id, queue_prop, &ret);
+#else
+  const cl_command_queue_properties queue_prop = {0};
+  ctx->command_queue =
+      clCreateCommandQueue(ctx->cl_ctx, ctx->device_id, queue_prop, &ret);
+#endif
+
+  if (ret != CL_SUCCESS) {
+    log_error("Error when calling clCreateCommandQueueWithProperties: %s",
+              cl_err_str(ret));
+    return false;
+  }
 
-  } while (status == CL_BUILD_IN_PROGRESS);
+  char build_options[256] = {0};
+  sprintf(build_options, "-DWORKSIZE=%d -DMAX_RESULTS=%d", (int)ctx->worksize,
+          OUTPUT_MAX_RESULTS);
+  char cache_name[128];
+  monero_solver_cl_program_cache_name(ctx, build_options, cache_name,
+                                      sizeof(cache_name));
+  if (cache_dir == NULL || !monero_solver_cl_load_program(
+                               ctx, cache_dir, cache_name, build_options)) {
+    log_debug("Creating CL kernel from source");
+    const char *source = cryptonight_cl_source;
+    ctx->cryptonight_program = clCreateProgramWithSource(
+        ctx->cl_ctx, 1, &source, &cryptonight_cl_source_size, &ret);
+    if (ret != CL_SUCCESS) {
+      log_error("Error when calling clCreateProgramWithSource: %s",
+                cl_err_str(ret));
+      return false;
+    }
+
+    log_debug("Compiling CL kernel with options: %s", build_options);
+    if (!monero_solver_cl_build_program(ctx, build_options)) {
+      return false;
+    }
+    if (cache_dir != NULL) {
+      monero_solver_cl_store_program(ctx, cache_dir, cache_name);
+    }
+  }
 
 #define CREATE_KERNEL(krn, krnname)                                            \
   {                                                                            \
@@ -559,6 +1010,7 @@ bool monero_solver_cl_context_prepare_kernel(
   CREATE_KERNEL(ctx->krn_explode, "cn_explode")
   CREATE_KERNEL(ctx->krn_memloop, "cn_memloop")
   CREATE_KERNEL(ctx->krn_implode, "cn_implode")
+  CREATE_KERNEL(ctx->krn_final, "cn_final")
 
   // buffers
   ctx->input_buffer = clCreateBuffer(ctx->cl_ctx, CL_MEM_READ_ONLY,
@@ -582,13 +1034,61 @@ bool monero_solver_cl_context_prepare_kernel(
     return false;
   }
 
-  ctx->output_buffer =
-      clCreateBuffer(ctx->cl_ctx, CL_MEM_WRITE_ONLY,
-                     OUTPUT_BUFFER_SIZE(ctx->intensity), NULL, &ret);
-  if (ret != CL_SUCCESS) {
-    log_error("Error when calling clCreateBuffer for output buffer: %s",
-              cl_err_str(ret));
-    return false;
+  // cn_final results, or whole states with cpu_final, are read back
+  const size_t host_size = ctx->cpu_final
+                               ? STATE_BUFFER_SIZE(ctx->intensity)
+                               : sizeof(struct monero_solver_cl_output);
+  for (size_t i = 0; i < ctx->slots_len; ++i) {
+    struct monero_solver_cl_slot *slot = &ctx->slots[i];
+    slot->state_buffer = clCreateBuffer(
+        ctx->cl_ctx,
+        CL_MEM_READ_WRITE |
+            (ctx->cpu_final ? CL_MEM_HOST_READ_ONLY : CL_MEM_HOST_NO_ACCESS),
+        STATE_BUFFER_SIZE(ctx->intensity), NULL, &ret);
+    if (ret != CL_SUCCESS) {
+      log_error("Error when calling clCreateBuffer for state buffer #%lu: %s",
+                i, cl_err_str(ret));
+      return false;
+    }
+
+    if (!ctx->cpu_final) {
+      slot->output_buffer =
+          clCreateBuffer(ctx->cl_ctx, CL_MEM_READ_WRITE,
+                         sizeof(struct monero_solver_cl_output), NULL, &ret);
+      if (ret != CL_SUCCESS) {
+        log_error("Error when calling clCreateBuffer for output buffer #%lu: "
+                  "%s",
+                  i, cl_err_str(ret));
+        return false;
+      }
+    }
+
+    // pinned memory, read back by DMA without staging copy
+    slot->host_buffer =
+        clCreateBuffer(ctx->cl_ctx, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                       host_size, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+      log_error("Error when calling clCreateBuffer for host buffer #%lu: %s",
+                i, cl_err_str(ret));
+      return false;
+    }
+    void *mapped = clEnqueueMapBuffer(ctx->command_queue, slot->host_buffer,
+                                      CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0,
+                                      host_size, 0, NULL, NULL, &ret);
+    if (ret != CL_SUCCESS) {
+      log_error("Error when calling clEnqueueMapBuffer for host buffer #%lu: "
+                "%s",
+                i, cl_err_str(ret));
+      return false;
+    }
+    if (ctx->cpu_final) {
+      slot->states = mapped;
+      slot->batch.states = slot->states;
+      slot->batch.n = ctx->intensity;
+      slot->batch.keccak_f = true;
+    } else {
+      slot->output = mapped;
+    }
   }
 
 #define SET_KERNEL_BUF(krn, argn, buf)                                         \
@@ -601,14 +1101,209 @@ bool monero_solver_cl_context_prepare_kernel(
     }                                                                          \
   }
 
-  SET_KERNEL_BUF(ctx->krn_init, 1, ctx->output_buffer)
+  // state buffers are bound per batch, see monero_solver_cl_enqueue
   SET_KERNEL_BUF(ctx->krn_explode, 0, ctx->scratchpad_buffer)
-  SET_KERNEL_BUF(ctx->krn_explode, 1, ctx->output_buffer)
   SET_KERNEL_BUF(ctx->krn_memloop, 0, ctx->scratchpad_buffer)
-  SET_KERNEL_BUF(ctx->krn_memloop, 1, ctx->output_buffer)
   SET_KERNEL_BUF(ctx->krn_implode, 0, ctx->scratchpad_buffer)
-  SET_KERNEL_BUF(ctx->krn_implode, 1, ctx->output_buffer)
 
   log_debug("Successfully created cryptonight kernel");
   return true;
 }
+
+/** Seconds each autotune candidate is timed for */
+#define CL_AUTOTUNE_SECONDS 2.0
+
+/** Worksizes tried by autotune, as far as device limits allow */
+static const size_t cl_autotune_worksizes[] = {4, 8, 16, 32, 64};
+
+static double monero_solver_cl_seconds_since(const struct timespec *from)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((double)now.tv_sec + 1.0e-9 * now.tv_nsec) -
+         ((double)from->tv_sec + 1.0e-9 * from->tv_nsec);
+}
+
+/** Tuning cache entry name: results hold for the same device, driver,
+ *  kernel source and solver settings */
+static void
+monero_solver_cl_tuning_cache_name(struct monero_solver_cl_context *ctx,
+                                   const struct monero_config_solver_cl *cfg,
+                                   char *name, size_t name_len)
+{
+  const int settings[] = {cfg->in_flight, cfg->intensity, cfg->cpu_final,
+                          OUTPUT_MAX_RESULTS};
+  uint64_t h = FILE_CACHE_HASH_INIT;
+  h = file_cache_hash(h, cryptonight_cl_source, cryptonight_cl_source_size);
+  h = file_cache_hash(h, settings, sizeof(settings));
+  snprintf(name, name_len, "tune-cl-%016llx-%016llx.txt",
+           (unsigned long long)monero_solver_cl_device_hash(ctx),
+           (unsigned long long)h);
+}
+
+static bool monero_solver_cl_load_tuning(const char *cache_dir,
+                                         const char *cache_name,
+                                         size_t *worksize, size_t *intensity)
+{
+  size_t size = 0;
+  char *data = file_cache_load(cache_dir, cache_name, &size);
+  if (data == NULL) {
+    return false;
+  }
+  char text[128] = {0};
+  memcpy(text, data, size < sizeof(text) - 1 ? size : sizeof(text) - 1);
+  free(data);
+
+  unsigned long ws = 0, n = 0;
+  if (sscanf(text, "worksize %lu\nintensity %lu", &ws, &n) != 2 || ws == 0 ||
+      n < ws) {
+    log_warn("Tuning cache %s is malformed, ignored", cache_name);
+    return false;
+  }
+  *worksize = ws;
+  *intensity = n;
+  return true;
+}
+
+/** Hashes per second of one candidate, 0 when it does not run */
+static double
+monero_solver_cl_autotune_run(const struct monero_config_solver_cl *cfg,
+                              struct monero_finalizer *finalizer,
+                              const char *cache_dir, size_t worksize,
+                              size_t intensity)
+{
+  struct monero_solver_cl *solver =
+      monero_solver_cl_create(cfg, finalizer, cache_dir, worksize, intensity);
+  if (solver == NULL) {
+    return 0;
+  }
+
+  // zero target, nothing is ever found
+  const uint8_t input[MONERO_INPUT_HASH_LEN] = {0};
+  uint8_t hashes[MONERO_OUTPUT_HASH_LEN * MONERO_SOLVER_MAX_SOLUTIONS];
+  uint32_t nonces[MONERO_SOLVER_MAX_SOLUTIONS];
+  size_t num = 0;
+  bool ok = monero_solver_cl_set_job(&solver->solver, input, sizeof(input), 0,
+                                     hashes, nonces, &num);
+
+  // first round fills the queue and pays for lazy driver initialization
+  uint32_t nonce = 0;
+  for (size_t i = 0; i < solver->cl->slots_len && ok; ++i) {
+    int n = monero_solver_cl_process(&solver->solver, nonce);
+    ok = n > 0;
+    nonce += (uint32_t)n;
+  }
+  ok = ok && monero_solver_cl_flush(&solver->solver) == 0;
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  size_t hashes_done = 0;
+  while (ok && monero_solver_cl_seconds_since(&start) < CL_AUTOTUNE_SECONDS) {
+    int n = monero_solver_cl_process(&solver->solver, nonce);
+    ok = n > 0;
+    hashes_done += ok ? (size_t)n : 0;
+    nonce += (uint32_t)n;
+  }
+  ok = ok && monero_solver_cl_flush(&solver->solver) == 0;
+  double hashrate =
+      ok ? (double)hashes_done / monero_solver_cl_seconds_since(&start) : 0;
+
+  log_info("Autotune OpenCL(%d:%d): worksize %lu, intensity %lu: %.1f H/s",
+           cfg->platform_id, cfg->device_id, solver->cl->worksize,
+           solver->cl->intensity, hashrate);
+  monero_solver_cl_free(&solver->solver);
+  return hashrate;
+}
+
+static bool
+monero_solver_cl_autotune(const struct monero_config_solver_cl *cfg,
+                          struct monero_finalizer *finalizer,
+                          const char *cache_dir, size_t *worksize,
+                          size_t *intensity)
+{
+  struct monero_solver_cl_context *ctx = monero_solver_cl_context_open(
+      (cl_uint)cfg->platform_id, (cl_uint)cfg->device_id,
+      (size_t)cfg->in_flight);
+  if (ctx == NULL) {
+    return false;
+  }
+
+  char cache_name[128];
+  monero_solver_cl_tuning_cache_name(ctx, cfg, cache_name, sizeof(cache_name));
+  if (cache_dir != NULL && monero_solver_cl_load_tuning(cache_dir, cache_name,
+                                                        worksize, intensity)) {
+    log_info("Autotune OpenCL(%d:%d): worksize %lu, intensity %lu from %s",
+             cfg->platform_id, cfg->device_id, *worksize, *intensity,
+             cache_name);
+    monero_solver_cl_context_release(ctx);
+    return true;
+  }
+
+  // largest batch fitting device memory
+  size_t max_intensity = monero_solver_cl_max_intensity(ctx, 1);
+  if (cfg->intensity > 0 && (size_t)cfg->intensity < max_intensity) {
+    max_intensity = (size_t)cfg->intensity;
+  }
+
+  // explode and implode run 8 work items per hash
+  size_t worksizes[sizeof(cl_autotune_worksizes) / sizeof(size_t)];
+  size_t worksizes_len = 0;
+  for (size_t i = 0; i < sizeof(worksizes) / sizeof(size_t); ++i) {
+    if (cl_autotune_worksizes[i] <= max_intensity &&
+        cl_autotune_worksizes[i] * 8 <= ctx->device_max_work_group_size) {
+      worksizes[worksizes_len++] = cl_autotune_worksizes[i];
+    }
+  }
+  // candidates create their own context
+  monero_solver_cl_context_release(ctx);
+  if (worksizes_len == 0) {
+    log_error("Autotune OpenCL(%d:%d): no worksize fits %lu hashes per batch",
+              cfg->platform_id, cfg->device_id, max_intensity);
+    return false;
+  }
+  log_info("Autotune OpenCL(%d:%d): up to %lu hashes per batch",
+           cfg->platform_id, cfg->device_id, max_intensity);
+
+  // worksize at half the batch, then batch size with the fastest worksize
+  double best = 0;
+  const size_t half = max_intensity / 2;
+  for (size_t i = 0; i < worksizes_len; ++i) {
+    size_t n = half < worksizes[i] ? worksizes[i] : half;
+    double hashrate = monero_solver_cl_autotune_run(cfg, finalizer, cache_dir,
+                                                    worksizes[i], n);
+    if (hashrate > best) {
+      best = hashrate;
+      *worksize = worksizes[i];
+      *intensity = n / worksizes[i] * worksizes[i];
+    }
+  }
+  if (best == 0) {
+    log_error("Autotune OpenCL(%d:%d): no candidate completed",
+              cfg->platform_id, cfg->device_id);
+    return false;
+  }
+  const size_t ws = *worksize;
+  for (size_t k = 1; k <= 4; ++k) {
+    size_t n = max_intensity * k / 4 / ws * ws;
+    if (n == 0 || n == *intensity) {
+      continue;
+    }
+    double hashrate =
+        monero_solver_cl_autotune_run(cfg, finalizer, cache_dir, ws, n);
+    if (hashrate > best) {
+      best = hashrate;
+      *intensity = n;
+    }
+  }
+  log_info("Autotune OpenCL(%d:%d): best worksize %lu, intensity %lu, %.1f "
+           "H/s",
+           cfg->platform_id, cfg->device_id, *worksize, *intensity, best);
+
+  if (cache_dir != NULL) {
+    char text[128];
+    int len = snprintf(text, sizeof(text), "worksize %lu\nintensity %lu\n",
+                       *worksize, *intensity);
+    file_cache_store(cache_dir, cache_name, text, (size_t)len);
+  }
+  return true;
+}
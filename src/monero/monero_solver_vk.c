@@ -1,6 +1,8 @@
 #include "monero/monero_solver.h"
 
 #include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,21 +10,26 @@
 #include <time.h>
 #include <vulkan/vulkan.h>
 
-#include "crypto/blake.h"
 #include "crypto/cryptonight/cryptonight.h"
 #include "crypto/cryptonight_spv.h"
-#include "crypto/groestl.h"
-#include "crypto/jh.h"
-#include "crypto/skein.h"
 
 #include "logging.h"
+#include "utils/file_cache.h"
 #include "utils/unused.h"
 
-#define CRYPTONIGHT_STATE_SIZE 200
-
 #define VK_FLAGS_NONE 0
 
-enum BUFFERS { INPUT_BUFFER = 0, STATE_BUFFER, SCRATCHPAD_BUFFER, NUM_BUFFERS };
+enum BUFFERS {
+  INPUT_BUFFER = 0,
+  STATE_BUFFER,
+  OUTPUT_BUFFER,
+  SCRATCHPAD_BUFFER,
+  NUM_BUFFERS
+};
+
+/** input, state and output buffers belong to a batch, scratchpad is shared
+ *  by the batches of one queue */
+#define NUM_SLOT_BUFFERS SCRATCHPAD_BUFFER
 
 enum PIPELINES {
   PIPELINE_INIT = 0,
@@ -30,36 +37,130 @@ enum PIPELINES {
   PIPELINE_EXPLODE,
   PIPELINE_MEMLOOP,
   PIPELINE_IMPLODE,
+  PIPELINE_FINAL,
+  PIPELINE_INIT_KECCAK,
+  PIPELINE_IMPLODE_KECCAK,
   NUM_COMPUTE_PIPELINES
 };
 
+/** Buffers bound to a pipeline, in binding order */
+struct monero_solver_vk_bindings {
+  uint32_t len;
+  enum BUFFERS buffers[3];
+};
+
+static const struct monero_solver_vk_bindings
+    vk_pipeline_bindings[NUM_COMPUTE_PIPELINES] = {
+        [PIPELINE_INIT] = {2, {INPUT_BUFFER, STATE_BUFFER}},
+        [PIPELINE_KECCAK] = {1, {STATE_BUFFER}},
+        [PIPELINE_EXPLODE] = {2, {STATE_BUFFER, SCRATCHPAD_BUFFER}},
+        [PIPELINE_MEMLOOP] = {3, {INPUT_BUFFER, STATE_BUFFER,
+                                  SCRATCHPAD_BUFFER}},
+        [PIPELINE_IMPLODE] = {2, {STATE_BUFFER, SCRATCHPAD_BUFFER}},
+        [PIPELINE_FINAL] = {3, {INPUT_BUFFER, STATE_BUFFER, OUTPUT_BUFFER}},
+        [PIPELINE_INIT_KECCAK] = {2, {INPUT_BUFFER, STATE_BUFFER}},
+        [PIPELINE_IMPLODE_KECCAK] = {2, {STATE_BUFFER, SCRATCHPAD_BUFFER}}};
+
+/** dispatches of a batch at most: init, keccak, explode, memloop, implode,
+ *  keccak and final */
+#define VK_MAX_DISPATCHES 7
+
+/** Shader specialization constants, see crypto/cryptonight_spv.h */
+struct monero_solver_vk_spec {
+  uint32_t wg_size;
+  uint32_t iterations;
+  uint32_t memory; /** uint4 per hash */
+  uint32_t mask;
+};
+
+/** Buffers and commands of one in-flight batch */
+struct monero_solver_vk_slot {
+  VkDeviceMemory memory[NUM_SLOT_BUFFERS];
+  VkBuffer buffer[NUM_SLOT_BUFFERS];
+  /** host visible copies of input and output buffers, copied by the batch
+   *  commands, state has none */
+  VkDeviceMemory staging_memory[NUM_SLOT_BUFFERS];
+  VkBuffer staging_buffer[NUM_SLOT_BUFFERS];
+  void *input_mmapped;
+  /** struct monero_solver_vk_output */
+  void *output_mmapped;
+
+  VkDescriptorSet descriptor_set[NUM_COMPUTE_PIPELINES];
+  VkCommandBuffer cmd_buffer;
+  VkFence fence;
+  /** queue the batch is submitted to, also its scratchpad */
+  size_t queue;
+
+  /** batch currently on GPU */
+  bool is_submitted;
+  uint32_t nonce_from;
+  struct timespec submitted_at;
+};
+
+/** Input buffer, shared by init, memloop and final shaders */
+struct monero_solver_vk_input {
+  uint32_t nonce;
+  uint8_t hash[CRYPTONIGHT_STATE_SIZE];
+  uint64_t target;
+};
+
+/** Output buffer, nonces and hashes below target appended by final shader */
+struct monero_solver_vk_output {
+  /** number of hashes found, may exceed results capacity */
+  uint32_t count;
+  struct {
+    uint32_t nonce;
+    uint8_t hash[MONERO_OUTPUT_HASH_LEN];
+  } results[CRYPTONIGHT_SPV_FINAL_MAX_RESULTS];
+};
+
 struct monero_solver_vk_context {
   uint32_t device_idx;
   VkInstance instance;
   VkPhysicalDevice physical_device;
   VkPhysicalDeviceProperties physical_device_properties;
+  /** VK_EXT_memory_budget is enabled, heap budget of the process is known */
+  bool memory_budget;
+  /** largest single allocation, VK_WHOLE_SIZE when unknown */
+  VkDeviceSize max_allocation;
+  /** device local memory allocated by the context */
+  VkDeviceSize allocated;
   VkDevice device;
-  VkQueue queue;
+  /** compute queues of one family, batches are spread over them in turn */
+  size_t queues_len;
+  VkQueue queue[MONERO_CONFIG_VK_MAX_IN_FLIGHT];
   VkCommandPool cmd_pool;
   VkDescriptorPool descriptor_pool;
 
-  // memory and buffers
-  VkDeviceMemory memory[NUM_BUFFERS];
-  VkBuffer buffer[NUM_BUFFERS];
-  void *input_mmapped;
-  void *output_mmapped;
-  //  void *scratchpad_mmapped;
+  // scratchpad per queue, shared by the batches of the queue
+  VkDeviceMemory scratchpad_memory[MONERO_CONFIG_VK_MAX_IN_FLIGHT];
+  VkBuffer scratchpad_buffer[MONERO_CONFIG_VK_MAX_IN_FLIGHT];
 
   // shaders
-  VkCommandBuffer cmd_buffer;
   VkShaderModule compute_shader[NUM_COMPUTE_PIPELINES];
   VkDescriptorSetLayout descriptor_set_layout[NUM_COMPUTE_PIPELINES];
-  VkDescriptorSet descriptor_set[NUM_COMPUTE_PIPELINES];
   VkPipelineLayout pipeline_layout[NUM_COMPUTE_PIPELINES];
   VkPipeline pipeline[NUM_COMPUTE_PIPELINES];
-
-  // fence
-  VkFence fence;
+  VkPipelineCache pipeline_cache;
+  struct monero_solver_vk_spec spec;
+  /** init and implode run fused with keccak */
+  bool fused;
+  /** time shader stages with timestamp queries */
+  bool profile;
+
+  // stage profiling, timestamps before the first and after every dispatch
+  // of a batch, VK_NULL_HANDLE when disabled
+  VkQueryPool query_pool;
+  uint32_t timestamp_valid_bits;
+  /** pipeline of every dispatch in recording order, the same for all slots */
+  size_t dispatches_len;
+  size_t dispatch_pipeline[VK_MAX_DISPATCHES];
+  /** device time per pipeline, added by the worker thread */
+  atomic_ullong stage_ns[NUM_COMPUTE_PIPELINES];
+
+  // batches queued on GPU in turn
+  size_t slots_len;
+  struct monero_solver_vk_slot slots[MONERO_CONFIG_VK_MAX_IN_FLIGHT];
 };
 
 struct monero_solver_vk {
@@ -72,6 +173,9 @@ struct monero_solver_vk {
   size_t parallelism;
   size_t workgroups;
 
+  /** slot of the next batch, also the oldest batch on GPU */
+  size_t next_slot;
+
   /** Job params */
   const uint8_t *input_hash;
   size_t input_hash_len;
@@ -79,19 +183,16 @@ struct monero_solver_vk {
   uint8_t *output_hash;
   uint32_t *output_nonces;
   size_t *output_num;
-
-  /** cryptonight context */
-  struct cryptonight_ctx *cryptonight_ctx;
-  struct cryptonight_hash cryptonight_output_hash;
 };
 
 struct monero_solver_vk_context *
-monero_solver_vk_context_init(uint32_t device_idx);
+monero_solver_vk_context_init(uint32_t device_idx, size_t slots_len,
+                              size_t queues_len);
 
 void monero_solver_vk_context_release(struct monero_solver_vk_context *ctx);
 
 bool monero_solver_vk_context_prepare_pipelines(
-    struct monero_solver_vk_context *cl);
+    struct monero_solver_vk_context *vk, const char *cache_dir);
 
 bool monero_solver_vk_context_prepare_buffers(
     struct monero_solver_vk_context *vk, size_t parallelism);
@@ -99,17 +200,59 @@ bool monero_solver_vk_context_prepare_buffers(
 bool monero_solver_vk_context_prepare_command_buffer(
     struct monero_solver_vk_context *vk, size_t workgroups);
 
-void monero_solver_vk_free(struct monero_solver *ptr)
+/** Pipelines recorded into command buffers, others are not created */
+static inline bool
+monero_solver_vk_pipeline_used(const struct monero_solver_vk_context *vk,
+                               size_t pipeline)
 {
-  struct monero_solver_vk *solver = (struct monero_solver_vk *)ptr;
-
-  if (solver->vk != NULL) {
-    monero_solver_vk_context_release(solver->vk);
+  switch (pipeline) {
+  case PIPELINE_INIT:
+  case PIPELINE_KECCAK:
+  case PIPELINE_IMPLODE:
+    return !vk->fused;
+  case PIPELINE_INIT_KECCAK:
+  case PIPELINE_IMPLODE_KECCAK:
+    return vk->fused;
+  default:
+    return true;
   }
+}
 
-  free(ptr);
+/** First timestamp query of the batch */
+static inline uint32_t
+monero_solver_vk_slot_query(const struct monero_solver_vk_context *vk,
+                            const struct monero_solver_vk_slot *slot)
+{
+  return (uint32_t)(slot - vk->slots) * (VK_MAX_DISPATCHES + 1);
+}
+
+/** explode and implode run 8 invocations per hash */
+static inline bool
+monero_solver_vk_worksize_supported(const struct monero_solver_vk_context *vk,
+                                    uint32_t worksize)
+{
+  const VkPhysicalDeviceLimits *limits = &vk->physical_device_properties.limits;
+  return worksize <= limits->maxComputeWorkGroupSize[0] &&
+         worksize * 8 <= limits->maxComputeWorkGroupInvocations;
 }
 
+/** Hashes per batch fitting device local memory left to the solver and the
+ *  largest buffer allowed, `memory` scratchpad bytes per hash */
+static size_t
+monero_solver_vk_max_parallelism(struct monero_solver_vk_context *vk,
+                                 VkDeviceSize memory, size_t slots_len,
+                                 size_t queues_len);
+
+/** Log device local memory allocated and left after buffers are created */
+static void monero_solver_vk_log_headroom(struct monero_solver_vk_context *vk);
+
+/** Find the fastest worksize and parallelism for the device, from tuning
+ *  cache when possible */
+static bool
+monero_solver_vk_autotune(const struct monero_config_solver_vk *cfg,
+                          const char *cache_dir, uint32_t *worksize,
+                          size_t *parallelism);
+
 static inline void print_debug(const char *s, uint8_t *mem, size_t N)
 {
   printf("CPU: %s", s);
@@ -136,10 +279,8 @@ bool monero_solver_vk_set_job(struct monero_solver *ptr,
   solver->output_nonces = output_nonces;
   solver->output_num = output_num;
 
-  struct {
-    uint32_t nonce;
-    uint8_t hash[CRYPTONIGHT_STATE_SIZE];
-  } input_data = {0};
+  struct monero_solver_vk_input input_data = {0};
+  input_data.target = target;
 
   memcpy(input_data.hash, input_hash, input_hash_len);
   // padding
@@ -150,139 +291,264 @@ bool monero_solver_vk_set_job(struct monero_solver *ptr,
     input_data.hash[135] = 0x80;
   }
 
-  // copy memory to GPU
-  memcpy(vk->input_mmapped, &input_data, sizeof(input_data));
+  // copy memory to GPU, no batch is in flight on job change
+  for (size_t i = 0; i < vk->slots_len; ++i) {
+    assert(!vk->slots[i].is_submitted);
+    memcpy(vk->slots[i].input_mmapped, &input_data, sizeof(input_data));
+  }
   return true;
 }
 
-int monero_solver_vk_process(struct monero_solver *ptr, uint32_t nonce_from)
+/** Add device time of every dispatch of completed batch to its pipeline */
+static void
+monero_solver_vk_add_stage_times(struct monero_solver_vk_context *vk,
+                                 const struct monero_solver_vk_slot *slot)
 {
-  log_warn("new job");
-  struct monero_solver_vk *solver = (struct monero_solver_vk *)ptr;
-  struct monero_solver_vk_context *vk = solver->vk;
-
-  *(uint32_t *)vk->input_mmapped = nonce_from;
-
-  VkSubmitInfo submit_info = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-                              .pNext = NULL,
-                              .waitSemaphoreCount = 0,
-                              .pWaitSemaphores = NULL,
-                              .pWaitDstStageMask = NULL,
-                              .commandBufferCount = 1,
-                              .pCommandBuffers = &vk->cmd_buffer,
-                              .signalSemaphoreCount = 0,
-                              .pSignalSemaphores = NULL};
-
-  struct timespec tstart, tend;
-  clock_gettime(CLOCK_MONOTONIC, &tstart);
-
-  log_info("Queue submit: %lu hashes, start nonce: %x", solver->parallelism, nonce_from);
-  VkResult vk_res = vkQueueSubmit(vk->queue, 1, &submit_info, vk->fence);
+  uint64_t ts[VK_MAX_DISPATCHES + 1];
+  const uint32_t n = (uint32_t)vk->dispatches_len + 1;
+  VkResult vk_res = vkGetQueryPoolResults(
+      vk->device, vk->query_pool, monero_solver_vk_slot_query(vk, slot), n,
+      sizeof(ts), ts, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
   if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkQueueSubmit");
-    return -1;
+    log_warn("Batch %x: timestamps unavailable", slot->nonce_from);
+    return;
+  }
+  const uint64_t mask = vk->timestamp_valid_bits < 64
+                            ? (1ULL << vk->timestamp_valid_bits) - 1
+                            : UINT64_MAX;
+  const double period =
+      vk->physical_device_properties.limits.timestampPeriod;
+  for (size_t i = 0; i < vk->dispatches_len; ++i) {
+    uint64_t ticks = (ts[i + 1] - ts[i]) & mask;
+    atomic_fetch_add(&vk->stage_ns[vk->dispatch_pipeline[i]],
+                     (unsigned long long)(ticks * period));
   }
+}
 
-  log_info("Wait for fences");
-  vk_res = vkWaitForFences(vk->device, 1, &vk->fence, VK_TRUE, UINT64_MAX);
-  clock_gettime(CLOCK_MONOTONIC, &tend);
+/** Wait for the batch on GPU and append its solutions to output */
+static bool monero_solver_vk_complete(struct monero_solver_vk *solver,
+                                      struct monero_solver_vk_slot *slot)
+{
+  struct monero_solver_vk_context *vk = solver->vk;
+  assert(slot->is_submitted);
+
+  log_debug("Wait for fences");
+  VkResult vk_res =
+      vkWaitForFences(vk->device, 1, &slot->fence, VK_TRUE, UINT64_MAX);
+  slot->is_submitted = false;
   if (vk_res != VK_SUCCESS) {
     log_error("Error when calling vkWaitForFences");
-    return -1;
+    return false;
   }
 
-  double time_spent = ((double)tend.tv_sec + 1.0e-9 * tend.tv_nsec) -
-                      ((double)tstart.tv_sec + 1.0e-9 * tstart.tv_nsec);
+  struct timespec tend;
+  clock_gettime(CLOCK_MONOTONIC, &tend);
+  double time_spent =
+      ((double)tend.tv_sec + 1.0e-9 * tend.tv_nsec) -
+      ((double)slot->submitted_at.tv_sec + 1.0e-9 * slot->submitted_at.tv_nsec);
 
-  log_info("Reset fences. Exec time: %f", time_spent);
-  vk_res = vkResetFences(vk->device, 1, &vk->fence);
+  log_debug("Reset fences. Batch %x, time since submit: %f", slot->nonce_from,
+            time_spent);
+  vk_res = vkResetFences(vk->device, 1, &slot->fence);
   if (vk_res != VK_SUCCESS) {
     log_error("Error when calling vkResetFences");
-    return -1;
+    return false;
+  }
+  if (vk->query_pool != VK_NULL_HANDLE) {
+    monero_solver_vk_add_stage_times(vk, slot);
+  }
+
+  const struct monero_solver_vk_output *output = slot->output_mmapped;
+  size_t n = output->count;
+  if (n > CRYPTONIGHT_SPV_FINAL_MAX_RESULTS) {
+    log_error("Batch %x: %lu solutions, results buffer full!",
+              slot->nonce_from, n);
+    n = CRYPTONIGHT_SPV_FINAL_MAX_RESULTS;
+  }
+  for (size_t i = 0; i < n; ++i) {
+    size_t k = *solver->output_num;
+    if (k == MONERO_SOLVER_MAX_SOLUTIONS) {
+      log_error("Solutions buffer full!");
+      break;
+    }
+    log_debug("Solution found: %x : %lu!", output->results[i].nonce, k);
+    memcpy(solver->output_hash + MONERO_OUTPUT_HASH_LEN * k,
+           output->results[i].hash, MONERO_OUTPUT_HASH_LEN);
+    solver->output_nonces[k] = output->results[i].nonce;
+    ++(*solver->output_num);
+  }
+  return true;
+}
+
+/** Complete all batches on GPU in submission order and collect solutions */
+static bool monero_solver_vk_drain(struct monero_solver_vk *solver)
+{
+  struct monero_solver_vk_context *vk = solver->vk;
+  bool res = true;
+  for (size_t i = 0; i < vk->slots_len; ++i) {
+    struct monero_solver_vk_slot *slot =
+        &vk->slots[(solver->next_slot + i) % vk->slots_len];
+    if (slot->is_submitted && !monero_solver_vk_complete(solver, slot)) {
+      res = false;
+    }
+  }
+  return res;
+}
+
+void monero_solver_vk_free(struct monero_solver *ptr)
+{
+  struct monero_solver_vk *solver = (struct monero_solver_vk *)ptr;
+
+  if (solver->vk != NULL) {
+    // worker thread is gone, drop solutions
+    uint8_t hashes[MONERO_OUTPUT_HASH_LEN * MONERO_SOLVER_MAX_SOLUTIONS];
+    uint32_t nonces[MONERO_SOLVER_MAX_SOLUTIONS];
+    size_t num = 0;
+    solver->output_hash = hashes;
+    solver->output_nonces = nonces;
+    solver->output_num = &num;
+    monero_solver_vk_drain(solver);
+
+    monero_solver_vk_context_release(solver->vk);
   }
 
-  static void (*const extra_hashes[4])(const void *, size_t, uint8_t *) = {
-      blake_256, groestl_256, jh_256, skein_512_256};
+  free(ptr);
+}
 
-  uint8_t output[256];
+/** Report solutions of all batches still in flight */
+int monero_solver_vk_flush(struct monero_solver *ptr)
+{
+  struct monero_solver_vk *solver = (struct monero_solver_vk *)ptr;
   *solver->output_num = 0;
+  return monero_solver_vk_drain(solver) ? 0 : -1;
+}
 
-  for (size_t i = 0; i < solver->parallelism; ++i) {
-    uint8_t *hash_state =
-        ((uint8_t *)vk->output_mmapped) + i * CRYPTONIGHT_STATE_SIZE;
-
-    const int final_hash_idx = hash_state[0] & 3;
-    extra_hashes[final_hash_idx](hash_state, CRYPTONIGHT_STATE_SIZE * 8,
-                                 output);
-
-    if (monero_solution_hash_val(output) < solver->target) {
-      uint32_t nonce = nonce_from + (uint32_t)i;
-      log_debug("Solution found: %x : %u!", nonce, *solver->output_num);
-      // solution found
-      memcpy(solver->output_hash, output, MONERO_OUTPUT_HASH_LEN);
-      solver->output_nonces[*solver->output_num] = nonce;
-      ++(*solver->output_num);
+/** Device time per shader stage, fused stages are reported as such */
+static void monero_solver_vk_stage_metrics(struct monero_solver *ptr,
+                                           struct monero_solver_metrics *m)
+{
+  struct monero_solver_vk *solver = (struct monero_solver_vk *)ptr;
+  m->stages_len = 0;
+  for (size_t k = 0; k < NUM_COMPUTE_PIPELINES; ++k) {
+    if (monero_solver_vk_pipeline_used(solver->vk, k) &&
+        m->stages_len < MONERO_SOLVER_MAX_STAGES) {
+      m->stages[m->stages_len].name = cryptonight_spv_stage_name(k);
+      m->stages[m->stages_len].ns_total = atomic_load(&solver->vk->stage_ns[k]);
+      ++m->stages_len;
     }
+  }
+}
 
-//#define __VERIFY_VK_
-#ifdef __VERIFY_VK_
-    log_debug("Verifying results");
-    *(uint32_t *)&solver->input_hash[MONERO_NONCE_POSITION] = nonce_from + i;
-    cryptonight_aesni(solver->input_hash, solver->input_hash_len,
-                      &solver->cryptonight_output_hash,
-                      solver->cryptonight_ctx);
-//    print_debug("FINAL HASH VK:: ", output, 32);
-//    print_debug("FINAL HASH CPU: ", &solver->cryptonight_output_hash, 32);
-    if (memcmp(output, &solver->cryptonight_output_hash, 32) != 0) {
-      log_error("Don't match: %lu", i);
-      exit(1);
-    } else {
-      // log_info("Match: %lu", i);
-    }
-#endif
+int monero_solver_vk_process(struct monero_solver *ptr, uint32_t nonce_from)
+{
+  struct monero_solver_vk *solver = (struct monero_solver_vk *)ptr;
+  struct monero_solver_vk_context *vk = solver->vk;
+  struct monero_solver_vk_slot *slot = &vk->slots[solver->next_slot];
+  *solver->output_num = 0;
+
+  // oldest batch, the rest of the queue keeps GPU busy meanwhile
+  if (slot->is_submitted && !monero_solver_vk_complete(solver, slot)) {
+    monero_solver_vk_drain(solver);
+    return -1;
+  }
+
+  // result count is reset by the batch commands
+  *(uint32_t *)slot->input_mmapped = nonce_from;
+
+  VkSubmitInfo submit_info = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                              .pNext = NULL,
+                              .waitSemaphoreCount = 0,
+                              .pWaitSemaphores = NULL,
+                              .pWaitDstStageMask = NULL,
+                              .commandBufferCount = 1,
+                              .pCommandBuffers = &slot->cmd_buffer,
+                              .signalSemaphoreCount = 0,
+                              .pSignalSemaphores = NULL};
 
+  log_debug("Queue submit #%lu: %lu hashes, start nonce: %x",
+            solver->next_slot, solver->parallelism, nonce_from);
+  VkResult vk_res =
+      vkQueueSubmit(vk->queue[slot->queue], 1, &submit_info, slot->fence);
+  if (vk_res != VK_SUCCESS) {
+    log_error("Error when calling vkQueueSubmit");
+    monero_solver_vk_drain(solver); // batches in flight are dropped
+    return -1;
   }
+  slot->is_submitted = true;
+  slot->nonce_from = nonce_from;
+  clock_gettime(CLOCK_MONOTONIC, &slot->submitted_at);
+  solver->next_slot = (solver->next_slot + 1) % vk->slots_len;
 
   return solver->parallelism;
 }
 
-struct monero_solver *
-monero_solver_new_vk(const struct monero_config_solver_vk *cfg)
+/** Create solver with given worksize and parallelism, worker thread is not
+ *  started */
+static struct monero_solver_vk *
+monero_solver_vk_create(const struct monero_config_solver_vk *cfg,
+                        const char *cache_dir, uint32_t worksize,
+                        size_t parallelism)
 {
-  ////////////////////////////// TEMORARY DEBUG ///////////////////////////
-#if 0
-//  log_info("Dumping shader: %p: %lu", cryptonight_init_shader,
-//           cryptonight_implode_shader_size);
-  FILE *f = fopen("/home/fedor/src/dorenom/src/crypto/binary.spv", "w");
-  fwrite((void *)cryptonight_memloop_shader, 1, cryptonight_memloop_shader_size,
-         f);
-  fclose(f);
-  log_info("Wrote %lu, bytes", cryptonight_memloop_shader_size);
-  exit(1);
-#endif
-  ////////////////////////////// TEMORARY DEBUG ///////////////////////////
-
-  assert(cfg != NULL);
-  assert(cfg->device_id >= 0);
   struct monero_solver_vk_context *vk_ctx =
-      monero_solver_vk_context_init((uint32_t)cfg->device_id);
+      monero_solver_vk_context_init((uint32_t)cfg->device_id,
+                                    (size_t)cfg->in_flight,
+                                    (size_t)cfg->queues);
   if (vk_ctx == NULL) {
     log_error("Error when creating Vulkan Context");
     return NULL;
   }
 
-  size_t workgroups = cfg->parallelism / CRYPTONIGHT_SPV_LOCAL_WG_SIZE;
+  vk_ctx->spec = (struct monero_solver_vk_spec){
+      .wg_size = worksize,
+      .iterations = (uint32_t)cfg->iterations,
+      .memory = (uint32_t)cfg->memory >> 4,
+      .mask = (uint32_t)cfg->mask};
+  vk_ctx->fused = cfg->fused;
+  vk_ctx->profile = cfg->profile;
+  if (!monero_solver_vk_worksize_supported(vk_ctx, worksize)) {
+    const VkPhysicalDeviceLimits *limits =
+        &vk_ctx->physical_device_properties.limits;
+    log_error("Worksize %u exceeds device limits: size %u, invocations %u",
+              worksize, limits->maxComputeWorkGroupSize[0],
+              limits->maxComputeWorkGroupInvocations);
+    monero_solver_vk_context_release(vk_ctx);
+    return NULL;
+  }
+  log_info("Worksize: %u, iterations: %u, memory: %u, mask: 0x%x%s",
+           vk_ctx->spec.wg_size, vk_ctx->spec.iterations,
+           vk_ctx->spec.memory << 4, vk_ctx->spec.mask,
+           vk_ctx->fused ? ", fused" : "");
+
+  // the same config fits devices with less memory with smaller batches
+  const size_t max_parallelism = monero_solver_vk_max_parallelism(
+      vk_ctx, (VkDeviceSize)cfg->memory, vk_ctx->slots_len,
+      vk_ctx->queues_len);
+  if (max_parallelism < worksize) {
+    log_error("GPU(%d): device memory left does not fit %u hashes per batch",
+              cfg->device_id, worksize);
+    monero_solver_vk_context_release(vk_ctx);
+    return NULL;
+  }
+  if (parallelism > max_parallelism) {
+    log_warn("GPU(%d): parallelism %lu does not fit device memory, lowered "
+             "to %lu",
+             cfg->device_id, parallelism, max_parallelism);
+    parallelism = max_parallelism;
+  }
+
+  size_t workgroups = parallelism / worksize;
   workgroups = workgroups == 0 ? 1 : workgroups;
-  size_t parallelism = workgroups * CRYPTONIGHT_SPV_LOCAL_WG_SIZE;
+  parallelism = workgroups * worksize;
   // init memory buffers
   if (!monero_solver_vk_context_prepare_buffers(vk_ctx, parallelism)) {
     log_error("Error when initializing memory buffers");
     monero_solver_vk_context_release(vk_ctx);
     return NULL;
   }
+  monero_solver_vk_log_headroom(vk_ctx);
 
   // init compute shaders and pipelines
-  if (!monero_solver_vk_context_prepare_pipelines(vk_ctx)) {
+  if (!monero_solver_vk_context_prepare_pipelines(vk_ctx, cache_dir)) {
     log_error("Error when initializing compute pipelines");
     monero_solver_vk_context_release(vk_ctx);
     return NULL;
@@ -298,13 +564,38 @@ monero_solver_new_vk(const struct monero_config_solver_vk *cfg)
   struct monero_solver_vk *solver_vk =
       calloc(1, sizeof(struct monero_solver_vk));
 
-  solver_vk->cryptonight_ctx = cryptonight_ctx_new();
   solver_vk->vk = vk_ctx;
   solver_vk->parallelism = parallelism;
   solver_vk->workgroups = workgroups;
   solver_vk->solver.set_job = monero_solver_vk_set_job;
   solver_vk->solver.process = monero_solver_vk_process;
+  solver_vk->solver.flush = monero_solver_vk_flush;
   solver_vk->solver.free = monero_solver_vk_free;
+  if (vk_ctx->query_pool != VK_NULL_HANDLE) {
+    solver_vk->solver.stage_metrics = monero_solver_vk_stage_metrics;
+  }
+  return solver_vk;
+}
+
+struct monero_solver *
+monero_solver_new_vk(const struct monero_config_solver_vk *cfg,
+                     const char *cache_dir)
+{
+  assert(cfg != NULL);
+  assert(cfg->device_id >= 0);
+  uint32_t worksize = (uint32_t)cfg->worksize;
+  size_t parallelism = (size_t)cfg->parallelism;
+  if (cfg->autotune &&
+      !monero_solver_vk_autotune(cfg, cache_dir, &worksize, &parallelism)) {
+    log_error("Autotune failed for GPU(%d)", cfg->device_id);
+    return NULL;
+  }
+
+  struct monero_solver_vk *solver_vk =
+      monero_solver_vk_create(cfg, cache_dir, worksize, parallelism);
+  if (solver_vk == NULL) {
+    return NULL;
+  }
 
   if (monero_solver_init(&cfg->solver, &solver_vk->solver)) {
     return &solver_vk->solver;
@@ -348,19 +639,69 @@ VkBool32 vk_debug_report_callback_ext(VkDebugReportFlagsEXT flags,
 
 #endif
 
-struct monero_solver_vk_context *
-monero_solver_vk_context_init(uint32_t device_idx)
+#ifndef NDEBUG
+
+/** Name of installed validation layer or NULL */
+static const char *vk_find_validation_layer()
 {
-  struct monero_solver_vk_context *ctx =
-      calloc(1, sizeof(struct monero_solver_vk_context));
+  static const char *names[] = {"VK_LAYER_KHRONOS_validation",
+                                "VK_LAYER_LUNARG_standard_validation"};
+  uint32_t count = 0;
+  if (vkEnumerateInstanceLayerProperties(&count, NULL) != VK_SUCCESS) {
+    return NULL;
+  }
+  VkLayerProperties *layers = calloc(count, sizeof(VkLayerProperties));
+  const char *res = NULL;
+  if (vkEnumerateInstanceLayerProperties(&count, layers) == VK_SUCCESS) {
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]) && !res; ++i) {
+      for (uint32_t k = 0; k < count; ++k) {
+        if (strcmp(layers[k].layerName, names[i]) == 0) {
+          res = names[i];
+          break;
+        }
+      }
+    }
+  }
+  free(layers);
+  return res;
+}
 
+#endif
+
+/** Vulkan instance shared by all contexts, solvers are created and released
+ *  on the main thread */
+static struct {
+  VkInstance instance;
 #ifndef NDEBUG
-  const char *enabled_layers[] = {"VK_LAYER_LUNARG_standard_validation"};
-  uint32_t enabled_layers_count = sizeof(enabled_layers) / sizeof(const char *);
+  VkDebugReportCallbackEXT debug_callback;
+#endif
+  size_t refs;
+  /** device local memory allocated by all contexts, by device index */
+  VkDeviceSize *allocated;
+  uint32_t devices_len;
+} vk_shared;
+
+/** Shared instance, created on first use */
+static VkInstance monero_solver_vk_instance_acquire()
+{
+  if (vk_shared.refs > 0) {
+    ++vk_shared.refs;
+    return vk_shared.instance;
+  }
 
+#ifndef NDEBUG
+  // validation is optional, software implementations ship without it
+  const char *enabled_layers[1];
+  uint32_t enabled_layers_count = 0;
   const char *enabled_extensions[] = {VK_EXT_DEBUG_REPORT_EXTENSION_NAME};
-  const uint32_t enabled_extensions_count =
-      sizeof(enabled_extensions) / sizeof(char *);
+  uint32_t enabled_extensions_count = 0;
+  const char *validation_layer = vk_find_validation_layer();
+  if (validation_layer != NULL) {
+    enabled_layers[enabled_layers_count++] = validation_layer;
+    enabled_extensions_count = 1;
+  } else {
+    log_warn("Vulkan validation layer not found");
+  }
 
 #else
   const char **enabled_layers = NULL;
@@ -393,38 +734,113 @@ monero_solver_vk_context_init(uint32_t device_idx)
   VkResult vk_res;
 
   // create instance
-  vk_res = vkCreateInstance(&instance_create_info, 0, &ctx->instance);
+  vk_res = vkCreateInstance(&instance_create_info, 0, &vk_shared.instance);
   if (vk_res != VK_SUCCESS) {
     log_error("Error when calling vkCreateInstance: %d", (int)vk_res);
-    goto ERROR;
+    return VK_NULL_HANDLE;
   }
 
 #ifndef NDEBUG
-  log_info("Setting up debug callback");
-
   PFN_vkCreateDebugReportCallbackEXT create_debug_report_callback =
-      (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(
-          ctx->instance, "vkCreateDebugReportCallbackEXT");
+      enabled_extensions_count == 0
+          ? NULL
+          : (PFN_vkCreateDebugReportCallbackEXT)vkGetInstanceProcAddr(
+                vk_shared.instance, "vkCreateDebugReportCallbackEXT");
+
+  if (create_debug_report_callback != NULL) {
+    log_info("Setting up debug callback");
+    VkDebugReportCallbackCreateInfoEXT debug_report_callback_info = {
+        .sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT,
+        .pNext = NULL,
+        .flags = VK_DEBUG_REPORT_INFORMATION_BIT_EXT |
+                 VK_DEBUG_REPORT_WARNING_BIT_EXT |
+                 VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT |
+                 VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_DEBUG_BIT_EXT,
+        .pfnCallback = vk_debug_report_callback_ext,
+        .pUserData = NULL};
+    vk_res = create_debug_report_callback(vk_shared.instance,
+                                          &debug_report_callback_info, NULL,
+                                          &vk_shared.debug_callback);
+    if (vk_res != VK_SUCCESS) {
+      log_error("Error when calling vkCreateDebugReportCallbackEXT: %d",
+                (int)vk_res);
+      vkDestroyInstance(vk_shared.instance, NULL);
+      vk_shared.instance = VK_NULL_HANDLE;
+      return VK_NULL_HANDLE;
+    }
+  }
+#endif
 
-  VkDebugReportCallbackCreateInfoEXT debug_report_callback_info = {
-      .sType = VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT,
-      .pNext = NULL,
-      .flags = VK_DEBUG_REPORT_INFORMATION_BIT_EXT |
-               VK_DEBUG_REPORT_WARNING_BIT_EXT |
-               VK_DEBUG_REPORT_PERFORMANCE_WARNING_BIT_EXT |
-               VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_DEBUG_BIT_EXT,
-      .pfnCallback = vk_debug_report_callback_ext,
-      .pUserData = NULL};
-  VkDebugReportCallbackEXT cbh;
-  vk_res = create_debug_report_callback(
-      ctx->instance, &debug_report_callback_info, NULL, &cbh);
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkCreateDebugReportCallbackEXT: %d",
-              (int)vk_res);
-    goto ERROR;
+  uint32_t physical_device_count = 0;
+  if (vkEnumeratePhysicalDevices(vk_shared.instance, &physical_device_count,
+                                 0) != VK_SUCCESS) {
+    physical_device_count = 0;
   }
+  vk_shared.allocated = calloc(physical_device_count, sizeof(VkDeviceSize));
+  vk_shared.devices_len = physical_device_count;
+
+  vk_shared.refs = 1;
+  return vk_shared.instance;
+}
 
+/** Destroy shared instance when the last context is gone */
+static void monero_solver_vk_instance_release()
+{
+  assert(vk_shared.refs > 0);
+  if (--vk_shared.refs > 0) {
+    return;
+  }
+#ifndef NDEBUG
+  if (vk_shared.debug_callback != VK_NULL_HANDLE) {
+    PFN_vkDestroyDebugReportCallbackEXT destroy_debug_report_callback =
+        (PFN_vkDestroyDebugReportCallbackEXT)vkGetInstanceProcAddr(
+            vk_shared.instance, "vkDestroyDebugReportCallbackEXT");
+    if (destroy_debug_report_callback != NULL) {
+      destroy_debug_report_callback(vk_shared.instance,
+                                    vk_shared.debug_callback, NULL);
+    }
+    vk_shared.debug_callback = VK_NULL_HANDLE;
+  }
 #endif
+  vkDestroyInstance(vk_shared.instance, NULL);
+  vk_shared.instance = VK_NULL_HANDLE;
+  free(vk_shared.allocated);
+  vk_shared.allocated = NULL;
+  vk_shared.devices_len = 0;
+}
+
+size_t monero_solver_vk_devices()
+{
+  VkInstance instance = monero_solver_vk_instance_acquire();
+  if (instance == VK_NULL_HANDLE) {
+    return 0;
+  }
+  uint32_t physical_device_count = 0;
+  if (vkEnumeratePhysicalDevices(instance, &physical_device_count, 0) !=
+      VK_SUCCESS) {
+    log_error("Error when calling vkEnumeratePhysicalDevices");
+    physical_device_count = 0;
+  }
+  monero_solver_vk_instance_release();
+  return physical_device_count;
+}
+
+struct monero_solver_vk_context *
+monero_solver_vk_context_init(uint32_t device_idx, size_t slots_len,
+                              size_t queues_len)
+{
+  assert(slots_len > 0 && slots_len <= MONERO_CONFIG_VK_MAX_IN_FLIGHT);
+  assert(queues_len > 0 && queues_len <= slots_len);
+  struct monero_solver_vk_context *ctx =
+      calloc(1, sizeof(struct monero_solver_vk_context));
+  ctx->device_idx = device_idx;
+  ctx->slots_len = slots_len;
+
+  VkResult vk_res;
+  ctx->instance = monero_solver_vk_instance_acquire();
+  if (ctx->instance == VK_NULL_HANDLE) {
+    goto ERROR;
+  }
 
   // get number of physical devices in the system
   uint32_t physical_device_count = 0;
@@ -434,7 +850,8 @@ monero_solver_vk_context_init(uint32_t device_idx)
     goto ERROR;
   }
   log_debug("Physical devices found: %u", physical_device_count);
-  if (device_idx >= physical_device_count) {
+  if (device_idx >= physical_device_count ||
+      device_idx >= vk_shared.devices_len) {
     log_error("Invalid device id: %u, total number of devices found: %u",
               device_idx, physical_device_count);
     goto ERROR;
@@ -459,9 +876,49 @@ monero_solver_vk_context_init(uint32_t device_idx)
   log_info("Initializing GPU(%u): %s", device_idx,
            ctx->physical_device_properties.deviceName);
 
-  // request compute queue
+  // optional heap budget and allocation limit, both need Vulkan 1.1
+  const char *enabled_device_extensions[1];
+  uint32_t enabled_device_extensions_count = 0;
+  ctx->max_allocation = VK_WHOLE_SIZE;
+  if (ctx->physical_device_properties.apiVersion >= VK_API_VERSION_1_1) {
+    VkPhysicalDeviceMaintenance3Properties maintenance3 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES,
+        .pNext = NULL};
+    VkPhysicalDeviceProperties2 properties2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &maintenance3};
+    vkGetPhysicalDeviceProperties2(ctx->physical_device, &properties2);
+    ctx->max_allocation = maintenance3.maxMemoryAllocationSize;
+
+    uint32_t extensions_count = 0;
+    vkEnumerateDeviceExtensionProperties(ctx->physical_device, NULL,
+                                         &extensions_count, NULL);
+    VkExtensionProperties *extensions =
+        calloc(extensions_count, sizeof(VkExtensionProperties));
+    if (vkEnumerateDeviceExtensionProperties(ctx->physical_device, NULL,
+                                             &extensions_count,
+                                             extensions) == VK_SUCCESS) {
+      for (uint32_t i = 0; i < extensions_count; ++i) {
+        if (strcmp(extensions[i].extensionName,
+                   VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+          ctx->memory_budget = true;
+          enabled_device_extensions[enabled_device_extensions_count++] =
+              VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+          break;
+        }
+      }
+    }
+    free(extensions);
+  }
+  if (!ctx->memory_budget) {
+    log_info("GPU(%u): no memory budget, solver keeps to 3/4 of device "
+             "memory",
+             device_idx);
+  }
+
+  // request compute queues
   uint32_t queue_family_count;
-  const float default_queue_priority = 0.0f;
+  const float queue_priorities[MONERO_CONFIG_VK_MAX_IN_FLIGHT] = {0.0f};
   VkDeviceQueueCreateInfo queue_create_info = {0};
   vkGetPhysicalDeviceQueueFamilyProperties(ctx->physical_device,
                                            &queue_family_count, NULL);
@@ -475,10 +932,16 @@ monero_solver_vk_context_init(uint32_t device_idx)
   for (uint32_t i = 0; i < queue_family_count; ++i) {
     if (queue_family_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
       queue_family_index = i;
+      ctx->timestamp_valid_bits = queue_family_properties[i].timestampValidBits;
       queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
       queue_create_info.queueFamilyIndex = i;
-      queue_create_info.queueCount = 1;
-      queue_create_info.pQueuePriorities = &default_queue_priority;
+      if (queues_len > queue_family_properties[i].queueCount) {
+        log_warn("GPU(%u) has %u compute queues, %lu requested", device_idx,
+                 queue_family_properties[i].queueCount, queues_len);
+        queues_len = queue_family_properties[i].queueCount;
+      }
+      queue_create_info.queueCount = (uint32_t)queues_len;
+      queue_create_info.pQueuePriorities = queue_priorities;
       break;
     }
   }
@@ -500,8 +963,8 @@ monero_solver_vk_context_init(uint32_t device_idx)
       .flags = VK_FLAGS_NONE,
       .queueCreateInfoCount = 1,
       .pQueueCreateInfos = &queue_create_info,
-      .enabledExtensionCount = 0,
-      .ppEnabledExtensionNames = NULL,
+      .enabledExtensionCount = enabled_device_extensions_count,
+      .ppEnabledExtensionNames = enabled_device_extensions,
       .pEnabledFeatures = &enabled_device_features};
 
   vk_res = vkCreateDevice(ctx->physical_device, &device_create_info, NULL,
@@ -511,8 +974,15 @@ monero_solver_vk_context_init(uint32_t device_idx)
     goto ERROR;
   }
 
-  // Get a compute queue
-  vkGetDeviceQueue(ctx->device, queue_family_index, 0, &ctx->queue);
+  // Get compute queues, batches are submitted to them in turn
+  ctx->queues_len = queues_len;
+  for (size_t i = 0; i < queues_len; ++i) {
+    vkGetDeviceQueue(ctx->device, queue_family_index, (uint32_t)i,
+                     &ctx->queue[i]);
+  }
+  for (size_t i = 0; i < slots_len; ++i) {
+    ctx->slots[i].queue = i % queues_len;
+  }
 
   // Compute command pool
   VkCommandPoolCreateInfo cmd_pool_info = {
@@ -527,18 +997,6 @@ monero_solver_vk_context_init(uint32_t device_idx)
     goto ERROR;
   }
 
-  VkCommandBufferAllocateInfo command_buffer_allocate_info = {
-      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL, ctx->cmd_pool,
-      VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
-
-  vk_res = vkAllocateCommandBuffers(ctx->device, &command_buffer_allocate_info,
-                                    &ctx->cmd_buffer);
-
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkAllocateCommandBuffers");
-    goto ERROR;
-  }
-
   return ctx;
 
 ERROR:
@@ -553,6 +1011,9 @@ void monero_solver_vk_context_release(struct monero_solver_vk_context *ctx)
   if (ctx->descriptor_pool != VK_NULL_HANDLE) {
     vkDestroyDescriptorPool(ctx->device, ctx->descriptor_pool, NULL);
   }
+  if (ctx->query_pool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(ctx->device, ctx->query_pool, NULL);
+  }
   for (size_t i = 0; i < NUM_COMPUTE_PIPELINES; ++i) {
     if (ctx->descriptor_set_layout[i] != VK_NULL_HANDLE) {
       vkDestroyDescriptorSetLayout(ctx->device, ctx->descriptor_set_layout[i],
@@ -565,17 +1026,37 @@ void monero_solver_vk_context_release(struct monero_solver_vk_context *ctx)
       vkDestroyPipeline(ctx->device, ctx->pipeline[i], NULL);
     }
   }
-  for (size_t i = 0; i < NUM_BUFFERS; ++i) {
-    if (ctx->buffer[i] != VK_NULL_HANDLE) {
-      vkDestroyBuffer(ctx->device, ctx->buffer[i], NULL);
+  if (ctx->pipeline_cache != VK_NULL_HANDLE) {
+    vkDestroyPipelineCache(ctx->device, ctx->pipeline_cache, NULL);
+  }
+  for (size_t i = 0; i < ctx->slots_len; ++i) {
+    struct monero_solver_vk_slot *slot = &ctx->slots[i];
+    for (size_t k = 0; k < NUM_SLOT_BUFFERS; ++k) {
+      if (slot->buffer[k] != VK_NULL_HANDLE) {
+        vkDestroyBuffer(ctx->device, slot->buffer[k], NULL);
+      }
+      if (slot->memory[k] != VK_NULL_HANDLE) {
+        vkFreeMemory(ctx->device, slot->memory[k], NULL);
+      }
+      if (slot->staging_buffer[k] != VK_NULL_HANDLE) {
+        vkDestroyBuffer(ctx->device, slot->staging_buffer[k], NULL);
+      }
+      // mapped staging memory is unmapped when freed
+      if (slot->staging_memory[k] != VK_NULL_HANDLE) {
+        vkFreeMemory(ctx->device, slot->staging_memory[k], NULL);
+      }
     }
-    if (ctx->memory[i] != VK_NULL_HANDLE) {
-      vkUnmapMemory(ctx->device, ctx->memory[i]);
-      vkFreeMemory(ctx->device, ctx->memory[i], NULL);
+    if (slot->fence != VK_NULL_HANDLE) {
+      vkDestroyFence(ctx->device, slot->fence, NULL);
     }
   }
-  if (ctx->fence != VK_NULL_HANDLE) {
-    vkDestroyFence(ctx->device, ctx->fence, NULL);
+  for (size_t i = 0; i < ctx->queues_len; ++i) {
+    if (ctx->scratchpad_buffer[i] != VK_NULL_HANDLE) {
+      vkDestroyBuffer(ctx->device, ctx->scratchpad_buffer[i], NULL);
+    }
+    if (ctx->scratchpad_memory[i] != VK_NULL_HANDLE) {
+      vkFreeMemory(ctx->device, ctx->scratchpad_memory[i], NULL);
+    }
   }
   if (ctx->cmd_pool != VK_NULL_HANDLE) {
     vkDestroyCommandPool(ctx->device, ctx->cmd_pool, NULL);
@@ -584,14 +1065,22 @@ void monero_solver_vk_context_release(struct monero_solver_vk_context *ctx)
     vkDestroyDevice(ctx->device, NULL);
   }
   if (ctx->instance != VK_NULL_HANDLE) {
-    vkDestroyInstance(ctx->instance, NULL);
+    if (ctx->allocated > 0) {
+      vk_shared.allocated[ctx->device_idx] -= ctx->allocated;
+    }
+    monero_solver_vk_instance_release();
   }
   free(ctx);
 }
 
+/** Memory type of `type_bits` with all `required` flags, the first one with
+ *  `preferred` flags as well when there is one. Host visible memory is
+ *  avoided unless asked for, it is slower or scarce on discrete GPUs */
 static uint32_t
 monero_solver_vk_find_memory(struct monero_solver_vk_context *vk,
-                             VkMemoryPropertyFlags memory_property_flags,
+                             uint32_t type_bits,
+                             VkMemoryPropertyFlags required,
+                             VkMemoryPropertyFlags preferred,
                              VkDeviceSize required_memory_size)
 {
   VkPhysicalDeviceMemoryProperties properties;
@@ -600,252 +1089,445 @@ monero_solver_vk_find_memory(struct monero_solver_vk_context *vk,
   // find appropriate memory
   log_debug("Looking for device memory at least size: %lu",
             required_memory_size);
+  uint32_t res = VK_MAX_MEMORY_TYPES;
+  int res_score = -1;
   for (uint32_t k = 0; k < properties.memoryTypeCount; ++k) {
     VkDeviceSize heap_size =
         properties.memoryHeaps[properties.memoryTypes[k].heapIndex].size;
-
-    bool is_requested_type =
-        memory_property_flags & properties.memoryTypes[k].propertyFlags;
-
-    if (is_requested_type && heap_size >= required_memory_size) {
-      log_debug("Found suitable memory @index: %u", k);
-      return k;
+    VkMemoryPropertyFlags flags = properties.memoryTypes[k].propertyFlags;
+    if (!(type_bits & (1u << k)) || (flags & required) != required ||
+        heap_size < required_memory_size) {
+      continue;
     }
+    bool unwanted_host_visible = flags & ~(required | preferred) &
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    int score = 2 * ((flags & preferred) == preferred) + !unwanted_host_visible;
+    if (score > res_score) {
+      res = k;
+      res_score = score;
+    }
+  }
+  if (res != VK_MAX_MEMORY_TYPES) {
+    log_debug("Found suitable memory @index: %u", res);
   }
-  return VK_MAX_MEMORY_TYPES;
+  return res;
 }
 
-bool monero_solver_vk_context_prepare_buffers(
-    struct monero_solver_vk_context *vk, size_t parallelism)
+/** Log memory type a buffer was allocated from */
+static void monero_solver_vk_log_memory(struct monero_solver_vk_context *vk,
+                                        const char *name, VkDeviceSize size,
+                                        uint32_t memory_type)
 {
-  VkResult vk_res;
-
-  // calculate required memory size
-  const VkDeviceSize buffer_size[NUM_BUFFERS] = {
-      sizeof(uint32_t) + CRYPTONIGHT_STATE_SIZE, // input buffer
-      CRYPTONIGHT_STATE_SIZE * parallelism,      // state buffer
-      MONERO_CRYPTONIGHT_MEMORY * parallelism    // scratchpad buffer
-  };
+  VkPhysicalDeviceMemoryProperties properties;
+  vkGetPhysicalDeviceMemoryProperties(vk->physical_device, &properties);
+  const VkMemoryType *type = &properties.memoryTypes[memory_type];
+  const VkMemoryPropertyFlags f = type->propertyFlags;
+  log_info("Vulkan: %s buffer, %lu bytes, memory type %u (%s%s%s%s), heap %u",
+           name, size, memory_type,
+           f & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT ? "device local" : "host",
+           f & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT ? ", host visible" : "",
+           f & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT ? ", coherent" : "",
+           f & VK_MEMORY_PROPERTY_HOST_CACHED_BIT ? ", cached" : "",
+           type->heapIndex);
+}
 
-  const VkMemoryPropertyFlags buffer_flags[NUM_BUFFERS] = {
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      //      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-      //      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-      //          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT};
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT};
-
-  const VkBufferCreateInfo buffer_create_info[3] = {
-      {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, 0, 0, buffer_size[0],
-       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, 1, NULL},
-      {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, 0, 0, buffer_size[1],
-       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, 1, NULL},
-      {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO, 0, 0, buffer_size[2],
-       VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_SHARING_MODE_EXCLUSIVE, 1, NULL}};
+/** Create buffer backed by its own memory allocation, `name` of the buffer
+ *  is logged with its memory type unless NULL */
+static bool monero_solver_vk_create_buffer(struct monero_solver_vk_context *vk,
+                                           const char *name, VkDeviceSize size,
+                                           VkBufferUsageFlags usage,
+                                           VkMemoryPropertyFlags required,
+                                           VkMemoryPropertyFlags preferred,
+                                           VkBuffer *buffer,
+                                           VkDeviceMemory *memory)
+{
+  const VkBufferCreateInfo buffer_create_info = {
+      VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      0,
+      0,
+      size,
+      usage,
+      VK_SHARING_MODE_EXCLUSIVE,
+      1,
+      NULL};
+
+  VkResult vk_res =
+      vkCreateBuffer(vk->device, &buffer_create_info, NULL, buffer);
+  if (vk_res != VK_SUCCESS) {
+    log_error("Error when calling vkCreateBuffer: buffer of size(%lu)", size);
+    return false;
+  }
 
-  for (size_t k = 0; k < NUM_BUFFERS; ++k) {
-    vk_res = vkCreateBuffer(vk->device, &buffer_create_info[k], NULL,
-                            &vk->buffer[k]);
-    if (vk_res != VK_SUCCESS) {
-      log_error("Error when calling vkCreateBuffer: buffer #%lu of size(%lu)",
-                k, buffer_size[k]);
-      return false;
-    }
+  VkMemoryRequirements buffer_memory_requirements;
+  // determine buffer memory requirements
+  vkGetBufferMemoryRequirements(vk->device, *buffer,
+                                &buffer_memory_requirements);
 
-    VkMemoryRequirements buffer_memory_requirements;
-    // determine buffer memory requirements
-    vkGetBufferMemoryRequirements(vk->device, vk->buffer[k],
-                                  &buffer_memory_requirements);
-
-    // find appropriate memory
-    uint32_t memory_type_index =
-        monero_solver_vk_find_memory(vk, buffer_flags[k], buffer_size[k]);
-    if (memory_type_index == VK_MAX_MEMORY_TYPES) {
-      log_error("Could not find suitable device memory for buffer #%lu. At "
-                "least size: %lu is required",
-                k, buffer_memory_requirements.size);
+  // find appropriate memory
+  uint32_t memory_type_index = monero_solver_vk_find_memory(
+      vk, buffer_memory_requirements.memoryTypeBits, required, preferred,
+      buffer_memory_requirements.size);
+  if (memory_type_index == VK_MAX_MEMORY_TYPES) {
+    log_error("Could not find suitable device memory. At least size: %lu is "
+              "required",
+              buffer_memory_requirements.size);
+    return false;
+  }
+
+  const VkMemoryAllocateInfo memory_allocate_info = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, 0,
+      buffer_memory_requirements.size, memory_type_index};
+
+  vk_res = vkAllocateMemory(vk->device, &memory_allocate_info, 0, memory);
+  if (vk_res != VK_SUCCESS) {
+    log_error("Error when calling vkAllocateMemory: size of(%lu)",
+              buffer_memory_requirements.size);
+    return false;
+  }
+  log_debug("Successfully allocated %lu bytes of memory @memory type %u",
+            buffer_memory_requirements.size, memory_type_index);
+  if (required & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+    vk->allocated += buffer_memory_requirements.size;
+    vk_shared.allocated[vk->device_idx] += buffer_memory_requirements.size;
+  }
+  if (name != NULL) {
+    monero_solver_vk_log_memory(vk, name, buffer_memory_requirements.size,
+                                memory_type_index);
+  }
+
+  vk_res = vkBindBufferMemory(vk->device, *buffer, *memory, 0);
+  if (vk_res != VK_SUCCESS) {
+    log_error("Error when calling vkBindBufferMemory");
+    return false;
+  }
+  return true;
+}
+
+bool monero_solver_vk_context_prepare_buffers(
+    struct monero_solver_vk_context *vk, size_t parallelism)
+{
+  VkResult vk_res;
+
+  // calculate required memory size
+  const VkDeviceSize buffer_size[NUM_BUFFERS] = {
+      sizeof(struct monero_solver_vk_input),  // input buffer
+      CRYPTONIGHT_STATE_SIZE * parallelism,   // state buffer
+      sizeof(struct monero_solver_vk_output), // output buffer
+      (VkDeviceSize)vk->spec.memory * 16 * parallelism // scratchpad buffer
+  };
+  static const char *buffer_name[NUM_BUFFERS] = {"input", "state", "output",
+                                                 "scratchpad"};
+  static const char *staging_name[NUM_SLOT_BUFFERS] = {"input staging", NULL,
+                                                       "output staging"};
+
+  // shaders see device local memory only, input and output are copied
+  // from and to host visible staging buffers by the batch commands
+  const VkBufferUsageFlags buffer_usage[NUM_SLOT_BUFFERS] = {
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+          VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+  const VkBufferUsageFlags staging_usage[NUM_SLOT_BUFFERS] = {
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 0, VK_BUFFER_USAGE_TRANSFER_DST_BIT};
+  const VkMemoryPropertyFlags host_visible =
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+  // results are read by host, cached memory is faster to read from
+  const VkMemoryPropertyFlags staging_preferred[NUM_SLOT_BUFFERS] = {
+      0, 0, VK_MEMORY_PROPERTY_HOST_CACHED_BIT};
+
+  // scratchpad is written and read by one batch of the queue at a time, see
+  // monero_solver_vk_record_commands
+  for (size_t i = 0; i < vk->queues_len; ++i) {
+    if (!monero_solver_vk_create_buffer(
+            vk, i == 0 ? buffer_name[SCRATCHPAD_BUFFER] : NULL,
+            buffer_size[SCRATCHPAD_BUFFER], VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, &vk->scratchpad_buffer[i],
+            &vk->scratchpad_memory[i])) {
+      log_error("Error when creating scratchpad buffer for queue #%lu", i);
       return false;
     }
+  }
 
-    const VkMemoryAllocateInfo memory_allocate_info = {
-        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, 0,
-        buffer_memory_requirements.size, memory_type_index};
+  for (size_t i = 0; i < vk->slots_len; ++i) {
+    struct monero_solver_vk_slot *slot = &vk->slots[i];
+    for (size_t k = 0; k < NUM_SLOT_BUFFERS; ++k) {
+      if (!monero_solver_vk_create_buffer(
+              vk, i == 0 ? buffer_name[k] : NULL, buffer_size[k],
+              buffer_usage[k], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+              &slot->buffer[k], &slot->memory[k])) {
+        log_error("Error when creating buffer #%lu for batch #%lu", k, i);
+        return false;
+      }
+      if (staging_usage[k] != 0 &&
+          !monero_solver_vk_create_buffer(
+              vk, i == 0 ? staging_name[k] : NULL, buffer_size[k],
+              staging_usage[k],
+              host_visible, staging_preferred[k], &slot->staging_buffer[k],
+              &slot->staging_memory[k])) {
+        log_error("Error when creating staging buffer #%lu for batch #%lu", k,
+                  i);
+        return false;
+      }
+    }
 
-    vk_res =
-        vkAllocateMemory(vk->device, &memory_allocate_info, 0, &vk->memory[k]);
+    // map staging buffers to host memory
+    vk_res = vkMapMemory(vk->device, slot->staging_memory[INPUT_BUFFER], 0,
+                         VK_WHOLE_SIZE, 0, &slot->input_mmapped);
     if (vk_res != VK_SUCCESS) {
-      log_error("Error when calling vkAllocateMemory: size of(%lu)",
-                buffer_memory_requirements.size);
+      log_error("Error when calling vkMapMemory for input buffer: %d",
+                (int)vk_res);
       return false;
     }
-    log_debug("Successfully allocated %lu bytes of memory @memory type %u",
-              buffer_memory_requirements.size, memory_type_index);
 
-    vk_res = vkBindBufferMemory(vk->device, vk->buffer[k], vk->memory[k], 0);
+    vk_res = vkMapMemory(vk->device, slot->staging_memory[OUTPUT_BUFFER], 0,
+                         VK_WHOLE_SIZE, 0, &slot->output_mmapped);
     if (vk_res != VK_SUCCESS) {
-      log_error("Error when calling vkBindBufferMemory: buffer #%lu", k);
+      log_error("Error when calling vkMapMemory for output buffer: %d",
+                (int)vk_res);
       return false;
     }
   }
 
-  // map input/output buffers to host memory
-  vk_res = vkMapMemory(vk->device, vk->memory[INPUT_BUFFER], 0, VK_WHOLE_SIZE,
-                       0, &vk->input_mmapped);
+  return true;
+}
 
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkMapMemory for input buffer: %d",
-              (int)vk_res);
-    return false;
+/** Device local memory the context may still allocate: the heap budget left
+ *  to the process with VK_EXT_memory_budget, otherwise three quarters of the
+ *  heap less what all contexts on the device hold, the rest is left to driver
+ *  and other applications */
+static VkDeviceSize
+monero_solver_vk_memory_available(struct monero_solver_vk_context *vk)
+{
+  uint32_t memory_type = monero_solver_vk_find_memory(
+      vk, ~0u, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, 0);
+  if (memory_type == VK_MAX_MEMORY_TYPES) {
+    return 0;
   }
-
-  vk_res = vkMapMemory(vk->device, vk->memory[STATE_BUFFER], 0, VK_WHOLE_SIZE,
-                       0, &vk->output_mmapped);
-
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkMapMemory for output buffer: %d",
-              (int)vk_res);
-    return false;
+  VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+      .pNext = NULL};
+  VkPhysicalDeviceMemoryProperties2 properties = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+      .pNext = vk->memory_budget ? &budget : NULL};
+  if (vk->memory_budget) {
+    vkGetPhysicalDeviceMemoryProperties2(vk->physical_device, &properties);
+  } else {
+    vkGetPhysicalDeviceMemoryProperties(vk->physical_device,
+                                        &properties.memoryProperties);
+  }
+  const uint32_t heap =
+      properties.memoryProperties.memoryTypes[memory_type].heapIndex;
+  if (vk->memory_budget) {
+    return budget.heapBudget[heap] > budget.heapUsage[heap]
+               ? budget.heapBudget[heap] - budget.heapUsage[heap]
+               : 0;
   }
+  const VkDeviceSize limit =
+      properties.memoryProperties.memoryHeaps[heap].size / 4 * 3;
+  const VkDeviceSize allocated = vk_shared.allocated[vk->device_idx];
+  return limit > allocated ? limit - allocated : 0;
+}
 
-  /*
-  vk_res = vkMapMemory(vk->device, vk->memory[SCRATCHPAD_BUFFER], 0,
-  VK_WHOLE_SIZE, 0, &vk->scratchpad_mmapped);
+static size_t
+monero_solver_vk_max_parallelism(struct monero_solver_vk_context *vk,
+                                 VkDeviceSize memory, size_t slots_len,
+                                 size_t queues_len)
+{
+  VkDeviceSize available = monero_solver_vk_memory_available(vk);
+  if (vk->memory_budget) {
+    // pipelines and driver allocations come out of the same budget
+    available -= available / 16;
+  }
+  // scratchpad per queue, state per batch
+  const VkDeviceSize hash_size =
+      memory * queues_len + CRYPTONIGHT_STATE_SIZE * slots_len;
+  // scratchpad of a queue is one buffer
+  VkDeviceSize max_buffer =
+      vk->physical_device_properties.limits.maxStorageBufferRange;
+  if (vk->max_allocation < max_buffer) {
+    max_buffer = vk->max_allocation;
+  }
+  VkDeviceSize res = available / hash_size;
+  if (res > max_buffer / memory) {
+    res = max_buffer / memory;
+  }
+  return (size_t)res;
+}
 
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkMapMemory for output buffer: %d",
-              (int)vk_res);
-    return false;
-  }*/
+static void monero_solver_vk_log_headroom(struct monero_solver_vk_context *vk)
+{
+  log_info("GPU(%u): %lu MiB of device memory allocated, %lu MiB headroom%s",
+           vk->device_idx, (unsigned long)(vk->allocated >> 20),
+           (unsigned long)(monero_solver_vk_memory_available(vk) >> 20),
+           vk->memory_budget ? "" : " below 3/4 of the heap");
+}
 
-  return true;
+/** Hash of all shader binaries */
+static uint64_t monero_solver_vk_shaders_hash()
+{
+  uint64_t h = FILE_CACHE_HASH_INIT;
+  for (size_t i = 0; i < CRYPTONIGHT_SPV_STAGES; ++i) {
+    size_t size;
+    uint32_t *code = cryptonight_spv_shader(i, &size);
+    if (code == NULL) {
+      continue;
+    }
+    h = file_cache_hash(h, code, size);
+    free(code);
+  }
+  return h;
 }
 
-bool monero_solver_vk_context_prepare_pipelines(
-    struct monero_solver_vk_context *vk)
+/** Pipeline cache entry name: compiled pipelines are only valid for the same
+ *  device, driver and shaders */
+static void
+monero_solver_vk_pipeline_cache_name(struct monero_solver_vk_context *vk,
+                                     char *name, size_t name_len)
 {
-  VkResult vk_res;
-  VkShaderModuleCreateInfo cn_init_create_info = {
-      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-      .pNext = 0,
-      .flags = VK_FLAGS_NONE,
-      .codeSize = cryptonight_init_shader_size,
-      .pCode = cryptonight_init_shader};
+  const VkPhysicalDeviceProperties *props = &vk->physical_device_properties;
+  uint64_t h = monero_solver_vk_shaders_hash();
 
-  vk_res = vkCreateShaderModule(vk->device, &cn_init_create_info, 0,
-                                &vk->compute_shader[PIPELINE_INIT]);
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkCreateShaderModule for cn_init shader");
-    return false;
+  char uuid[2 * VK_UUID_SIZE + 1];
+  for (size_t i = 0; i < VK_UUID_SIZE; ++i) {
+    snprintf(uuid + 2 * i, 3, "%02x", props->pipelineCacheUUID[i]);
   }
-  log_debug("`cn_init` shader initialized");
+  snprintf(name, name_len, "vk-%s-%08x-%016llx.bin", uuid,
+           props->driverVersion, (unsigned long long)h);
+}
 
-  VkShaderModuleCreateInfo cn_keccak_create_info = {
-      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-      .pNext = 0,
-      .flags = VK_FLAGS_NONE,
-      .codeSize = cryptonight_keccak_shader_size,
-      .pCode = cryptonight_keccak_shader};
+/** Create pipeline cache, seeded from disk when a matching entry exists */
+static bool
+monero_solver_vk_load_pipeline_cache(struct monero_solver_vk_context *vk,
+                                     const char *cache_dir,
+                                     const char *cache_name,
+                                     void **cache_data, size_t *cache_size)
+{
+  *cache_data = NULL;
+  *cache_size = 0;
+  if (cache_dir != NULL) {
+    *cache_data = file_cache_load(cache_dir, cache_name, cache_size);
+  }
 
-  vk_res = vkCreateShaderModule(vk->device, &cn_keccak_create_info, 0,
-                                &vk->compute_shader[PIPELINE_KECCAK]);
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkCreateShaderModule for `cn_keccak` shader");
-    return false;
+  // header as of VK_PIPELINE_CACHE_HEADER_VERSION_ONE, drivers should reject
+  // foreign data themselves but not all of them do
+  const VkPhysicalDeviceProperties *props = &vk->physical_device_properties;
+  const uint32_t *header = *cache_data;
+  if (header != NULL &&
+      (*cache_size < 16 + VK_UUID_SIZE ||
+       header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+       header[2] != props->vendorID || header[3] != props->deviceID ||
+       memcmp(header + 4, props->pipelineCacheUUID, VK_UUID_SIZE) != 0)) {
+    log_warn("Pipeline cache %s does not match device, ignored", cache_name);
+    free(*cache_data);
+    *cache_data = NULL;
+    *cache_size = 0;
   }
-  log_debug("`cn_keccak` shader initialized");
 
-  VkShaderModuleCreateInfo cn_explode_create_info = {
-      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-      .pNext = 0,
+  VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .pNext = NULL,
       .flags = VK_FLAGS_NONE,
-      .codeSize = cryptonight_explode_shader_size,
-      .pCode = cryptonight_explode_shader};
-
-  vk_res = vkCreateShaderModule(vk->device, &cn_explode_create_info, 0,
-                                &vk->compute_shader[PIPELINE_EXPLODE]);
+      .initialDataSize = *cache_size,
+      .pInitialData = *cache_data};
+
+  VkResult vk_res = vkCreatePipelineCache(
+      vk->device, &pipeline_cache_create_info, NULL, &vk->pipeline_cache);
+  if (vk_res != VK_SUCCESS && *cache_data != NULL) {
+    log_warn("Pipeline cache %s rejected by driver", cache_name);
+    free(*cache_data);
+    *cache_data = NULL;
+    *cache_size = 0;
+    pipeline_cache_create_info.initialDataSize = 0;
+    pipeline_cache_create_info.pInitialData = NULL;
+    vk_res = vkCreatePipelineCache(vk->device, &pipeline_cache_create_info,
+                                   NULL, &vk->pipeline_cache);
+  }
   if (vk_res != VK_SUCCESS) {
-    log_error(
-        "Error when calling vkCreateShaderModule for `cn_explode` shader");
+    log_error("Error when calling vkCreatePipelineCache");
     return false;
   }
-  log_debug("`cn_explode` shader initialized");
-
-  VkShaderModuleCreateInfo cn_memloop_create_info = {
-      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-      .pNext = 0,
-      .flags = VK_FLAGS_NONE,
-      .codeSize = cryptonight_memloop_shader_size,
-      .pCode = cryptonight_memloop_shader};
+  if (*cache_data != NULL) {
+    log_info("Loaded pipeline cache %s, %lu bytes", cache_name, *cache_size);
+  }
+  return true;
+}
 
-  vk_res = vkCreateShaderModule(vk->device, &cn_memloop_create_info, 0,
-                                &vk->compute_shader[PIPELINE_MEMLOOP]);
-  if (vk_res != VK_SUCCESS) {
-    log_error(
-        "Error when calling vkCreateShaderModule for `cn_memloop` shader");
-    return false;
+/** Write pipeline cache back to disk unless it is unchanged */
+static void
+monero_solver_vk_store_pipeline_cache(struct monero_solver_vk_context *vk,
+                                      const char *cache_dir,
+                                      const char *cache_name,
+                                      const void *cache_data, size_t cache_size)
+{
+  size_t size = 0;
+  VkResult vk_res =
+      vkGetPipelineCacheData(vk->device, vk->pipeline_cache, &size, NULL);
+  if (vk_res != VK_SUCCESS || size == 0) {
+    return;
   }
-  log_debug("`cn_memloop` shader initialized");
+  void *data = malloc(size);
+  vk_res = vkGetPipelineCacheData(vk->device, vk->pipeline_cache, &size, data);
+  if (vk_res == VK_SUCCESS &&
+      (size != cache_size || memcmp(data, cache_data, size) != 0) &&
+      file_cache_store(cache_dir, cache_name, data, size)) {
+    log_info("Saved pipeline cache %s, %lu bytes", cache_name, size);
+  }
+  free(data);
+}
 
-  VkShaderModuleCreateInfo cn_implode_create_info = {
-      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-      .pNext = 0,
-      .flags = VK_FLAGS_NONE,
-      .codeSize = cryptonight_implode_shader_size,
-      .pCode = cryptonight_implode_shader};
+/** Create shader modules and compute pipelines through pipeline cache */
+static bool
+monero_solver_vk_context_create_pipelines(struct monero_solver_vk_context *vk)
+{
+  VkResult vk_res;
+  _Static_assert((int)NUM_COMPUTE_PIPELINES == (int)CRYPTONIGHT_SPV_STAGES,
+                 "pipeline per shader stage");
+  for (size_t i = 0; i < NUM_COMPUTE_PIPELINES; ++i) {
+    if (!monero_solver_vk_pipeline_used(vk, i)) {
+      continue;
+    }
+    const char *name = cryptonight_spv_stage_name(i);
+    size_t size;
+    uint32_t *code = cryptonight_spv_shader(i, &size);
+    if (code == NULL) {
+      log_error("Out of memory generating `%s` shader", name);
+      return false;
+    }
+    VkShaderModuleCreateInfo create_info = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .pNext = 0,
+        .flags = VK_FLAGS_NONE,
+        .codeSize = size,
+        .pCode = code};
+    vk_res = vkCreateShaderModule(vk->device, &create_info, 0,
+                                  &vk->compute_shader[i]);
+    free(code);
+    if (vk_res != VK_SUCCESS) {
+      log_error("Error when calling vkCreateShaderModule for `%s` shader",
+                name);
+      return false;
+    }
+    log_debug("`%s` shader initialized", name);
+  }
 
-  vk_res = vkCreateShaderModule(vk->device, &cn_implode_create_info, 0,
-                                &vk->compute_shader[PIPELINE_IMPLODE]);
-  if (vk_res != VK_SUCCESS) {
-    log_error(
-        "Error when calling vkCreateShaderModule for `cn_implode` shader");
-    return false;
+  // descriptors set, storage buffers only
+  VkDescriptorSetLayoutBinding descriptor_set_layout_bindings[3];
+  for (uint32_t i = 0; i < 3; ++i) {
+    descriptor_set_layout_bindings[i] = (VkDescriptorSetLayoutBinding){
+        i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
+        0};
   }
-  log_debug("`cn_implode` shader initialized");
-
-  // descriptors set
-  VkDescriptorSetLayoutBinding input_descriptor_set_layout_bindings[2] = {
-      {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
-      {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
-       0}};
-
-  VkDescriptorSetLayoutBinding keccak_descriptor_set_layout_bindings[1] = {
-      {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
-       0}};
-
-  VkDescriptorSetLayoutBinding explode_descriptor_set_layout_bindings[2] = {
-      {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
-      {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
-       0}};
-
-  VkDescriptorSetLayoutBinding memloop_descriptor_set_layout_bindings[3] = {
-      {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
-      {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
-      {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
-       0}};
-
-  VkDescriptorSetLayoutBinding implode_descriptor_set_layout_bindings[2] = {
-      {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, 0},
-      {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT,
-       0}};
-
-  VkDescriptorSetLayoutCreateInfo
-      descriptor_set_layout_create_info[NUM_COMPUTE_PIPELINES] = {
-          {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0, 2,
-           input_descriptor_set_layout_bindings},
-          {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0, 1,
-           keccak_descriptor_set_layout_bindings},
-          {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0, 2,
-           explode_descriptor_set_layout_bindings},
-          {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0, 3,
-           memloop_descriptor_set_layout_bindings},
-          {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0, 2,
-           implode_descriptor_set_layout_bindings}};
 
   for (size_t k = 0; k < NUM_COMPUTE_PIPELINES; ++k) {
+    if (!monero_solver_vk_pipeline_used(vk, k)) {
+      continue;
+    }
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, 0, 0,
+        vk_pipeline_bindings[k].len, descriptor_set_layout_bindings};
     vk_res = vkCreateDescriptorSetLayout(vk->device,
-                                         &descriptor_set_layout_create_info[k],
+                                         &descriptor_set_layout_create_info,
                                          NULL, &vk->descriptor_set_layout[k]);
     if (vk_res != VK_SUCCESS) {
       log_error(
@@ -871,6 +1553,22 @@ bool monero_solver_vk_context_prepare_pipelines(
       return false;
     }
 
+    // shaders ignore constants they do not declare
+    const VkSpecializationMapEntry spec_entries[] = {
+        {CRYPTONIGHT_SPV_SPEC_WG_SIZE,
+         offsetof(struct monero_solver_vk_spec, wg_size), sizeof(uint32_t)},
+        {CRYPTONIGHT_SPV_SPEC_ITERATIONS,
+         offsetof(struct monero_solver_vk_spec, iterations), sizeof(uint32_t)},
+        {CRYPTONIGHT_SPV_SPEC_MEMORY,
+         offsetof(struct monero_solver_vk_spec, memory), sizeof(uint32_t)},
+        {CRYPTONIGHT_SPV_SPEC_MASK, offsetof(struct monero_solver_vk_spec, mask),
+         sizeof(uint32_t)}};
+    const VkSpecializationInfo spec_info = {
+        .mapEntryCount = sizeof(spec_entries) / sizeof(spec_entries[0]),
+        .pMapEntries = spec_entries,
+        .dataSize = sizeof(vk->spec),
+        .pData = &vk->spec};
+
     VkComputePipelineCreateInfo compute_pipeline_create_info = {
         .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
         .pNext = NULL,
@@ -885,13 +1583,13 @@ bool monero_solver_vk_context_prepare_pipelines(
                   .stage = VK_SHADER_STAGE_COMPUTE_BIT,
                   .module = vk->compute_shader[k],
                   .pName = "main",
-                  .pSpecializationInfo = NULL},
+                  .pSpecializationInfo = &spec_info},
         .layout = vk->pipeline_layout[k],
         .basePipelineHandle = VK_NULL_HANDLE,
         .basePipelineIndex = -1};
 
     log_info("About to create pipilene: %u", k);
-    vk_res = vkCreateComputePipelines(vk->device, VK_NULL_HANDLE, 1,
+    vk_res = vkCreateComputePipelines(vk->device, vk->pipeline_cache, 1,
                                       &compute_pipeline_create_info, NULL,
                                       &vk->pipeline[k]);
     if (vk_res != VK_SUCCESS) {
@@ -901,196 +1599,197 @@ bool monero_solver_vk_context_prepare_pipelines(
     }
   }
 
-  // create fence
-  VkFenceCreateInfo fence_create_info = {
-      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-      .pNext = NULL,
-      .flags = VK_FLAGS_NONE};
-
-  vk_res = vkCreateFence(vk->device, &fence_create_info, NULL, &vk->fence);
-
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkCreateFence");
-    return false;
-  }
-
   return true;
 }
 
-bool monero_solver_vk_context_prepare_command_buffer(
-    struct monero_solver_vk_context *vk, size_t workgroups)
+bool monero_solver_vk_context_prepare_pipelines(
+    struct monero_solver_vk_context *vk, const char *cache_dir)
 {
-  VkResult vk_res;
-
-  VkDescriptorPoolSize descriptor_pool_size[NUM_COMPUTE_PIPELINES] = {
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},  // input
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},  // keccak
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2},  // explode
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},  // memloop
-      {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2}}; // implode
-
-  VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
-      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-      .pNext = NULL,
-      .flags = VK_FLAGS_NONE,
-      .maxSets = NUM_COMPUTE_PIPELINES,
-      .poolSizeCount = NUM_COMPUTE_PIPELINES,
-      .pPoolSizes = descriptor_pool_size};
-
-  vk_res = vkCreateDescriptorPool(vk->device, &descriptor_pool_create_info, 0,
-                                  &vk->descriptor_pool);
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkCreateDescriptorPool");
+  char cache_name[128];
+  void *cache_data;
+  size_t cache_size;
+  monero_solver_vk_pipeline_cache_name(vk, cache_name, sizeof(cache_name));
+  if (!monero_solver_vk_load_pipeline_cache(vk, cache_dir, cache_name,
+                                            &cache_data, &cache_size)) {
     return false;
   }
+  bool res = monero_solver_vk_context_create_pipelines(vk);
+  if (res && cache_dir != NULL) {
+    monero_solver_vk_store_pipeline_cache(vk, cache_dir, cache_name,
+                                          cache_data, cache_size);
+  }
+  free(cache_data);
+  return res;
+}
 
-  // populate descriptor set
-  VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
-      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, 0, vk->descriptor_pool,
-      NUM_COMPUTE_PIPELINES, vk->descriptor_set_layout};
-
-  vk_res = vkAllocateDescriptorSets(vk->device, &descriptor_set_allocate_info,
-                                    vk->descriptor_set);
-  if (vk_res != VK_SUCCESS) {
-    log_error("Error when calling vkAllocateDescriptorSets");
-    return false;
+/** Bind pipeline with its descriptor set of the batch and dispatch it */
+static void monero_solver_vk_cmd_dispatch(struct monero_solver_vk_context *vk,
+                                          struct monero_solver_vk_slot *slot,
+                                          size_t pipeline, size_t workgroups)
+{
+  vkCmdBindPipeline(slot->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    vk->pipeline[pipeline]);
+
+  vkCmdBindDescriptorSets(slot->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          vk->pipeline_layout[pipeline], 0, 1,
+                          &slot->descriptor_set[pipeline], 0, 0);
+
+  vkCmdDispatch(slot->cmd_buffer, workgroups, 1, 1);
+
+  assert(vk->dispatches_len < VK_MAX_DISPATCHES);
+  vk->dispatch_pipeline[vk->dispatches_len++] = pipeline;
+  if (vk->query_pool != VK_NULL_HANDLE) {
+    vkCmdWriteTimestamp(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        vk->query_pool,
+                        monero_solver_vk_slot_query(vk, slot) +
+                            (uint32_t)vk->dispatches_len);
   }
+}
+
+/** Bind batch buffers to descriptor sets and record its command buffer */
+static bool
+monero_solver_vk_record_commands(struct monero_solver_vk_context *vk,
+                                 struct monero_solver_vk_slot *slot,
+                                 size_t workgroups)
+{
+  VkResult vk_res;
 
   VkDescriptorBufferInfo buffer_desc[NUM_BUFFERS];
   for (size_t k = 0; k < NUM_BUFFERS; ++k) {
-    buffer_desc[k].buffer = vk->buffer[k];
+    buffer_desc[k].buffer =
+        k < NUM_SLOT_BUFFERS ? slot->buffer[k]
+                             : vk->scratchpad_buffer[slot->queue];
     buffer_desc[k].range = VK_WHOLE_SIZE;
     buffer_desc[k].offset = 0;
   }
 
-  VkWriteDescriptorSet input_write_descriptor_set[2] = {
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_INIT], 0, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[INPUT_BUFFER],
-       NULL},
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_INIT], 1, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[STATE_BUFFER],
-       NULL}};
-
-  vkUpdateDescriptorSets(vk->device, 2, input_write_descriptor_set, 0, NULL);
-
-  VkWriteDescriptorSet keccak_write_descriptor_set[1] = {
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_KECCAK], 0, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[STATE_BUFFER],
-       NULL}};
-
-  vkUpdateDescriptorSets(vk->device, 1, keccak_write_descriptor_set, 0, NULL);
-
-  VkWriteDescriptorSet explode_write_descriptor_set[2] = {
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_EXPLODE], 0, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[STATE_BUFFER],
-       NULL},
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_EXPLODE], 1, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[SCRATCHPAD_BUFFER],
-       NULL}};
-
-  vkUpdateDescriptorSets(vk->device, 2, explode_write_descriptor_set, 0, NULL);
-
-  VkWriteDescriptorSet memloop_write_descriptor_set[3] = {
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_MEMLOOP], 0, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[INPUT_BUFFER],
-       NULL},
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_MEMLOOP], 1, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[STATE_BUFFER],
-       NULL},
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_MEMLOOP], 2, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[SCRATCHPAD_BUFFER],
-       NULL}};
-
-  vkUpdateDescriptorSets(vk->device, 3, memloop_write_descriptor_set, 0, NULL);
-
-  VkWriteDescriptorSet implode_write_descriptor_set[2] = {
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_IMPLODE], 0, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[STATE_BUFFER],
-       NULL},
-      {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL,
-       vk->descriptor_set[PIPELINE_IMPLODE], 1, 0, 1,
-       VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, NULL, &buffer_desc[SCRATCHPAD_BUFFER],
-       NULL}};
-
-  vkUpdateDescriptorSets(vk->device, 2, implode_write_descriptor_set, 0, NULL);
+  for (size_t k = 0; k < NUM_COMPUTE_PIPELINES; ++k) {
+    if (!monero_solver_vk_pipeline_used(vk, k)) {
+      continue;
+    }
+    const struct monero_solver_vk_bindings *bindings = &vk_pipeline_bindings[k];
+    VkWriteDescriptorSet write_descriptor_set[3];
+    for (uint32_t i = 0; i < bindings->len; ++i) {
+      write_descriptor_set[i] = (VkWriteDescriptorSet){
+          VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+          NULL,
+          slot->descriptor_set[k],
+          i,
+          0,
+          1,
+          VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+          NULL,
+          &buffer_desc[bindings->buffers[i]],
+          NULL};
+    }
+    vkUpdateDescriptorSets(vk->device, bindings->len, write_descriptor_set, 0,
+                           NULL);
+  }
 
   // record commands
   VkCommandBufferBeginInfo command_buffer_begin_info = {
       VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, 0,
       VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, 0};
 
-  vk_res = vkBeginCommandBuffer(vk->cmd_buffer, &command_buffer_begin_info);
+  vk_res = vkBeginCommandBuffer(slot->cmd_buffer, &command_buffer_begin_info);
 
   if (vk_res != VK_SUCCESS) {
     log_error("Error when calling vkBeginCommandBuffer");
     return false;
   }
 
-  vkCmdBindPipeline(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                    vk->pipeline[PIPELINE_INIT]);
+  // job input from host, result count cleared before final appends to it
+  const VkBufferCopy input_copy = {0, 0, sizeof(struct monero_solver_vk_input)};
+  vkCmdCopyBuffer(slot->cmd_buffer, slot->staging_buffer[INPUT_BUFFER],
+                  slot->buffer[INPUT_BUFFER], 1, &input_copy);
+  vkCmdFillBuffer(slot->cmd_buffer, slot->buffer[OUTPUT_BUFFER], 0,
+                  sizeof(uint32_t), 0);
+
+  VkBufferMemoryBarrier io_buffer_transfer_barriers[2];
+  const size_t io_buffers[2] = {INPUT_BUFFER, OUTPUT_BUFFER};
+  for (size_t i = 0; i < 2; ++i) {
+    io_buffer_transfer_barriers[i] = (VkBufferMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = slot->buffer[io_buffers[i]],
+        .offset = 0,
+        .size = VK_WHOLE_SIZE};
+  }
+
+  vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 2,
+                       io_buffer_transfer_barriers, 0, NULL);
+
+  vk->dispatches_len = 0;
+  if (vk->query_pool != VK_NULL_HANDLE) {
+    const uint32_t query = monero_solver_vk_slot_query(vk, slot);
+    vkCmdResetQueryPool(slot->cmd_buffer, vk->query_pool, query,
+                        VK_MAX_DISPATCHES + 1);
+    // written once commands submitted before are done with compute
+    vkCmdWriteTimestamp(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                        vk->query_pool, query);
+  }
 
-  vkCmdBindDescriptorSets(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          vk->pipeline_layout[PIPELINE_INIT], 0, 1,
-                          &vk->descriptor_set[PIPELINE_INIT], 0, 0);
+  if (vk->fused) {
+    monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_INIT_KECCAK, workgroups);
+  } else {
+    monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_INIT, workgroups);
 
-  vkCmdDispatch(vk->cmd_buffer, workgroups, 1, 1);
+    VkBufferMemoryBarrier state_buffer_init_barrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext = NULL,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = slot->buffer[STATE_BUFFER],
+        .offset = 0,
+        .size = VK_WHOLE_SIZE};
+
+    vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
+                         &state_buffer_init_barrier, 0, NULL);
+
+    monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_KECCAK, workgroups);
+  }
 
-  VkBufferMemoryBarrier state_buffer_init_barrier = {
+  VkBufferMemoryBarrier state_buffer_keccak_barrier = {
       .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
       .pNext = NULL,
-      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
-      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      .srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-      .buffer = vk->buffer[STATE_BUFFER],
+      .buffer = slot->buffer[STATE_BUFFER],
       .offset = 0,
       .size = VK_WHOLE_SIZE};
 
-  vkCmdPipelineBarrier(vk->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
-                       &state_buffer_init_barrier, 0, NULL);
-
-  vkCmdBindPipeline(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                    vk->pipeline[PIPELINE_KECCAK]);
-
-  vkCmdBindDescriptorSets(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          vk->pipeline_layout[PIPELINE_KECCAK], 0, 1,
-                          &vk->descriptor_set[PIPELINE_KECCAK], 0, 0);
-
-  vkCmdDispatch(vk->cmd_buffer, workgroups, 1, 1);
-
-  VkBufferMemoryBarrier state_buffer_keccak_barrier = {
+  // scratchpad is shared with the batch submitted before to the same queue,
+  // whose implode must be done before explode overwrites it. Barrier scope
+  // covers all commands submitted earlier to the queue
+  VkBufferMemoryBarrier scratchpad_buffer_reuse_barrier = {
       .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
       .pNext = NULL,
       .srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
-      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-      .buffer = vk->buffer[STATE_BUFFER],
+      .buffer = vk->scratchpad_buffer[slot->queue],
       .offset = 0,
       .size = VK_WHOLE_SIZE};
 
-  vkCmdPipelineBarrier(vk->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
-                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
-                       &state_buffer_keccak_barrier, 0, NULL);
-
-  vkCmdBindPipeline(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                    vk->pipeline[PIPELINE_EXPLODE]);
+  const VkBufferMemoryBarrier explode_barriers[2] = {
+      state_buffer_keccak_barrier, scratchpad_buffer_reuse_barrier};
 
-  vkCmdBindDescriptorSets(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          vk->pipeline_layout[PIPELINE_EXPLODE], 0, 1,
-                          &vk->descriptor_set[PIPELINE_EXPLODE], 0, 0);
+  vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 2,
+                       explode_barriers, 0, NULL);
 
-  vkCmdDispatch(vk->cmd_buffer, workgroups, 1, 1);
+  monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_EXPLODE, workgroups);
 
   VkBufferMemoryBarrier scratchpad_buffer_explode_barrier = {
       .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
@@ -1099,22 +1798,15 @@ bool monero_solver_vk_context_prepare_command_buffer(
       .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-      .buffer = vk->buffer[SCRATCHPAD_BUFFER],
+      .buffer = vk->scratchpad_buffer[slot->queue],
       .offset = 0,
       .size = VK_WHOLE_SIZE};
 
-  vkCmdPipelineBarrier(vk->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+  vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
                        &scratchpad_buffer_explode_barrier, 0, NULL);
 
-  vkCmdBindPipeline(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                    vk->pipeline[PIPELINE_MEMLOOP]);
-
-  vkCmdBindDescriptorSets(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          vk->pipeline_layout[PIPELINE_MEMLOOP], 0, 1,
-                          &vk->descriptor_set[PIPELINE_MEMLOOP], 0, 0);
-
-  vkCmdDispatch(vk->cmd_buffer, workgroups, 1, 1);
+  monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_MEMLOOP, workgroups);
 
   VkBufferMemoryBarrier scratchpad_buffer_memloop_barrier = {
       .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
@@ -1123,37 +1815,70 @@ bool monero_solver_vk_context_prepare_command_buffer(
       .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-      .buffer = vk->buffer[SCRATCHPAD_BUFFER],
+      .buffer = vk->scratchpad_buffer[slot->queue],
       .offset = 0,
       .size = VK_WHOLE_SIZE};
 
-  vkCmdPipelineBarrier(vk->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+  vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
                        &scratchpad_buffer_memloop_barrier, 0, NULL);
 
-  vkCmdBindPipeline(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                    vk->pipeline[PIPELINE_IMPLODE]);
+  if (vk->fused) {
+    monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_IMPLODE_KECCAK,
+                                  workgroups);
+  } else {
+    monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_IMPLODE, workgroups);
 
-  vkCmdBindDescriptorSets(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          vk->pipeline_layout[PIPELINE_IMPLODE], 0, 1,
-                          &vk->descriptor_set[PIPELINE_IMPLODE], 0, 0);
+    vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
+                         &state_buffer_keccak_barrier, 0, NULL);
 
-  vkCmdDispatch(vk->cmd_buffer, workgroups, 1, 1);
+    monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_KECCAK, workgroups);
+  }
 
-  vkCmdPipelineBarrier(vk->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+  vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
                        VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 1,
                        &state_buffer_keccak_barrier, 0, NULL);
 
-  vkCmdBindPipeline(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                    vk->pipeline[PIPELINE_KECCAK]);
+  monero_solver_vk_cmd_dispatch(vk, slot, PIPELINE_FINAL, workgroups);
 
-  vkCmdBindDescriptorSets(vk->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-                          vk->pipeline_layout[PIPELINE_KECCAK], 0, 1,
-                          &vk->descriptor_set[PIPELINE_KECCAK], 0, 0);
+  // results are copied to staging, read by host once the fence is signalled
+  VkBufferMemoryBarrier output_buffer_final_barrier = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .pNext = NULL,
+      .srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = slot->buffer[OUTPUT_BUFFER],
+      .offset = 0,
+      .size = VK_WHOLE_SIZE};
+
+  vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1,
+                       &output_buffer_final_barrier, 0, NULL);
+
+  const VkBufferCopy output_copy = {0, 0,
+                                    sizeof(struct monero_solver_vk_output)};
+  vkCmdCopyBuffer(slot->cmd_buffer, slot->buffer[OUTPUT_BUFFER],
+                  slot->staging_buffer[OUTPUT_BUFFER], 1, &output_copy);
+
+  VkBufferMemoryBarrier output_staging_barrier = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .pNext = NULL,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = slot->staging_buffer[OUTPUT_BUFFER],
+      .offset = 0,
+      .size = VK_WHOLE_SIZE};
 
-  vkCmdDispatch(vk->cmd_buffer, workgroups, 1, 1);
+  vkCmdPipelineBarrier(slot->cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1,
+                       &output_staging_barrier, 0, NULL);
 
-  vk_res = vkEndCommandBuffer(vk->cmd_buffer);
+  vk_res = vkEndCommandBuffer(slot->cmd_buffer);
 
   if (vk_res != VK_SUCCESS) {
     log_error("Error when calling vkEndCommandBuffer");
@@ -1162,3 +1887,310 @@ bool monero_solver_vk_context_prepare_command_buffer(
 
   return true;
 }
+
+bool monero_solver_vk_context_prepare_command_buffer(
+    struct monero_solver_vk_context *vk, size_t workgroups)
+{
+  VkResult vk_res;
+  const uint32_t slots_len = (uint32_t)vk->slots_len;
+
+  VkDescriptorPoolSize descriptor_pool_size = {
+      VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 0};
+  VkDescriptorSetLayout descriptor_set_layout[NUM_COMPUTE_PIPELINES];
+  uint32_t sets_len = 0;
+  for (size_t k = 0; k < NUM_COMPUTE_PIPELINES; ++k) {
+    if (monero_solver_vk_pipeline_used(vk, k)) {
+      descriptor_pool_size.descriptorCount +=
+          vk_pipeline_bindings[k].len * slots_len;
+      descriptor_set_layout[sets_len++] = vk->descriptor_set_layout[k];
+    }
+  }
+
+  VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .pNext = NULL,
+      .flags = VK_FLAGS_NONE,
+      .maxSets = sets_len * slots_len,
+      .poolSizeCount = 1,
+      .pPoolSizes = &descriptor_pool_size};
+
+  vk_res = vkCreateDescriptorPool(vk->device, &descriptor_pool_create_info, 0,
+                                  &vk->descriptor_pool);
+  if (vk_res != VK_SUCCESS) {
+    log_error("Error when calling vkCreateDescriptorPool");
+    return false;
+  }
+
+  if (vk->profile && vk->timestamp_valid_bits == 0) {
+    log_warn("Compute queue has no timestamps, stage profiling disabled");
+  } else if (vk->profile) {
+    VkQueryPoolCreateInfo query_pool_create_info = {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_FLAGS_NONE,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = (VK_MAX_DISPATCHES + 1) * slots_len,
+        .pipelineStatistics = 0};
+    vk_res = vkCreateQueryPool(vk->device, &query_pool_create_info, NULL,
+                               &vk->query_pool);
+    if (vk_res != VK_SUCCESS) {
+      log_error("Error when calling vkCreateQueryPool");
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < vk->slots_len; ++i) {
+    struct monero_solver_vk_slot *slot = &vk->slots[i];
+
+    // populate descriptor set
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, 0, vk->descriptor_pool,
+        sets_len, descriptor_set_layout};
+
+    VkDescriptorSet descriptor_set[NUM_COMPUTE_PIPELINES];
+    vk_res = vkAllocateDescriptorSets(vk->device, &descriptor_set_allocate_info,
+                                      descriptor_set);
+    if (vk_res != VK_SUCCESS) {
+      log_error("Error when calling vkAllocateDescriptorSets");
+      return false;
+    }
+    for (size_t k = 0, n = 0; k < NUM_COMPUTE_PIPELINES; ++k) {
+      if (monero_solver_vk_pipeline_used(vk, k)) {
+        slot->descriptor_set[k] = descriptor_set[n++];
+      }
+    }
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, NULL, vk->cmd_pool,
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
+
+    vk_res = vkAllocateCommandBuffers(
+        vk->device, &command_buffer_allocate_info, &slot->cmd_buffer);
+    if (vk_res != VK_SUCCESS) {
+      log_error("Error when calling vkAllocateCommandBuffers");
+      return false;
+    }
+
+    // create fence
+    VkFenceCreateInfo fence_create_info = {
+        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+        .pNext = NULL,
+        .flags = VK_FLAGS_NONE};
+
+    vk_res = vkCreateFence(vk->device, &fence_create_info, NULL, &slot->fence);
+    if (vk_res != VK_SUCCESS) {
+      log_error("Error when calling vkCreateFence");
+      return false;
+    }
+
+    if (!monero_solver_vk_record_commands(vk, slot, workgroups)) {
+      return false;
+    }
+  }
+  log_info("Vulkan: %lu batches in flight on %lu queues", vk->slots_len,
+           vk->queues_len);
+
+  return true;
+}
+
+/** Seconds each autotune candidate is timed for */
+#define VK_AUTOTUNE_SECONDS 2.0
+
+/** Worksizes tried by autotune, as far as device limits allow */
+static const uint32_t vk_autotune_worksizes[] = {4, 8, 16, 32, 64};
+
+static double monero_solver_vk_seconds_since(const struct timespec *from)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((double)now.tv_sec + 1.0e-9 * now.tv_nsec) -
+         ((double)from->tv_sec + 1.0e-9 * from->tv_nsec);
+}
+
+/** Tuning cache entry name: results hold for the same device, driver,
+ *  shaders and solver settings */
+static void
+monero_solver_vk_tuning_cache_name(struct monero_solver_vk_context *vk,
+                                   const struct monero_config_solver_vk *cfg,
+                                   char *name, size_t name_len)
+{
+  const VkPhysicalDeviceProperties *props = &vk->physical_device_properties;
+  const int settings[] = {cfg->iterations,  cfg->memory, cfg->mask,
+                          cfg->in_flight,   cfg->queues, cfg->parallelism,
+                          cfg->fused};
+  uint64_t h = monero_solver_vk_shaders_hash();
+  h = file_cache_hash(h, settings, sizeof(settings));
+
+  char uuid[2 * VK_UUID_SIZE + 1];
+  for (size_t i = 0; i < VK_UUID_SIZE; ++i) {
+    snprintf(uuid + 2 * i, 3, "%02x", props->pipelineCacheUUID[i]);
+  }
+  snprintf(name, name_len, "tune-vk-%s-%08x-%016llx.txt", uuid,
+           props->driverVersion, (unsigned long long)h);
+}
+
+static bool monero_solver_vk_load_tuning(const char *cache_dir,
+                                         const char *cache_name,
+                                         uint32_t *worksize,
+                                         size_t *parallelism)
+{
+  size_t size = 0;
+  char *data = file_cache_load(cache_dir, cache_name, &size);
+  if (data == NULL) {
+    return false;
+  }
+  char text[128] = {0};
+  memcpy(text, data, size < sizeof(text) - 1 ? size : sizeof(text) - 1);
+  free(data);
+
+  unsigned ws = 0;
+  unsigned long p = 0;
+  if (sscanf(text, "worksize %u\nparallelism %lu", &ws, &p) != 2 || ws == 0 ||
+      p < ws) {
+    log_warn("Tuning cache %s is malformed, ignored", cache_name);
+    return false;
+  }
+  *worksize = ws;
+  *parallelism = p;
+  return true;
+}
+
+/** Hashes per second of one candidate, 0 when it does not run */
+static double
+monero_solver_vk_autotune_run(const struct monero_config_solver_vk *cfg,
+                              const char *cache_dir, uint32_t worksize,
+                              size_t parallelism)
+{
+  struct monero_solver_vk *solver =
+      monero_solver_vk_create(cfg, cache_dir, worksize, parallelism);
+  if (solver == NULL) {
+    return 0;
+  }
+
+  // zero target, nothing is ever found
+  const uint8_t input[MONERO_INPUT_HASH_LEN] = {0};
+  uint8_t hashes[MONERO_OUTPUT_HASH_LEN * MONERO_SOLVER_MAX_SOLUTIONS];
+  uint32_t nonces[MONERO_SOLVER_MAX_SOLUTIONS];
+  size_t num = 0;
+  monero_solver_vk_set_job(&solver->solver, input, sizeof(input), 0, hashes,
+                           nonces, &num);
+
+  // first round fills the queue and pays for lazy driver initialization
+  uint32_t nonce = 0;
+  bool ok = true;
+  for (size_t i = 0; i < solver->vk->slots_len && ok; ++i) {
+    int n = monero_solver_vk_process(&solver->solver, nonce);
+    ok = n > 0;
+    nonce += (uint32_t)n;
+  }
+  ok = ok && monero_solver_vk_flush(&solver->solver) == 0;
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  size_t hashes_done = 0;
+  while (ok && monero_solver_vk_seconds_since(&start) < VK_AUTOTUNE_SECONDS) {
+    int n = monero_solver_vk_process(&solver->solver, nonce);
+    ok = n > 0;
+    hashes_done += ok ? (size_t)n : 0;
+    nonce += (uint32_t)n;
+  }
+  ok = ok && monero_solver_vk_flush(&solver->solver) == 0;
+  double hashrate =
+      ok ? (double)hashes_done / monero_solver_vk_seconds_since(&start) : 0;
+
+  log_info("Autotune GPU(%d): worksize %u, parallelism %lu: %.1f H/s",
+           cfg->device_id, worksize, solver->parallelism, hashrate);
+  monero_solver_vk_free(&solver->solver);
+  return hashrate;
+}
+
+static bool
+monero_solver_vk_autotune(const struct monero_config_solver_vk *cfg,
+                          const char *cache_dir, uint32_t *worksize,
+                          size_t *parallelism)
+{
+  struct monero_solver_vk_context *vk =
+      monero_solver_vk_context_init((uint32_t)cfg->device_id, 1, 1);
+  if (vk == NULL) {
+    return false;
+  }
+
+  char cache_name[128];
+  monero_solver_vk_tuning_cache_name(vk, cfg, cache_name, sizeof(cache_name));
+  if (cache_dir != NULL && monero_solver_vk_load_tuning(cache_dir, cache_name,
+                                                        worksize, parallelism)) {
+    log_info("Autotune GPU(%d): worksize %u, parallelism %lu from %s",
+             cfg->device_id, *worksize, *parallelism, cache_name);
+    monero_solver_vk_context_release(vk);
+    return true;
+  }
+
+  // largest batch fitting device memory left, see
+  // monero_solver_vk_memory_available
+  size_t max_parallelism = monero_solver_vk_max_parallelism(
+      vk, (VkDeviceSize)cfg->memory, (size_t)cfg->in_flight,
+      (size_t)cfg->queues);
+  const VkDeviceSize available = monero_solver_vk_memory_available(vk);
+  if (cfg->parallelism > 0 && (size_t)cfg->parallelism < max_parallelism) {
+    max_parallelism = (size_t)cfg->parallelism;
+  }
+
+  uint32_t worksizes[sizeof(vk_autotune_worksizes) / sizeof(uint32_t)];
+  size_t worksizes_len = 0;
+  for (size_t i = 0; i < sizeof(worksizes) / sizeof(uint32_t); ++i) {
+    if (vk_autotune_worksizes[i] <= max_parallelism &&
+        monero_solver_vk_worksize_supported(vk, vk_autotune_worksizes[i])) {
+      worksizes[worksizes_len++] = vk_autotune_worksizes[i];
+    }
+  }
+  // candidates allocate their own device
+  monero_solver_vk_context_release(vk);
+  if (worksizes_len == 0) {
+    log_error("Autotune GPU(%d): no worksize fits %lu hashes per batch",
+              cfg->device_id, max_parallelism);
+    return false;
+  }
+  log_info("Autotune GPU(%d): %lu MiB device memory available, up to %lu "
+           "hashes per batch",
+           cfg->device_id, (unsigned long)(available >> 20), max_parallelism);
+
+  // worksize at half the batch, then batch size with the fastest worksize
+  double best = 0;
+  const size_t half = max_parallelism / 2;
+  for (size_t i = 0; i < worksizes_len; ++i) {
+    size_t p = half < worksizes[i] ? worksizes[i] : half;
+    double hashrate = monero_solver_vk_autotune_run(cfg, cache_dir,
+                                                    worksizes[i], p);
+    if (hashrate > best) {
+      best = hashrate;
+      *worksize = worksizes[i];
+      *parallelism = p / worksizes[i] * worksizes[i];
+    }
+  }
+  if (best == 0) {
+    log_error("Autotune GPU(%d): no candidate completed", cfg->device_id);
+    return false;
+  }
+  const uint32_t ws = *worksize;
+  for (size_t k = 1; k <= 4; ++k) {
+    size_t p = max_parallelism * k / 4 / ws * ws;
+    if (p == 0 || p == half / ws * ws) {
+      continue;
+    }
+    double hashrate = monero_solver_vk_autotune_run(cfg, cache_dir, ws, p);
+    if (hashrate > best) {
+      best = hashrate;
+      *parallelism = p;
+    }
+  }
+  log_info("Autotune GPU(%d): best worksize %u, parallelism %lu, %.1f H/s",
+           cfg->device_id, *worksize, *parallelism, best);
+
+  if (cache_dir != NULL) {
+    char text[128];
+    int len = snprintf(text, sizeof(text), "worksize %u\nparallelism %lu\n",
+                       *worksize, *parallelism);
+    file_cache_store(cache_dir, cache_name, text, (size_t)len);
+  }
+  return true;
+}
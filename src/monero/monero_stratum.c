@@ -176,8 +176,13 @@ void monero_stratum_handle_json_response(
   case MONERO_STRATUM_MESSAGE_TYPE_SUBMIT_SHARE:
     if (err_msg == NULL) {
       log_info("Share accepted");
+      struct stratum_event event = {STRATUM_EVENT_SHARE_ACCEPTED};
+      event_handler->cb(&event, event_handler->data);
     } else {
       log_error("Share rejected: %s", err_msg);
+      struct stratum_event_share_rejected event = {
+          .stratum_event = {STRATUM_EVENT_SHARE_REJECTED}, .error = err_msg};
+      event_handler->cb(&event.stratum_event, event_handler->data);
     }
     break;
   case MONERO_STRATUM_MESSAGE_TYPE_KEEPALIVE:
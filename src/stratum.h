@@ -16,7 +16,9 @@ enum stratum_event_type {
   STRATUM_EVENT_INVALID_REPLY,
   STRATUM_EVENT_LOGIN_SUCCESS,
   STRATUM_EVENT_LOGIN_FAILED,
-  STRATUM_EVENT_NEW_JOB
+  STRATUM_EVENT_NEW_JOB,
+  STRATUM_EVENT_SHARE_ACCEPTED,
+  STRATUM_EVENT_SHARE_REJECTED
 };
 
 struct stratum_event {
@@ -42,6 +44,11 @@ struct stratum_event_new_job {
   void *job_data;
 };
 
+struct stratum_event_share_rejected {
+  struct stratum_event stratum_event;
+  const char *error;
+};
+
 struct stratum_event_handler;
 
 typedef struct stratum *stratum_handle;
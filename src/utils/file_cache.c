@@ -0,0 +1,102 @@
+#include "utils/file_cache.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging.h"
+
+/** mkdir -p */
+static bool file_cache_mkdir(char *path)
+{
+  for (char *p = path + 1; *p != '\0'; ++p) {
+    if (*p != '/') {
+      continue;
+    }
+    *p = '\0';
+    int res = mkdir(path, 0755);
+    *p = '/';
+    if (res != 0 && errno != EEXIST) {
+      return false;
+    }
+  }
+  return mkdir(path, 0755) == 0 || errno == EEXIST;
+}
+
+bool file_cache_dir(const char *dir, char *path, size_t path_len)
+{
+  int len;
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  if (dir != NULL) {
+    len = snprintf(path, path_len, "%s", dir);
+  } else if (xdg != NULL && *xdg != '\0') {
+    len = snprintf(path, path_len, "%s/dorenom", xdg);
+  } else if (home != NULL && *home != '\0') {
+    len = snprintf(path, path_len, "%s/.cache/dorenom", home);
+  } else {
+    log_warn("Cache directory is not set and $HOME is unknown");
+    return false;
+  }
+  if (len <= 0 || (size_t)len >= path_len) {
+    log_warn("Cache directory path is too long");
+    return false;
+  }
+  if (!file_cache_mkdir(path)) {
+    log_warn("Unable to create cache directory %s: %s", path, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+void *file_cache_load(const char *dir, const char *name, size_t *size)
+{
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return NULL;
+  }
+  void *data = NULL;
+  long len;
+  if (fseek(f, 0, SEEK_END) == 0 && (len = ftell(f)) > 0 &&
+      fseek(f, 0, SEEK_SET) == 0) {
+    data = malloc((size_t)len);
+    if (fread(data, 1, (size_t)len, f) == (size_t)len) {
+      *size = (size_t)len;
+    } else {
+      free(data);
+      data = NULL;
+    }
+  }
+  fclose(f);
+  if (data == NULL) {
+    log_warn("Unable to read cache entry %s", path);
+  }
+  return data;
+}
+
+bool file_cache_store(const char *dir, const char *name, const void *data,
+                      size_t size)
+{
+  char path[4096], tmp_path[4096 + 32];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+
+  FILE *f = fopen(tmp_path, "wb");
+  if (f == NULL) {
+    log_warn("Unable to write cache entry %s: %s", tmp_path, strerror(errno));
+    return false;
+  }
+  bool res = fwrite(data, 1, size, f) == size;
+  res = fclose(f) == 0 && res;
+  if (!res || rename(tmp_path, path) != 0) {
+    log_warn("Unable to write cache entry %s: %s", path, strerror(errno));
+    unlink(tmp_path);
+    return false;
+  }
+  return true;
+}
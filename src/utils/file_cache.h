@@ -0,0 +1,36 @@
+/* file_cache.h -- on-disk cache of compiled GPU programs and tuning results
+ *
+ * Entries are plain files in one directory, named by the caller after
+ * everything that invalidates them (device, driver, program hash).
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Resolve cache directory and create it if missing: `dir` when given,
+ *  $XDG_CACHE_HOME/dorenom or $HOME/.cache/dorenom otherwise.
+ *  Return false when there is no usable directory */
+bool file_cache_dir(const char *dir, char *path, size_t path_len);
+
+/** Read whole entry, NULL when missing. Caller frees the result */
+void *file_cache_load(const char *dir, const char *name, size_t *size);
+
+/** Replace entry atomically, readers never see a partial file */
+bool file_cache_store(const char *dir, const char *name, const void *data,
+                      size_t size);
+
+/** FNV-1a, continue from previous result or start from
+ *  FILE_CACHE_HASH_INIT */
+#define FILE_CACHE_HASH_INIT 0xcbf29ce484222325ULL
+
+static inline uint64_t file_cache_hash(uint64_t h, const void *data,
+                                       size_t size)
+{
+  const uint8_t *p = data;
+  for (size_t i = 0; i < size; ++i) {
+    h = (h ^ p[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
@@ -62,6 +62,23 @@ static inline int json_get_uint(const cJSON *json, const char *field, int *out)
   return true;
 }
 
+/** Read number field from json, return false if field does not exists */
+static inline bool json_get_double(const cJSON *json, const char *field,
+                                   double *out)
+{
+  const cJSON *item = NULL;
+  if (!json_get_object(json, field, &item)) {
+    return false;
+  }
+  if (!cJSON_IsNumber(item)) {
+    log_error("Field \"%s\" is not a number", field);
+    return false;
+  }
+
+  *out = item->valuedouble;
+  return true;
+}
+
 /** Get a string field from json, return NULL if the field does not exists */
 static inline const char *json_get_string(const cJSON *json, const char *field)
 {
@@ -36,6 +36,7 @@ enum SPV_STORAGE_CLASS {
   SC_UNIFORM_CONST = 0,
   SC_INPUT = 1,
   SC_UNIFORM = 2,
+  SC_OUTPUT = 3,
   SC_WORKGROUP = 4,
   SC_FUNCTION = 7,
   SC_BUFFER = 12 // storage buffer
@@ -43,6 +44,7 @@ enum SPV_STORAGE_CLASS {
 
 enum SPV_DECORATIONS {
   DECOR_RELAXED_PRECISION = 0,
+  DECOR_SPEC_ID = 1,
   DECOR_BLOCK = 2,
   DECOR_ARRAY_STRIDE = 6,
   DECOR_BUILTIN = 11,
@@ -82,7 +84,16 @@ enum SPV_SCOPE {
   SCOPE_INVOCATION = 4
 };
 
+enum SPV_SELECTION_CONTROL {
+  SEL_NONE = 0,
+  SEL_FLATTEN = 1,
+  SEL_DONT_FLATTEN = 2
+};
+
 enum SPV_MEMORY_SEMANTICS {
+  MEMORY_SEMANTICS_RELAXED = 0,
+  MEMORY_SEMANTICS_ACQUIRE_RELEASE = 0x8,
+  MEMORY_SEMANTICS_UNIFORM_MEMORY = 0x40,
   MEMORY_SEMANTICS_WORGROUP_MEMORY = 0x100
 };
 
@@ -102,8 +113,12 @@ enum SPV_OPS {
   OP_TYPE_STRUCT = 30,
   OP_TYPE_POINTER = 32,
   OP_TYPE_FUNCTION = 33,
+  OP_CONSTANT_TRUE = 41,
+  OP_CONSTANT_FALSE = 42,
   OP_CONSTANT = 43,
   OP_CONSTANT_COMPOSITE = 44,
+  OP_SPEC_CONSTANT = 50,
+  OP_SPEC_CONSTANT_COMPOSITE = 51,
   OP_FUNCTION = 54,
   OP_FUNCTION_PARAMETER = 55,
   OP_FUNCTION_END = 56,
@@ -117,6 +132,7 @@ enum SPV_OPS {
   OP_DECORATE = 71,
   OP_MEMBER_DECORATE = 72,
   OP_VECTOR_EXTRACT_DYNAMIC = 77,
+  OP_VECTOR_SHUFFLE = 79,
   OP_COMPOSITE_CONSTRUCT = 80,
   OP_COMPOSITE_EXTRACT = 81,
   OP_COMPOSITE_INSERT = 82,
@@ -125,8 +141,10 @@ enum SPV_OPS {
   OP_IADD = 128,
   OP_ISUB = 130,
   OP_IMUL = 132,
+  OP_UMOD = 137,
   OP_UMUL_EXTENDED = 151,
   OP_SELECT = 169,
+  OP_IEQUAL = 170,
   OP_INOTEQUAL = 171,
   OP_ULESS_THAN = 176,
   OP_SHIFT_RIGHT_LOGICAL = 194,
@@ -139,11 +157,14 @@ enum SPV_OPS {
   OP_BITFIELD_UEXTRACT = 203,
   OP_CONTROL_BARRIER = 224,
   OP_MEMORY_BARRIER = 225,
+  OP_ATOMIC_IINCREMENT = 232,
   OP_PHI = 245,
   OP_LOOP_MERGE = 246,
+  OP_SELECTION_MERGE = 247,
   OP_LABEL = 248,
   OP_BRANCH = 249,
   OP_BRANCH_CONDITIONAL = 250,
+  OP_SWITCH = 251,
   OP_RETURN = 253,
   OP_RETURN_VALUE = 254,
 };
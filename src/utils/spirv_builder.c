@@ -0,0 +1,513 @@
+#include "utils/spirv_builder.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPIRV_VERSION_1_3 0x00010300
+
+void spirv_builder_init(struct spirv_builder *b)
+{
+  memset(b, 0, sizeof(*b));
+  b->bound = 1;
+  b->function_body = SIZE_MAX;
+}
+
+static bool spirv_words_reserve(struct spirv_builder *b,
+                                struct spirv_words *w, size_t len)
+{
+  if (b->is_oom) {
+    return false;
+  }
+  if (w->len + len <= w->cap) {
+    return true;
+  }
+  size_t cap = w->cap == 0 ? 256 : w->cap;
+  while (cap < w->len + len) {
+    cap *= 2;
+  }
+  uint32_t *data = realloc(w->data, cap * sizeof(uint32_t));
+  if (data == NULL) {
+    b->is_oom = true;
+    return false;
+  }
+  w->data = data;
+  w->cap = cap;
+  return true;
+}
+
+static void spirv_words_append(struct spirv_builder *b, struct spirv_words *w,
+                               const uint32_t *data, size_t len)
+{
+  if (spirv_words_reserve(b, w, len)) {
+    memcpy(w->data + w->len, data, len * sizeof(uint32_t));
+    w->len += len;
+  }
+}
+
+/** Nul terminated string literal, little endian */
+static size_t spirv_string_words(const char *s, uint32_t *words, size_t cap)
+{
+  size_t len = strlen(s) / 4 + 1;
+  assert(len <= cap);
+  memset(words, 0, len * sizeof(uint32_t));
+  for (size_t i = 0; s[i] != '\0'; ++i) {
+    words[i / 4] |= (uint32_t)(uint8_t)s[i] << (8 * (i % 4));
+  }
+  return len;
+}
+
+static enum spirv_builder_section
+spirv_section_of(enum SPV_OPS op, const uint32_t *operands, size_t len)
+{
+  switch (op) {
+  case OP_CAPABILITY:
+    return SPIRV_SECTION_CAPABILITY;
+  case OP_EXTENSION:
+    return SPIRV_SECTION_EXTENSION;
+  case OP_EXT_INST_IMPORT:
+    return SPIRV_SECTION_EXT_INST_IMPORT;
+  case OP_MEMORY_MODEL:
+    return SPIRV_SECTION_MEMORY_MODEL;
+  case OP_ENTRY_POINT:
+    return SPIRV_SECTION_ENTRY_POINT;
+  case OP_EXECUTION_MODE:
+    return SPIRV_SECTION_EXECUTION_MODE;
+  case OP_DECORATE:
+  case OP_MEMBER_DECORATE:
+    return SPIRV_SECTION_ANNOTATION;
+  case OP_VARIABLE:
+    assert(len >= 3);
+    return operands[2] == SC_FUNCTION ? SPIRV_SECTION_LOCAL
+                                      : SPIRV_SECTION_GLOBAL;
+  default:
+    if (op >= OP_TYPE_VOID && op <= OP_SPEC_CONSTANT_COMPOSITE) {
+      return SPIRV_SECTION_GLOBAL;
+    }
+    return SPIRV_SECTION_FUNCTION;
+  }
+}
+
+/** Find instruction equal to `op` with `operands` in `section`, ignoring
+ *  the word at `skip` (result id) when it is less than `len`. Return offset
+ *  of its first operand or SIZE_MAX */
+static size_t spirv_find(struct spirv_builder *b,
+                         enum spirv_builder_section section, enum SPV_OPS op,
+                         const uint32_t *operands, size_t len, size_t skip)
+{
+  const struct spirv_words *w = &b->section[section];
+  uint32_t head = ((uint32_t)(len + 1) << 16) | op;
+  for (size_t pos = 0; pos < w->len; pos += w->data[pos] >> 16) {
+    if (w->data[pos] != head) {
+      continue;
+    }
+    const uint32_t *p = w->data + pos + 1;
+    size_t k = 0;
+    while (k < len && (k == skip || p[k] == operands[k])) {
+      ++k;
+    }
+    if (k == len) {
+      return pos + 1;
+    }
+  }
+  return SIZE_MAX;
+}
+
+uint32_t spirv_id(struct spirv_builder *b) { return b->bound++; }
+
+void spirv_emit(struct spirv_builder *b, enum SPV_OPS op,
+                const uint32_t *operands, size_t len)
+{
+  enum spirv_builder_section section = spirv_section_of(op, operands, len);
+  if (section == SPIRV_SECTION_ANNOTATION &&
+      spirv_find(b, section, op, operands, len, len) != SIZE_MAX) {
+    return;
+  }
+  struct spirv_words *w = &b->section[section];
+  if (op == OP_FUNCTION_END) {
+    // hoist variables to the first block
+    struct spirv_words *locals = &b->section[SPIRV_SECTION_LOCAL];
+    assert(b->function_body != SIZE_MAX);
+    if (locals->len > 0 && spirv_words_reserve(b, w, locals->len)) {
+      uint32_t *body = w->data + b->function_body;
+      memmove(body + locals->len, body,
+              (w->len - b->function_body) * sizeof(uint32_t));
+      memcpy(body, locals->data, locals->len * sizeof(uint32_t));
+      w->len += locals->len;
+    }
+    locals->len = 0;
+    b->function_body = SIZE_MAX;
+  }
+  uint32_t head = ((uint32_t)(len + 1) << 16) | op;
+  spirv_words_append(b, w, &head, 1);
+  spirv_words_append(b, w, operands, len);
+  if (op == OP_LABEL) {
+    b->block = operands[0];
+    if (b->function_body == SIZE_MAX) {
+      b->function_body = w->len;
+    }
+  }
+}
+
+uint32_t spirv_emit_value(struct spirv_builder *b, enum SPV_OPS op,
+                          uint32_t type, const uint32_t *operands, size_t len)
+{
+  uint32_t words[len + 2];
+  words[0] = type;
+  words[1] = spirv_id(b);
+  memcpy(words + 2, operands, len * sizeof(uint32_t));
+  spirv_emit(b, op, words, len + 2);
+  return words[1];
+}
+
+/** Deduplicated global: `result` is the index of the result id in
+ *  `operands`, its value is ignored */
+static uint32_t spirv_unique(struct spirv_builder *b, enum SPV_OPS op,
+                             uint32_t *operands, size_t len, size_t result)
+{
+  size_t pos =
+      spirv_find(b, SPIRV_SECTION_GLOBAL, op, operands, len, result);
+  if (pos != SIZE_MAX) {
+    return b->section[SPIRV_SECTION_GLOBAL].data[pos + result];
+  }
+  operands[result] = spirv_id(b);
+  spirv_emit(b, op, operands, len);
+  return operands[result];
+}
+
+void spirv_capability(struct spirv_builder *b, enum SPV_CAPABILITIES cap)
+{
+  uint32_t operands[] = {cap};
+  if (spirv_find(b, SPIRV_SECTION_CAPABILITY, OP_CAPABILITY, operands, 1,
+                 1) == SIZE_MAX) {
+    spirv_emit(b, OP_CAPABILITY, operands, 1);
+  }
+}
+
+void spirv_extension(struct spirv_builder *b, const char *name)
+{
+  uint32_t words[64];
+  spirv_emit(b, OP_EXTENSION, words,
+             spirv_string_words(name, words, sizeof(words) / sizeof(*words)));
+}
+
+void spirv_entry_point(struct spirv_builder *b, enum SPV_EXECUTION_MODEL model,
+                       uint32_t function, const char *name)
+{
+  b->entry_model = model;
+  b->entry_function = function;
+  b->entry_name = name;
+}
+
+uint32_t spirv_type_void(struct spirv_builder *b)
+{
+  uint32_t operands[] = {0};
+  return spirv_unique(b, OP_TYPE_VOID, operands, 1, 0);
+}
+
+uint32_t spirv_type_bool(struct spirv_builder *b)
+{
+  uint32_t operands[] = {0};
+  return spirv_unique(b, OP_TYPE_BOOL, operands, 1, 0);
+}
+
+uint32_t spirv_type_int(struct spirv_builder *b, uint32_t width)
+{
+  if (width == 64) {
+    spirv_capability(b, CAP_INT64);
+  }
+  uint32_t operands[] = {0, width, 0};
+  return spirv_unique(b, OP_TYPE_INT, operands, 3, 0);
+}
+
+uint32_t spirv_type_vector(struct spirv_builder *b, uint32_t component,
+                           uint32_t count)
+{
+  uint32_t operands[] = {0, component, count};
+  return spirv_unique(b, OP_TYPE_VECTOR, operands, 3, 0);
+}
+
+uint32_t spirv_type_array(struct spirv_builder *b, uint32_t element,
+                          uint32_t len)
+{
+  uint32_t operands[] = {0, element, spirv_const_uint(b, len)};
+  return spirv_unique(b, OP_TYPE_ARRAY, operands, 3, 0);
+}
+
+uint32_t spirv_type_runtime_array(struct spirv_builder *b, uint32_t element)
+{
+  uint32_t operands[] = {0, element};
+  return spirv_unique(b, OP_TYPE_RUNTIME_ARRAY, operands, 2, 0);
+}
+
+uint32_t spirv_type_struct(struct spirv_builder *b, const uint32_t *members,
+                           size_t len)
+{
+  uint32_t operands[len + 1];
+  operands[0] = spirv_id(b);
+  memcpy(operands + 1, members, len * sizeof(uint32_t));
+  spirv_emit(b, OP_TYPE_STRUCT, operands, len + 1);
+  return operands[0];
+}
+
+uint32_t spirv_type_pointer(struct spirv_builder *b,
+                            enum SPV_STORAGE_CLASS storage, uint32_t type)
+{
+  uint32_t operands[] = {0, storage, type};
+  return spirv_unique(b, OP_TYPE_POINTER, operands, 3, 0);
+}
+
+uint32_t spirv_type_function(struct spirv_builder *b, uint32_t result,
+                             const uint32_t *params, size_t len)
+{
+  uint32_t operands[len + 2];
+  operands[1] = result;
+  memcpy(operands + 2, params, len * sizeof(uint32_t));
+  return spirv_unique(b, OP_TYPE_FUNCTION, operands, len + 2, 0);
+}
+
+uint32_t spirv_const_uint(struct spirv_builder *b, uint32_t value)
+{
+  uint32_t operands[] = {spirv_type_int(b, 32), 0, value};
+  return spirv_unique(b, OP_CONSTANT, operands, 3, 1);
+}
+
+uint32_t spirv_const_ulong(struct spirv_builder *b, uint64_t value)
+{
+  uint32_t operands[] = {spirv_type_int(b, 64), 0, (uint32_t)value,
+                         (uint32_t)(value >> 32)};
+  return spirv_unique(b, OP_CONSTANT, operands, 4, 1);
+}
+
+uint32_t spirv_const_composite(struct spirv_builder *b, uint32_t type,
+                               const uint32_t *values, size_t len)
+{
+  uint32_t operands[len + 2];
+  operands[0] = type;
+  memcpy(operands + 2, values, len * sizeof(uint32_t));
+  return spirv_unique(b, OP_CONSTANT_COMPOSITE, operands, len + 2, 1);
+}
+
+uint32_t spirv_spec_const_uint(struct spirv_builder *b, uint32_t spec_id,
+                               uint32_t value)
+{
+  uint32_t id = spirv_val(b, OP_SPEC_CONSTANT, spirv_type_int(b, 32), value);
+  spirv_decorate(b, id, DECOR_SPEC_ID, spec_id);
+  return id;
+}
+
+uint32_t spirv_spec_const_composite(struct spirv_builder *b, uint32_t type,
+                                    const uint32_t *values, size_t len)
+{
+  return spirv_emit_value(b, OP_SPEC_CONSTANT_COMPOSITE, type, values, len);
+}
+
+uint32_t spirv_variable(struct spirv_builder *b, uint32_t type,
+                        enum SPV_STORAGE_CLASS storage, uint32_t init)
+{
+  if (init != 0) {
+    return spirv_val(b, OP_VARIABLE, type, storage, init);
+  }
+  return spirv_val(b, OP_VARIABLE, type, storage);
+}
+
+uint32_t spirv_builtin(struct spirv_builder *b, enum SPV_BUILTINS builtin,
+                       uint32_t type)
+{
+  uint32_t operands[] = {0, DECOR_BUILTIN, builtin};
+  size_t pos = spirv_find(b, SPIRV_SECTION_ANNOTATION, OP_DECORATE, operands,
+                          3, 0);
+  if (pos != SIZE_MAX) {
+    return b->section[SPIRV_SECTION_ANNOTATION].data[pos];
+  }
+  uint32_t id = spirv_variable(b, spirv_type_pointer(b, SC_INPUT, type),
+                               SC_INPUT, 0);
+  spirv_decorate(b, id, DECOR_BUILTIN, builtin);
+  return id;
+}
+
+void spirv_label(struct spirv_builder *b, uint32_t label)
+{
+  spirv_op(b, OP_LABEL, label);
+}
+
+uint32_t spirv_block(struct spirv_builder *b)
+{
+  uint32_t label = spirv_id(b);
+  spirv_op(b, OP_BRANCH, label);
+  spirv_label(b, label);
+  return label;
+}
+
+uint32_t spirv_function(struct spirv_builder *b, uint32_t result,
+                        enum SPV_FUNCTION_CONTROL control,
+                        const uint32_t *param_types, size_t len,
+                        uint32_t *params)
+{
+  assert(b->function_body == SIZE_MAX);
+  uint32_t type = spirv_type_function(b, result, param_types, len);
+  uint32_t function = spirv_val(b, OP_FUNCTION, result, control, type);
+  for (size_t i = 0; i < len; ++i) {
+    uint32_t id = spirv_id(b);
+    spirv_op(b, OP_FUNCTION_PARAMETER, param_types[i], id);
+    if (params != NULL) {
+      params[i] = id;
+    }
+  }
+  spirv_label(b, spirv_id(b));
+  return function;
+}
+
+void spirv_function_end(struct spirv_builder *b)
+{
+  spirv_emit(b, OP_FUNCTION_END, NULL, 0);
+}
+
+void spirv_return(struct spirv_builder *b) { spirv_emit(b, OP_RETURN, NULL, 0); }
+
+void spirv_return_value(struct spirv_builder *b, uint32_t value)
+{
+  spirv_op(b, OP_RETURN_VALUE, value);
+}
+
+uint32_t spirv_if_begin(struct spirv_builder *b, uint32_t cond)
+{
+  uint32_t then = spirv_id(b);
+  uint32_t merge = spirv_id(b);
+  spirv_op(b, OP_SELECTION_MERGE, merge, SEL_NONE);
+  spirv_op(b, OP_BRANCH_CONDITIONAL, cond, then, merge);
+  spirv_label(b, then);
+  return merge;
+}
+
+void spirv_if_end(struct spirv_builder *b, uint32_t merge)
+{
+  spirv_op(b, OP_BRANCH, merge);
+  spirv_label(b, merge);
+}
+
+/** OpPhi with single incoming value from the current block, next value from
+ *  the continue block is set by spirv_loop_next() */
+static uint32_t spirv_loop_add_phi(struct spirv_builder *b,
+                                   struct spirv_loop *loop, uint32_t type,
+                                   uint32_t init, uint32_t from)
+{
+  assert(loop->phis_len < SPIRV_LOOP_MAX_PHIS + 1);
+  uint32_t phi = spirv_val(b, OP_PHI, type, init, from, 0, loop->cont);
+  loop->phis[loop->phis_len] = phi;
+  loop->phi_next[loop->phis_len] =
+      b->section[SPIRV_SECTION_FUNCTION].len - 2;
+  ++loop->phis_len;
+  return phi;
+}
+
+uint32_t spirv_loop_begin(struct spirv_builder *b, struct spirv_loop *loop,
+                          uint32_t from)
+{
+  uint32_t preheader = b->block;
+  loop->header = spirv_id(b);
+  loop->body = spirv_id(b);
+  loop->cont = spirv_id(b);
+  loop->end = spirv_id(b);
+  loop->phis_len = 0;
+  spirv_op(b, OP_BRANCH, loop->header);
+  spirv_label(b, loop->header);
+  loop->i = spirv_loop_add_phi(b, loop, spirv_type_int(b, 32), from,
+                               preheader);
+  return loop->i;
+}
+
+uint32_t spirv_loop_phi(struct spirv_builder *b, struct spirv_loop *loop,
+                        uint32_t type, uint32_t init)
+{
+  // incoming block is the loop preheader, as for the counter
+  struct spirv_words *w = &b->section[SPIRV_SECTION_FUNCTION];
+  uint32_t preheader = b->is_oom ? 0 : w->data[loop->phi_next[0] - 1];
+  return spirv_loop_add_phi(b, loop, type, init, preheader);
+}
+
+void spirv_loop_body(struct spirv_builder *b, struct spirv_loop *loop,
+                     uint32_t to, enum SPV_LOOP_CONTROL control)
+{
+  uint32_t cond = spirv_val(b, OP_ULESS_THAN, spirv_type_bool(b), loop->i, to);
+  spirv_op(b, OP_LOOP_MERGE, loop->end, loop->cont, control);
+  spirv_op(b, OP_BRANCH_CONDITIONAL, cond, loop->body, loop->end);
+  spirv_label(b, loop->body);
+}
+
+void spirv_loop_next(struct spirv_builder *b, struct spirv_loop *loop,
+                     uint32_t phi, uint32_t value)
+{
+  for (size_t k = 0; k < loop->phis_len; ++k) {
+    if (loop->phis[k] == phi) {
+      if (!b->is_oom) {
+        b->section[SPIRV_SECTION_FUNCTION].data[loop->phi_next[k]] = value;
+      }
+      return;
+    }
+  }
+  assert(!"not a phi of the loop");
+}
+
+void spirv_loop_end(struct spirv_builder *b, struct spirv_loop *loop,
+                    uint32_t step)
+{
+  spirv_op(b, OP_BRANCH, loop->cont);
+  spirv_label(b, loop->cont);
+  spirv_loop_next(b, loop, loop->i,
+                  spirv_val(b, OP_IADD, spirv_type_int(b, 32), loop->i, step));
+  spirv_op(b, OP_BRANCH, loop->header);
+  spirv_label(b, loop->end);
+}
+
+/** OpEntryPoint listing every Input and Output variable */
+static void spirv_emit_entry_point(struct spirv_builder *b)
+{
+  const struct spirv_words *g = &b->section[SPIRV_SECTION_GLOBAL];
+  size_t name_len = strlen(b->entry_name) / 4 + 1;
+  size_t len = 2 + name_len;
+  for (size_t pos = 0; pos < g->len; pos += g->data[pos] >> 16) {
+    len += (g->data[pos] & 0xffff) == OP_VARIABLE &&
+           (g->data[pos + 3] == SC_INPUT || g->data[pos + 3] == SC_OUTPUT);
+  }
+  uint32_t operands[len];
+  operands[0] = b->entry_model;
+  operands[1] = b->entry_function;
+  size_t k = 2 + spirv_string_words(b->entry_name, operands + 2, name_len);
+  for (size_t pos = 0; pos < g->len; pos += g->data[pos] >> 16) {
+    if ((g->data[pos] & 0xffff) == OP_VARIABLE &&
+        (g->data[pos + 3] == SC_INPUT || g->data[pos + 3] == SC_OUTPUT)) {
+      operands[k++] = g->data[pos + 2];
+    }
+  }
+  spirv_emit(b, OP_ENTRY_POINT, operands, len);
+}
+
+uint32_t *spirv_builder_finish(struct spirv_builder *b, size_t *size)
+{
+  assert(b->function_body == SIZE_MAX);
+  if (b->entry_name != NULL && !b->is_oom) {
+    spirv_emit_entry_point(b);
+  }
+  const uint32_t header[] = {SPIRV_MAGIC, SPIRV_VERSION_1_3, 0, b->bound, 0};
+  size_t len = sizeof(header) / sizeof(*header);
+  for (size_t s = 0; s < SPIRV_SECTION_COUNT; ++s) {
+    len += b->section[s].len;
+  }
+  uint32_t *code = b->is_oom ? NULL : malloc(len * sizeof(uint32_t));
+  if (code != NULL) {
+    memcpy(code, header, sizeof(header));
+    size_t pos = sizeof(header) / sizeof(*header);
+    for (size_t s = 0; s < SPIRV_SECTION_COUNT; ++s) {
+      memcpy(code + pos, b->section[s].data,
+             b->section[s].len * sizeof(uint32_t));
+      pos += b->section[s].len;
+    }
+    *size = len * sizeof(uint32_t);
+  }
+  for (size_t s = 0; s < SPIRV_SECTION_COUNT; ++s) {
+    free(b->section[s].data);
+  }
+  memset(b->section, 0, sizeof(b->section));
+  return code;
+}
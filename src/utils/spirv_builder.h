@@ -0,0 +1,223 @@
+/* spirv_builder.h -- assemble SPIR-V modules at run time
+ *
+ * The builder allocates ids and keeps one word buffer per logical section
+ * of a module, every instruction is routed to its section by opcode. Types,
+ * constants and decorations are deduplicated, so code generators ask for
+ * them where they are needed. Function variables are hoisted to the first
+ * block of their function.
+ *
+ *   struct spirv_builder b;
+ *   spirv_builder_init(&b);
+ *   uint32_t uint_t = spirv_type_int(&b, 32);
+ *   uint32_t x = spirv_val(&b, OP_IADD, uint_t, a, spirv_const_uint(&b, 1));
+ *   uint32_t *code = spirv_builder_finish(&b, &size);
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "utils/spirv.h"
+
+enum spirv_builder_section {
+  SPIRV_SECTION_CAPABILITY = 0,
+  SPIRV_SECTION_EXTENSION,
+  SPIRV_SECTION_EXT_INST_IMPORT,
+  SPIRV_SECTION_MEMORY_MODEL,
+  SPIRV_SECTION_ENTRY_POINT,
+  SPIRV_SECTION_EXECUTION_MODE,
+  SPIRV_SECTION_ANNOTATION,
+  SPIRV_SECTION_GLOBAL,
+  SPIRV_SECTION_FUNCTION,
+  /** Function variables of the current function */
+  SPIRV_SECTION_LOCAL,
+  SPIRV_SECTION_COUNT
+};
+
+struct spirv_words {
+  uint32_t *data;
+  size_t len;
+  size_t cap;
+};
+
+struct spirv_builder {
+  struct spirv_words section[SPIRV_SECTION_COUNT];
+  /** next free id */
+  uint32_t bound;
+  /** label of the current block */
+  uint32_t block;
+  /** offset of the first block body of current function in FUNCTION
+   *  section, SIZE_MAX until the first label */
+  size_t function_body;
+  /** entry point, emitted by spirv_builder_finish() with its interface */
+  enum SPV_EXECUTION_MODEL entry_model;
+  uint32_t entry_function;
+  const char *entry_name;
+  /** set on allocation failure, later calls are no-op */
+  bool is_oom;
+};
+
+#define SPIRV_LOOP_MAX_PHIS 4
+
+/** Counted loop: for (i = from; i < to; i += step) */
+struct spirv_loop {
+  uint32_t header, body, cont, end;
+  /** counter */
+  uint32_t i;
+  /** loop carried values and offsets of their next value in phi */
+  size_t phis_len;
+  uint32_t phis[SPIRV_LOOP_MAX_PHIS + 1];
+  size_t phi_next[SPIRV_LOOP_MAX_PHIS + 1];
+};
+
+void spirv_builder_init(struct spirv_builder *b);
+
+/** Module binary, NULL on allocation failure. Releases builder buffers,
+ *  caller frees the result */
+uint32_t *spirv_builder_finish(struct spirv_builder *b, size_t *size);
+
+/** Fresh id */
+uint32_t spirv_id(struct spirv_builder *b);
+
+/** Append instruction to the section of its opcode */
+void spirv_emit(struct spirv_builder *b, enum SPV_OPS op,
+                const uint32_t *operands, size_t len);
+
+/** Append instruction with result type and fresh result id, return the id */
+uint32_t spirv_emit_value(struct spirv_builder *b, enum SPV_OPS op,
+                          uint32_t type, const uint32_t *operands, size_t len);
+
+#define SPIRV_ARGS(...)                                                        \
+  ((const uint32_t[]){__VA_ARGS__}),                                           \
+      (sizeof((const uint32_t[]){__VA_ARGS__}) / sizeof(uint32_t))
+
+/** spirv_op(b, OP_STORE, ptr, value) */
+#define spirv_op(b, op, ...) spirv_emit((b), (op), SPIRV_ARGS(__VA_ARGS__))
+
+/** x = spirv_val(b, OP_IADD, uint_t, a, c) */
+#define spirv_val(b, op, type, ...)                                            \
+  spirv_emit_value((b), (op), (type), SPIRV_ARGS(__VA_ARGS__))
+
+/** spirv_decorate(b, id, DECOR_BINDING, 1), duplicates are dropped */
+#define spirv_decorate(b, ...) spirv_op((b), OP_DECORATE, __VA_ARGS__)
+
+#define spirv_member_decorate(b, ...)                                          \
+  spirv_op((b), OP_MEMBER_DECORATE, __VA_ARGS__)
+
+void spirv_capability(struct spirv_builder *b, enum SPV_CAPABILITIES cap);
+
+void spirv_extension(struct spirv_builder *b, const char *name);
+
+/** Entry point of `function`, its interface lists all Input and Output
+ *  variables of the module. `name` must outlive the builder */
+void spirv_entry_point(struct spirv_builder *b, enum SPV_EXECUTION_MODEL model,
+                       uint32_t function, const char *name);
+
+// types, deduplicated except structs
+uint32_t spirv_type_void(struct spirv_builder *b);
+uint32_t spirv_type_bool(struct spirv_builder *b);
+/** unsigned integer of `width` bits */
+uint32_t spirv_type_int(struct spirv_builder *b, uint32_t width);
+uint32_t spirv_type_vector(struct spirv_builder *b, uint32_t component,
+                           uint32_t count);
+/** element[len], `len` is a literal */
+uint32_t spirv_type_array(struct spirv_builder *b, uint32_t element,
+                          uint32_t len);
+uint32_t spirv_type_runtime_array(struct spirv_builder *b, uint32_t element);
+uint32_t spirv_type_struct(struct spirv_builder *b, const uint32_t *members,
+                           size_t len);
+uint32_t spirv_type_pointer(struct spirv_builder *b,
+                            enum SPV_STORAGE_CLASS storage, uint32_t type);
+uint32_t spirv_type_function(struct spirv_builder *b, uint32_t result,
+                             const uint32_t *params, size_t len);
+
+// constants, deduplicated except specialization constants
+uint32_t spirv_const_uint(struct spirv_builder *b, uint32_t value);
+uint32_t spirv_const_ulong(struct spirv_builder *b, uint64_t value);
+uint32_t spirv_const_composite(struct spirv_builder *b, uint32_t type,
+                               const uint32_t *values, size_t len);
+/** uint specialization constant `spec_id` */
+uint32_t spirv_spec_const_uint(struct spirv_builder *b, uint32_t spec_id,
+                               uint32_t value);
+uint32_t spirv_spec_const_composite(struct spirv_builder *b, uint32_t type,
+                                    const uint32_t *values, size_t len);
+
+/** Variable of pointer type `type`, `init` is optional constant */
+uint32_t spirv_variable(struct spirv_builder *b, uint32_t type,
+                        enum SPV_STORAGE_CLASS storage, uint32_t init);
+
+/** Input variable decorated as `builtin`, one per module */
+uint32_t spirv_builtin(struct spirv_builder *b, enum SPV_BUILTINS builtin,
+                       uint32_t type);
+
+static inline uint32_t spirv_load(struct spirv_builder *b, uint32_t type,
+                                  uint32_t pointer)
+{
+  return spirv_val(b, OP_LOAD, type, pointer);
+}
+
+static inline void spirv_store(struct spirv_builder *b, uint32_t pointer,
+                               uint32_t value)
+{
+  spirv_op(b, OP_STORE, pointer, value);
+}
+
+// control flow
+void spirv_label(struct spirv_builder *b, uint32_t label);
+
+/** Branch to and open new block, return its label */
+uint32_t spirv_block(struct spirv_builder *b);
+
+/** Begin function, its parameter ids go to `params` and the first block is
+ *  open on return */
+uint32_t spirv_function(struct spirv_builder *b, uint32_t result,
+                        enum SPV_FUNCTION_CONTROL control,
+                        const uint32_t *param_types, size_t len,
+                        uint32_t *params);
+
+void spirv_function_end(struct spirv_builder *b);
+
+void spirv_return(struct spirv_builder *b);
+
+void spirv_return_value(struct spirv_builder *b, uint32_t value);
+
+/** if (cond) { ...: open the then block, return the merge block for
+ *  spirv_if_end() */
+uint32_t spirv_if_begin(struct spirv_builder *b, uint32_t cond);
+
+/** ... }: close the then block and open the merge block */
+void spirv_if_end(struct spirv_builder *b, uint32_t merge);
+
+/** Open loop header and return the counter starting at `from`, header phis
+ *  of other loop carried values are added with spirv_loop_phi() */
+uint32_t spirv_loop_begin(struct spirv_builder *b, struct spirv_loop *loop,
+                          uint32_t from);
+
+/** Loop carried value, `init` on entry, see spirv_loop_next() */
+uint32_t spirv_loop_phi(struct spirv_builder *b, struct spirv_loop *loop,
+                        uint32_t type, uint32_t init);
+
+/** Test counter against `to` and open loop body */
+void spirv_loop_body(struct spirv_builder *b, struct spirv_loop *loop,
+                     uint32_t to, enum SPV_LOOP_CONTROL control);
+
+/** Value of loop carried `phi` in the next iteration */
+void spirv_loop_next(struct spirv_builder *b, struct spirv_loop *loop,
+                     uint32_t phi, uint32_t value);
+
+/** Close loop body, advance the counter by `step` and open the block after
+ *  the loop */
+void spirv_loop_end(struct spirv_builder *b, struct spirv_loop *loop,
+                    uint32_t step);
+
+/** for (i = from; i < to; ...) with no other loop carried values */
+static inline uint32_t spirv_loop_for(struct spirv_builder *b,
+                                      struct spirv_loop *loop, uint32_t from,
+                                      uint32_t to,
+                                      enum SPV_LOOP_CONTROL control)
+{
+  uint32_t i = spirv_loop_begin(b, loop, from);
+  spirv_loop_body(b, loop, to, control);
+  return i;
+}